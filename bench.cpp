@@ -0,0 +1,373 @@
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "dex.h"
+#include "dex_call_graph.h"
+#include "dex_checksum.h"
+#include "dex_file.h"
+#include "dex_insns.h"
+#include "dex_model.h"
+#include "dex_reachability.h"
+#include "dex_verifier.h"
+#include "dex_writer.h"
+#include "dex_xref.h"
+#include "utils.h"
+
+// Times the phases of reading and analysing dex and class files, one input
+// at a time. Every phase runs single-threaded over the whole input, after
+// warmup runs that aren't counted, and is reported as the min, median, mean
+// and standard deviation of the timed runs, with the median per byte of
+// input and as throughput. The dump phase runs read_dex or read_class with
+// the output going to /dev/null. Starting the tool is timed on its own as
+// the spawn phase, by running it without arguments, and its median is taken
+// off every dump run, so dump shows the dump itself.
+
+// Keeps the compiler from dropping work whose result is unused.
+static volatile uint64_t bench_sink;
+
+static bool RunHeader(const char* data, size_t size) {
+  DexFile dex("", data, size);
+  return dex.Init();
+}
+
+static bool RunChecksums(const char* data, size_t size) {
+  DexFile dex("", data, size);
+  std::string error;
+  return dex.Init() && CheckDexChecksums(dex, &error);
+}
+
+static bool RunStrings(const char* data, size_t size) {
+  DexFile dex("", data, size);
+  std::string error;
+  return dex.Init() && dex.CheckStrings(&error);
+}
+
+static bool RunClassData(const char* data, size_t size) {
+  DexFile dex("", data, size);
+  if (!dex.Init()) {
+    return false;
+  }
+  DexClassData class_data;
+  std::vector<DexClassMember> storage;
+  uint64_t members = 0;
+  for (uint32_t i = 0; i < dex.class_defs_size(); ++i) {
+    dex.GetClassData(i, &class_data, &storage);
+    members += class_data.direct_methods_size + class_data.virtual_methods_size;
+  }
+  bench_sink = members;
+  return true;
+}
+
+static void GetAllMethods(const DexFile& dex, std::vector<DexMethod>* methods) {
+  for (uint32_t i = 0; i < dex.class_defs_size(); ++i) {
+    dex.GetClassMethods(i, methods);
+  }
+}
+
+static bool RunCode(const char* data, size_t size) {
+  DexFile dex("", data, size);
+  std::vector<DexMethod> methods;
+  if (!dex.Init()) {
+    return false;
+  }
+  GetAllMethods(dex, &methods);
+  DexInsn buf[64];
+  uint64_t insns = 0;
+  for (const DexMethod& method : methods) {
+    const char* code;
+    uint32_t code_size;
+    if (method.code_off == 0) {
+      continue;
+    }
+    if (!dex.GetCodeInsns(method.code_off, &code, &code_size)) {
+      return false;
+    }
+    DexInsnScanner scanner(code, code_size);
+    while (size_t count = scanner.Next(buf, 64)) {
+      insns += count;
+    }
+    if (scanner.error() != nullptr) {
+      return false;
+    }
+  }
+  bench_sink = insns;
+  return true;
+}
+
+static bool RunVerify(const char* data, size_t size) {
+  DexFile dex("", data, size);
+  std::vector<DexMethod> methods;
+  if (!dex.Init()) {
+    return false;
+  }
+  GetAllMethods(dex, &methods);
+  uint64_t verified = 0;
+  for (const DexMethod& method : methods) {
+    DexVerifier verifier(dex, method);
+    verified += verifier.Verify();
+  }
+  bench_sink = verified;
+  return true;
+}
+
+static bool RunCallGraph(const char* data, size_t size) {
+  DexFile dex("", data, size);
+  if (!dex.Init()) {
+    return false;
+  }
+  DexCallGraph graph(dex);
+  graph.Build();
+  bench_sink = graph.bad_methods();
+  return true;
+}
+
+static bool RunXref(const char* data, size_t size) {
+  DexFile dex("", data, size);
+  if (!dex.Init()) {
+    return false;
+  }
+  DexXref xref(dex);
+  xref.Build();
+  bench_sink = xref.bad_methods();
+  return true;
+}
+
+static bool RunReachability(const char* data, size_t size) {
+  DexFile dex("", data, size);
+  if (!dex.Init()) {
+    return false;
+  }
+  DexReachability reachability(dex);
+  reachability.Init();
+  reachability.AddDefaultRoots();
+  reachability.Run();
+  return true;
+}
+
+static bool RunModel(const char* data, size_t size) {
+  DexFile dex("", data, size);
+  DexModel model;
+  std::string error;
+  return dex.Init() && LoadDexModel(dex, &model, &error);
+}
+
+static bool RunWrite(const char* data, size_t size) {
+  DexFile dex("", data, size);
+  DexModel model;
+  std::string error;
+  std::string out;
+  if (!dex.Init() || !LoadDexModel(dex, &model, &error)) {
+    return false;
+  }
+  DexWriter writer(model);
+  bool ok = writer.Write(&out, &error);
+  bench_sink = out.size();
+  return ok;
+}
+
+static void GetDexBenchPhases(std::vector<BenchPhase>* phases) {
+  phases->push_back({"header", RunHeader});
+  phases->push_back({"checksums", RunChecksums});
+  phases->push_back({"strings", RunStrings});
+  phases->push_back({"class_data", RunClassData});
+  phases->push_back({"code", RunCode});
+  phases->push_back({"verify", RunVerify});
+  phases->push_back({"call_graph", RunCallGraph});
+  phases->push_back({"xref", RunXref});
+  phases->push_back({"reachability", RunReachability});
+  phases->push_back({"model", RunModel});
+  phases->push_back({"write", RunWrite});
+}
+
+// Runs tool on filename with its output going to /dev/null. With filename
+// nullptr, runs tool without arguments, where it only prints its usage, and
+// accepts any exit status but 127, which stands for a failed exec.
+static bool RunTool(const std::string& tool, const char* filename) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    return false;
+  }
+  if (pid == 0) {
+    int fd = open("/dev/null", O_WRONLY);
+    dup2(fd, 1);
+    dup2(fd, 2);
+    execl(tool.c_str(), tool.c_str(), filename, (char*)nullptr);
+    _exit(127);
+  }
+  int status;
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+    return false;
+  }
+  return filename == nullptr ? WEXITSTATUS(status) != 127 : WEXITSTATUS(status) == 0;
+}
+
+struct BenchOptions {
+  int warmup = 1;
+  int runs = 5;
+  // Comma separated phase names, or nullptr for all phases.
+  const char* phases = nullptr;
+  // Where read_dex and read_class are.
+  std::string tools_dir = ".";
+
+  bool HasPhase(const char* name) const {
+    if (phases == nullptr) {
+      return true;
+    }
+    size_t length = strlen(name);
+    for (const char* p = phases; p != nullptr; p = strchr(p, ',')) {
+      p += *p == ',';
+      if (strncmp(p, name, length) == 0 && (p[length] == ',' || p[length] == '\0')) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+// Times run and prints a line of statistics. baseline is taken off each
+// time, and the median is stored in median if it isn't nullptr. Returns
+// false if a run fails.
+static bool Measure(const char* name, size_t size, const BenchOptions& options,
+                    const std::function<bool()>& run, double baseline = 0,
+                    double* median_out = nullptr) {
+  for (int i = 0; i < options.warmup; ++i) {
+    if (!run()) {
+      printf("  %-14s failed\n", name);
+      return false;
+    }
+  }
+  std::vector<double> times;
+  for (int i = 0; i < options.runs; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    bool ok = run();
+    auto end = std::chrono::steady_clock::now();
+    if (!ok) {
+      printf("  %-14s failed\n", name);
+      return false;
+    }
+    double time = std::chrono::duration<double, std::nano>(end - start).count() - baseline;
+    times.push_back(std::max(time, 0.0));
+  }
+  std::sort(times.begin(), times.end());
+  double median = times.size() % 2 ? times[times.size() / 2]
+                                   : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+  double mean = 0;
+  for (double t : times) {
+    mean += t;
+  }
+  mean /= times.size();
+  double variance = 0;
+  for (double t : times) {
+    variance += (t - mean) * (t - mean);
+  }
+  double stddev = times.size() > 1 ? sqrt(variance / (times.size() - 1)) : 0;
+  if (median_out != nullptr) {
+    *median_out = median;
+  }
+  printf("  %-14s %10.3f %10.3f %10.3f %9.3f %10.3f %10.1f\n", name, times.front() / 1e6,
+         median / 1e6, mean / 1e6, stddev / 1e6, median / size, size * 1e3 / median);
+  return true;
+}
+
+static bool ReadFile(const char* filename, std::vector<char>* buf) {
+  FILE* fp = fopen(filename, "rb");
+  if (fp == nullptr) {
+    return false;
+  }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  buf->resize(size);
+  bool ok = size == 0 || fread(buf->data(), size, 1, fp) == 1;
+  fclose(fp);
+  return ok;
+}
+
+static bool Bench(const char* filename, const BenchOptions& options) {
+  std::vector<char> buf;
+  if (!ReadFile(filename, &buf)) {
+    fprintf(stderr, "failed to read %s\n", filename);
+    return false;
+  }
+  std::vector<BenchPhase> phases;
+  const char* tool;
+  if (buf.size() >= 4 && memcmp(buf.data(), "dex\n", 4) == 0) {
+    GetDexBenchPhases(&phases);
+    tool = "read_dex";
+  } else if (buf.size() >= 4 && memcmp(buf.data(), "\xca\xfe\xba\xbe", 4) == 0) {
+    GetClassBenchPhases(&phases);
+    tool = "read_class";
+  } else {
+    fprintf(stderr, "%s is not a dex or class file\n", filename);
+    return false;
+  }
+  printf("%s: %zu bytes\n", filename, buf.size());
+  printf("  %-14s %10s %10s %10s %9s %10s %10s\n", "phase", "min ms", "median ms", "mean ms",
+         "stddev", "ns/byte", "MB/s");
+  bool ok = true;
+  for (const BenchPhase& phase : phases) {
+    if (options.HasPhase(phase.name)) {
+      ok = Measure(phase.name, buf.size(), options, [&]() {
+        return phase.run(buf.data(), buf.size());
+      }) && ok;
+    }
+  }
+  if (options.HasPhase("dump")) {
+    std::string path = options.tools_dir + "/" + tool;
+    double spawn = 0;
+    ok = Measure("spawn", buf.size(), options, [&]() {
+      return RunTool(path, nullptr);
+    }, 0, &spawn) && Measure("dump", buf.size(), options, [&]() {
+      return RunTool(path, filename);
+    }, spawn) && ok;
+  }
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  BenchOptions options;
+  std::vector<const char*> filenames;
+  bool usage_error = false;
+  const char* slash = strrchr(argv[0], '/');
+  if (slash != nullptr) {
+    options.tools_dir.assign(argv[0], slash - argv[0]);
+  }
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+      options.warmup = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+      options.runs = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--phases") == 0 && i + 1 < argc) {
+      options.phases = argv[++i];
+    } else if (strcmp(argv[i], "--tools-dir") == 0 && i + 1 < argc) {
+      options.tools_dir = argv[++i];
+    } else if (argv[i][0] == '-') {
+      usage_error = true;
+    } else {
+      filenames.push_back(argv[i]);
+    }
+  }
+  if (filenames.empty() || usage_error || options.runs < 1 || options.warmup < 0) {
+    fprintf(stderr, "benchmark [--warmup <n>] [--runs <n>] [--phases <phase>,...] "
+            "[--tools-dir <dir>] <dex_or_class_file>...\n");
+    return 1;
+  }
+  bool ok = true;
+  for (const char* filename : filenames) {
+    ok = Bench(filename, options) && ok;
+  }
+  return ok ? 0 : 1;
+}
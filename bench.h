@@ -0,0 +1,21 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+// One phase of the benchmark: run does the phase's work once over a whole
+// input and returns false if the input is malformed. Each run starts from
+// the raw bytes, so a phase also pays for whatever it needs of the phases
+// before it; the header and constant pool phases show how much that is.
+struct BenchPhase {
+  const char* name;
+  bool (*run)(const char* data, size_t size);
+};
+
+// The phases over a class file. They live in bench_class.cpp, because
+// java_class.h and dex.h can't be included together.
+void GetClassBenchPhases(std::vector<BenchPhase>* phases);
+
+#endif  // BENCH_H_
@@ -0,0 +1,81 @@
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "class_dexer.h"
+#include "class_insns.h"
+#include "class_members.h"
+#include "class_verifier.h"
+#include "dexer.h"
+#include "java_class.h"
+
+// Keeps the compiler from dropping work whose result is unused.
+static volatile uint64_t bench_sink;
+
+static bool RunConstantPool(const char* data, size_t size) {
+  ClassMembers cls;
+  const char* p = data;
+  return ReadClassHead(data, size, p, &cls);
+}
+
+static bool RunMembers(const char* data, size_t size) {
+  ClassMembers cls;
+  bool ok = ReadClassMembers(data, size, &cls);
+  bench_sink = cls.methods.size();
+  return ok;
+}
+
+static bool RunCode(const char* data, size_t size) {
+  ClassMembers cls;
+  if (!ReadClassMembers(data, size, &cls)) {
+    return false;
+  }
+  ClassInsn buf[64];
+  uint64_t insns = 0;
+  for (const ClassMethodInfo& method : cls.methods) {
+    if (!method.has_code) {
+      continue;
+    }
+    ClassInsnScanner scanner(method.code, method.code_length);
+    while (size_t count = scanner.Next(buf, 64)) {
+      insns += count;
+    }
+    if (scanner.error() != nullptr) {
+      return false;
+    }
+  }
+  bench_sink = insns;
+  return true;
+}
+
+static bool RunVerify(const char* data, size_t size) {
+  ClassMembers cls;
+  if (!ReadClassMembers(data, size, &cls)) {
+    return false;
+  }
+  uint64_t verified = 0;
+  for (const ClassMethodInfo& method : cls.methods) {
+    MethodVerifier verifier(cls.pool.entries(), cls.pool.end(), cls.this_class, method);
+    verified += verifier.Verify(cls.major_version);
+  }
+  bench_sink = verified;
+  return true;
+}
+
+static bool RunDex(const char* data, size_t size) {
+  DexerClass cls;
+  std::string error;
+  bool ok = DexClassFile(data, size, &cls, &error);
+  bench_sink = cls.methods.size();
+  return ok;
+}
+
+void GetClassBenchPhases(std::vector<BenchPhase>* phases) {
+  phases->push_back({"constant_pool", RunConstantPool});
+  phases->push_back({"members", RunMembers});
+  phases->push_back({"code", RunCode});
+  phases->push_back({"verify", RunVerify});
+  phases->push_back({"dex", RunDex});
+}
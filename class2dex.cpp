@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "dex_model.h"
+#include "dex_writer.h"
+#include "dexer.h"
+#include "dexer_model.h"
+#include "utils.h"
+
+// Converts class files into one dex file. Each class is converted on its own
+// thread, and the results are added to the model in the order of the
+// command line, so the output doesn't depend on the thread count.
+
+static bool ReadFile(const char* filename, std::vector<char>* buf, std::string* error) {
+  FILE* fp = fopen(filename, "rb");
+  if (fp == nullptr) {
+    *error = "failed to open";
+    return false;
+  }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  buf->resize(size);
+  bool ok = size == 0 || fread(buf->data(), size, 1, fp) == 1;
+  fclose(fp);
+  if (!ok) {
+    *error = "failed to read";
+  }
+  return ok;
+}
+
+static bool Class2Dex(const std::vector<const char*>& filenames, const char* output) {
+  std::vector<DexerClass> classes(filenames.size());
+  std::vector<std::string> errors(filenames.size());
+  std::vector<char> ok(filenames.size(), 0);
+  ParallelFor(filenames.size(), [&](size_t i) {
+    std::vector<char> buf;
+    ok[i] = ReadFile(filenames[i], &buf, &errors[i]) &&
+            DexClassFile(buf.data(), buf.size(), &classes[i], &errors[i]);
+  });
+  bool all_ok = true;
+  for (size_t i = 0; i < filenames.size(); ++i) {
+    if (!ok[i]) {
+      fprintf(stderr, "%s: %s\n", filenames[i], errors[i].c_str());
+      all_ok = false;
+    }
+  }
+  if (!all_ok) {
+    return false;
+  }
+  DexModel model;
+  DexerModelBuilder builder(&model);
+  std::string error;
+  for (size_t i = 0; i < filenames.size(); ++i) {
+    if (!builder.AddClass(classes[i], &error)) {
+      fprintf(stderr, "%s: %s\n", filenames[i], error.c_str());
+      return false;
+    }
+    // The model has a copy of everything it needs.
+    classes[i] = DexerClass();
+  }
+  DexWriter writer(model);
+  if (!writer.WriteFile(output, &error)) {
+    fprintf(stderr, "%s: %s\n", output, error.c_str());
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  const char* output = nullptr;
+  std::vector<const char*> filenames;
+  bool usage_error = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else if (argv[i][0] == '-') {
+      usage_error = true;
+    } else {
+      filenames.push_back(argv[i]);
+    }
+  }
+  if (output == nullptr || filenames.empty() || usage_error) {
+    fprintf(stderr, "class2dex -o <dex_file> <class_file>...\n");
+    return 1;
+  }
+  return Class2Dex(filenames, output) ? 0 : 1;
+}
@@ -0,0 +1,6 @@
+#include "class_dexer.h"
+
+bool DexClassFile(const char* data, size_t size, DexerClass* cls, std::string* error) {
+  ClassDexer dexer(data, size);
+  return dexer.Convert(cls, error);
+}
@@ -0,0 +1,1944 @@
+#ifndef CLASS_DEXER_H_
+#define CLASS_DEXER_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "class_insns.h"
+#include "class_verifier.h"
+#include "dex_bytecode.h"
+#include "dexer.h"
+#include "java_class.h"
+#include "mutf8.h"
+#include "utils.h"
+
+// The class file side of the dexer: translates the stack code of each method
+// into register code, with ids referenced by name as DexerRefs.
+
+// Dex-only access flags, which dex.h defines along with names that clash with
+// java_class.h.
+static constexpr uint32_t DEXER_ACC_CONSTRUCTOR = 0x10000;
+static constexpr uint32_t DEXER_ACC_DECLARED_SYNCHRONIZED = 0x20000;
+
+static std::string ClassNameToDescriptor(const std::string& name) {
+  return name[0] == '[' ? name : "L" + name + ";";
+}
+
+// The constant pool of a class file, with silent lookups that fail on
+// entries of the wrong kind.
+class DexerConstantPool {
+ public:
+  bool Index(const char*& p, const char* end, uint16_t count, std::string* error) {
+    end_ = end;
+    entries_.assign(count + 1, nullptr);
+    for (uint32_t i = 1; i < count; ++i) {
+      if (p >= end) {
+        *error = "truncated constant pool";
+        return false;
+      }
+      entries_[i] = p;
+      switch ((uint8_t)*p) {
+        case CONSTANT_Class:
+        case CONSTANT_String:
+        case CONSTANT_MethodType:
+          p += 3;
+          break;
+        case CONSTANT_MethodHandle:
+          p += 4;
+          break;
+        case CONSTANT_Fieldref:
+        case CONSTANT_Methodref:
+        case CONSTANT_InterfaceMethodref:
+        case CONSTANT_Integer:
+        case CONSTANT_Float:
+        case CONSTANT_NameAndType:
+        case CONSTANT_InvokeDynamic:
+          p += 5;
+          break;
+        case CONSTANT_Long:
+        case CONSTANT_Double:
+          p += 9;
+          ++i;
+          break;
+        case CONSTANT_Utf8: {
+          const char* q = p + 1;
+          uint16_t length;
+          Read(q, end, length);
+          size_t utf16_length;
+          if (length > end - q || !ValidateMutf8(q, length, &utf16_length)) {
+            *error = StringPrintf("constant #%u is not valid modified UTF-8", i);
+            return false;
+          }
+          p = q + length;
+          break;
+        }
+        default:
+          *error = StringPrintf("constant #%u has unknown tag %u", i, (uint8_t)*p);
+          return false;
+      }
+    }
+    if (p > end) {
+      *error = "truncated constant pool";
+      return false;
+    }
+    return true;
+  }
+
+  uint8_t GetTag(uint16_t index) const {
+    if (index == 0 || index >= entries_.size() || entries_[index] == nullptr) {
+      return 0;
+    }
+    return (uint8_t)*entries_[index];
+  }
+
+  bool GetUtf8(uint16_t index, std::string* s) const {
+    const char* p;
+    if (!GetEntry(index, CONSTANT_Utf8, &p)) {
+      return false;
+    }
+    uint16_t length;
+    Read(p, end_, length);
+    s->assign(p, length);
+    return true;
+  }
+
+  bool GetClassName(uint16_t index, std::string* name) const {
+    const char* p;
+    uint16_t name_index;
+    if (!GetEntry(index, CONSTANT_Class, &p)) {
+      return false;
+    }
+    Read(p, end_, name_index);
+    return GetUtf8(name_index, name) && !name->empty();
+  }
+
+  bool GetString(uint16_t index, std::string* s) const {
+    const char* p;
+    uint16_t string_index;
+    if (!GetEntry(index, CONSTANT_String, &p)) {
+      return false;
+    }
+    Read(p, end_, string_index);
+    return GetUtf8(string_index, s);
+  }
+
+  bool GetNameAndType(uint16_t index, std::string* name, std::string* descriptor) const {
+    const char* p;
+    uint16_t name_index;
+    uint16_t descriptor_index;
+    if (!GetEntry(index, CONSTANT_NameAndType, &p)) {
+      return false;
+    }
+    Read(p, end_, name_index);
+    Read(p, end_, descriptor_index);
+    return GetUtf8(name_index, name) && GetUtf8(descriptor_index, descriptor);
+  }
+
+  // A Fieldref, Methodref or InterfaceMethodref, whichever tag is.
+  bool GetMemberRef(uint16_t index, uint8_t tag, std::string* class_name, std::string* name,
+                    std::string* descriptor) const {
+    const char* p;
+    uint16_t class_index;
+    uint16_t name_and_type_index;
+    if (!GetEntry(index, tag, &p)) {
+      return false;
+    }
+    Read(p, end_, class_index);
+    Read(p, end_, name_and_type_index);
+    return GetClassName(class_index, class_name) &&
+           GetNameAndType(name_and_type_index, name, descriptor);
+  }
+
+  // The bits of an Integer, Float, Long or Double.
+  bool GetValue(uint16_t index, uint64_t* bits) const {
+    uint8_t tag = GetTag(index);
+    const char* p = entries_[index] + 1;
+    if (tag == CONSTANT_Integer || tag == CONSTANT_Float) {
+      uint32_t value;
+      Read(p, end_, value);
+      *bits = value;
+      return true;
+    }
+    if (tag == CONSTANT_Long || tag == CONSTANT_Double) {
+      Read(p, end_, *bits);
+      return true;
+    }
+    return false;
+  }
+
+  bool GetMethodHandle(uint16_t index, uint8_t* kind, uint16_t* reference_index) const {
+    const char* p;
+    if (!GetEntry(index, CONSTANT_MethodHandle, &p)) {
+      return false;
+    }
+    Read(p, end_, *kind);
+    Read(p, end_, *reference_index);
+    return true;
+  }
+
+  bool GetInvokeDynamic(uint16_t index, uint16_t* bootstrap_index, std::string* name,
+                        std::string* descriptor) const {
+    const char* p;
+    uint16_t name_and_type_index;
+    if (!GetEntry(index, CONSTANT_InvokeDynamic, &p)) {
+      return false;
+    }
+    Read(p, end_, *bootstrap_index);
+    Read(p, end_, name_and_type_index);
+    return GetNameAndType(name_and_type_index, name, descriptor);
+  }
+
+  const std::vector<const char*>& entries() const {
+    return entries_;
+  }
+
+  const char* end() const {
+    return end_;
+  }
+
+ private:
+  bool GetEntry(uint16_t index, uint8_t tag, const char** p) const {
+    if (GetTag(index) != tag) {
+      return false;
+    }
+    *p = entries_[index] + 1;
+    return true;
+  }
+
+  std::vector<const char*> entries_;
+  const char* end_;
+};
+
+// The refs of one class, without duplicates.
+class DexerRefTable {
+ public:
+  explicit DexerRefTable(std::vector<DexerRef>* refs) : refs_(refs) {
+  }
+
+  uint32_t Add(uint8_t index_type, const std::string& name, const std::string& class_descriptor,
+               const std::string& descriptor) {
+    DexerRef ref;
+    ref.index_type = index_type;
+    ref.name = name;
+    ref.class_descriptor = class_descriptor;
+    ref.descriptor = descriptor;
+    auto it = index_.find(ref);
+    if (it != index_.end()) {
+      return it->second;
+    }
+    refs_->push_back(ref);
+    index_.emplace(ref, refs_->size() - 1);
+    return refs_->size() - 1;
+  }
+
+  uint32_t AddString(const std::string& s) {
+    return Add(DEX_INDEX_STRING, s, "", "");
+  }
+
+  uint32_t AddType(const std::string& descriptor) {
+    return Add(DEX_INDEX_TYPE, descriptor, "", "");
+  }
+
+  uint32_t AddField(const std::string& class_descriptor, const std::string& name,
+                    const std::string& type) {
+    return Add(DEX_INDEX_FIELD, name, class_descriptor, type);
+  }
+
+  uint32_t AddMethod(const std::string& class_descriptor, const std::string& name,
+                     const std::string& descriptor) {
+    return Add(DEX_INDEX_METHOD, name, class_descriptor, descriptor);
+  }
+
+ private:
+  std::vector<DexerRef>* refs_;
+  std::map<DexerRef, uint32_t> index_;
+};
+
+struct DexerBootstrapMethod {
+  uint16_t method_handle;
+  std::vector<uint16_t> arguments;
+};
+
+// What the method converter needs to know about the class.
+struct DexerClassContext {
+  const DexerConstantPool* pool;
+  // The internal name, like "java/lang/String".
+  std::string this_class;
+  std::vector<DexerBootstrapMethod> bootstrap_methods;
+  // name + descriptor of the private methods, which are invoked directly.
+  std::set<std::string> private_methods;
+};
+
+// Converts the code of one method. Each operand stack slot and local
+// variable gets a register of its own, laid out as
+//
+//   [temps] [stack] [scratch] [lock] [locals] [arguments]
+//
+// so that the arguments are the last ins_size registers, as dex requires.
+// Stack values keep their slot, which keeps the arguments of an invoke in
+// consecutive registers for the /range form. The types of the stack slots,
+// needed to pick move opcodes, come from type inference by MethodVerifier.
+// Temps are only reserved when there are more than 16 registers: operands
+// that don't fit in the 4 or 8 bits of an instruction go through them.
+class MethodDexer {
+ public:
+  MethodDexer(const DexerClassContext& context, DexerRefTable* refs,
+              const ClassMethodInfo& method, const std::vector<std::pair<uint16_t, uint16_t>>& lines)
+      : context_(context), pool_(*context.pool), refs_(refs), method_(method), lines_(lines),
+        code_(nullptr), pc_(0) {
+  }
+
+  bool Convert(DexerCode* code, std::string* error) {
+    MethodVerifier verifier(pool_.entries(), pool_.end(), context_.this_class, method_);
+    if (!verifier.InferFrames(&frames_, &reached_)) {
+      *error = verifier.error();
+      return false;
+    }
+    code_ = code;
+    if (!Scan() || !Layout()) {
+      *error = error_;
+      return false;
+    }
+    // Branches are first emitted in their 16-bit forms, and the method is
+    // converted again with 32-bit ones if any offset doesn't fit.
+    long_branches_ = false;
+    if (!Emit()) {
+      if (!overflow_) {
+        *error = error_;
+        return false;
+      }
+      long_branches_ = true;
+      if (!Emit()) {
+        *error = error_;
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  enum {
+    KIND_NARROW,
+    KIND_WIDE,
+    KIND_OBJECT,
+  };
+
+  // A register operand of an instruction: used (read), defined (written)
+  // or both.
+  struct Operand {
+    uint32_t reg;
+    uint8_t kind;
+    bool use;
+    bool def;
+  };
+
+  struct Branch {
+    uint32_t insn_addr;
+    uint32_t operand_pos;
+    uint32_t target;
+    bool is_32bit;
+  };
+
+  struct Switch {
+    uint32_t insn_addr;
+    uint32_t pc;
+  };
+
+  struct Handler {
+    uint32_t start;
+    uint32_t end;
+    uint32_t handler;
+    // Empty for catch-all.
+    std::string type;
+    // The synthetic handler that releases the lock of a synchronized method.
+    bool is_unlock;
+  };
+
+  static constexpr uint32_t TEMP_COUNT = 6;
+
+  bool Fail(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    char buf[256];
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    error_ = StringPrintf("pc 0x%x: %s", pc_, buf);
+    return false;
+  }
+
+  static Operand Use(uint32_t reg, uint8_t kind) {
+    return Operand{reg, kind, true, false};
+  }
+
+  static Operand Def(uint32_t reg, uint8_t kind) {
+    return Operand{reg, kind, false, true};
+  }
+
+  static Operand UseDef(uint32_t reg, uint8_t kind) {
+    return Operand{reg, kind, true, true};
+  }
+
+  static uint8_t KindOfDescriptor(char c) {
+    if (c == 'J' || c == 'D') {
+      return KIND_WIDE;
+    }
+    return (c == 'L' || c == '[') ? KIND_OBJECT : KIND_NARROW;
+  }
+
+  bool KindOf(uint32_t unit, uint8_t* kind) {
+    const VerifyType& type = frame().stack[unit];
+    switch (type.tag) {
+      case VT_INTEGER:
+      case VT_FLOAT:
+        *kind = KIND_NARROW;
+        return true;
+      case VT_LONG:
+      case VT_DOUBLE:
+      case VT_LONG2:
+      case VT_DOUBLE2:
+        *kind = KIND_WIDE;
+        return true;
+      case VT_NULL:
+      case VT_UNINITIALIZED_THIS:
+      case VT_UNINITIALIZED:
+      case VT_REFERENCE:
+        *kind = KIND_OBJECT;
+        return true;
+    }
+    return Fail("stack slot %u has no usable type", unit);
+  }
+
+  // Splits a method descriptor into its parameter and return descriptors.
+  static bool ParseDescriptor(const std::string& desc, std::vector<std::string>* params,
+                              std::string* return_type) {
+    if (desc.empty() || desc[0] != '(') {
+      return false;
+    }
+    size_t pos = 1;
+    while (pos < desc.size() && desc[pos] != ')') {
+      size_t start = pos;
+      while (pos < desc.size() && desc[pos] == '[') {
+        pos++;
+      }
+      if (pos < desc.size() && desc[pos] == 'L') {
+        pos = desc.find(';', pos);
+        if (pos == std::string::npos) {
+          return false;
+        }
+      }
+      if (pos >= desc.size()) {
+        return false;
+      }
+      params->push_back(desc.substr(start, ++pos - start));
+    }
+    if (pos + 1 >= desc.size()) {
+      return false;
+    }
+    *return_type = desc.substr(pos + 1);
+    return true;
+  }
+
+  static uint32_t CountUnits(const std::vector<std::string>& params) {
+    uint32_t units = 0;
+    for (const std::string& param : params) {
+      units += KindOfDescriptor(param[0]) == KIND_WIDE ? 2 : 1;
+    }
+    return units;
+  }
+
+  const VerifyFrame& frame() const {
+    return frames_[pc_];
+  }
+
+  uint32_t depth() const {
+    return frame().stack.size();
+  }
+
+  // Finds the instructions, the handlers and what the method needs besides
+  // its locals and stack.
+  bool Scan() {
+    code_length_ = method_.code_length;
+    lengths_.assign(code_length_, 0);
+    for (uint32_t pc = 0; pc < code_length_; pc += lengths_[pc]) {
+      lengths_[pc] = GetClassInsnLength(method_.code, code_length_, pc);
+    }
+    is_static_ = (method_.access_flags & METHOD_ACC_STATIC) != 0;
+    is_synchronized_ = (method_.access_flags & METHOD_ACC_SYNCHRONIZED) != 0;
+    scratch_size_ = 0;
+    for (uint32_t pc = 0; pc < code_length_; pc += lengths_[pc]) {
+      pc_ = pc;
+      uint8_t op = GetClassU1(method_.code, pc);
+      if (!reached_[pc]) {
+        continue;
+      }
+      if (op == INST_JSR || op == INST_JSR_W || op == INST_RET ||
+          (op == INST_WIDE && GetClassU1(method_.code, pc + 1) == INST_RET)) {
+        return Fail("jsr and ret are not supported");
+      }
+      if (op == INST_SWAP) {
+        scratch_size_ = std::max(scratch_size_, 1u);
+      } else if (op == INST_INVOKEDYNAMIC) {
+        // The StringBuilder and a copy of one argument.
+        scratch_size_ = std::max(scratch_size_, 3u);
+      }
+    }
+    const char* p = method_.exception_table;
+    handler_starts_.assign(code_length_, false);
+    handlers_.clear();
+    for (uint16_t i = 0; i < method_.exception_table_length; ++i) {
+      uint16_t entry[4];
+      for (uint16_t& value : entry) {
+        Read(p, pool_.end(), value);
+      }
+      Handler handler;
+      handler.start = entry[0];
+      handler.end = entry[1];
+      handler.handler = entry[2];
+      handler.is_unlock = false;
+      if (entry[3] != 0) {
+        std::string name;
+        if (!pool_.GetClassName(entry[3], &name)) {
+          return Fail("bad catch type %u", entry[3]);
+        }
+        handler.type = ClassNameToDescriptor(name);
+      }
+      // The verifier checked the bounds; handlers of unreached code are
+      // never reached themselves.
+      if (reached_[handler.handler]) {
+        handler_starts_[handler.handler] = true;
+        handlers_.push_back(handler);
+      }
+    }
+    if (is_synchronized_) {
+      // Whatever the method throws releases the lock on the way out.
+      Handler handler;
+      handler.start = 0;
+      handler.end = code_length_;
+      handler.handler = 0;
+      handler.is_unlock = true;
+      handlers_.push_back(handler);
+    }
+    return true;
+  }
+
+  bool Layout() {
+    std::vector<std::string> params;
+    std::string return_type;
+    if (!ParseDescriptor(method_.descriptor, &params, &return_type)) {
+      return Fail("bad method descriptor %s", method_.descriptor.c_str());
+    }
+    ins_size_ = CountUnits(params) + (is_static_ ? 0 : 1);
+    uint32_t lock_size = is_synchronized_ ? 2 : 0;
+    uint32_t size = method_.max_stack + scratch_size_ + lock_size + method_.max_locals;
+    temps_ = size > 16 ? TEMP_COUNT : 0;
+    stack_base_ = temps_;
+    scratch_base_ = stack_base_ + method_.max_stack;
+    lock_reg_ = scratch_base_ + scratch_size_;
+    locals_base_ = lock_reg_ + lock_size;
+    args_base_ = locals_base_ + method_.max_locals - ins_size_;
+    registers_size_ = temps_ + size;
+    if (registers_size_ > 0xffff) {
+      return Fail("too many registers");
+    }
+    return true;
+  }
+
+  uint32_t Stack(uint32_t unit) const {
+    return stack_base_ + unit;
+  }
+
+  bool Local(uint32_t index, bool wide, uint32_t* reg) {
+    if (wide && index + 1 == ins_size_) {
+      return Fail("wide local %u spans the last argument", index);
+    }
+    *reg = index < ins_size_ ? args_base_ + index : locals_base_ + index - ins_size_;
+    return true;
+  }
+
+  uint32_t Addr() const {
+    return code_->insns.size();
+  }
+
+  void Unit(uint16_t unit) {
+    code_->insns.push_back(unit);
+  }
+
+  void Unit32(uint32_t value) {
+    Unit(value & 0xffff);
+    Unit(value >> 16);
+  }
+
+  void Ref(uint32_t ref) {
+    code_->fixups.emplace_back(Addr(), ref);
+    Unit(0);
+  }
+
+  void EmitMove(uint8_t kind, uint32_t dst, uint32_t src) {
+    if (dst == src) {
+      return;
+    }
+    uint8_t op = kind == KIND_WIDE ? DEX_OP_MOVE_WIDE
+                 : kind == KIND_OBJECT ? DEX_OP_MOVE_OBJECT : DEX_OP_MOVE;
+    if (dst < 16 && src < 16) {
+      Unit(op | dst << 8 | src << 12);
+    } else if (dst < 256) {
+      Unit((op + 1) | dst << 8);
+      Unit(src);
+    } else {
+      Unit(op + 2);
+      Unit(dst);
+      Unit(src);
+    }
+  }
+
+  // Calls emit with the registers to encode for ops. Registers that don't
+  // fit in bits are replaced by temps, which used values are moved into
+  // before the instruction and defined values are moved out of after it.
+  template <typename F>
+  bool Legalize(std::initializer_list<Operand> ops, uint32_t bits, F emit) {
+    const Operand* operands = ops.begin();
+    size_t count = ops.size();
+    uint32_t regs[3];
+    uint32_t next_temp = 0;
+    for (size_t i = 0; i < count; ++i) {
+      regs[i] = operands[i].reg;
+      if (operands[i].reg < (1u << bits)) {
+        continue;
+      }
+      bool shared = false;
+      for (size_t j = 0; j < i && !shared; ++j) {
+        if (operands[j].reg == operands[i].reg) {
+          regs[i] = regs[j];
+          shared = true;
+        }
+      }
+      if (!shared) {
+        regs[i] = next_temp;
+        next_temp += 2;
+      }
+    }
+    if (next_temp > temps_) {
+      return Fail("register out of range");
+    }
+    for (size_t i = 0; i < count; ++i) {
+      bool first = true;
+      for (size_t j = 0; j < i; ++j) {
+        first = first && !(operands[j].use && operands[j].reg == operands[i].reg);
+      }
+      if (operands[i].use && first && regs[i] != operands[i].reg) {
+        EmitMove(operands[i].kind, regs[i], operands[i].reg);
+      }
+    }
+    emit(regs);
+    for (size_t i = 0; i < count; ++i) {
+      if (operands[i].def && regs[i] != operands[i].reg) {
+        EmitMove(operands[i].kind, operands[i].reg, regs[i]);
+      }
+    }
+    return true;
+  }
+
+  bool Op11x(uint8_t op, Operand a) {
+    return Legalize({a}, 8, [&](const uint32_t* r) {
+      Unit(op | r[0] << 8);
+    });
+  }
+
+  bool Op12x(uint8_t op, Operand a, Operand b) {
+    return Legalize({a, b}, 4, [&](const uint32_t* r) {
+      Unit(op | r[0] << 8 | r[1] << 12);
+    });
+  }
+
+  bool Op21c(uint8_t op, Operand a, uint32_t ref) {
+    return Legalize({a}, 8, [&](const uint32_t* r) {
+      Unit(op | r[0] << 8);
+      Ref(ref);
+    });
+  }
+
+  bool Op22c(uint8_t op, Operand a, Operand b, uint32_t ref) {
+    return Legalize({a, b}, 4, [&](const uint32_t* r) {
+      Unit(op | r[0] << 8 | r[1] << 12);
+      Ref(ref);
+    });
+  }
+
+  // A binary operation, in the 2addr form when the registers allow.
+  bool Op23x(uint8_t op, Operand a, Operand b, Operand c) {
+    if (a.reg == b.reg && a.reg < 16 && c.reg < 16 && op >= DEX_OP_ADD_INT &&
+        op <= DEX_OP_REM_DOUBLE) {
+      Unit((op + DEX_OP_ADD_INT_2ADDR - DEX_OP_ADD_INT) | a.reg << 8 | c.reg << 12);
+      return true;
+    }
+    return Legalize({a, b, c}, 8, [&](const uint32_t* r) {
+      Unit(op | r[0] << 8);
+      Unit(r[1] | r[2] << 8);
+    });
+  }
+
+  // Invokes with the arguments in count registers from first.
+  void OpInvokeRange(uint8_t op, uint32_t count, uint32_t first, uint32_t method) {
+    Unit(op | count << 8);
+    Ref(method);
+    Unit(count == 0 ? 0 : first);
+    outs_size_ = std::max(outs_size_, count);
+  }
+
+  bool EmitConst(uint32_t reg, int32_t value) {
+    if (reg < 16 && value >= -8 && value < 8) {
+      Unit(DEX_OP_CONST_4 | reg << 8 | (value & 0xf) << 12);
+      return true;
+    }
+    return Legalize({Def(reg, KIND_NARROW)}, 8, [&](const uint32_t* r) {
+      if (value == (int16_t)value) {
+        Unit(DEX_OP_CONST_16 | r[0] << 8);
+        Unit(value);
+      } else if ((value & 0xffff) == 0) {
+        Unit(DEX_OP_CONST_HIGH16 | r[0] << 8);
+        Unit((uint32_t)value >> 16);
+      } else {
+        Unit(DEX_OP_CONST | r[0] << 8);
+        Unit32(value);
+      }
+    });
+  }
+
+  bool EmitConstWide(uint32_t reg, int64_t value) {
+    return Legalize({Def(reg, KIND_WIDE)}, 8, [&](const uint32_t* r) {
+      if (value == (int16_t)value) {
+        Unit(DEX_OP_CONST_WIDE_16 | r[0] << 8);
+        Unit(value);
+      } else if (value == (int32_t)value) {
+        Unit(DEX_OP_CONST_WIDE_32 | r[0] << 8);
+        Unit32(value);
+      } else if ((value & 0xffffffffffffULL) == 0) {
+        Unit(DEX_OP_CONST_WIDE_HIGH16 | r[0] << 8);
+        Unit((uint64_t)value >> 48);
+      } else {
+        Unit(DEX_OP_CONST_WIDE | r[0] << 8);
+        Unit32(value);
+        Unit32((uint64_t)value >> 32);
+      }
+    });
+  }
+
+  void AddBranch(uint32_t insn_addr, uint32_t target, bool is_32bit) {
+    branches_.push_back(Branch{insn_addr, Addr(), target, is_32bit});
+    Unit(0);
+    if (is_32bit) {
+      Unit(0);
+    }
+  }
+
+  void EmitGoto(uint32_t target) {
+    uint32_t addr = Addr();
+    // goto/16 can't branch to itself.
+    if (long_branches_ || target == pc_) {
+      Unit(DEX_OP_GOTO_32);
+      AddBranch(addr, target, true);
+    } else {
+      Unit(DEX_OP_GOTO_16);
+      AddBranch(addr, target, false);
+    }
+  }
+
+  // An if-test against zero (21t) or between two registers (22t). With long
+  // branches the test is inverted to skip a goto/32.
+  bool EmitIf(uint8_t op, Operand a, const Operand* b, uint32_t target) {
+    auto emit = [&](const uint32_t* r) {
+      uint32_t addr = Addr();
+      uint16_t regs = b != nullptr ? (r[0] << 8 | r[1] << 12) : r[0] << 8;
+      if (long_branches_) {
+        Unit((op ^ 1) | regs);
+        Unit(5);
+        Unit(DEX_OP_GOTO_32);
+        AddBranch(addr + 2, target, true);
+      } else {
+        Unit(op | regs);
+        AddBranch(addr, target, false);
+      }
+    };
+    if (b != nullptr) {
+      return Legalize({a, *b}, 4, emit);
+    }
+    return Legalize({a}, 8, emit);
+  }
+
+  bool EmitReturn(uint8_t jvm_op) {
+    if (is_synchronized_ && !Op11x(DEX_OP_MONITOR_EXIT, Use(lock_reg_, KIND_OBJECT))) {
+      return false;
+    }
+    uint32_t d = depth();
+    switch (jvm_op) {
+      case INST_RETURN:
+        Unit(DEX_OP_RETURN_VOID);
+        return true;
+      case INST_LRETURN:
+      case INST_DRETURN:
+        return Op11x(DEX_OP_RETURN_WIDE, Use(Stack(d - 2), KIND_WIDE));
+      case INST_ARETURN:
+        return Op11x(DEX_OP_RETURN_OBJECT, Use(Stack(d - 1), KIND_OBJECT));
+      default:
+        return Op11x(DEX_OP_RETURN, Use(Stack(d - 1), KIND_NARROW));
+    }
+  }
+
+  // The offset of the iget/sget/iput/sput/aget/aput variant for a type.
+  static uint8_t AccessVariant(char c) {
+    switch (c) {
+      case 'J':
+      case 'D':
+        return 1;
+      case 'L':
+      case '[':
+        return 2;
+      case 'Z':
+        return 3;
+      case 'B':
+        return 4;
+      case 'C':
+        return 5;
+      case 'S':
+        return 6;
+    }
+    return 0;
+  }
+
+  // baload and bastore serve byte and boolean arrays alike.
+  bool IsBooleanArray(uint32_t unit) {
+    const VerifyType& type = frame().stack[unit];
+    return type.tag == VT_REFERENCE && strcmp(GetInternedString(type.value), "[Z") == 0;
+  }
+
+  bool EmitArrayAccess(uint8_t op) {
+    static const char LOAD_TYPES[] = "IJFDLBCS";
+    uint32_t d = depth();
+    bool is_load = op <= INST_SALOAD;
+    char c = LOAD_TYPES[is_load ? op - INST_IALOAD : op - INST_IASTORE];
+    uint8_t kind = KindOfDescriptor(c);
+    uint32_t width = kind == KIND_WIDE ? 2 : 1;
+    if (is_load) {
+      if (c == 'B' && IsBooleanArray(d - 2)) {
+        c = 'Z';
+      }
+      return Op23x(DEX_OP_AGET + AccessVariant(c), Def(Stack(d - 2), kind),
+                   Use(Stack(d - 2), KIND_OBJECT), Use(Stack(d - 1), KIND_NARROW));
+    }
+    uint32_t array = d - width - 2;
+    if (c == 'B' && IsBooleanArray(array)) {
+      c = 'Z';
+    }
+    return Op23x(DEX_OP_APUT + AccessVariant(c), Use(Stack(d - width), kind),
+                 Use(Stack(array), KIND_OBJECT), Use(Stack(array + 1), KIND_NARROW));
+  }
+
+  bool EmitFieldAccess(uint8_t op, uint16_t index) {
+    std::string class_name;
+    std::string name;
+    std::string type;
+    if (!pool_.GetMemberRef(index, CONSTANT_Fieldref, &class_name, &name, &type)) {
+      return Fail("bad field ref %u", index);
+    }
+    uint32_t ref = refs_->AddField(ClassNameToDescriptor(class_name), name, type);
+    uint8_t kind = KindOfDescriptor(type[0]);
+    uint8_t variant = AccessVariant(type[0]);
+    uint32_t width = kind == KIND_WIDE ? 2 : 1;
+    uint32_t d = depth();
+    switch (op) {
+      case INST_GETSTATIC:
+        return Op21c(DEX_OP_SGET + variant, Def(Stack(d), kind), ref);
+      case INST_PUTSTATIC:
+        return Op21c(DEX_OP_SPUT + variant, Use(Stack(d - width), kind), ref);
+      case INST_GETFIELD:
+        return Op22c(DEX_OP_IGET + variant, Def(Stack(d - 1), kind), Use(Stack(d - 1), KIND_OBJECT),
+                     ref);
+      default:
+        return Op22c(DEX_OP_IPUT + variant, Use(Stack(d - width), kind),
+                     Use(Stack(d - width - 1), KIND_OBJECT), ref);
+    }
+  }
+
+  bool EmitInvoke(uint8_t op, uint16_t index) {
+    std::string class_name;
+    std::string name;
+    std::string descriptor;
+    uint8_t tag = pool_.GetTag(index);
+    if ((tag != CONSTANT_Methodref && tag != CONSTANT_InterfaceMethodref) ||
+        !pool_.GetMemberRef(index, tag, &class_name, &name, &descriptor)) {
+      return Fail("bad method ref %u", index);
+    }
+    std::vector<std::string> params;
+    std::string return_type;
+    if (!ParseDescriptor(descriptor, &params, &return_type)) {
+      return Fail("bad method descriptor %s", descriptor.c_str());
+    }
+    uint32_t count = CountUnits(params) + (op == INST_INVOKESTATIC ? 0 : 1);
+    bool is_private = class_name == context_.this_class &&
+                      context_.private_methods.count(name + descriptor) != 0;
+    uint8_t dex_op;
+    if (op == INST_INVOKESTATIC) {
+      dex_op = DEX_OP_INVOKE_STATIC_RANGE;
+    } else if (is_private || (op == INST_INVOKESPECIAL && name == "<init>")) {
+      dex_op = DEX_OP_INVOKE_DIRECT_RANGE;
+    } else if (op == INST_INVOKESPECIAL) {
+      dex_op = DEX_OP_INVOKE_SUPER_RANGE;
+    } else if (op == INST_INVOKEINTERFACE) {
+      dex_op = DEX_OP_INVOKE_INTERFACE_RANGE;
+    } else {
+      dex_op = DEX_OP_INVOKE_VIRTUAL_RANGE;
+    }
+    if (count > 255) {
+      return Fail("too many arguments");
+    }
+    uint32_t first = depth() - count;
+    OpInvokeRange(dex_op, count, Stack(first),
+                  refs_->AddMethod(ClassNameToDescriptor(class_name), name, descriptor));
+    return EmitMoveResult(return_type[0], Stack(first));
+  }
+
+  bool EmitMoveResult(char type, uint32_t reg) {
+    if (type == 'V') {
+      return true;
+    }
+    uint8_t kind = KindOfDescriptor(type);
+    return Op11x(DEX_OP_MOVE_RESULT + kind, Def(reg, kind));
+  }
+
+  // multianewarray calls java.lang.reflect.Array.newInstance() with the
+  // component class and the dimensions as an int[], as dx does.
+  bool EmitMultiNewArray(uint16_t index, uint32_t dimensions) {
+    std::string name;
+    if (!pool_.GetClassName(index, &name) || name.size() <= dimensions) {
+      return Fail("bad multianewarray class %u", index);
+    }
+    uint32_t d = depth();
+    if (dimensions == 1) {
+      return Op22c(DEX_OP_NEW_ARRAY, Def(Stack(d - 1), KIND_OBJECT),
+                   Use(Stack(d - 1), KIND_NARROW), refs_->AddType(name));
+    }
+    uint32_t first = d - dimensions;
+    Unit(DEX_OP_FILLED_NEW_ARRAY_RANGE | dimensions << 8);
+    Ref(refs_->AddType("[I"));
+    Unit(Stack(first));
+    if (!Op11x(DEX_OP_MOVE_RESULT_OBJECT, Def(Stack(first + 1), KIND_OBJECT))) {
+      return false;
+    }
+    std::string component = name.substr(dimensions);
+    static const char* const BOXES[][2] = {
+        {"Z", "Ljava/lang/Boolean;"}, {"B", "Ljava/lang/Byte;"},   {"C", "Ljava/lang/Character;"},
+        {"S", "Ljava/lang/Short;"},   {"I", "Ljava/lang/Integer;"}, {"J", "Ljava/lang/Long;"},
+        {"F", "Ljava/lang/Float;"},   {"D", "Ljava/lang/Double;"},
+    };
+    bool ok = true;
+    bool is_primitive = false;
+    for (auto& box : BOXES) {
+      if (component == box[0]) {
+        // Primitive classes are only reachable through the TYPE fields.
+        is_primitive = true;
+        ok = Op21c(DEX_OP_SGET_OBJECT, Def(Stack(first), KIND_OBJECT),
+                   refs_->AddField(box[1], "TYPE", "Ljava/lang/Class;"));
+      }
+    }
+    if (!is_primitive) {
+      ok = Op21c(DEX_OP_CONST_CLASS, Def(Stack(first), KIND_OBJECT), refs_->AddType(component));
+    }
+    if (!ok) {
+      return false;
+    }
+    OpInvokeRange(DEX_OP_INVOKE_STATIC_RANGE, 2, Stack(first),
+                  refs_->AddMethod("Ljava/lang/reflect/Array;", "newInstance",
+                                   "(Ljava/lang/Class;[I)Ljava/lang/Object;"));
+    return Op11x(DEX_OP_MOVE_RESULT_OBJECT, Def(Stack(first), KIND_OBJECT)) &&
+           Op21c(DEX_OP_CHECK_CAST, UseDef(Stack(first), KIND_OBJECT), refs_->AddType(name));
+  }
+
+  // Desugars the string concatenation of javac 9 and later, an
+  // invokedynamic of StringConcatFactory, into StringBuilder calls.
+  bool EmitInvokeDynamic(uint16_t index) {
+    uint16_t bootstrap_index;
+    std::string name;
+    std::string descriptor;
+    if (!pool_.GetInvokeDynamic(index, &bootstrap_index, &name, &descriptor) ||
+        bootstrap_index >= context_.bootstrap_methods.size()) {
+      return Fail("bad invokedynamic %u", index);
+    }
+    const DexerBootstrapMethod& bootstrap = context_.bootstrap_methods[bootstrap_index];
+    uint8_t handle_kind;
+    uint16_t method_index;
+    std::string class_name;
+    std::string method_name;
+    std::string method_descriptor;
+    if (!pool_.GetMethodHandle(bootstrap.method_handle, &handle_kind, &method_index) ||
+        !pool_.GetMemberRef(method_index, CONSTANT_Methodref, &class_name, &method_name,
+                            &method_descriptor)) {
+      return Fail("bad bootstrap method %u", bootstrap_index);
+    }
+    if (class_name != "java/lang/invoke/StringConcatFactory") {
+      return Fail("invokedynamic with %s.%s is not supported", class_name.c_str(),
+                  method_name.c_str());
+    }
+    std::vector<std::string> params;
+    std::string return_type;
+    if (!ParseDescriptor(descriptor, &params, &return_type)) {
+      return Fail("bad invokedynamic descriptor %s", descriptor.c_str());
+    }
+    // \1 stands for the next argument and \2 for the next constant.
+    std::string recipe;
+    std::vector<std::string> constants;
+    if (method_name == "makeConcatWithConstants") {
+      if (bootstrap.arguments.empty() || !pool_.GetString(bootstrap.arguments[0], &recipe)) {
+        return Fail("bad string concatenation recipe");
+      }
+      for (size_t i = 1; i < bootstrap.arguments.size(); ++i) {
+        std::string constant;
+        if (!pool_.GetString(bootstrap.arguments[i], &constant)) {
+          return Fail("string concatenation constant %zu is not a string", i);
+        }
+        constants.push_back(constant);
+      }
+    } else if (method_name == "makeConcat") {
+      recipe.assign(params.size(), '\1');
+    } else {
+      return Fail("StringConcatFactory.%s is not supported", method_name.c_str());
+    }
+
+    const std::string builder = "Ljava/lang/StringBuilder;";
+    uint32_t sb = scratch_base_;
+    uint32_t arg = scratch_base_ + 1;
+    uint32_t first = depth() - CountUnits(params);
+    if (!Op21c(DEX_OP_NEW_INSTANCE, Def(sb, KIND_OBJECT), refs_->AddType(builder))) {
+      return false;
+    }
+    OpInvokeRange(DEX_OP_INVOKE_DIRECT_RANGE, 1, sb, refs_->AddMethod(builder, "<init>", "()V"));
+    size_t next_param = 0;
+    size_t next_constant = 0;
+    uint32_t unit = first;
+    for (size_t i = 0; i < recipe.size();) {
+      std::string append_type;
+      if (recipe[i] == '\1') {
+        if (next_param >= params.size()) {
+          return Fail("string concatenation recipe has too many arguments");
+        }
+        const std::string& param = params[next_param++];
+        uint8_t kind = KindOfDescriptor(param[0]);
+        EmitMove(kind, arg, Stack(unit));
+        unit += kind == KIND_WIDE ? 2 : 1;
+        switch (param[0]) {
+          case 'B':
+          case 'S':
+            append_type = "I";
+            break;
+          case 'L':
+            append_type = (param == "Ljava/lang/String;" || param == "Ljava/lang/CharSequence;")
+                              ? param
+                              : "Ljava/lang/Object;";
+            break;
+          case '[':
+            append_type = "Ljava/lang/Object;";
+            break;
+          default:
+            append_type = param;
+            break;
+        }
+        i++;
+      } else {
+        std::string literal;
+        for (; i < recipe.size() && recipe[i] != '\1'; ++i) {
+          if (recipe[i] != '\2') {
+            literal.push_back(recipe[i]);
+          } else if (next_constant < constants.size()) {
+            literal += constants[next_constant++];
+          } else {
+            return Fail("string concatenation recipe has too many constants");
+          }
+        }
+        if (!Op21c(DEX_OP_CONST_STRING, Def(arg, KIND_OBJECT), refs_->AddString(literal))) {
+          return false;
+        }
+        append_type = "Ljava/lang/String;";
+      }
+      OpInvokeRange(DEX_OP_INVOKE_VIRTUAL_RANGE, KindOfDescriptor(append_type[0]) == KIND_WIDE ? 3 : 2,
+                    sb, refs_->AddMethod(builder, "append", "(" + append_type + ")" + builder));
+    }
+    OpInvokeRange(DEX_OP_INVOKE_VIRTUAL_RANGE, 1, sb,
+                  refs_->AddMethod(builder, "toString", "()Ljava/lang/String;"));
+    return EmitMoveResult('L', Stack(first));
+  }
+
+  // dup and friends copy values between stack slots; s(i) is the slot i
+  // below the top. Values only move within the slots the instruction
+  // touches, so each form is a fixed sequence of moves.
+  bool EmitStackOp(uint8_t op) {
+    uint32_t d = depth();
+    uint8_t k1 = KIND_NARROW;
+    uint8_t k2 = KIND_NARROW;
+    uint8_t k3 = KIND_NARROW;
+    auto move = [&](int32_t dst, int32_t src, uint8_t kind) {
+      EmitMove(kind, Stack(d + dst), Stack(d + src));
+    };
+    if (!KindOf(d - 1, &k1)) {
+      return false;
+    }
+    switch (op) {
+      case INST_DUP:
+        move(0, -1, k1);
+        return true;
+      case INST_DUP_X1:
+        if (!KindOf(d - 2, &k2)) {
+          return false;
+        }
+        move(0, -1, k1);
+        move(-1, -2, k2);
+        move(-2, 0, k1);
+        return true;
+      case INST_DUP_X2:
+        if (!KindOf(d - 2, &k2)) {
+          return false;
+        }
+        if (IsSecondHalf(d - 2)) {
+          move(0, -1, k1);
+          move(-2, -3, KIND_WIDE);
+          move(-3, 0, k1);
+          return true;
+        }
+        if (!KindOf(d - 3, &k3)) {
+          return false;
+        }
+        move(0, -1, k1);
+        move(-1, -2, k2);
+        move(-2, -3, k3);
+        move(-3, 0, k1);
+        return true;
+      case INST_DUP2:
+        if (k1 == KIND_WIDE) {
+          move(0, -2, KIND_WIDE);
+          return true;
+        }
+        if (!KindOf(d - 2, &k2)) {
+          return false;
+        }
+        move(0, -2, k2);
+        move(1, -1, k1);
+        return true;
+      case INST_DUP2_X1:
+        if (k1 == KIND_WIDE) {
+          if (!KindOf(d - 3, &k3)) {
+            return false;
+          }
+          move(0, -2, KIND_WIDE);
+          move(-1, -3, k3);
+          move(-3, 0, KIND_WIDE);
+          return true;
+        }
+        if (!KindOf(d - 2, &k2) || !KindOf(d - 3, &k3)) {
+          return false;
+        }
+        move(1, -1, k1);
+        move(0, -2, k2);
+        move(-1, -3, k3);
+        move(-3, 0, k2);
+        move(-2, 1, k1);
+        return true;
+      case INST_DUP2_X2:
+        if (k1 == KIND_WIDE) {
+          if (IsSecondHalf(d - 3)) {
+            move(0, -2, KIND_WIDE);
+            move(-2, -4, KIND_WIDE);
+            move(-4, 0, KIND_WIDE);
+            return true;
+          }
+          if (!KindOf(d - 3, &k2) || !KindOf(d - 4, &k3)) {
+            return false;
+          }
+          move(0, -2, KIND_WIDE);
+          move(-1, -3, k2);
+          move(-2, -4, k3);
+          move(-4, 0, KIND_WIDE);
+          return true;
+        }
+        if (!KindOf(d - 2, &k2)) {
+          return false;
+        }
+        if (IsSecondHalf(d - 3)) {
+          move(0, -2, k2);
+          move(1, -1, k1);
+          move(-2, -4, KIND_WIDE);
+          move(-4, 0, k2);
+          move(-3, 1, k1);
+          return true;
+        }
+        {
+          uint8_t k4 = KIND_NARROW;
+          if (!KindOf(d - 3, &k3) || !KindOf(d - 4, &k4)) {
+            return false;
+          }
+          move(0, -2, k2);
+          move(1, -1, k1);
+          move(-1, -3, k3);
+          move(-2, -4, k4);
+          move(-4, 0, k2);
+          move(-3, 1, k1);
+        }
+        return true;
+      case INST_SWAP:
+        if (!KindOf(d - 2, &k2)) {
+          return false;
+        }
+        EmitMove(k1, scratch_base_, Stack(d - 1));
+        move(-1, -2, k2);
+        EmitMove(k1, Stack(d - 2), scratch_base_);
+        return true;
+    }
+    return true;
+  }
+
+  bool IsSecondHalf(uint32_t unit) {
+    uint8_t tag = frame().stack[unit].tag;
+    return tag == VT_LONG2 || tag == VT_DOUBLE2;
+  }
+
+  bool EmitLdc(uint16_t index) {
+    uint32_t reg = Stack(depth());
+    uint64_t bits;
+    std::string s;
+    switch (pool_.GetTag(index)) {
+      case CONSTANT_Integer:
+      case CONSTANT_Float:
+        pool_.GetValue(index, &bits);
+        return EmitConst(reg, (int32_t)bits);
+      case CONSTANT_Long:
+      case CONSTANT_Double:
+        pool_.GetValue(index, &bits);
+        return EmitConstWide(reg, (int64_t)bits);
+      case CONSTANT_String:
+        pool_.GetString(index, &s);
+        return Op21c(DEX_OP_CONST_STRING, Def(reg, KIND_OBJECT), refs_->AddString(s));
+      case CONSTANT_Class:
+        pool_.GetClassName(index, &s);
+        return Op21c(DEX_OP_CONST_CLASS, Def(reg, KIND_OBJECT),
+                     refs_->AddType(ClassNameToDescriptor(s)));
+    }
+    return Fail("ldc of constant %u is not supported", index);
+  }
+
+  bool EmitSwitch(const ClassInsn& insn) {
+    uint32_t addr = Addr();
+    uint8_t op = insn.op == INST_TABLESWITCH ? DEX_OP_PACKED_SWITCH : DEX_OP_SPARSE_SWITCH;
+    if (insn.op == INST_TABLESWITCH && (int64_t)insn.c - insn.b >= 0xffff) {
+      return Fail("tableswitch is too large");
+    }
+    if (insn.op == INST_LOOKUPSWITCH && insn.b > 0xffff) {
+      return Fail("lookupswitch is too large");
+    }
+    bool ok = Legalize({Use(Stack(depth() - 1), KIND_NARROW)}, 8, [&](const uint32_t* r) {
+      addr = Addr();
+      Unit(op | r[0] << 8);
+      Unit32(0);
+    });
+    if (!ok) {
+      return false;
+    }
+    switches_.push_back(Switch{addr, pc_});
+    // No case matched: fall through to the default.
+    EmitGoto(pc_ + insn.a);
+    return true;
+  }
+
+  // Appends the switch payloads, 4-byte aligned, and points the switches to
+  // them.
+  void EmitPayloads() {
+    for (const Switch& s : switches_) {
+      if (Addr() % 2 != 0) {
+        Unit(DEX_OP_NOP);
+      }
+      uint32_t payload = Addr();
+      uint32_t offset = payload - s.insn_addr;
+      code_->insns[s.insn_addr + 1] = offset & 0xffff;
+      code_->insns[s.insn_addr + 2] = offset >> 16;
+      ClassInsn insn;
+      DecodeClassInsn(method_.code, s.pc, lengths_[s.pc], &insn);
+      auto target = [&](int32_t jvm_offset) {
+        return addresses_[s.pc + jvm_offset] - s.insn_addr;
+      };
+      if (insn.op == INST_TABLESWITCH) {
+        uint32_t size = insn.c - insn.b + 1;
+        Unit(PACKED_SWITCH_PAYLOAD);
+        Unit(size);
+        Unit32(insn.b);
+        for (uint32_t i = 0; i < size; ++i) {
+          Unit32(target(GetClassS4(method_.code, insn.table + 4 * i)));
+        }
+      } else {
+        uint32_t size = insn.b;
+        Unit(SPARSE_SWITCH_PAYLOAD);
+        Unit(size);
+        for (uint32_t i = 0; i < size; ++i) {
+          Unit32(GetClassS4(method_.code, insn.table + 8 * i));
+        }
+        for (uint32_t i = 0; i < size; ++i) {
+          Unit32(target(GetClassS4(method_.code, insn.table + 8 * i + 4)));
+        }
+      }
+    }
+  }
+
+  bool EmitInsn(const ClassInsn& insn) {
+    uint8_t op = insn.op;
+    uint32_t d = depth();
+    uint32_t reg = 0;
+    if (op == INST_NOP) {
+      return true;
+    }
+    if (op == INST_ACONST_NULL) {
+      return EmitConst(Stack(d), 0);
+    }
+    if (op >= INST_ICONST_M1 && op <= INST_ICONST_5) {
+      return EmitConst(Stack(d), op - INST_ICONST_0);
+    }
+    if (op >= INST_LCONST_0 && op <= INST_LCONST_1) {
+      return EmitConstWide(Stack(d), op - INST_LCONST_0);
+    }
+    if (op >= INST_FCONST_0 && op <= INST_FCONST_2) {
+      float value = op - INST_FCONST_0;
+      uint32_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+      return EmitConst(Stack(d), bits);
+    }
+    if (op >= INST_DCONST_0 && op <= INST_DCONST_1) {
+      double value = op - INST_DCONST_0;
+      uint64_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+      return EmitConstWide(Stack(d), bits);
+    }
+    if (op == INST_BIPUSH || op == INST_SIPUSH) {
+      return EmitConst(Stack(d), insn.a);
+    }
+    if (op == INST_LDC || op == INST_LDC_W || op == INST_LDC2_W) {
+      return EmitLdc(insn.a);
+    }
+    // Loads and stores of locals: the short forms are in groups of four by
+    // type, in the order of "ILFDA".
+    static const char LOCAL_TYPES[] = "IJFDL";
+    if ((op >= INST_ILOAD && op <= INST_ALOAD_3) || (op >= INST_ISTORE && op <= INST_ASTORE_3)) {
+      bool is_load = op <= INST_ALOAD_3;
+      uint8_t base = is_load ? INST_ILOAD : INST_ISTORE;
+      uint8_t short_base = is_load ? INST_ILOAD_0 : INST_ISTORE_0;
+      uint32_t type;
+      uint32_t index;
+      if (op < short_base) {
+        type = op - base;
+        index = insn.a;
+      } else {
+        type = (op - short_base) / 4;
+        index = (op - short_base) % 4;
+      }
+      uint8_t kind = KindOfDescriptor(LOCAL_TYPES[type]);
+      if (!Local(index, kind == KIND_WIDE, &reg)) {
+        return false;
+      }
+      if (is_load) {
+        EmitMove(kind, Stack(d), reg);
+      } else {
+        EmitMove(kind, reg, Stack(d - (kind == KIND_WIDE ? 2 : 1)));
+      }
+      return true;
+    }
+    if (op >= INST_IALOAD && op <= INST_SALOAD) {
+      return EmitArrayAccess(op);
+    }
+    if (op >= INST_IASTORE && op <= INST_SASTORE) {
+      return EmitArrayAccess(op);
+    }
+    if (op == INST_POP || op == INST_POP2) {
+      return true;
+    }
+    if (op >= INST_DUP && op <= INST_SWAP) {
+      return EmitStackOp(op);
+    }
+    // Arithmetic comes in groups of "IJFD".
+    if (op >= INST_IADD && op <= INST_DREM) {
+      static const uint8_t BASES[] = {DEX_OP_ADD_INT, DEX_OP_ADD_LONG, DEX_OP_ADD_FLOAT,
+                                      DEX_OP_ADD_DOUBLE};
+      uint32_t type = (op - INST_IADD) % 4;
+      uint8_t kind = (type % 2) ? KIND_WIDE : KIND_NARROW;
+      uint32_t width = kind == KIND_WIDE ? 2 : 1;
+      uint32_t a = d - 2 * width;
+      return Op23x(BASES[type] + (op - INST_IADD) / 4, UseDef(Stack(a), kind), Use(Stack(a), kind),
+                   Use(Stack(a + width), kind));
+    }
+    if (op >= INST_INEG && op <= INST_DNEG) {
+      static const uint8_t OPS[] = {DEX_OP_NEG_INT, DEX_OP_NEG_LONG, DEX_OP_NEG_FLOAT,
+                                    DEX_OP_NEG_DOUBLE};
+      uint8_t kind = (op - INST_INEG) % 2 ? KIND_WIDE : KIND_NARROW;
+      reg = Stack(d - (kind == KIND_WIDE ? 2 : 1));
+      return Op12x(OPS[op - INST_INEG], Def(reg, kind), Use(reg, kind));
+    }
+    // Shifts and bitwise operations come in pairs of int and long; the
+    // shift distance is an int either way.
+    if (op >= INST_ISHL && op <= INST_LXOR) {
+      static const uint8_t OFFSETS[] = {8, 9, 10, 5, 6, 7};
+      bool is_long = (op - INST_ISHL) % 2;
+      bool is_shift = op <= INST_LUSHR;
+      uint8_t kind = is_long ? KIND_WIDE : KIND_NARROW;
+      uint32_t second = is_shift ? 1 : (is_long ? 2 : 1);
+      uint32_t a = d - second - (is_long ? 2 : 1);
+      uint8_t base = is_long ? DEX_OP_ADD_LONG : DEX_OP_ADD_INT;
+      return Op23x(base + OFFSETS[(op - INST_ISHL) / 2], UseDef(Stack(a), kind),
+                   Use(Stack(a), kind), Use(Stack(d - second), is_shift ? KIND_NARROW : kind));
+    }
+    if (op == INST_IINC) {
+      if (!Local(insn.a, false, &reg)) {
+        return false;
+      }
+      int32_t value = insn.b;
+      if (value == (int8_t)value && reg < 256) {
+        Unit(DEX_OP_ADD_INT_LIT8 | reg << 8);
+        Unit(reg | (value & 0xff) << 8);
+        return true;
+      }
+      return Legalize({Def(reg, KIND_NARROW), Use(reg, KIND_NARROW)}, 4, [&](const uint32_t* r) {
+        Unit(DEX_OP_ADD_INT_LIT16 | r[0] << 8 | r[1] << 12);
+        Unit(value);
+      });
+    }
+    // Conversions are in the same order in both instruction sets.
+    if (op >= INST_I2L && op <= INST_I2S) {
+      static const char TYPES[][3] = {"IJ", "IF", "ID", "JI", "JF", "JD", "FI", "FJ",
+                                      "FD", "DI", "DJ", "DF", "II", "II", "II"};
+      const char* types = TYPES[op - INST_I2L];
+      uint8_t from = KindOfDescriptor(types[0]);
+      uint8_t to = KindOfDescriptor(types[1]);
+      reg = Stack(d - (from == KIND_WIDE ? 2 : 1));
+      return Op12x(DEX_OP_INT_TO_LONG + (op - INST_I2L), Def(reg, to), Use(reg, from));
+    }
+    if (op >= INST_LCMP && op <= INST_DCMPG) {
+      static const uint8_t OPS[] = {DEX_OP_CMP_LONG, DEX_OP_CMPL_FLOAT, DEX_OP_CMPG_FLOAT,
+                                    DEX_OP_CMPL_DOUBLE, DEX_OP_CMPG_DOUBLE};
+      uint8_t kind = (op == INST_FCMPL || op == INST_FCMPG) ? KIND_NARROW : KIND_WIDE;
+      uint32_t width = kind == KIND_WIDE ? 2 : 1;
+      uint32_t a = d - 2 * width;
+      return Op23x(OPS[op - INST_LCMP], Def(Stack(a), KIND_NARROW), Use(Stack(a), kind),
+                   Use(Stack(a + width), kind));
+    }
+    uint32_t target = pc_ + insn.a;
+    if (op >= INST_IFEQ && op <= INST_IFLE) {
+      return EmitIf(DEX_OP_IF_EQZ + (op - INST_IFEQ), Use(Stack(d - 1), KIND_NARROW), nullptr,
+                    target);
+    }
+    if (op >= INST_IF_ICMPEQ && op <= INST_IF_ACMPNE) {
+      uint8_t kind = op >= INST_IF_ACMPEQ ? KIND_OBJECT : KIND_NARROW;
+      uint8_t dex_op = op >= INST_IF_ACMPEQ ? DEX_OP_IF_EQ + (op - INST_IF_ACMPEQ)
+                                            : DEX_OP_IF_EQ + (op - INST_IF_ICMPEQ);
+      Operand b = Use(Stack(d - 1), kind);
+      return EmitIf(dex_op, Use(Stack(d - 2), kind), &b, target);
+    }
+    if (op == INST_IFNULL || op == INST_IFNONNULL) {
+      return EmitIf(op == INST_IFNULL ? DEX_OP_IF_EQZ : DEX_OP_IF_NEZ,
+                    Use(Stack(d - 1), KIND_OBJECT), nullptr, target);
+    }
+    switch (op) {
+      case INST_GOTO:
+      case INST_GOTO_W:
+        EmitGoto(target);
+        return true;
+      case INST_TABLESWITCH:
+      case INST_LOOKUPSWITCH:
+        return EmitSwitch(insn);
+      case INST_IRETURN:
+      case INST_LRETURN:
+      case INST_FRETURN:
+      case INST_DRETURN:
+      case INST_ARETURN:
+      case INST_RETURN:
+        return EmitReturn(op);
+      case INST_GETSTATIC:
+      case INST_PUTSTATIC:
+      case INST_GETFIELD:
+      case INST_PUTFIELD:
+        return EmitFieldAccess(op, insn.a);
+      case INST_INVOKEVIRTUAL:
+      case INST_INVOKESPECIAL:
+      case INST_INVOKESTATIC:
+      case INST_INVOKEINTERFACE:
+        return EmitInvoke(op, insn.a);
+      case INST_INVOKEDYNAMIC:
+        return EmitInvokeDynamic(insn.a);
+      case INST_NEW: {
+        std::string name;
+        if (!pool_.GetClassName(insn.a, &name)) {
+          return Fail("bad class %d", insn.a);
+        }
+        return Op21c(DEX_OP_NEW_INSTANCE, Def(Stack(d), KIND_OBJECT),
+                     refs_->AddType(ClassNameToDescriptor(name)));
+      }
+      case INST_NEWARRAY: {
+        static const char TYPES[] = "ZCFDBSIJ";
+        if (insn.a < T_BOOLEAN || insn.a > T_LONG) {
+          return Fail("bad array type %d", insn.a);
+        }
+        return Op22c(DEX_OP_NEW_ARRAY, Def(Stack(d - 1), KIND_OBJECT),
+                     Use(Stack(d - 1), KIND_NARROW),
+                     refs_->AddType(std::string("[") + TYPES[insn.a - T_BOOLEAN]));
+      }
+      case INST_ANEWARRAY:
+      case INST_CHECKCAST:
+      case INST_INSTANCEOF: {
+        std::string name;
+        if (!pool_.GetClassName(insn.a, &name)) {
+          return Fail("bad class %d", insn.a);
+        }
+        reg = Stack(d - 1);
+        if (op == INST_ANEWARRAY) {
+          return Op22c(DEX_OP_NEW_ARRAY, Def(reg, KIND_OBJECT), Use(reg, KIND_NARROW),
+                       refs_->AddType("[" + ClassNameToDescriptor(name)));
+        }
+        uint32_t type = refs_->AddType(ClassNameToDescriptor(name));
+        if (op == INST_CHECKCAST) {
+          return Op21c(DEX_OP_CHECK_CAST, UseDef(reg, KIND_OBJECT), type);
+        }
+        return Op22c(DEX_OP_INSTANCE_OF, Def(reg, KIND_NARROW), Use(reg, KIND_OBJECT), type);
+      }
+      case INST_MULTIANEWARRAY:
+        return EmitMultiNewArray(insn.a, insn.b);
+      case INST_ARRAYLENGTH:
+        reg = Stack(d - 1);
+        return Op12x(DEX_OP_ARRAY_LENGTH, Def(reg, KIND_NARROW), Use(reg, KIND_OBJECT));
+      case INST_ATHROW:
+        return Op11x(DEX_OP_THROW, Use(Stack(d - 1), KIND_OBJECT));
+      case INST_MONITORENTER:
+      case INST_MONITOREXIT:
+        return Op11x(op == INST_MONITORENTER ? DEX_OP_MONITOR_ENTER : DEX_OP_MONITOR_EXIT,
+                     Use(Stack(d - 1), KIND_OBJECT));
+    }
+    return Fail("unsupported instruction 0x%x", op);
+  }
+
+  bool Emit() {
+    code_->insns.clear();
+    code_->fixups.clear();
+    code_->tries.clear();
+    code_->lines.clear();
+    branches_.clear();
+    switches_.clear();
+    outs_size_ = 0;
+    overflow_ = false;
+    pc_ = 0;
+
+    // A synchronized method holds the lock of this or of its class.
+    if (is_synchronized_) {
+      bool ok;
+      if (is_static_) {
+        ok = Op21c(DEX_OP_CONST_CLASS, Def(lock_reg_, KIND_OBJECT),
+                   refs_->AddType(ClassNameToDescriptor(context_.this_class)));
+      } else {
+        EmitMove(KIND_OBJECT, lock_reg_, args_base_);
+        ok = true;
+      }
+      if (!ok || !Op11x(DEX_OP_MONITOR_ENTER, Use(lock_reg_, KIND_OBJECT))) {
+        return false;
+      }
+    }
+    addresses_.assign(code_length_ + 1, 0);
+    for (uint32_t pc = 0; pc < code_length_; pc += lengths_[pc]) {
+      pc_ = pc;
+      addresses_[pc] = Addr();
+      if (!reached_[pc]) {
+        continue;
+      }
+      if (handler_starts_[pc] && !Op11x(DEX_OP_MOVE_EXCEPTION, Def(Stack(0), KIND_OBJECT))) {
+        return false;
+      }
+      ClassInsn insn;
+      DecodeClassInsn(method_.code, pc, lengths_[pc], &insn);
+      if (!EmitInsn(insn)) {
+        return false;
+      }
+    }
+    addresses_[code_length_] = Addr();
+    uint32_t unlock_addr = Addr();
+    if (is_synchronized_) {
+      uint32_t exception = lock_reg_ + 1;
+      if (!Op11x(DEX_OP_MOVE_EXCEPTION, Def(exception, KIND_OBJECT)) ||
+          !Op11x(DEX_OP_MONITOR_EXIT, Use(lock_reg_, KIND_OBJECT)) ||
+          !Op11x(DEX_OP_THROW, Use(exception, KIND_OBJECT))) {
+        return false;
+      }
+    }
+    EmitPayloads();
+
+    for (const Branch& branch : branches_) {
+      int64_t offset = (int64_t)addresses_[branch.target] - branch.insn_addr;
+      if (branch.is_32bit) {
+        code_->insns[branch.operand_pos] = offset & 0xffff;
+        code_->insns[branch.operand_pos + 1] = (uint32_t)offset >> 16;
+      } else if (offset != (int16_t)offset) {
+        overflow_ = true;
+        return Fail("branch offset out of range");
+      } else {
+        code_->insns[branch.operand_pos] = offset;
+      }
+    }
+    BuildTries(unlock_addr);
+    for (const auto& line : lines_) {
+      if (line.first < code_length_) {
+        code_->lines.emplace_back(addresses_[line.first], line.second);
+      }
+    }
+    std::stable_sort(code_->lines.begin(), code_->lines.end(),
+                     [](const std::pair<uint32_t, uint32_t>& a,
+                        const std::pair<uint32_t, uint32_t>& b) { return a.first < b.first; });
+    code_->registers_size = registers_size_;
+    code_->ins_size = ins_size_;
+    code_->outs_size = outs_size_;
+    return true;
+  }
+
+  // The exception table may nest and overlap ranges, while try_items may
+  // not. The code is cut at every range boundary, and each piece gets the
+  // handlers covering it in table order, up to the first catch-all.
+  void BuildTries(uint32_t unlock_addr) {
+    std::vector<uint32_t> bounds;
+    for (const Handler& handler : handlers_) {
+      bounds.push_back(addresses_[handler.start]);
+      bounds.push_back(handler.is_unlock ? unlock_addr : addresses_[handler.end]);
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+    for (size_t i = 0; i + 1 < bounds.size(); ++i) {
+      uint32_t start = bounds[i];
+      uint32_t end = bounds[i + 1];
+      std::vector<DexerCatch> handlers;
+      for (const Handler& handler : handlers_) {
+        uint32_t handler_end = handler.is_unlock ? unlock_addr : addresses_[handler.end];
+        if (start < addresses_[handler.start] || start >= handler_end) {
+          continue;
+        }
+        bool seen = false;
+        for (const DexerCatch& c : handlers) {
+          seen = seen || c.type == handler.type;
+        }
+        if (!seen) {
+          DexerCatch c;
+          c.type = handler.type;
+          c.address = handler.is_unlock ? unlock_addr : addresses_[handler.handler];
+          handlers.push_back(c);
+        }
+        if (handler.type.empty()) {
+          break;
+        }
+      }
+      if (handlers.empty()) {
+        continue;
+      }
+      // Extend the previous try if it has the same handlers.
+      if (!code_->tries.empty()) {
+        DexerTry& last = code_->tries.back();
+        bool same = last.handlers.size() == handlers.size() &&
+                    last.start_addr + last.insn_count == start;
+        for (size_t j = 0; same && j < handlers.size(); ++j) {
+          same = last.handlers[j].type == handlers[j].type &&
+                 last.handlers[j].address == handlers[j].address;
+        }
+        if (same && end - last.start_addr <= 0xffff) {
+          last.insn_count = end - last.start_addr;
+          continue;
+        }
+      }
+      for (uint32_t piece = start; piece < end; piece += 0xffff) {
+        DexerTry item;
+        item.start_addr = piece;
+        item.insn_count = std::min(end - piece, 0xffffu);
+        item.handlers = handlers;
+        code_->tries.push_back(item);
+      }
+    }
+  }
+
+  const DexerClassContext& context_;
+  const DexerConstantPool& pool_;
+  DexerRefTable* refs_;
+  const ClassMethodInfo& method_;
+  const std::vector<std::pair<uint16_t, uint16_t>>& lines_;
+  DexerCode* code_;
+  std::string error_;
+
+  std::vector<VerifyFrame> frames_;
+  std::vector<bool> reached_;
+  uint32_t code_length_;
+  std::vector<uint32_t> lengths_;
+  std::vector<bool> handler_starts_;
+  std::vector<Handler> handlers_;
+  bool is_static_;
+  bool is_synchronized_;
+  uint32_t scratch_size_;
+
+  // Register layout.
+  uint32_t temps_;
+  uint32_t stack_base_;
+  uint32_t scratch_base_;
+  uint32_t lock_reg_;
+  uint32_t locals_base_;
+  uint32_t args_base_;
+  uint32_t ins_size_;
+  uint32_t registers_size_;
+
+  // Emission state.
+  uint32_t pc_;
+  bool long_branches_;
+  bool overflow_;
+  uint32_t outs_size_;
+  // Dex address of each class file pc.
+  std::vector<uint32_t> addresses_;
+  std::vector<Branch> branches_;
+  std::vector<Switch> switches_;
+};
+
+// Parses a class file and converts its methods one after another; classes
+// are what the dexer converts in parallel.
+class ClassDexer {
+ public:
+  ClassDexer(const char* data, size_t size) : data_(data), end_(data + size) {
+  }
+
+  bool Convert(DexerClass* cls, std::string* error) {
+    const char* p = data_;
+    uint32_t magic;
+    uint16_t minor_version;
+    uint16_t major_version;
+    uint16_t constant_pool_count;
+    if (end_ - data_ < 10) {
+      *error = "not a class file";
+      return false;
+    }
+    Read(p, end_, magic);
+    if (magic != 0xCAFEBABE) {
+      *error = "not a class file";
+      return false;
+    }
+    Read(p, end_, minor_version);
+    Read(p, end_, major_version);
+    Read(p, end_, constant_pool_count);
+    if (!pool_.Index(p, end_, constant_pool_count, error)) {
+      return false;
+    }
+    context_.pool = &pool_;
+    cls->refs.clear();
+    DexerRefTable refs(&cls->refs);
+
+    uint16_t access_flags;
+    uint16_t this_class;
+    uint16_t super_class;
+    uint16_t interface_count;
+    Read(p, end_, access_flags);
+    Read(p, end_, this_class);
+    Read(p, end_, super_class);
+    if (!pool_.GetClassName(this_class, &context_.this_class)) {
+      *error = "bad this_class";
+      return false;
+    }
+    // ACC_SUPER has no meaning in dex.
+    cls->access_flags = access_flags & ~CLASS_ACC_SUPER;
+    cls->descriptor = ClassNameToDescriptor(context_.this_class);
+    cls->superclass.clear();
+    if (super_class != 0) {
+      std::string name;
+      if (!pool_.GetClassName(super_class, &name)) {
+        *error = "bad super_class";
+        return false;
+      }
+      cls->superclass = ClassNameToDescriptor(name);
+    }
+    Read(p, end_, interface_count);
+    cls->interfaces.clear();
+    for (uint16_t i = 0; i < interface_count; ++i) {
+      uint16_t index;
+      std::string name;
+      Read(p, end_, index);
+      if (!pool_.GetClassName(index, &name)) {
+        *error = StringPrintf("bad interface %u", index);
+        return false;
+      }
+      cls->interfaces.push_back(ClassNameToDescriptor(name));
+    }
+
+    uint16_t field_count;
+    Read(p, end_, field_count);
+    cls->static_fields.clear();
+    cls->instance_fields.clear();
+    for (uint16_t i = 0; i < field_count; ++i) {
+      DexerField field;
+      if (!ParseField(p, &field, error)) {
+        return false;
+      }
+      bool is_static = (field.access_flags & FIELD_ACC_STATIC) != 0;
+      (is_static ? cls->static_fields : cls->instance_fields).push_back(field);
+    }
+
+    uint16_t method_count;
+    Read(p, end_, method_count);
+    std::vector<ClassMethodInfo> methods(method_count);
+    std::vector<std::vector<std::pair<uint16_t, uint16_t>>> lines(method_count);
+    for (uint16_t i = 0; i < method_count; ++i) {
+      ClassMethodInfo& method = methods[i];
+      uint16_t name_index;
+      uint16_t descriptor_index;
+      Read(p, end_, method.access_flags);
+      Read(p, end_, name_index);
+      Read(p, end_, descriptor_index);
+      if (!pool_.GetUtf8(name_index, &method.name) ||
+          !pool_.GetUtf8(descriptor_index, &method.descriptor)) {
+        *error = StringPrintf("bad name or descriptor of method #%u", i);
+        return false;
+      }
+      auto get_name = [&](uint16_t index, std::string* name) {
+        return pool_.GetUtf8(index, name);
+      };
+      if (!ScanClassAttributes(p, end_, get_name, &method, &lines[i], error)) {
+        return false;
+      }
+      if (method.access_flags & METHOD_ACC_PRIVATE) {
+        context_.private_methods.insert(method.name + method.descriptor);
+      }
+    }
+
+    uint16_t attribute_count;
+    Read(p, end_, attribute_count);
+    cls->source_file.clear();
+    for (uint16_t i = 0; i < attribute_count; ++i) {
+      std::string name;
+      uint32_t length;
+      if (!ReadAttributeHeader(p, &name, &length, error)) {
+        return false;
+      }
+      const char* next = p + length;
+      if (name == "SourceFile") {
+        uint16_t index;
+        Read(p, next, index);
+        pool_.GetUtf8(index, &cls->source_file);
+      } else if (name == "BootstrapMethods") {
+        uint16_t count;
+        Read(p, next, count);
+        for (uint16_t j = 0; j < count; ++j) {
+          DexerBootstrapMethod bootstrap;
+          uint16_t argument_count;
+          Read(p, next, bootstrap.method_handle);
+          Read(p, next, argument_count);
+          bootstrap.arguments.resize(argument_count);
+          for (uint16_t& argument : bootstrap.arguments) {
+            Read(p, next, argument);
+          }
+          context_.bootstrap_methods.push_back(bootstrap);
+        }
+      }
+      p = next;
+    }
+
+    cls->methods.clear();
+    cls->needs_default_methods = false;
+    for (uint16_t i = 0; i < method_count; ++i) {
+      const ClassMethodInfo& info = methods[i];
+      DexerMethod method;
+      method.name = info.name;
+      method.descriptor = info.descriptor;
+      method.access_flags = info.access_flags;
+      bool is_constructor = info.name == "<init>" || info.name == "<clinit>";
+      if (is_constructor) {
+        method.access_flags |= DEXER_ACC_CONSTRUCTOR;
+      }
+      // Only native methods keep ACC_SYNCHRONIZED; the code of the others
+      // takes the lock itself.
+      if ((info.access_flags & METHOD_ACC_SYNCHRONIZED) &&
+          !(info.access_flags & METHOD_ACC_NATIVE)) {
+        method.access_flags =
+            (method.access_flags & ~METHOD_ACC_SYNCHRONIZED) | DEXER_ACC_DECLARED_SYNCHRONIZED;
+      }
+      method.is_direct =
+          (info.access_flags & (METHOD_ACC_STATIC | METHOD_ACC_PRIVATE)) != 0 || is_constructor;
+      method.has_code = info.has_code;
+      if (info.has_code) {
+        if ((access_flags & CLASS_ACC_INTERFACE) && info.name != "<clinit>") {
+          cls->needs_default_methods = true;
+        }
+        MethodDexer dexer(context_, &refs, info, lines[i]);
+        std::string method_error;
+        if (!dexer.Convert(&method.code, &method_error)) {
+          *error = StringPrintf("%s%s: %s", info.name.c_str(), info.descriptor.c_str(),
+                                method_error.c_str());
+          return false;
+        }
+      }
+      cls->methods.push_back(std::move(method));
+    }
+    return true;
+  }
+
+ private:
+  bool ReadAttributeHeader(const char*& p, std::string* name, uint32_t* length,
+                           std::string* error) {
+    uint16_t name_index;
+    Read(p, end_, name_index);
+    Read(p, end_, *length);
+    if (*length > (uint64_t)(end_ - p) || !pool_.GetUtf8(name_index, name)) {
+      *error = "bad attribute";
+      return false;
+    }
+    return true;
+  }
+
+  bool ParseField(const char*& p, DexerField* field, std::string* error) {
+    uint16_t access_flags;
+    uint16_t name_index;
+    uint16_t descriptor_index;
+    uint16_t attribute_count;
+    Read(p, end_, access_flags);
+    Read(p, end_, name_index);
+    Read(p, end_, descriptor_index);
+    field->access_flags = access_flags;
+    field->has_value = false;
+    field->value = 0;
+    if (!pool_.GetUtf8(name_index, &field->name) ||
+        !pool_.GetUtf8(descriptor_index, &field->descriptor) || field->descriptor.empty()) {
+      *error = "bad field name or descriptor";
+      return false;
+    }
+    Read(p, end_, attribute_count);
+    for (uint16_t i = 0; i < attribute_count; ++i) {
+      std::string name;
+      uint32_t length;
+      if (!ReadAttributeHeader(p, &name, &length, error)) {
+        return false;
+      }
+      const char* next = p + length;
+      if (name == "ConstantValue" && (access_flags & FIELD_ACC_STATIC)) {
+        uint16_t index;
+        Read(p, next, index);
+        if (field->descriptor == "Ljava/lang/String;") {
+          field->has_value = pool_.GetString(index, &field->string_value);
+        } else {
+          field->has_value = pool_.GetValue(index, &field->value);
+        }
+        if (!field->has_value) {
+          *error = StringPrintf("bad ConstantValue of field %s", field->name.c_str());
+          return false;
+        }
+      }
+      p = next;
+    }
+    return true;
+  }
+
+  const char* data_;
+  const char* end_;
+  DexerConstantPool pool_;
+  DexerClassContext context_;
+};
+
+#endif  // CLASS_DEXER_H_
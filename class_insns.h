@@ -0,0 +1,198 @@
+#ifndef CLASS_INSNS_H_
+#define CLASS_INSNS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "class_opcodes.h"
+
+// One instruction of a Code attribute with its operands decoded. Offsets
+// and lengths are in bytes.
+struct ClassInsn {
+  uint32_t pc;
+  uint32_t length;
+  // For wide, the opcode it modifies; wide is then set.
+  uint8_t op;
+  bool wide;
+  // a is the local variable index, constant pool index, immediate, array
+  // type or branch offset; for switches, the default offset.
+  // b is the iinc increment, invokeinterface count or multianewarray
+  // dimensions; for tableswitch, low, and for lookupswitch, npairs.
+  // c is high for tableswitch.
+  int32_t a;
+  int32_t b;
+  int32_t c;
+  // For switches, the offset of the jump offsets (tableswitch) or of the
+  // match-offset pairs (lookupswitch).
+  uint32_t table;
+};
+
+static uint8_t GetClassU1(const char* code, uint32_t pc) {
+  return (uint8_t)code[pc];
+}
+
+static uint16_t GetClassU2(const char* code, uint32_t pc) {
+  return (GetClassU1(code, pc) << 8) | GetClassU1(code, pc + 1);
+}
+
+static int32_t GetClassS4(const char* code, uint32_t pc) {
+  return (int32_t)(((uint32_t)GetClassU2(code, pc) << 16) | GetClassU2(code, pc + 2));
+}
+
+// Length of the instruction at pc. Returns 0 if it is unknown, malformed or
+// runs past the code.
+static uint32_t GetClassInsnLength(const char* code, uint32_t code_length, uint32_t pc) {
+  uint8_t op = GetClassU1(code, pc);
+  const ClassOpcodeInfo& info = CLASS_OPCODES[op];
+  uint64_t length = info.length;
+  if (info.operands == CLASS_OPERANDS_TABLESWITCH ||
+      info.operands == CLASS_OPERANDS_LOOKUPSWITCH) {
+    // The operands start at the next multiple of 4 from the method start.
+    uint64_t p = (pc + 4) & ~3u;
+    if (p + 12 > code_length) {
+      return 0;
+    }
+    if (info.operands == CLASS_OPERANDS_TABLESWITCH) {
+      int64_t low = GetClassS4(code, p + 4);
+      int64_t high = GetClassS4(code, p + 8);
+      if (low > high) {
+        return 0;
+      }
+      length = p + 12 + 4 * (high - low + 1) - pc;
+    } else {
+      int64_t npairs = GetClassS4(code, p + 4);
+      if (npairs < 0) {
+        return 0;
+      }
+      length = p + 8 + 8 * npairs - pc;
+    }
+  } else if (info.operands == CLASS_OPERANDS_WIDE) {
+    if (pc + 1 >= code_length) {
+      return 0;
+    }
+    uint8_t wide_op = GetClassU1(code, pc + 1);
+    if (CLASS_OPCODES[wide_op].operands == CLASS_OPERANDS_IINC) {
+      length = 6;
+    } else if (CLASS_OPCODES[wide_op].operands == CLASS_OPERANDS_LOCAL) {
+      length = 4;
+    } else {
+      return 0;
+    }
+  } else if (length == 0) {
+    return 0;
+  }
+  if (pc + length > code_length) {
+    return 0;
+  }
+  return length;
+}
+
+// Decodes the instruction at pc, whose length must come from
+// GetClassInsnLength.
+static void DecodeClassInsn(const char* code, uint32_t pc, uint32_t length, ClassInsn* insn) {
+  insn->pc = pc;
+  insn->length = length;
+  insn->op = GetClassU1(code, pc);
+  insn->wide = false;
+  insn->a = insn->b = insn->c = 0;
+  insn->table = 0;
+  switch (CLASS_OPCODES[insn->op].operands) {
+    case CLASS_OPERANDS_LOCAL:
+    case CLASS_OPERANDS_CONSTANT_U1:
+    case CLASS_OPERANDS_NEWARRAY:
+      insn->a = GetClassU1(code, pc + 1);
+      break;
+    case CLASS_OPERANDS_BYTE:
+      insn->a = (int8_t)GetClassU1(code, pc + 1);
+      break;
+    case CLASS_OPERANDS_SHORT:
+    case CLASS_OPERANDS_BRANCH:
+      insn->a = (int16_t)GetClassU2(code, pc + 1);
+      break;
+    case CLASS_OPERANDS_CONSTANT:
+    case CLASS_OPERANDS_INVOKEDYNAMIC:
+      insn->a = GetClassU2(code, pc + 1);
+      break;
+    case CLASS_OPERANDS_BRANCH_W:
+      insn->a = GetClassS4(code, pc + 1);
+      break;
+    case CLASS_OPERANDS_IINC:
+      insn->a = GetClassU1(code, pc + 1);
+      insn->b = (int8_t)GetClassU1(code, pc + 2);
+      break;
+    case CLASS_OPERANDS_INVOKEINTERFACE:
+    case CLASS_OPERANDS_MULTIANEWARRAY:
+      insn->a = GetClassU2(code, pc + 1);
+      insn->b = GetClassU1(code, pc + 3);
+      break;
+    case CLASS_OPERANDS_TABLESWITCH: {
+      uint32_t p = (pc + 4) & ~3u;
+      insn->a = GetClassS4(code, p);
+      insn->b = GetClassS4(code, p + 4);
+      insn->c = GetClassS4(code, p + 8);
+      insn->table = p + 12;
+      break;
+    }
+    case CLASS_OPERANDS_LOOKUPSWITCH: {
+      uint32_t p = (pc + 4) & ~3u;
+      insn->a = GetClassS4(code, p);
+      insn->b = GetClassS4(code, p + 4);
+      insn->table = p + 8;
+      break;
+    }
+    case CLASS_OPERANDS_WIDE:
+      insn->op = GetClassU1(code, pc + 1);
+      insn->wide = true;
+      insn->a = GetClassU2(code, pc + 2);
+      if (CLASS_OPCODES[insn->op].operands == CLASS_OPERANDS_IINC) {
+        insn->b = (int16_t)GetClassU2(code, pc + 4);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+// Walks the code array of a Code attribute, decoding instructions in order
+// into a caller's buffer, in the same way as DexInsnScanner.
+class ClassInsnScanner {
+ public:
+  ClassInsnScanner(const char* code, uint32_t code_length)
+      : code_(code), code_length_(code_length), pc_(0), error_(nullptr) {
+  }
+
+  // Decodes up to capacity instructions and returns how many. Stops before a
+  // malformed instruction, which error() then describes; returns 0 once
+  // there is nothing more to decode.
+  size_t Next(ClassInsn* out, size_t capacity) {
+    size_t count = 0;
+    while (count < capacity && pc_ < code_length_ && error_ == nullptr) {
+      uint32_t length = GetClassInsnLength(code_, code_length_, pc_);
+      if (length == 0) {
+        error_ = "bad instruction";
+      } else {
+        DecodeClassInsn(code_, pc_, length, &out[count]);
+        pc_ += length;
+        count++;
+      }
+    }
+    return count;
+  }
+
+  // Where scanning goes on, or the pc of the bad instruction.
+  uint32_t pc() const {
+    return pc_;
+  }
+
+  const char* error() const {
+    return error_;
+  }
+
+ private:
+  const char* code_;
+  uint32_t code_length_;
+  uint32_t pc_;
+  const char* error_;
+};
+
+#endif  // CLASS_INSNS_H_
@@ -0,0 +1,95 @@
+#ifndef CLASS_MEMBERS_H_
+#define CLASS_MEMBERS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "class_dexer.h"
+#include "class_verifier.h"
+#include "java_class.h"
+
+// What the benchmark and opstat read of a class file, short of converting
+// it: the constant pool and where the code of each method is.
+struct ClassMembers {
+  uint16_t major_version;
+  std::string this_class;
+  DexerConstantPool pool;
+  std::vector<ClassMethodInfo> methods;
+};
+
+// Reads the class file up to the end of the constant pool, leaving p there.
+static bool ReadClassHead(const char* data, size_t size, const char*& p, ClassMembers* cls) {
+  const char* end = data + size;
+  if (size < 10) {
+    return false;
+  }
+  uint32_t magic;
+  uint16_t minor_version;
+  uint16_t constant_pool_count;
+  Read(p, end, magic);
+  if (magic != 0xCAFEBABE) {
+    return false;
+  }
+  Read(p, end, minor_version);
+  Read(p, end, cls->major_version);
+  Read(p, end, constant_pool_count);
+  std::string error;
+  return cls->pool.Index(p, end, constant_pool_count, &error);
+}
+
+// Reads the class file up to the end of its methods.
+static bool ReadClassMembers(const char* data, size_t size, ClassMembers* cls) {
+  const char* p = data;
+  const char* end = data + size;
+  if (!ReadClassHead(data, size, p, cls)) {
+    return false;
+  }
+  uint16_t access_flags;
+  uint16_t this_class;
+  uint16_t super_class;
+  uint16_t interface_count;
+  Read(p, end, access_flags);
+  Read(p, end, this_class);
+  Read(p, end, super_class);
+  Read(p, end, interface_count);
+  if (!cls->pool.GetClassName(this_class, &cls->this_class) || interface_count * 2 > end - p) {
+    return false;
+  }
+  p += interface_count * 2;
+  auto get_name = [&](uint16_t index, std::string* name) {
+    return cls->pool.GetUtf8(index, name);
+  };
+  std::string error;
+  uint16_t field_count;
+  Read(p, end, field_count);
+  for (uint16_t i = 0; i < field_count; ++i) {
+    if (end - p < 6) {
+      return false;
+    }
+    p += 6;
+    if (!ScanClassAttributes(p, end, get_name, nullptr, nullptr, &error)) {
+      return false;
+    }
+  }
+  uint16_t method_count;
+  Read(p, end, method_count);
+  cls->methods.resize(method_count);
+  for (ClassMethodInfo& method : cls->methods) {
+    uint16_t name_index;
+    uint16_t descriptor_index;
+    Read(p, end, method.access_flags);
+    Read(p, end, name_index);
+    Read(p, end, descriptor_index);
+    if (!cls->pool.GetUtf8(name_index, &method.name) ||
+        !cls->pool.GetUtf8(descriptor_index, &method.descriptor) ||
+        !ScanClassAttributes(p, end, get_name, &method, nullptr, &error)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif  // CLASS_MEMBERS_H_
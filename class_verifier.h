@@ -0,0 +1,1621 @@
+#ifndef CLASS_VERIFIER_H_
+#define CLASS_VERIFIER_H_
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "class_insns.h"
+#include "java_class.h"
+#include "profiler.h"
+#include "string_pool.h"
+#include "utils.h"
+
+// Where the pieces of one method live in the class file, found by a silent
+// walk over its attributes.
+struct ClassMethodInfo {
+  uint16_t access_flags;
+  std::string name;
+  std::string descriptor;
+  bool has_code;
+  uint16_t max_stack;
+  uint16_t max_locals;
+  const char* code;
+  uint32_t code_length;
+  const char* exception_table;
+  uint16_t exception_table_length;
+  // nullptr if the Code attribute has no StackMapTable.
+  const char* stack_map_table;
+  const char* stack_map_table_end;
+  // The first LineNumberTable of the Code attribute, nullptr if it has none.
+  const char* line_number_table;
+  uint16_t line_number_table_length;
+};
+
+// Reads the attribute_count and attribute array of a field or method at p,
+// leaving p after them. get_name(index, &name) names an attribute by its
+// constant. If method is not nullptr, records where its Code attribute, its
+// StackMapTable and its first LineNumberTable are, and if lines is not
+// nullptr as well, appends the (start_pc, line) entries of every
+// LineNumberTable.
+template <typename GetName>
+static bool ScanClassAttributes(const char*& p, const char* end, const GetName& get_name,
+                                ClassMethodInfo* method,
+                                std::vector<std::pair<uint16_t, uint16_t>>* lines,
+                                std::string* error) {
+  if (method != nullptr) {
+    method->has_code = false;
+    method->stack_map_table = nullptr;
+    method->line_number_table = nullptr;
+  }
+  uint16_t attribute_count;
+  Read(p, end, attribute_count);
+  std::string name;
+  for (uint16_t i = 0; i < attribute_count; ++i) {
+    uint16_t name_index;
+    uint32_t length;
+    Read(p, end, name_index);
+    Read(p, end, length);
+    if (length > (uint64_t)(end - p) || !get_name(name_index, &name)) {
+      *error = "bad attribute";
+      return false;
+    }
+    const char* next = p + length;
+    if (method == nullptr || name != "Code") {
+      p = next;
+      continue;
+    }
+    method->has_code = true;
+    Read(p, next, method->max_stack);
+    Read(p, next, method->max_locals);
+    Read(p, next, method->code_length);
+    if (method->code_length > (uint64_t)(next - p)) {
+      *error = "truncated Code attribute";
+      return false;
+    }
+    method->code = p;
+    p += method->code_length;
+    Read(p, next, method->exception_table_length);
+    if (method->exception_table_length * 8 > next - p) {
+      *error = "truncated exception table";
+      return false;
+    }
+    method->exception_table = p;
+    p += method->exception_table_length * 8;
+    uint16_t code_attribute_count;
+    Read(p, next, code_attribute_count);
+    for (uint16_t j = 0; j < code_attribute_count; ++j) {
+      uint16_t code_name_index;
+      uint32_t code_length;
+      Read(p, next, code_name_index);
+      Read(p, next, code_length);
+      if (code_length > (uint64_t)(next - p) || !get_name(code_name_index, &name)) {
+        *error = "bad attribute";
+        return false;
+      }
+      const char* code_attribute_end = p + code_length;
+      if (name == "StackMapTable") {
+        method->stack_map_table = p;
+        method->stack_map_table_end = code_attribute_end;
+      } else if (name == "LineNumberTable") {
+        const char* q = p;
+        uint16_t count;
+        Read(q, code_attribute_end, count);
+        if (count * 4 > code_attribute_end - q) {
+          *error = "truncated LineNumberTable";
+          return false;
+        }
+        if (method->line_number_table == nullptr) {
+          method->line_number_table = q;
+          method->line_number_table_length = count;
+        }
+        for (uint16_t k = 0; lines != nullptr && k < count; ++k) {
+          uint16_t start_pc;
+          uint16_t line;
+          Read(q, code_attribute_end, start_pc);
+          Read(q, code_attribute_end, line);
+          lines->emplace_back(start_pc, line);
+        }
+      }
+      p = code_attribute_end;
+    }
+    p = next;
+  }
+  return true;
+}
+
+enum VERIFY_TYPE_TAG {
+  VT_TOP,
+  VT_INTEGER,
+  VT_FLOAT,
+  VT_LONG,
+  VT_DOUBLE,
+  // Second slot of a long/double, in locals and on the operand stack.
+  VT_LONG2,
+  VT_DOUBLE2,
+  VT_NULL,
+  VT_UNINITIALIZED_THIS,
+  // value is the offset of the new instruction.
+  VT_UNINITIALIZED,
+  // value is the StringHandle of the class name.
+  VT_REFERENCE,
+  // value is the target of the jsr, only seen by type inference.
+  VT_RETURN_ADDRESS,
+};
+
+struct VerifyType {
+  uint8_t tag;
+  uint32_t value;
+
+  bool operator==(const VerifyType& other) const {
+    return tag == other.tag && value == other.value;
+  }
+  bool operator!=(const VerifyType& other) const {
+    return !(*this == other);
+  }
+};
+
+struct VerifyFrame {
+  std::vector<VerifyType> locals;
+  std::vector<VerifyType> stack;
+};
+
+// Verifies the bytecode of one method. A MethodVerifier is not shared between
+// threads; verifying methods in parallel uses one verifier per method.
+//
+// The class hierarchy is not loaded, so an assignment between two class types
+// is always accepted. Everything else the JVM spec checks about types (primitive
+// kinds, array element types, initialization of new objects, stack depth and
+// local variable bounds, stack map frames and exception handlers) is checked.
+class MethodVerifier {
+ public:
+  MethodVerifier(const std::vector<const char*>& constant_pool, const char* end,
+                 const std::string& this_class, const ClassMethodInfo& method)
+      : constant_pool_(constant_pool), end_(end), this_class_(this_class), method_(method),
+        code_(method.code), code_length_(method.code_length), pc_(0), used_inference_(false) {
+  }
+
+  // Class files of version 50 and above are type checked against their
+  // StackMapTable in one linear pass. Older class files, and version 50 files
+  // that fail type checking, fall back to type inference as the spec allows.
+  bool Verify(uint16_t major_version) {
+    bool is_abstract = (method_.access_flags & (METHOD_ACC_ABSTRACT | METHOD_ACC_NATIVE)) != 0;
+    if (!method_.has_code) {
+      return is_abstract ? true : Fail("missing Code attribute");
+    }
+    if (is_abstract) {
+      return Fail("abstract or native method has a Code attribute");
+    }
+    if (code_length_ == 0) {
+      return Fail("empty code");
+    }
+    if (!ScanInstructions() || !DecodeExceptionTable()) {
+      return false;
+    }
+    if (major_version >= 50) {
+      if (TypeCheck()) {
+        return true;
+      }
+      if (major_version > 50) {
+        return false;
+      }
+    }
+    used_inference_ = true;
+    return Infer();
+  }
+
+  bool used_inference() const {
+    return used_inference_;
+  }
+
+  const std::string& error() const {
+    return error_;
+  }
+
+  // Infers the frame before each instruction by the dataflow verifier, for
+  // the dexer, which needs the types on the operand stack. frames and reached
+  // are indexed by pc; instructions that are never reached have no frame.
+  bool InferFrames(std::vector<VerifyFrame>* frames, std::vector<bool>* reached) {
+    if (!method_.has_code || code_length_ == 0) {
+      return Fail("no code");
+    }
+    if (!ScanInstructions() || !DecodeExceptionTable() || !Infer()) {
+      return false;
+    }
+    frames->swap(in_frames_);
+    reached->swap(has_frame_);
+    return true;
+  }
+
+ private:
+  struct Handler {
+    uint32_t start;
+    uint32_t end;
+    uint32_t handler;
+    VerifyType catch_type;
+  };
+
+  bool Fail(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    char buf[256];
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    error_ = StringPrintf("pc 0x%x: %s", pc_, buf);
+    return false;
+  }
+
+  uint8_t U1(uint32_t pc) {
+    return (uint8_t)code_[pc];
+  }
+
+  uint16_t U2(uint32_t pc) {
+    return (U1(pc) << 8) | U1(pc + 1);
+  }
+
+  int32_t S4(uint32_t pc) {
+    return (int32_t)(((uint32_t)U2(pc) << 16) | U2(pc + 2));
+  }
+
+  bool ScanInstructions() {
+    instruction_length_.assign(code_length_, 0);
+    for (uint32_t pc = 0; pc < code_length_;) {
+      pc_ = pc;
+      uint32_t length = GetClassInsnLength(code_, code_length_, pc);
+      if (length == 0) {
+        return Fail("bad instruction 0x%x", U1(pc));
+      }
+      instruction_length_[pc] = length;
+      uint8_t op = U1(pc);
+      if (op == INST_JSR || op == INST_JSR_W) {
+        return_points_.push_back(pc + length);
+      }
+      pc += length;
+    }
+    return true;
+  }
+
+  bool IsInstructionStart(int64_t pc) {
+    return pc >= 0 && pc < code_length_ && instruction_length_[pc] != 0;
+  }
+
+  bool GetEntry(uint16_t index, uint8_t tag, const char** p) {
+    if (index == 0 || index >= constant_pool_.size() || constant_pool_[index] == nullptr ||
+        (uint8_t)*constant_pool_[index] != tag) {
+      return false;
+    }
+    *p = constant_pool_[index] + 1;
+    return true;
+  }
+
+  bool GetUtf8(uint16_t index, std::string* s) {
+    const char* p;
+    if (!GetEntry(index, CONSTANT_Utf8, &p)) {
+      return false;
+    }
+    uint16_t length;
+    Read(p, end_, length);
+    if (p + length > end_) {
+      return false;
+    }
+    s->assign(p, length);
+    return true;
+  }
+
+  bool GetClassName(uint16_t index, std::string* name) {
+    const char* p;
+    uint16_t name_index;
+    if (!GetEntry(index, CONSTANT_Class, &p)) {
+      return false;
+    }
+    Read(p, end_, name_index);
+    return GetUtf8(name_index, name) && !name->empty();
+  }
+
+  bool GetNameAndType(uint16_t index, std::string* name, std::string* descriptor) {
+    const char* p;
+    uint16_t name_index;
+    uint16_t descriptor_index;
+    if (!GetEntry(index, CONSTANT_NameAndType, &p)) {
+      return false;
+    }
+    Read(p, end_, name_index);
+    Read(p, end_, descriptor_index);
+    return GetUtf8(name_index, name) && GetUtf8(descriptor_index, descriptor);
+  }
+
+  // Fieldref, Methodref or InterfaceMethodref, depending on tag.
+  bool GetMemberRef(uint16_t index, uint8_t tag, std::string* class_name, std::string* name,
+                    std::string* descriptor) {
+    const char* p;
+    uint16_t class_index;
+    uint16_t name_and_type_index;
+    if (!GetEntry(index, tag, &p)) {
+      return false;
+    }
+    Read(p, end_, class_index);
+    Read(p, end_, name_and_type_index);
+    return GetClassName(class_index, class_name) &&
+           GetNameAndType(name_and_type_index, name, descriptor);
+  }
+
+  static VerifyType Type(uint8_t tag, uint32_t value = 0) {
+    VerifyType type;
+    type.tag = tag;
+    type.value = value;
+    return type;
+  }
+
+  static VerifyType Reference(const char* name) {
+    return Type(VT_REFERENCE, InternString(name));
+  }
+
+  static VerifyType Reference(const std::string& name) {
+    return Type(VT_REFERENCE, InternString(name));
+  }
+
+  static const char* Name(const VerifyType& type) {
+    return GetInternedString(type.value);
+  }
+
+  static bool IsCategory2(const VerifyType& type) {
+    return type.tag == VT_LONG || type.tag == VT_DOUBLE;
+  }
+
+  static bool IsSecondHalf(const VerifyType& type) {
+    return type.tag == VT_LONG2 || type.tag == VT_DOUBLE2;
+  }
+
+  static VerifyType SecondHalf(const VerifyType& type) {
+    return Type(type.tag == VT_LONG ? VT_LONG2 : VT_DOUBLE2);
+  }
+
+  static bool IsReference(const VerifyType& type) {
+    return type.tag == VT_NULL || type.tag == VT_UNINITIALIZED_THIS ||
+           type.tag == VT_UNINITIALIZED || type.tag == VT_REFERENCE;
+  }
+
+  // Array descriptors are used as names for array classes, so the element
+  // name of "[Ljava/lang/String;" is "java/lang/String" and that of "[[I"
+  // is "[I".
+  static std::string ElementName(const std::string& component) {
+    if (component[0] == 'L') {
+      return component.substr(1, component.size() - 2);
+    }
+    return component;
+  }
+
+  static std::string ToDescriptor(const std::string& name) {
+    return name[0] == '[' ? name : "L" + name + ";";
+  }
+
+  static bool IsReferenceComponent(const char* array_name) {
+    return array_name[0] != '\0' && (array_name[1] == 'L' || array_name[1] == '[');
+  }
+
+  bool ParseFieldType(const std::string& desc, size_t& pos, VerifyType* type) {
+    if (pos >= desc.size()) {
+      return false;
+    }
+    switch (desc[pos]) {
+      case 'B': case 'C': case 'I': case 'S': case 'Z':
+        *type = Type(VT_INTEGER);
+        pos++;
+        return true;
+      case 'F':
+        *type = Type(VT_FLOAT);
+        pos++;
+        return true;
+      case 'J':
+        *type = Type(VT_LONG);
+        pos++;
+        return true;
+      case 'D':
+        *type = Type(VT_DOUBLE);
+        pos++;
+        return true;
+      case 'L':
+      {
+        size_t semi = desc.find(';', pos);
+        if (semi == std::string::npos || semi == pos + 1) {
+          return false;
+        }
+        *type = Reference(desc.substr(pos + 1, semi - pos - 1));
+        pos = semi + 1;
+        return true;
+      }
+      case '[':
+      {
+        size_t start = pos;
+        while (pos < desc.size() && desc[pos] == '[') {
+          pos++;
+        }
+        if (pos - start > 255 || pos >= desc.size()) {
+          return false;
+        }
+        if (desc[pos] == 'L') {
+          size_t semi = desc.find(';', pos);
+          if (semi == std::string::npos || semi == pos + 1) {
+            return false;
+          }
+          pos = semi + 1;
+        } else if (strchr("BCDFIJSZ", desc[pos]) != nullptr) {
+          pos++;
+        } else {
+          return false;
+        }
+        *type = Reference(desc.substr(start, pos - start));
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool ParseMethodDescriptor(const std::string& desc, std::vector<VerifyType>* params,
+                             bool* is_void, VerifyType* return_type) {
+    if (desc.empty() || desc[0] != '(') {
+      return false;
+    }
+    size_t pos = 1;
+    while (pos < desc.size() && desc[pos] != ')') {
+      VerifyType type;
+      if (!ParseFieldType(desc, pos, &type)) {
+        return false;
+      }
+      params->push_back(type);
+    }
+    if (pos >= desc.size()) {
+      return false;
+    }
+    pos++;
+    *is_void = (pos < desc.size() && desc[pos] == 'V');
+    if (*is_void) {
+      pos++;
+    } else if (!ParseFieldType(desc, pos, return_type)) {
+      return false;
+    }
+    return pos == desc.size();
+  }
+
+  bool IsReferenceAssignable(const char* from, const char* to) {
+    if (strcmp(from, to) == 0 || strcmp(to, "java/lang/Object") == 0) {
+      return true;
+    }
+    if (from[0] == '[') {
+      if (to[0] != '[') {
+        return strcmp(to, "java/lang/Cloneable") == 0 || strcmp(to, "java/io/Serializable") == 0;
+      }
+      if (!IsReferenceComponent(from) || !IsReferenceComponent(to)) {
+        return false;
+      }
+      return IsReferenceAssignable(ElementName(from + 1).c_str(), ElementName(to + 1).c_str());
+    }
+    return to[0] != '[';
+  }
+
+  bool IsAssignable(const VerifyType& from, const VerifyType& to) {
+    if (from == to || to.tag == VT_TOP) {
+      return true;
+    }
+    if (to.tag != VT_REFERENCE) {
+      return false;
+    }
+    if (from.tag == VT_NULL) {
+      return true;
+    }
+    return from.tag == VT_REFERENCE &&
+           IsReferenceAssignable(Name(from), Name(to));
+  }
+
+  bool IsFrameAssignable(const VerifyFrame& from, const VerifyFrame& to) {
+    if (from.stack.size() != to.stack.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < from.locals.size(); ++i) {
+      if (!IsAssignable(from.locals[i], to.locals[i])) {
+        return false;
+      }
+    }
+    for (size_t i = 0; i < from.stack.size(); ++i) {
+      if (!IsAssignable(from.stack[i], to.stack[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool Push(VerifyFrame& f, const VerifyType& type) {
+    size_t slots = IsCategory2(type) ? 2 : 1;
+    if (f.stack.size() + slots > method_.max_stack) {
+      return Fail("stack overflow");
+    }
+    f.stack.push_back(type);
+    if (slots == 2) {
+      f.stack.push_back(SecondHalf(type));
+    }
+    return true;
+  }
+
+  bool Pop(VerifyFrame& f, const VerifyType& expected) {
+    if (IsCategory2(expected)) {
+      if (f.stack.size() < 2 || f.stack.back() != SecondHalf(expected) ||
+          f.stack[f.stack.size() - 2] != expected) {
+        return Fail("expected a %s on the stack", expected.tag == VT_LONG ? "long" : "double");
+      }
+      f.stack.resize(f.stack.size() - 2);
+      return true;
+    }
+    if (f.stack.empty()) {
+      return Fail("stack underflow");
+    }
+    if (!IsAssignable(f.stack.back(), expected)) {
+      return Fail("bad type on the stack");
+    }
+    f.stack.pop_back();
+    return true;
+  }
+
+  bool PopReference(VerifyFrame& f, VerifyType* type) {
+    if (f.stack.empty()) {
+      return Fail("stack underflow");
+    }
+    *type = f.stack.back();
+    if (!IsReference(*type)) {
+      return Fail("expected a reference on the stack");
+    }
+    f.stack.pop_back();
+    return true;
+  }
+
+  // Pops an initialized reference, which must be null or an array.
+  bool PopArray(VerifyFrame& f, VerifyType* type) {
+    if (!PopReference(f, type)) {
+      return false;
+    }
+    if (type->tag == VT_NULL ||
+        (type->tag == VT_REFERENCE && Name(*type)[0] == '[')) {
+      return true;
+    }
+    return Fail("expected an array on the stack");
+  }
+
+  // A cut `depth` slots below the top of the stack must not split a long or
+  // double into halves.
+  bool CheckStackCut(VerifyFrame& f, size_t depth) {
+    if (f.stack.size() < depth) {
+      return Fail("stack underflow");
+    }
+    if (IsSecondHalf(f.stack[f.stack.size() - depth])) {
+      return Fail("splitting a long or double on the stack");
+    }
+    return true;
+  }
+
+  // The dup family: copies the top `count` slots and inserts them `depth`
+  // slots below the top.
+  bool Dup(VerifyFrame& f, size_t count, size_t depth) {
+    if (!CheckStackCut(f, count) || !CheckStackCut(f, depth)) {
+      return false;
+    }
+    if (f.stack.size() + count > method_.max_stack) {
+      return Fail("stack overflow");
+    }
+    std::vector<VerifyType> copy(f.stack.end() - count, f.stack.end());
+    f.stack.insert(f.stack.end() - depth, copy.begin(), copy.end());
+    return true;
+  }
+
+  bool CheckLocal(uint32_t index, bool wide) {
+    if (index + (wide ? 1 : 0) >= method_.max_locals) {
+      return Fail("local %u out of range", index);
+    }
+    return true;
+  }
+
+  void KillLocal(VerifyFrame& f, uint32_t index) {
+    if (IsCategory2(f.locals[index]) && index + 1 < f.locals.size()) {
+      f.locals[index + 1] = Type(VT_TOP);
+    } else if (IsSecondHalf(f.locals[index]) && index > 0) {
+      f.locals[index - 1] = Type(VT_TOP);
+    }
+    f.locals[index] = Type(VT_TOP);
+  }
+
+  bool Load(VerifyFrame& f, uint32_t index, const VerifyType& expected) {
+    if (!CheckLocal(index, IsCategory2(expected))) {
+      return false;
+    }
+    const VerifyType& local = f.locals[index];
+    bool ok;
+    if (expected.tag == VT_REFERENCE) {
+      ok = IsReference(local);
+    } else {
+      ok = local == expected && (!IsCategory2(expected) || f.locals[index + 1] == SecondHalf(expected));
+    }
+    if (!ok) {
+      return Fail("bad type in local %u", index);
+    }
+    return Push(f, local);
+  }
+
+  bool Store(VerifyFrame& f, uint32_t index, const VerifyType& expected) {
+    VerifyType value;
+    if (expected.tag == VT_REFERENCE) {
+      if (f.stack.empty()) {
+        return Fail("stack underflow");
+      }
+      value = f.stack.back();
+      if (!IsReference(value) && value.tag != VT_RETURN_ADDRESS) {
+        return Fail("expected a reference or return address on the stack");
+      }
+      f.stack.pop_back();
+    } else {
+      value = expected;
+      if (!Pop(f, expected)) {
+        return false;
+      }
+    }
+    if (!CheckLocal(index, IsCategory2(value))) {
+      return false;
+    }
+    KillLocal(f, index);
+    f.locals[index] = value;
+    if (IsCategory2(value)) {
+      KillLocal(f, index + 1);
+      f.locals[index + 1] = SecondHalf(value);
+    }
+    is_store_ = true;
+    return true;
+  }
+
+  // Opcode groups are laid out as int, long, float, double, reference.
+  VerifyType KindType(int kind) {
+    static const uint8_t tags[] = {VT_INTEGER, VT_LONG, VT_FLOAT, VT_DOUBLE};
+    return kind < 4 ? Type(tags[kind]) : Reference("java/lang/Object");
+  }
+
+  bool Branch(int32_t offset) {
+    int64_t target = (int64_t)pc_ + offset;
+    if (!IsInstructionStart(target)) {
+      return Fail("bad branch target 0x%" PRIx64, target);
+    }
+    targets_.push_back(target);
+    return true;
+  }
+
+  bool ArrayLoad(VerifyFrame& f, const char* element) {
+    VerifyType array = Type(VT_TOP);
+    if (!Pop(f, Type(VT_INTEGER)) || !PopArray(f, &array)) {
+      return false;
+    }
+    if (element == nullptr) {
+      if (array.tag == VT_NULL) {
+        return Push(f, array);
+      }
+      const char* name = Name(array);
+      if (!IsReferenceComponent(name)) {
+        return Fail("aaload on %s", name);
+      }
+      return Push(f, Reference(ElementName(name + 1)));
+    }
+    if (array.tag != VT_NULL && !MatchArray(Name(array), element)) {
+      return Fail("array load on %s", Name(array));
+    }
+    VerifyType type;
+    size_t pos = 0;
+    ParseFieldType(element, pos, &type);
+    return Push(f, type);
+  }
+
+  bool ArrayStore(VerifyFrame& f, const char* element) {
+    VerifyType array = Type(VT_TOP);
+    if (element == nullptr) {
+      VerifyType value;
+      if (!PopReference(f, &value) || !Pop(f, Type(VT_INTEGER)) || !PopArray(f, &array)) {
+        return false;
+      }
+      if (array.tag != VT_NULL && !IsReferenceComponent(Name(array))) {
+        return Fail("aastore on %s", Name(array));
+      }
+      return true;
+    }
+    VerifyType type;
+    size_t pos = 0;
+    ParseFieldType(element, pos, &type);
+    if (!Pop(f, type) || !Pop(f, Type(VT_INTEGER)) || !PopArray(f, &array)) {
+      return false;
+    }
+    if (array.tag != VT_NULL && !MatchArray(Name(array), element)) {
+      return Fail("array store on %s", Name(array));
+    }
+    return true;
+  }
+
+  // baload and bastore are shared between byte and boolean arrays.
+  static bool MatchArray(const char* name, const char* element) {
+    if (name[0] != '[' || name[1] == '\0' || name[2] != '\0') {
+      return false;
+    }
+    return name[1] == element[0] || (element[0] == 'B' && name[1] == 'Z');
+  }
+
+  bool Ldc(VerifyFrame& f, uint16_t index, bool wide_value) {
+    if (index == 0 || index >= constant_pool_.size() || constant_pool_[index] == nullptr) {
+      return Fail("bad constant pool index %u", index);
+    }
+    uint8_t tag = *constant_pool_[index];
+    if (wide_value) {
+      if (tag == CONSTANT_Long) {
+        return Push(f, Type(VT_LONG));
+      } else if (tag == CONSTANT_Double) {
+        return Push(f, Type(VT_DOUBLE));
+      }
+      return Fail("ldc2_w of constant tag %u", tag);
+    }
+    switch (tag) {
+      case CONSTANT_Integer: return Push(f, Type(VT_INTEGER));
+      case CONSTANT_Float: return Push(f, Type(VT_FLOAT));
+      case CONSTANT_String: return Push(f, Reference("java/lang/String"));
+      case CONSTANT_Class: return Push(f, Reference("java/lang/Class"));
+      case CONSTANT_MethodType: return Push(f, Reference("java/lang/invoke/MethodType"));
+      case CONSTANT_MethodHandle: return Push(f, Reference("java/lang/invoke/MethodHandle"));
+    }
+    return Fail("ldc of constant tag %u", tag);
+  }
+
+  bool FieldAccess(VerifyFrame& f, uint8_t op, uint16_t index) {
+    std::string class_name;
+    std::string name;
+    std::string descriptor;
+    if (!GetMemberRef(index, CONSTANT_Fieldref, &class_name, &name, &descriptor)) {
+      return Fail("bad Fieldref %u", index);
+    }
+    VerifyType type;
+    size_t pos = 0;
+    if (!ParseFieldType(descriptor, pos, &type) || pos != descriptor.size()) {
+      return Fail("bad field descriptor %s", descriptor.c_str());
+    }
+    if (op == INST_GETSTATIC) {
+      return Push(f, type);
+    } else if (op == INST_PUTSTATIC) {
+      return Pop(f, type);
+    } else if (op == INST_GETFIELD) {
+      return Pop(f, Reference(class_name)) && Push(f, type);
+    }
+    if (!Pop(f, type)) {
+      return false;
+    }
+    // A constructor may store to its own fields before calling super().
+    if (!f.stack.empty() && f.stack.back().tag == VT_UNINITIALIZED_THIS &&
+        class_name == this_class_) {
+      f.stack.pop_back();
+      return true;
+    }
+    return Pop(f, Reference(class_name));
+  }
+
+  bool Invoke(VerifyFrame& f, uint8_t op, uint16_t index) {
+    std::string class_name;
+    std::string name;
+    std::string descriptor;
+    if (op == INST_INVOKEDYNAMIC) {
+      const char* p;
+      uint16_t bootstrap_index;
+      uint16_t name_and_type_index;
+      if (!GetEntry(index, CONSTANT_InvokeDynamic, &p)) {
+        return Fail("bad InvokeDynamic %u", index);
+      }
+      Read(p, end_, bootstrap_index);
+      Read(p, end_, name_and_type_index);
+      if (!GetNameAndType(name_and_type_index, &name, &descriptor)) {
+        return Fail("bad InvokeDynamic %u", index);
+      }
+    } else if (op == INST_INVOKEINTERFACE) {
+      if (!GetMemberRef(index, CONSTANT_InterfaceMethodref, &class_name, &name, &descriptor)) {
+        return Fail("bad InterfaceMethodref %u", index);
+      }
+    } else if (!GetMemberRef(index, CONSTANT_Methodref, &class_name, &name, &descriptor) &&
+               (op == INST_INVOKEVIRTUAL ||
+                !GetMemberRef(index, CONSTANT_InterfaceMethodref, &class_name, &name, &descriptor))) {
+      return Fail("bad Methodref %u", index);
+    }
+    std::vector<VerifyType> params;
+    bool is_void;
+    VerifyType return_type;
+    if (!ParseMethodDescriptor(descriptor, &params, &is_void, &return_type)) {
+      return Fail("bad method descriptor %s", descriptor.c_str());
+    }
+    bool is_init = (name == "<init>");
+    if (name[0] == '<' && !(is_init && op == INST_INVOKESPECIAL)) {
+      return Fail("invoking %s", name.c_str());
+    }
+    for (size_t i = params.size(); i > 0; --i) {
+      if (!Pop(f, params[i - 1])) {
+        return false;
+      }
+    }
+    if (op == INST_INVOKESTATIC || op == INST_INVOKEDYNAMIC) {
+      // No receiver.
+    } else if (is_init) {
+      if (!is_void) {
+        return Fail("<init> must return void");
+      }
+      VerifyType receiver = Type(VT_TOP);
+      if (!PopReference(f, &receiver)) {
+        return false;
+      }
+      VerifyType initialized;
+      if (receiver.tag == VT_UNINITIALIZED_THIS) {
+        initialized = Reference(this_class_);
+      } else if (receiver.tag == VT_UNINITIALIZED) {
+        std::string new_class;
+        GetClassName(U2(receiver.value + 1), &new_class);
+        if (new_class != class_name) {
+          return Fail("calling %s.<init> on a new %s", class_name.c_str(), new_class.c_str());
+        }
+        initialized = Reference(new_class);
+      } else {
+        return Fail("<init> on an initialized object");
+      }
+      for (auto& type : f.locals) {
+        if (type == receiver) {
+          type = initialized;
+        }
+      }
+      for (auto& type : f.stack) {
+        if (type == receiver) {
+          type = initialized;
+        }
+      }
+    } else {
+      VerifyType receiver = Type(VT_TOP);
+      if (!PopReference(f, &receiver)) {
+        return false;
+      }
+      if (op != INST_INVOKEINTERFACE && !IsAssignable(receiver, Reference(class_name))) {
+        return Fail("bad receiver for %s.%s", class_name.c_str(), name.c_str());
+      }
+      if (op == INST_INVOKEINTERFACE && (receiver.tag == VT_UNINITIALIZED ||
+                                         receiver.tag == VT_UNINITIALIZED_THIS)) {
+        return Fail("invokeinterface on an uninitialized object");
+      }
+    }
+    return is_void || Push(f, return_type);
+  }
+
+  bool Return(VerifyFrame& f, const VerifyType* type) {
+    if (type == nullptr) {
+      if (!return_is_void_) {
+        return Fail("return in a non-void method");
+      }
+      if (method_.name == "<init>") {
+        for (auto& local : f.locals) {
+          if (local.tag == VT_UNINITIALIZED_THIS) {
+            return Fail("returning before this is initialized");
+          }
+        }
+      }
+    } else if (return_is_void_) {
+      return Fail("returning a value from a void method");
+    } else if (type->tag == VT_REFERENCE) {
+      if (return_type_.tag != VT_REFERENCE) {
+        return Fail("bad return type");
+      }
+      if (!Pop(f, return_type_)) {
+        return false;
+      }
+    } else if (return_type_ != *type || !Pop(f, *type)) {
+      return Fail("bad return type");
+    }
+    falls_through_ = false;
+    return true;
+  }
+
+  // Applies the instruction at pc_ to the frame, filling targets_,
+  // falls_through_, is_store_ and is_ret_.
+  bool Execute(VerifyFrame& f) {
+    uint32_t pc = pc_;
+    uint8_t op = U1(pc);
+    targets_.clear();
+    falls_through_ = true;
+    is_store_ = false;
+    is_ret_ = false;
+    if (op == INST_NOP) {
+      return true;
+    } else if (op == INST_ACONST_NULL) {
+      return Push(f, Type(VT_NULL));
+    } else if (op >= INST_ICONST_M1 && op <= INST_ICONST_5) {
+      return Push(f, Type(VT_INTEGER));
+    } else if (op == INST_LCONST_0 || op == INST_LCONST_1) {
+      return Push(f, Type(VT_LONG));
+    } else if (op >= INST_FCONST_0 && op <= INST_FCONST_2) {
+      return Push(f, Type(VT_FLOAT));
+    } else if (op == INST_DCONST_0 || op == INST_DCONST_1) {
+      return Push(f, Type(VT_DOUBLE));
+    } else if (op == INST_BIPUSH || op == INST_SIPUSH) {
+      return Push(f, Type(VT_INTEGER));
+    } else if (op == INST_LDC) {
+      return Ldc(f, U1(pc + 1), false);
+    } else if (op == INST_LDC_W) {
+      return Ldc(f, U2(pc + 1), false);
+    } else if (op == INST_LDC2_W) {
+      return Ldc(f, U2(pc + 1), true);
+    } else if (op >= INST_ILOAD && op <= INST_ALOAD) {
+      return Load(f, U1(pc + 1), KindType(op - INST_ILOAD));
+    } else if (op >= INST_ILOAD_0 && op <= INST_ALOAD_3) {
+      return Load(f, (op - INST_ILOAD_0) % 4, KindType((op - INST_ILOAD_0) / 4));
+    } else if (op >= INST_IALOAD && op <= INST_SALOAD) {
+      static const char* elements[] = {"I", "J", "F", "D", nullptr, "B", "C", "S"};
+      return ArrayLoad(f, elements[op - INST_IALOAD]);
+    } else if (op >= INST_ISTORE && op <= INST_ASTORE) {
+      return Store(f, U1(pc + 1), KindType(op - INST_ISTORE));
+    } else if (op >= INST_ISTORE_0 && op <= INST_ASTORE_3) {
+      return Store(f, (op - INST_ISTORE_0) % 4, KindType((op - INST_ISTORE_0) / 4));
+    } else if (op >= INST_IASTORE && op <= INST_SASTORE) {
+      static const char* elements[] = {"I", "J", "F", "D", nullptr, "B", "C", "S"};
+      return ArrayStore(f, elements[op - INST_IASTORE]);
+    } else if (op == INST_POP) {
+      if (!CheckStackCut(f, 1)) {
+        return false;
+      }
+      f.stack.pop_back();
+      return true;
+    } else if (op == INST_POP2) {
+      if (!CheckStackCut(f, 2)) {
+        return false;
+      }
+      f.stack.resize(f.stack.size() - 2);
+      return true;
+    } else if (op == INST_DUP) {
+      return Dup(f, 1, 1);
+    } else if (op == INST_DUP_X1) {
+      return Dup(f, 1, 2);
+    } else if (op == INST_DUP_X2) {
+      return Dup(f, 1, 3);
+    } else if (op == INST_DUP2) {
+      return Dup(f, 2, 2);
+    } else if (op == INST_DUP2_X1) {
+      return Dup(f, 2, 3);
+    } else if (op == INST_DUP2_X2) {
+      return Dup(f, 2, 4);
+    } else if (op == INST_SWAP) {
+      if (!CheckStackCut(f, 1) || !CheckStackCut(f, 2)) {
+        return false;
+      }
+      std::swap(f.stack[f.stack.size() - 1], f.stack[f.stack.size() - 2]);
+      return true;
+    } else if (op >= INST_IADD && op <= INST_DREM) {
+      VerifyType type = KindType((op - INST_IADD) % 4);
+      return Pop(f, type) && Pop(f, type) && Push(f, type);
+    } else if (op >= INST_INEG && op <= INST_DNEG) {
+      VerifyType type = KindType((op - INST_INEG) % 4);
+      return Pop(f, type) && Push(f, type);
+    } else if (op >= INST_ISHL && op <= INST_LUSHR) {
+      VerifyType type = KindType((op - INST_ISHL) % 2);
+      return Pop(f, Type(VT_INTEGER)) && Pop(f, type) && Push(f, type);
+    } else if (op >= INST_IAND && op <= INST_LXOR) {
+      VerifyType type = KindType((op - INST_IAND) % 2);
+      return Pop(f, type) && Pop(f, type) && Push(f, type);
+    } else if (op == INST_IINC) {
+      uint8_t index = U1(pc + 1);
+      if (!CheckLocal(index, false) || f.locals[index].tag != VT_INTEGER) {
+        return Fail("iinc on a non-int local %u", index);
+      }
+      return true;
+    } else if (op >= INST_I2L && op <= INST_I2S) {
+      // i2l i2f i2d l2i l2f l2d f2i f2l f2d d2i d2l d2f i2b i2c i2s
+      static const int from[] = {0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 0, 0, 0};
+      static const int to[] = {1, 2, 3, 0, 2, 3, 0, 1, 3, 0, 1, 2, 0, 0, 0};
+      return Pop(f, KindType(from[op - INST_I2L])) && Push(f, KindType(to[op - INST_I2L]));
+    } else if (op == INST_LCMP) {
+      return Pop(f, Type(VT_LONG)) && Pop(f, Type(VT_LONG)) && Push(f, Type(VT_INTEGER));
+    } else if (op == INST_FCMPL || op == INST_FCMPG) {
+      return Pop(f, Type(VT_FLOAT)) && Pop(f, Type(VT_FLOAT)) && Push(f, Type(VT_INTEGER));
+    } else if (op == INST_DCMPL || op == INST_DCMPG) {
+      return Pop(f, Type(VT_DOUBLE)) && Pop(f, Type(VT_DOUBLE)) && Push(f, Type(VT_INTEGER));
+    } else if (op >= INST_IFEQ && op <= INST_IFLE) {
+      return Pop(f, Type(VT_INTEGER)) && Branch((int16_t)U2(pc + 1));
+    } else if (op >= INST_IF_ICMPEQ && op <= INST_IF_ICMPLE) {
+      return Pop(f, Type(VT_INTEGER)) && Pop(f, Type(VT_INTEGER)) &&
+             Branch((int16_t)U2(pc + 1));
+    } else if (op == INST_IF_ACMPEQ || op == INST_IF_ACMPNE) {
+      VerifyType a;
+      VerifyType b;
+      return PopReference(f, &a) && PopReference(f, &b) && Branch((int16_t)U2(pc + 1));
+    } else if (op == INST_IFNULL || op == INST_IFNONNULL) {
+      VerifyType a;
+      return PopReference(f, &a) && Branch((int16_t)U2(pc + 1));
+    } else if (op == INST_GOTO || op == INST_GOTO_W) {
+      falls_through_ = false;
+      return Branch(op == INST_GOTO ? (int16_t)U2(pc + 1) : S4(pc + 1));
+    } else if (op == INST_JSR || op == INST_JSR_W) {
+      if (!used_inference_) {
+        return Fail("jsr in a class file with stack map frames");
+      }
+      falls_through_ = false;
+      if (!Branch(op == INST_JSR ? (int16_t)U2(pc + 1) : S4(pc + 1))) {
+        return false;
+      }
+      return Push(f, Type(VT_RETURN_ADDRESS, targets_.back()));
+    } else if (op == INST_RET) {
+      if (!used_inference_) {
+        return Fail("ret in a class file with stack map frames");
+      }
+      uint8_t index = U1(pc + 1);
+      if (!CheckLocal(index, false) || f.locals[index].tag != VT_RETURN_ADDRESS) {
+        return Fail("ret on a local %u without a return address", index);
+      }
+      falls_through_ = false;
+      is_ret_ = true;
+      return true;
+    } else if (op == INST_TABLESWITCH || op == INST_LOOKUPSWITCH) {
+      if (!Pop(f, Type(VT_INTEGER))) {
+        return false;
+      }
+      uint32_t p = (pc + 4) & ~3u;
+      if (!Branch(S4(p))) {
+        return false;
+      }
+      if (op == INST_TABLESWITCH) {
+        int64_t count = (int64_t)S4(p + 8) - S4(p + 4) + 1;
+        for (int64_t i = 0; i < count; ++i) {
+          if (!Branch(S4(p + 12 + 4 * i))) {
+            return false;
+          }
+        }
+      } else {
+        int32_t npairs = S4(p + 4);
+        for (int32_t i = 0; i < npairs; ++i) {
+          if (i > 0 && S4(p + 8 + 8 * i) <= S4(p + 8 + 8 * (i - 1))) {
+            return Fail("lookupswitch keys are not sorted");
+          }
+          if (!Branch(S4(p + 12 + 8 * i))) {
+            return false;
+          }
+        }
+      }
+      falls_through_ = false;
+      return true;
+    } else if (op >= INST_IRETURN && op <= INST_DRETURN) {
+      VerifyType type = KindType(op - INST_IRETURN);
+      return Return(f, &type);
+    } else if (op == INST_ARETURN) {
+      VerifyType type = Reference("java/lang/Object");
+      return Return(f, &type);
+    } else if (op == INST_RETURN) {
+      return Return(f, nullptr);
+    } else if (op >= INST_GETSTATIC && op <= INST_PUTFIELD) {
+      return FieldAccess(f, op, U2(pc + 1));
+    } else if (op >= INST_INVOKEVIRTUAL && op <= INST_INVOKEDYNAMIC) {
+      if (op == INST_INVOKEINTERFACE && (U1(pc + 3) == 0 || U1(pc + 4) != 0)) {
+        return Fail("bad invokeinterface operands");
+      }
+      if (op == INST_INVOKEDYNAMIC && U2(pc + 3) != 0) {
+        return Fail("bad invokedynamic operands");
+      }
+      return Invoke(f, op, U2(pc + 1));
+    } else if (op == INST_NEW) {
+      std::string name;
+      if (!GetClassName(U2(pc + 1), &name) || name[0] == '[') {
+        return Fail("bad class for new");
+      }
+      return Push(f, Type(VT_UNINITIALIZED, pc));
+    } else if (op == INST_NEWARRAY) {
+      static const char* arrays[] = {"[Z", "[C", "[F", "[D", "[B", "[S", "[I", "[J"};
+      uint8_t atype = U1(pc + 1);
+      if (atype < T_BOOLEAN || atype > T_LONG) {
+        return Fail("bad newarray type %u", atype);
+      }
+      return Pop(f, Type(VT_INTEGER)) && Push(f, Reference(arrays[atype - T_BOOLEAN]));
+    } else if (op == INST_ANEWARRAY) {
+      std::string name;
+      if (!GetClassName(U2(pc + 1), &name)) {
+        return Fail("bad class for anewarray");
+      }
+      return Pop(f, Type(VT_INTEGER)) && Push(f, Reference("[" + ToDescriptor(name)));
+    } else if (op == INST_ARRAYLENGTH) {
+      VerifyType array = Type(VT_TOP);
+      return PopArray(f, &array) && Push(f, Type(VT_INTEGER));
+    } else if (op == INST_ATHROW) {
+      falls_through_ = false;
+      return Pop(f, Reference("java/lang/Throwable"));
+    } else if (op == INST_CHECKCAST || op == INST_INSTANCEOF) {
+      std::string name;
+      if (!GetClassName(U2(pc + 1), &name)) {
+        return Fail("bad class for %s", op == INST_CHECKCAST ? "checkcast" : "instanceof");
+      }
+      if (!Pop(f, Reference("java/lang/Object"))) {
+        return false;
+      }
+      return Push(f, op == INST_CHECKCAST ? Reference(name) : Type(VT_INTEGER));
+    } else if (op == INST_MONITORENTER || op == INST_MONITOREXIT) {
+      return Pop(f, Reference("java/lang/Object"));
+    } else if (op == INST_WIDE) {
+      uint8_t wide_op = U1(pc + 1);
+      uint16_t index = U2(pc + 2);
+      if (wide_op == INST_IINC) {
+        if (!CheckLocal(index, false) || f.locals[index].tag != VT_INTEGER) {
+          return Fail("iinc on a non-int local %u", index);
+        }
+        return true;
+      } else if (wide_op >= INST_ILOAD && wide_op <= INST_ALOAD) {
+        return Load(f, index, KindType(wide_op - INST_ILOAD));
+      } else if (wide_op >= INST_ISTORE && wide_op <= INST_ASTORE) {
+        return Store(f, index, KindType(wide_op - INST_ISTORE));
+      }
+      return Fail("wide ret is not supported");
+    } else if (op == INST_MULTIANEWARRAY) {
+      std::string name;
+      uint8_t dimensions = U1(pc + 3);
+      if (!GetClassName(U2(pc + 1), &name) || dimensions == 0 ||
+          name.find_first_not_of('[') < dimensions) {
+        return Fail("bad multianewarray");
+      }
+      for (uint8_t i = 0; i < dimensions; ++i) {
+        if (!Pop(f, Type(VT_INTEGER))) {
+          return false;
+        }
+      }
+      return Push(f, Reference(name));
+    }
+    return Fail("unknown instruction 0x%x", op);
+  }
+
+  bool DecodeExceptionTable() {
+    const char* p = method_.exception_table;
+    for (uint16_t i = 0; i < method_.exception_table_length; ++i) {
+      uint16_t start_pc;
+      uint16_t end_pc;
+      uint16_t handler_pc;
+      uint16_t catch_type;
+      Read(p, end_, start_pc);
+      Read(p, end_, end_pc);
+      Read(p, end_, handler_pc);
+      Read(p, end_, catch_type);
+      if (start_pc >= end_pc || !IsInstructionStart(start_pc) ||
+          (end_pc != code_length_ && !IsInstructionStart(end_pc)) ||
+          !IsInstructionStart(handler_pc)) {
+        return Fail("bad exception table entry %u", i);
+      }
+      Handler handler;
+      handler.start = start_pc;
+      handler.end = end_pc;
+      handler.handler = handler_pc;
+      if (catch_type == 0) {
+        handler.catch_type = Reference("java/lang/Throwable");
+      } else {
+        std::string name;
+        if (!GetClassName(catch_type, &name)) {
+          return Fail("bad catch type %u", catch_type);
+        }
+        handler.catch_type = Reference(name);
+      }
+      handlers_.push_back(handler);
+    }
+    return true;
+  }
+
+  void Expand(const std::vector<VerifyType>& types, std::vector<VerifyType>* slots) {
+    for (auto& type : types) {
+      slots->push_back(type);
+      if (IsCategory2(type)) {
+        slots->push_back(SecondHalf(type));
+      }
+    }
+  }
+
+  // Returns the declared argument types, with longs and doubles taking one
+  // entry, which is the form stack map frames describe locals in.
+  bool InitialLocals(std::vector<VerifyType>* args) {
+    if (!(method_.access_flags & METHOD_ACC_STATIC)) {
+      if (method_.name == "<init>" && this_class_ != "java/lang/Object") {
+        args->push_back(Type(VT_UNINITIALIZED_THIS));
+      } else {
+        args->push_back(Reference(this_class_));
+      }
+    }
+    if (!ParseMethodDescriptor(method_.descriptor, args, &return_is_void_, &return_type_)) {
+      return Fail("bad method descriptor %s", method_.descriptor.c_str());
+    }
+    return true;
+  }
+
+  bool MakeFrame(const std::vector<VerifyType>& locals, const std::vector<VerifyType>& stack,
+                 VerifyFrame* frame) {
+    frame->locals.clear();
+    frame->stack.clear();
+    Expand(locals, &frame->locals);
+    Expand(stack, &frame->stack);
+    if (frame->locals.size() > method_.max_locals) {
+      return Fail("frame has more locals than max_locals");
+    }
+    if (frame->stack.size() > method_.max_stack) {
+      return Fail("frame has a deeper stack than max_stack");
+    }
+    frame->locals.resize(method_.max_locals, Type(VT_TOP));
+    return true;
+  }
+
+  template <typename T>
+  bool ReadFrameData(const char*& p, T& value) {
+    if (p + sizeof(T) > method_.stack_map_table_end) {
+      return Fail("truncated StackMapTable");
+    }
+    Read(p, method_.stack_map_table_end, value);
+    return true;
+  }
+
+  bool ReadVerificationType(const char*& p, std::vector<VerifyType>* types) {
+    uint8_t tag = 0;
+    if (!ReadFrameData(p, tag)) {
+      return false;
+    }
+    switch (tag) {
+      case ITEM_Top: types->push_back(Type(VT_TOP)); return true;
+      case ITEM_Integer: types->push_back(Type(VT_INTEGER)); return true;
+      case ITEM_Float: types->push_back(Type(VT_FLOAT)); return true;
+      case ITEM_Double: types->push_back(Type(VT_DOUBLE)); return true;
+      case ITEM_Long: types->push_back(Type(VT_LONG)); return true;
+      case ITEM_Null: types->push_back(Type(VT_NULL)); return true;
+      case ITEM_UninitializedThis: types->push_back(Type(VT_UNINITIALIZED_THIS)); return true;
+      case ITEM_Object:
+      {
+        uint16_t index = 0;
+        std::string name;
+        if (!ReadFrameData(p, index)) {
+          return false;
+        }
+        if (!GetClassName(index, &name)) {
+          return Fail("bad class %u in StackMapTable", index);
+        }
+        types->push_back(Reference(name));
+        return true;
+      }
+      case ITEM_Uninitialized:
+      {
+        uint16_t offset = 0;
+        if (!ReadFrameData(p, offset)) {
+          return false;
+        }
+        if (!IsInstructionStart(offset) || U1(offset) != INST_NEW) {
+          return Fail("uninitialized type at 0x%x is not a new instruction", offset);
+        }
+        types->push_back(Type(VT_UNINITIALIZED, offset));
+        return true;
+      }
+    }
+    return Fail("bad verification type %u", tag);
+  }
+
+  bool DecodeStackMapTable(const std::vector<VerifyType>& initial_locals) {
+    frame_index_.assign(code_length_, -1);
+    frames_.clear();
+    if (method_.stack_map_table == nullptr) {
+      return true;
+    }
+    const char* p = method_.stack_map_table;
+    uint16_t number_of_entries = 0;
+    if (!ReadFrameData(p, number_of_entries)) {
+      return false;
+    }
+    std::vector<VerifyType> locals = initial_locals;
+    int64_t offset = -1;
+    for (uint16_t i = 0; i < number_of_entries; ++i) {
+      uint8_t frame_type = 0;
+      uint16_t offset_delta = 0;
+      std::vector<VerifyType> stack;
+      if (!ReadFrameData(p, frame_type)) {
+        return false;
+      }
+      if (frame_type <= 63) {
+        offset_delta = frame_type;
+      } else if (frame_type <= 127) {
+        offset_delta = frame_type - 64;
+        if (!ReadVerificationType(p, &stack)) {
+          return false;
+        }
+      } else if (frame_type <= 246) {
+        return Fail("reserved frame_type %u", frame_type);
+      } else {
+        if (!ReadFrameData(p, offset_delta)) {
+          return false;
+        }
+        if (frame_type == 247) {
+          if (!ReadVerificationType(p, &stack)) {
+            return false;
+          }
+        } else if (frame_type <= 250) {
+          size_t chop = 251 - frame_type;
+          if (locals.size() < chop) {
+            return Fail("chop_frame removes too many locals");
+          }
+          locals.resize(locals.size() - chop);
+        } else if (frame_type <= 254) {
+          for (int j = 0; j < frame_type - 251; ++j) {
+            if (!ReadVerificationType(p, &locals)) {
+              return false;
+            }
+          }
+        } else {
+          uint16_t number_of_locals = 0;
+          uint16_t number_of_stack_items = 0;
+          locals.clear();
+          if (!ReadFrameData(p, number_of_locals)) {
+            return false;
+          }
+          for (uint16_t j = 0; j < number_of_locals; ++j) {
+            if (!ReadVerificationType(p, &locals)) {
+              return false;
+            }
+          }
+          if (!ReadFrameData(p, number_of_stack_items)) {
+            return false;
+          }
+          for (uint16_t j = 0; j < number_of_stack_items; ++j) {
+            if (!ReadVerificationType(p, &stack)) {
+              return false;
+            }
+          }
+        }
+      }
+      offset += offset_delta + 1;
+      if (!IsInstructionStart(offset)) {
+        return Fail("stack map frame at 0x%" PRIx64 " is not at an instruction", offset);
+      }
+      VerifyFrame frame;
+      if (!MakeFrame(locals, stack, &frame)) {
+        return false;
+      }
+      frame_index_[offset] = frames_.size();
+      frames_.push_back(frame);
+    }
+    return true;
+  }
+
+  bool CheckHandlers(const std::vector<VerifyType>& locals) {
+    for (auto& handler : handlers_) {
+      if (pc_ < handler.start || pc_ >= handler.end) {
+        continue;
+      }
+      int index = frame_index_[handler.handler];
+      if (index < 0) {
+        return Fail("exception handler 0x%x has no stack map frame", handler.handler);
+      }
+      const VerifyFrame& target = frames_[index];
+      if (target.stack.size() != 1 || !IsAssignable(handler.catch_type, target.stack[0])) {
+        return Fail("bad stack in the frame of exception handler 0x%x", handler.handler);
+      }
+      for (size_t i = 0; i < locals.size(); ++i) {
+        if (!IsAssignable(locals[i], target.locals[i])) {
+          return Fail("locals are not assignable to exception handler 0x%x", handler.handler);
+        }
+      }
+    }
+    return true;
+  }
+
+  // The linear type checker: every branch target and exception handler has a
+  // stack map frame, so each instruction is visited exactly once.
+  bool TypeCheck() {
+    std::vector<VerifyType> args;
+    VerifyFrame frame;
+    if (!InitialLocals(&args) || !MakeFrame(args, {}, &frame) || !DecodeStackMapTable(args)) {
+      return false;
+    }
+    bool reachable = true;
+    for (uint32_t pc = 0; pc < code_length_; pc += instruction_length_[pc]) {
+      pc_ = pc;
+      SetProfilePc(pc);
+      int index = frame_index_[pc];
+      if (index >= 0) {
+        if (reachable && !IsFrameAssignable(frame, frames_[index])) {
+          return Fail("frame is not assignable to the stack map frame");
+        }
+        frame = frames_[index];
+      } else if (!reachable) {
+        return Fail("no stack map frame after an unconditional branch");
+      }
+      if (!CheckHandlers(frame.locals) || !Execute(frame)) {
+        return false;
+      }
+      if (is_store_ && !CheckHandlers(frame.locals)) {
+        return false;
+      }
+      for (uint32_t target : targets_) {
+        index = frame_index_[target];
+        if (index < 0) {
+          return Fail("branch target 0x%x has no stack map frame", target);
+        }
+        if (!IsFrameAssignable(frame, frames_[index])) {
+          return Fail("frame is not assignable to the stack map frame at 0x%x", target);
+        }
+      }
+      reachable = falls_through_;
+    }
+    pc_ = code_length_;
+    if (reachable) {
+      return Fail("falling off the end of the code");
+    }
+    return true;
+  }
+
+  VerifyType MergeType(const VerifyType& a, const VerifyType& b) {
+    if (a == b) {
+      return a;
+    }
+    if ((a.tag != VT_REFERENCE && a.tag != VT_NULL) ||
+        (b.tag != VT_REFERENCE && b.tag != VT_NULL)) {
+      return Type(VT_TOP);
+    }
+    if (a.tag == VT_NULL) {
+      return b;
+    }
+    if (b.tag == VT_NULL) {
+      return a;
+    }
+    return Reference(MergeReferenceName(Name(a), Name(b)));
+  }
+
+  // Without the class hierarchy, two different classes merge to Object rather
+  // than to their closest common superclass as in the JVM, even where a
+  // StackMapTable frame names that superclass. This only loses precision:
+  // IsReferenceAssignable accepts any class where a class is expected, so the
+  // merged Object doesn't reject code the JVM would accept. Arrays of
+  // references keep their dimension so aaload still works after a merge.
+  std::string MergeReferenceName(const std::string& a, const std::string& b) {
+    if (a == b) {
+      return a;
+    }
+    if (IsReferenceComponent(a.c_str()) && IsReferenceComponent(b.c_str())) {
+      return "[" + ToDescriptor(MergeReferenceName(ElementName(a.substr(1)),
+                                                   ElementName(b.substr(1))));
+    }
+    return "java/lang/Object";
+  }
+
+  bool MergeInto(uint32_t pc, const VerifyFrame& frame) {
+    if (!has_frame_[pc]) {
+      has_frame_[pc] = true;
+      in_frames_[pc] = frame;
+    } else {
+      VerifyFrame& target = in_frames_[pc];
+      if (target.stack.size() != frame.stack.size()) {
+        return Fail("stack size mismatch when merging into 0x%x", pc);
+      }
+      bool changed = false;
+      for (size_t i = 0; i < frame.locals.size(); ++i) {
+        VerifyType type = MergeType(target.locals[i], frame.locals[i]);
+        if (type != target.locals[i]) {
+          target.locals[i] = type;
+          changed = true;
+        }
+      }
+      for (size_t i = 0; i < frame.stack.size(); ++i) {
+        VerifyType type = MergeType(target.stack[i], frame.stack[i]);
+        if (type.tag == VT_TOP) {
+          return Fail("incompatible stack types when merging into 0x%x", pc);
+        }
+        if (type != target.stack[i]) {
+          target.stack[i] = type;
+          changed = true;
+        }
+      }
+      if (!changed) {
+        return true;
+      }
+    }
+    if (!in_worklist_[pc]) {
+      in_worklist_[pc] = true;
+      worklist_.push_back(pc);
+    }
+    return true;
+  }
+
+  bool MergeIntoHandlers(const std::vector<VerifyType>& locals) {
+    for (auto& handler : handlers_) {
+      if (pc_ >= handler.start && pc_ < handler.end) {
+        VerifyFrame frame;
+        frame.locals = locals;
+        frame.stack.push_back(handler.catch_type);
+        if (!MergeInto(handler.handler, frame)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // The dataflow verifier for class files without stack map frames. A ret
+  // flows to the instruction after every jsr in the method, which may lose
+  // precision in locals but never accepts ill-typed code.
+  bool Infer() {
+    std::vector<VerifyType> args;
+    VerifyFrame frame;
+    if (!InitialLocals(&args) || !MakeFrame(args, {}, &frame)) {
+      return false;
+    }
+    in_frames_.assign(code_length_, VerifyFrame());
+    has_frame_.assign(code_length_, false);
+    in_worklist_.assign(code_length_, false);
+    worklist_.clear();
+    pc_ = 0;
+    if (!MergeInto(0, frame)) {
+      return false;
+    }
+    while (!worklist_.empty()) {
+      uint32_t pc = worklist_.back();
+      worklist_.pop_back();
+      in_worklist_[pc] = false;
+      pc_ = pc;
+      SetProfilePc(pc);
+      frame = in_frames_[pc];
+      if (!MergeIntoHandlers(frame.locals) || !Execute(frame)) {
+        return false;
+      }
+      if (is_store_ && !MergeIntoHandlers(frame.locals)) {
+        return false;
+      }
+      for (uint32_t target : targets_) {
+        if (!MergeInto(target, frame)) {
+          return false;
+        }
+      }
+      if (is_ret_) {
+        for (uint32_t target : return_points_) {
+          if (target < code_length_ && !MergeInto(target, frame)) {
+            return false;
+          }
+        }
+      }
+      if (falls_through_) {
+        uint32_t next = pc + instruction_length_[pc];
+        if (next >= code_length_) {
+          return Fail("falling off the end of the code");
+        }
+        if (!MergeInto(next, frame)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  const std::vector<const char*>& constant_pool_;
+  const char* end_;
+  const std::string& this_class_;
+  const ClassMethodInfo& method_;
+  const char* code_;
+  uint32_t code_length_;
+
+  uint32_t pc_;
+  bool used_inference_;
+  std::string error_;
+
+  bool return_is_void_;
+  VerifyType return_type_;
+
+  std::vector<uint32_t> instruction_length_;
+  std::vector<uint32_t> return_points_;
+  std::vector<Handler> handlers_;
+
+  // Stack map frames, indexed by frame_index_[pc] (-1 if none).
+  std::vector<int> frame_index_;
+  std::vector<VerifyFrame> frames_;
+
+  // Type inference state.
+  std::vector<VerifyFrame> in_frames_;
+  std::vector<bool> has_frame_;
+  std::vector<bool> in_worklist_;
+  std::vector<uint32_t> worklist_;
+
+  // Set by Execute() for the instruction at pc_.
+  std::vector<uint32_t> targets_;
+  bool falls_through_;
+  bool is_store_;
+  bool is_ret_;
+};
+
+#endif  // CLASS_VERIFIER_H_
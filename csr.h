@@ -0,0 +1,109 @@
+#ifndef CSR_H_
+#define CSR_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// A [begin, end) range of values, usable in range-based for loops.
+template <typename T>
+struct BasicCsrRow {
+  const T* begin_;
+  const T* end_;
+
+  const T* begin() const {
+    return begin_;
+  }
+  const T* end() const {
+    return end_;
+  }
+  size_t size() const {
+    return end_ - begin_;
+  }
+  bool empty() const {
+    return begin_ == end_;
+  }
+};
+
+// An adjacency list in compressed sparse row form: the values of row i are
+// values[offsets[i]] to values[offsets[i + 1] - 1], sorted and without
+// duplicates.
+template <typename T>
+class BasicCsr {
+ public:
+  // Builds from (row, value) pairs, all rows below rows, by counting sort.
+  void Build(uint32_t rows, const std::vector<std::pair<uint32_t, T>>& edges) {
+    offsets_.assign(rows + 1, 0);
+    for (auto& edge : edges) {
+      offsets_[edge.first + 1]++;
+    }
+    for (uint32_t i = 0; i < rows; ++i) {
+      offsets_[i + 1] += offsets_[i];
+    }
+    values_.resize(edges.size());
+    std::vector<uint32_t> next(offsets_.begin(), offsets_.end() - 1);
+    for (auto& edge : edges) {
+      values_[next[edge.first]++] = edge.second;
+    }
+    // Sort and dedupe each row, compacting the rows in place.
+    uint32_t out = 0;
+    for (uint32_t i = 0; i < rows; ++i) {
+      T* begin = values_.data() + offsets_[i];
+      T* end = values_.data() + offsets_[i + 1];
+      std::sort(begin, end);
+      end = std::unique(begin, end);
+      offsets_[i] = out;
+      out = std::copy(begin, end, values_.begin() + out) - values_.begin();
+    }
+    offsets_[rows] = out;
+    values_.resize(out);
+    values_.shrink_to_fit();
+  }
+
+  // The transpose: row v holds every row that has v as a value. Only for
+  // values that are row numbers themselves.
+  void Transpose(uint32_t rows, BasicCsr<uint32_t>* result) const {
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    edges.reserve(values_.size());
+    for (uint32_t i = 0; i + 1 < offsets_.size(); ++i) {
+      for (uint32_t j = offsets_[i]; j < offsets_[i + 1]; ++j) {
+        edges.emplace_back(values_[j], i);
+      }
+    }
+    result->Build(rows, edges);
+  }
+
+  BasicCsrRow<T> Get(uint32_t row) const {
+    BasicCsrRow<T> result;
+    result.begin_ = values_.data() + offsets_[row];
+    result.end_ = values_.data() + offsets_[row + 1];
+    return result;
+  }
+
+  uint32_t rows() const {
+    return offsets_.empty() ? 0 : offsets_.size() - 1;
+  }
+
+  size_t size() const {
+    return values_.size();
+  }
+
+  const std::vector<uint32_t>& offsets() const {
+    return offsets_;
+  }
+
+  const std::vector<T>& values() const {
+    return values_;
+  }
+
+ private:
+  std::vector<uint32_t> offsets_;
+  std::vector<T> values_;
+};
+
+typedef BasicCsrRow<uint32_t> CsrRow;
+typedef BasicCsr<uint32_t> Csr;
+
+#endif  // CSR_H_
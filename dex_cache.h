@@ -0,0 +1,222 @@
+#ifndef DEX_CACHE_H_
+#define DEX_CACHE_H_
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "dex_checksum.h"
+#include "dex_file.h"
+#include "utils.h"
+
+// A cache file holds the string and class_data_item tables of DexFile::SetIndex
+// for one dex file, so that reading an unchanged dex file again maps the
+// tables instead of decoding uleb128 values. Cache files live in a cache
+// directory and are named after the hex signature of their dex file.
+static const char DEX_CACHE_MAGIC[8] = {'d', 'e', 'x', 'i', 'd', 'x', '2', '\0'};
+
+struct DexCacheHeader {
+  char magic[8];
+  char signature[20];
+  uint32_t file_size;
+  // Adler-32 of the whole dex file, see DexCache::Open.
+  uint32_t adler32;
+  uint32_t string_ids_size;
+  // DexStringIndex[string_ids_size].
+  uint32_t strings_off;
+  uint32_t class_defs_size;
+  // DexClassIndex[class_defs_size].
+  uint32_t classes_off;
+  uint32_t members_size;
+  // DexClassMember[members_size].
+  uint32_t members_off;
+};
+
+class DexCache {
+ public:
+  DexCache() : base_(nullptr), size_(0), has_adler32_(false), adler32_(0) {
+  }
+
+  ~DexCache() {
+    if (base_ != nullptr) {
+      munmap((void*)base_, size_);
+    }
+  }
+
+  // Maps the cache file of dex from cache_dir if there is one that matches
+  // dex. Cache files are written only from checked files, so a match stands
+  // for DexFile::CheckStrings. dex must be initialized.
+  bool Find(const char* cache_dir, const DexFile& dex) {
+    return Open(GetPath(cache_dir, dex), dex);
+  }
+
+  // Attaches the cache file of dex to dex, writing it first if Find didn't
+  // map it. Returns false if the cache can't be used; dex then decodes as
+  // usual.
+  bool Attach(const char* cache_dir, DexFile* dex) {
+    if (base_ == nullptr) {
+      std::string path = GetPath(cache_dir, *dex);
+      mkdir(cache_dir, 0755);
+      if (!Write(path, *dex) || !Open(path, *dex)) {
+        return false;
+      }
+    }
+    const DexCacheHeader* header = (const DexCacheHeader*)base_;
+    dex->SetIndex((const DexStringIndex*)(base_ + header->strings_off),
+                  (const DexClassIndex*)(base_ + header->classes_off),
+                  (const DexClassMember*)(base_ + header->members_off));
+    return true;
+  }
+
+ private:
+  static std::string GetPath(const char* cache_dir, const DexFile& dex) {
+    return StringPrintf("%s/%s.idx", cache_dir, GetHexString(dex.signature(), 20).c_str());
+  }
+
+  // The signature in the dex header is what names a cache file, but read_dex
+  // verifies it only in some modes, so a file edited without updating it
+  // would still find the cache file of the original. A cache file therefore
+  // also holds the Adler-32 of the whole dex file, computed rather than read
+  // from the header, and is used only if that matches too. This costs one
+  // Adler-32 pass over the file per run, far less than the SHA-1 of the
+  // signature or DexFile::CheckStrings. Adler-32 catches stale and damaged
+  // files, not ones crafted to collide. The index itself is only checked
+  // against the bounds of dex.
+  bool Open(const std::string& path, const DexFile& dex) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(DexCacheHeader)) {
+      close(fd);
+      return false;
+    }
+    void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+      return false;
+    }
+    const DexCacheHeader& h = *(const DexCacheHeader*)base;
+    size_t size = st.st_size;
+    if (memcmp(h.magic, DEX_CACHE_MAGIC, sizeof(h.magic)) != 0 ||
+        memcmp(h.signature, dex.signature(), sizeof(h.signature)) != 0 ||
+        h.file_size != dex.size() || h.adler32 != GetAdler32(dex) || h.string_ids_size != dex.string_ids_size() ||
+        h.class_defs_size != dex.class_defs_size() ||
+        !CheckSection(size, h.strings_off, h.string_ids_size, sizeof(DexStringIndex)) ||
+        !CheckSection(size, h.classes_off, h.class_defs_size, sizeof(DexClassIndex)) ||
+        !CheckSection(size, h.members_off, h.members_size, sizeof(DexClassMember)) ||
+        !CheckIndex((const char*)base, h, dex)) {
+      munmap(base, size);
+      return false;
+    }
+    base_ = (const char*)base;
+    size_ = size;
+    return true;
+  }
+
+  static bool CheckSection(size_t size, uint32_t off, uint64_t count, uint64_t item_size) {
+    return off <= size && count * item_size <= size - off && (off & 3) == 0;
+  }
+
+  // Only bounds are checked; the header stands for the content, see Open.
+  static bool CheckIndex(const char* base, const DexCacheHeader& h, const DexFile& dex) {
+    const DexStringIndex* strings = (const DexStringIndex*)(base + h.strings_off);
+    for (uint32_t i = 0; i < h.string_ids_size; ++i) {
+      if (strings[i].data_off >= dex.size()) {
+        return false;
+      }
+    }
+    const DexClassIndex* classes = (const DexClassIndex*)(base + h.classes_off);
+    for (uint32_t i = 0; i < h.class_defs_size; ++i) {
+      const DexClassIndex& cls = classes[i];
+      uint64_t count = (uint64_t)cls.static_fields_size + cls.instance_fields_size +
+                       cls.direct_methods_size + cls.virtual_methods_size;
+      if (cls.members_start > h.members_size || count > h.members_size - cls.members_start) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Writes to a temporary file and renames it, so concurrent readers never see
+  // a partial cache file.
+  bool Write(const std::string& path, const DexFile& dex) {
+    DexCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DEX_CACHE_MAGIC, sizeof(header.magic));
+    memcpy(header.signature, dex.signature(), sizeof(header.signature));
+    header.file_size = dex.size();
+    header.adler32 = GetAdler32(dex);
+    header.string_ids_size = dex.string_ids_size();
+    header.class_defs_size = dex.class_defs_size();
+
+    std::vector<DexStringIndex> strings(header.string_ids_size);
+    for (uint32_t i = 0; i < header.string_ids_size; ++i) {
+      const char* data = dex.GetStringData(i, &strings[i].utf16_size);
+      strings[i].data_off = data - dex.data();
+    }
+    std::vector<DexClassIndex> classes(header.class_defs_size);
+    std::vector<DexClassMember> members;
+    std::vector<DexClassMember> storage;
+    for (uint32_t i = 0; i < header.class_defs_size; ++i) {
+      DexClassData class_data;
+      dex.GetClassData(i, &class_data, &storage);
+      DexClassIndex& cls = classes[i];
+      cls.static_fields_size = class_data.static_fields_size;
+      cls.instance_fields_size = class_data.instance_fields_size;
+      cls.direct_methods_size = class_data.direct_methods_size;
+      cls.virtual_methods_size = class_data.virtual_methods_size;
+      cls.members_start = members.size();
+      uint32_t count = cls.static_fields_size + cls.instance_fields_size +
+                       cls.direct_methods_size + cls.virtual_methods_size;
+      members.insert(members.end(), class_data.members, class_data.members + count);
+    }
+    header.members_size = members.size();
+    header.strings_off = sizeof(header);
+    header.classes_off = header.strings_off + strings.size() * sizeof(DexStringIndex);
+    header.members_off = header.classes_off + classes.size() * sizeof(DexClassIndex);
+
+    std::string tmp_path = StringPrintf("%s.%d.tmp", path.c_str(), (int)getpid());
+    FILE* fp = fopen(tmp_path.c_str(), "wb");
+    if (fp == nullptr) {
+      fprintf(stderr, "failed to open %s\n", tmp_path.c_str());
+      return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              (strings.empty() ||
+               fwrite(strings.data(), sizeof(DexStringIndex), strings.size(), fp) == strings.size()) &&
+              (classes.empty() ||
+               fwrite(classes.data(), sizeof(DexClassIndex), classes.size(), fp) == classes.size()) &&
+              (members.empty() ||
+               fwrite(members.data(), sizeof(DexClassMember), members.size(), fp) == members.size());
+    if (fclose(fp) != 0 || !ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+      fprintf(stderr, "failed to write %s\n", path.c_str());
+      unlink(tmp_path.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  // The Adler-32 of the whole dex file, computed on first use.
+  uint32_t GetAdler32(const DexFile& dex) {
+    if (!has_adler32_) {
+      adler32_ = Adler32(dex.data(), dex.size());
+      has_adler32_ = true;
+    }
+    return adler32_;
+  }
+
+  const char* base_;
+  size_t size_;
+  bool has_adler32_;
+  uint32_t adler32_;
+};
+
+#endif  // DEX_CACHE_H_
@@ -0,0 +1,194 @@
+#ifndef DEX_CALL_GRAPH_H_
+#define DEX_CALL_GRAPH_H_
+
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+#include "csr.h"
+#include "dex.h"
+#include "dex_file.h"
+#include "dex_insns.h"
+#include "utils.h"
+
+// The call graph and class hierarchy of one dex file, as CSR adjacency
+// lists built in one pass over the code of every class. Calls are edges
+// between method ids, by the method an invoke names rather than by what it
+// dispatches to at run time; the hierarchy has edges between type ids.
+class DexCallGraph {
+ public:
+  explicit DexCallGraph(const DexFile& dex) : dex_(dex), bad_methods_(0) {
+  }
+
+  // Scans the classes in parallel. Methods whose code can't be decoded
+  // contribute the calls before the bad instruction and are counted in
+  // bad_methods().
+  void Build() {
+    uint32_t class_defs_size = dex_.class_defs_size();
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> calls(class_defs_size);
+    std::vector<uint8_t> bad(class_defs_size, 0);
+    ParallelFor(class_defs_size, [&](size_t i) {
+      bad[i] = ScanClass(i, &calls[i]);
+    });
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    for (uint32_t i = 0; i < class_defs_size; ++i) {
+      edges.insert(edges.end(), calls[i].begin(), calls[i].end());
+      bad_methods_ += bad[i];
+    }
+    callees_.Build(dex_.method_ids_size(), edges);
+    callees_.Transpose(dex_.method_ids_size(), &callers_);
+
+    // Superclass and interface edges, and the virtual methods each class
+    // defines, for finding overrides.
+    std::vector<std::pair<uint32_t, uint32_t>> subclasses;
+    std::vector<std::pair<uint32_t, uint32_t>> implementors;
+    std::vector<std::pair<uint32_t, uint32_t>> virtual_methods;
+    std::vector<uint16_t> interfaces;
+    std::vector<DexMethod> methods;
+    for (uint32_t i = 0; i < class_defs_size; ++i) {
+      const class_def_item& cls = dex_.class_def(i);
+      if (cls.class_idx >= dex_.type_ids_size()) {
+        continue;
+      }
+      if (cls.superclass_idx < dex_.type_ids_size()) {
+        subclasses.emplace_back(cls.superclass_idx, cls.class_idx);
+      }
+      interfaces.clear();
+      dex_.GetTypeIds(cls.interfaces_off, &interfaces);
+      for (uint16_t interface : interfaces) {
+        if (interface < dex_.type_ids_size()) {
+          implementors.emplace_back(interface, cls.class_idx);
+        }
+      }
+      methods.clear();
+      dex_.GetClassMethods(i, &methods);
+      for (const DexMethod& method : methods) {
+        if ((method.access_flags &
+             (METHOD_ACC_STATIC | METHOD_ACC_PRIVATE | METHOD_ACC_CONSTRUCTOR)) == 0 &&
+            method.method_idx < dex_.method_ids_size()) {
+          virtual_methods.emplace_back(cls.class_idx, method.method_idx);
+        }
+      }
+    }
+    subclasses_.Build(dex_.type_ids_size(), subclasses);
+    implementors_.Build(dex_.type_ids_size(), implementors);
+    virtual_methods_.Build(dex_.type_ids_size(), virtual_methods);
+  }
+
+  // Methods invoked by method_idx.
+  CsrRow GetCallees(uint32_t method_idx) const {
+    return callees_.Get(method_idx);
+  }
+
+  // Methods that invoke method_idx.
+  CsrRow GetCallers(uint32_t method_idx) const {
+    return callers_.Get(method_idx);
+  }
+
+  // Classes whose superclass is type_idx.
+  CsrRow GetSubclasses(uint32_t type_idx) const {
+    return subclasses_.Get(type_idx);
+  }
+
+  // Classes and interfaces that directly implement or extend the interface
+  // type_idx.
+  CsrRow GetImplementors(uint32_t type_idx) const {
+    return implementors_.Get(type_idx);
+  }
+
+  // Appends every class defined in the dex file that is a subtype of
+  // type_idx, through any chain of superclasses and interfaces.
+  void GetAllSubtypes(uint32_t type_idx, std::vector<uint32_t>* types) const {
+    CHECK(type_idx < dex_.type_ids_size());
+    std::vector<uint8_t> seen(dex_.type_ids_size(), 0);
+    std::vector<uint32_t> worklist(1, type_idx);
+    seen[type_idx] = 1;
+    while (!worklist.empty()) {
+      uint32_t type = worklist.back();
+      worklist.pop_back();
+      for (const Csr* edges : {&subclasses_, &implementors_}) {
+        for (uint32_t subtype : edges->Get(type)) {
+          if (!seen[subtype]) {
+            seen[subtype] = 1;
+            types->push_back(subtype);
+            worklist.push_back(subtype);
+          }
+        }
+      }
+    }
+  }
+
+  // Appends the methods of subtypes that override the virtual method or
+  // implement the interface method method_idx.
+  void GetOverrides(uint32_t method_idx, std::vector<uint32_t>* overrides) const {
+    const method_id_item& method = dex_.method_id(method_idx);
+    if (method.class_idx >= dex_.type_ids_size()) {
+      return;
+    }
+    std::vector<uint32_t> subtypes;
+    GetAllSubtypes(method.class_idx, &subtypes);
+    for (uint32_t type : subtypes) {
+      for (uint32_t other_idx : virtual_methods_.Get(type)) {
+        const method_id_item& other = dex_.method_id(other_idx);
+        if (other.name_idx == method.name_idx && other.proto_idx == method.proto_idx) {
+          overrides->push_back(other_idx);
+        }
+      }
+    }
+  }
+
+  size_t calls_size() const {
+    return callees_.size();
+  }
+
+  uint32_t bad_methods() const {
+    return bad_methods_;
+  }
+
+ private:
+  // Returns the number of methods of the class whose code is malformed.
+  uint32_t ScanClass(uint32_t class_def_idx, std::vector<std::pair<uint32_t, uint32_t>>* calls) {
+    std::vector<DexMethod> methods;
+    dex_.GetClassMethods(class_def_idx, &methods);
+    uint32_t bad = 0;
+    DexInsn buf[64];
+    for (const DexMethod& method : methods) {
+      const char* insns;
+      uint32_t insns_size;
+      if (method.code_off == 0) {
+        continue;
+      }
+      if (method.method_idx >= dex_.method_ids_size() ||
+          !dex_.GetCodeInsns(method.code_off, &insns, &insns_size)) {
+        bad++;
+        continue;
+      }
+      DexInsnScanner scanner(insns, insns_size);
+      while (size_t count = scanner.Next(buf, 64)) {
+        for (size_t i = 0; i < count; ++i) {
+          const DexInsn& insn = buf[i];
+          if (insn.op <= 0xff && (DEX_OPCODES[insn.op].flags & OPCODE_INVOKE) &&
+              insn.b < dex_.method_ids_size()) {
+            calls->emplace_back(method.method_idx, insn.b);
+          }
+        }
+      }
+      if (scanner.error() != nullptr) {
+        bad++;
+      }
+    }
+    return bad;
+  }
+
+  const DexFile& dex_;
+  Csr callees_;
+  Csr callers_;
+  Csr subclasses_;
+  Csr implementors_;
+  // Type id -> virtual methods defined by that class.
+  Csr virtual_methods_;
+  uint32_t bad_methods_;
+};
+
+#endif  // DEX_CALL_GRAPH_H_
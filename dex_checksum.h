@@ -0,0 +1,352 @@
+#ifndef DEX_CHECKSUM_H_
+#define DEX_CHECKSUM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define DEX_CHECKSUM_X86 1
+#endif
+
+#include "dex_file.h"
+#include "utils.h"
+
+// Adler-32 as used by the dex header checksum. NMAX is the most bytes that can
+// be summed before s2 may overflow 32 bits.
+static constexpr uint32_t ADLER32_BASE = 65521;
+static constexpr size_t ADLER32_NMAX = 5552;
+
+static uint32_t Adler32Scalar(uint32_t adler, const uint8_t* p, size_t n) {
+  uint32_t s1 = adler & 0xffff;
+  uint32_t s2 = adler >> 16;
+  while (n > 0) {
+    size_t block = n < ADLER32_NMAX ? n : ADLER32_NMAX;
+    n -= block;
+    while (block-- > 0) {
+      s1 += *p++;
+      s2 += s1;
+    }
+    s1 %= ADLER32_BASE;
+    s2 %= ADLER32_BASE;
+  }
+  return s1 | (s2 << 16);
+}
+
+#ifdef DEX_CHECKSUM_X86
+
+// The vector kernels handle 32-byte blocks, taking s1 and s2 apart: each block
+// adds the sum of its bytes to s1, and 32 * s1 plus the bytes weighted 32..1
+// to s2. The scalar code finishes the tail.
+__attribute__((target("ssse3")))
+static uint32_t Adler32Ssse3(uint32_t adler, const uint8_t* p, size_t n) {
+  uint32_t s1 = adler & 0xffff;
+  uint32_t s2 = adler >> 16;
+  size_t blocks = n / 32;
+  const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+  const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi16(1);
+  while (blocks > 0) {
+    size_t count = ADLER32_NMAX / 32;
+    if (count > blocks) {
+      count = blocks;
+    }
+    blocks -= count;
+    __m128i v_ps = _mm_set_epi32(0, 0, 0, s1 * count);
+    __m128i v_s2 = _mm_set_epi32(0, 0, 0, s2);
+    __m128i v_s1 = _mm_setzero_si128();
+    for (size_t i = 0; i < count; ++i, p += 32) {
+      __m128i bytes1 = _mm_loadu_si128((const __m128i*)p);
+      __m128i bytes2 = _mm_loadu_si128((const __m128i*)(p + 16));
+      v_ps = _mm_add_epi32(v_ps, v_s1);
+      v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+      v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+      v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+      v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+    }
+    v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+    uint32_t sums1[4];
+    uint32_t sums2[4];
+    _mm_storeu_si128((__m128i*)sums1, v_s1);
+    _mm_storeu_si128((__m128i*)sums2, v_s2);
+    s1 += sums1[0] + sums1[1] + sums1[2] + sums1[3];
+    s2 = sums2[0] + sums2[1] + sums2[2] + sums2[3];
+    s1 %= ADLER32_BASE;
+    s2 %= ADLER32_BASE;
+  }
+  return Adler32Scalar(s1 | (s2 << 16), p, n % 32);
+}
+
+__attribute__((target("avx2")))
+static uint32_t Adler32Avx2(uint32_t adler, const uint8_t* p, size_t n) {
+  uint32_t s1 = adler & 0xffff;
+  uint32_t s2 = adler >> 16;
+  size_t blocks = n / 32;
+  const __m256i tap = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19,
+                                       18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3,
+                                       2, 1);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i ones = _mm256_set1_epi16(1);
+  while (blocks > 0) {
+    size_t count = ADLER32_NMAX / 32;
+    if (count > blocks) {
+      count = blocks;
+    }
+    blocks -= count;
+    __m256i v_ps = _mm256_set_epi32(0, 0, 0, 0, 0, 0, 0, s1 * count);
+    __m256i v_s2 = _mm256_set_epi32(0, 0, 0, 0, 0, 0, 0, s2);
+    __m256i v_s1 = _mm256_setzero_si256();
+    for (size_t i = 0; i < count; ++i, p += 32) {
+      __m256i bytes = _mm256_loadu_si256((const __m256i*)p);
+      v_ps = _mm256_add_epi32(v_ps, v_s1);
+      v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(bytes, zero));
+      v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, tap), ones));
+    }
+    v_s2 = _mm256_add_epi32(v_s2, _mm256_slli_epi32(v_ps, 5));
+    uint32_t sums1[8];
+    uint32_t sums2[8];
+    _mm256_storeu_si256((__m256i*)sums1, v_s1);
+    _mm256_storeu_si256((__m256i*)sums2, v_s2);
+    s2 = 0;
+    for (int i = 0; i < 8; ++i) {
+      s1 += sums1[i];
+      s2 += sums2[i];
+    }
+    s1 %= ADLER32_BASE;
+    s2 %= ADLER32_BASE;
+  }
+  return Adler32Scalar(s1 | (s2 << 16), p, n % 32);
+}
+
+#endif  // DEX_CHECKSUM_X86
+
+// Returns the Adler-32 of a followed by b, given the Adler-32 of each and the
+// length of b.
+static uint32_t Adler32Combine(uint32_t adler1, uint32_t adler2, size_t length2) {
+  uint32_t rem = length2 % ADLER32_BASE;
+  uint32_t s1 = adler1 & 0xffff;
+  uint32_t s2 = (uint64_t)rem * s1 % ADLER32_BASE;
+  s1 += (adler2 & 0xffff) + ADLER32_BASE - 1;
+  s2 += (adler1 >> 16) + (adler2 >> 16) + ADLER32_BASE - rem;
+  s1 %= ADLER32_BASE;
+  s2 %= ADLER32_BASE;
+  return s1 | (s2 << 16);
+}
+
+typedef uint32_t (*Adler32Kernel)(uint32_t adler, const uint8_t* p, size_t n);
+
+static Adler32Kernel GetAdler32Kernel() {
+#ifdef DEX_CHECKSUM_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return Adler32Avx2;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return Adler32Ssse3;
+  }
+#endif
+  return Adler32Scalar;
+}
+
+// Large inputs are summed in chunks on all cores and the chunk sums combined.
+static uint32_t Adler32(const char* data, size_t n) {
+  static const size_t CHUNK_SIZE = 1 << 20;
+  Adler32Kernel kernel = GetAdler32Kernel();
+  const uint8_t* p = (const uint8_t*)data;
+  if (n <= CHUNK_SIZE * 2) {
+    return kernel(1, p, n);
+  }
+  size_t chunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  std::vector<uint32_t> sums(chunks);
+  ParallelFor(chunks, [&](size_t i) {
+    size_t start = i * CHUNK_SIZE;
+    sums[i] = kernel(1, p + start, std::min(CHUNK_SIZE, n - start));
+  });
+  uint32_t adler = sums[0];
+  for (size_t i = 1; i < chunks; ++i) {
+    adler = Adler32Combine(adler, sums[i], std::min(CHUNK_SIZE, n - i * CHUNK_SIZE));
+  }
+  return adler;
+}
+
+static uint32_t RotateLeft(uint32_t x, int n) {
+  return (x << n) | (x >> (32 - n));
+}
+
+static void Sha1BlocksScalar(uint32_t state[5], const uint8_t* p, size_t blocks) {
+  for (; blocks > 0; --blocks, p += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+      w[i] = ((uint32_t)p[i * 4] << 24) | (p[i * 4 + 1] << 16) | (p[i * 4 + 2] << 8) | p[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; ++i) {
+      w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+    for (int i = 0; i < 80; ++i) {
+      uint32_t f;
+      uint32_t k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5a827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ed9eba1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8f1bbcdc;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xca62c1d6;
+      }
+      uint32_t t = RotateLeft(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = RotateLeft(b, 30);
+      b = a;
+      a = t;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+  }
+}
+
+#ifdef DEX_CHECKSUM_X86
+
+// Each group of four rounds takes the next four message words, while the
+// message schedule for later groups is computed with sha1msg1/sha1msg2.
+__attribute__((target("sha,sse4.1")))
+static void Sha1BlocksShaNi(uint32_t state[5], const uint8_t* p, size_t blocks) {
+  const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+  __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1b);
+  __m128i e0 = _mm_set_epi32(state[4], 0, 0, 0);
+  for (; blocks > 0; --blocks, p += 64) {
+    __m128i abcd_save = abcd;
+    __m128i e_save = e0;
+    __m128i msg[4];
+    __m128i e[2] = {e0, _mm_setzero_si128()};
+    for (int g = 0; g < 20; ++g) {
+      if (g < 4) {
+        msg[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + g * 16)), mask);
+      }
+      __m128i& cur = e[g & 1];
+      if (g == 0) {
+        cur = _mm_add_epi32(cur, msg[0]);
+      } else {
+        cur = _mm_sha1nexte_epu32(cur, msg[g % 4]);
+      }
+      e[(g + 1) & 1] = abcd;
+      if (g >= 3 && g <= 18) {
+        msg[(g + 1) % 4] = _mm_sha1msg2_epu32(msg[(g + 1) % 4], msg[g % 4]);
+      }
+      switch (g / 5) {
+        case 0:
+          abcd = _mm_sha1rnds4_epu32(abcd, cur, 0);
+          break;
+        case 1:
+          abcd = _mm_sha1rnds4_epu32(abcd, cur, 1);
+          break;
+        case 2:
+          abcd = _mm_sha1rnds4_epu32(abcd, cur, 2);
+          break;
+        default:
+          abcd = _mm_sha1rnds4_epu32(abcd, cur, 3);
+          break;
+      }
+      if (g >= 1 && g <= 16) {
+        msg[(g + 3) % 4] = _mm_sha1msg1_epu32(msg[(g + 3) % 4], msg[g % 4]);
+      }
+      if (g >= 2 && g <= 17) {
+        msg[(g + 2) % 4] = _mm_xor_si128(msg[(g + 2) % 4], msg[g % 4]);
+      }
+    }
+    // e[0] holds a from before the last group, from which sha1nexte derives
+    // the final e.
+    e0 = _mm_sha1nexte_epu32(e[0], e_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+  _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1b));
+  state[4] = _mm_extract_epi32(e0, 3);
+}
+
+static bool HasShaNi() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3)) {
+    return false;
+  }
+  return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA);
+}
+
+#endif  // DEX_CHECKSUM_X86
+
+static void Sha1(const char* data, size_t n, uint8_t digest[20]) {
+  void (*blocks_kernel)(uint32_t*, const uint8_t*, size_t) = Sha1BlocksScalar;
+#ifdef DEX_CHECKSUM_X86
+  if (HasShaNi()) {
+    blocks_kernel = Sha1BlocksShaNi;
+  }
+#endif
+  uint32_t state[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+  const uint8_t* p = (const uint8_t*)data;
+  size_t full_blocks = n / 64;
+  blocks_kernel(state, p, full_blocks);
+  uint8_t tail[128];
+  size_t rest = n % 64;
+  memset(tail, 0, sizeof(tail));
+  memcpy(tail, p + full_blocks * 64, rest);
+  tail[rest] = 0x80;
+  size_t tail_size = (rest < 56) ? 64 : 128;
+  uint64_t bits = (uint64_t)n * 8;
+  for (int i = 0; i < 8; ++i) {
+    tail[tail_size - 1 - i] = bits >> (i * 8);
+  }
+  blocks_kernel(state, tail, tail_size / 64);
+  for (int i = 0; i < 5; ++i) {
+    digest[i * 4] = state[i] >> 24;
+    digest[i * 4 + 1] = state[i] >> 16;
+    digest[i * 4 + 2] = state[i] >> 8;
+    digest[i * 4 + 3] = state[i];
+  }
+}
+
+// Checks the header checksum (Adler-32 of everything after it) and signature
+// (SHA-1 of everything after it). The two run on separate threads.
+static bool CheckDexChecksums(const DexFile& dex, std::string* error) {
+  if (dex.file_size() != dex.size()) {
+    *error = StringPrintf("file_size 0x%x does not match the file size 0x%zx",
+                          dex.file_size(), dex.size());
+    return false;
+  }
+  uint8_t digest[20];
+  std::thread sha1_thread([&]() {
+    Sha1(dex.data() + 32, dex.size() - 32, digest);
+  });
+  uint32_t checksum = Adler32(dex.data() + 12, dex.size() - 12);
+  sha1_thread.join();
+  if (checksum != dex.checksum()) {
+    *error = StringPrintf("checksum 0x%x does not match the computed 0x%x", dex.checksum(),
+                          checksum);
+    return false;
+  }
+  if (memcmp(digest, dex.signature(), 20) != 0) {
+    *error = StringPrintf("signature %s does not match the computed %s",
+                          GetHexString(dex.signature(), 20).c_str(),
+                          GetHexString((const char*)digest, 20).c_str());
+    return false;
+  }
+  return true;
+}
+
+#endif  // DEX_CHECKSUM_H_
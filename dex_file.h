@@ -0,0 +1,753 @@
+#ifndef DEX_FILE_H_
+#define DEX_FILE_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dex.h"
+#include "dex_opcodes.h"
+#include "mutf8.h"
+#include "string_pool.h"
+#include "utils.h"
+
+template <typename T>
+void Read(const char*& p, const char* end, T& value) {
+  static_assert(std::is_standard_layout<T>::value, "...");
+  if (p + sizeof(T) > end) {
+    Abort("data not enough for Read()\n");
+  }
+  memcpy(&value, p, sizeof(T));
+  p += sizeof(T);
+}
+
+template <typename T>
+void ReadEncodedValue(const char*& p, int size, T& value, bool sign_extend) {
+  value = 0;
+  char* t = (char*)&value;
+  memcpy(t, p, size + 1);
+  p += size + 1;
+  t += size + 1;
+  if (sign_extend && (*(t - 1) & 0x80)) {
+    memset(t, 0xff, sizeof(T) - size - 1);
+  }
+}
+
+template <typename T>
+void ReadEncodedFloatValue(const char*& p, int size, T& value) {
+  char* t = (char*)&value;
+  char* end = t + sizeof(value);
+  memset(t, '\0', sizeof(value));
+  for (int i = 0; i <= size; ++i) {
+    --end;
+    *end = *p++;
+  }
+}
+
+// One opcode of a debug_info_item, with its operands and the address and
+// line registers after it. Operands the opcode doesn't have are 0, or
+// NO_INDEX for ids.
+struct DexDebugOp {
+  uint8_t op;
+  uint32_t register_num;
+  uint32_t addr_diff;
+  int32_t line_diff;
+  uint32_t name_idx;
+  uint32_t type_idx;
+  uint32_t sig_idx;
+  uint32_t address;
+  uint32_t line;
+};
+
+// What DecodeDebugInfo calls; a visitor derives from it and hides the calls
+// it wants. Returning false stops the decoding.
+struct DexDebugInfoVisitor {
+  bool OnHeader(uint32_t line_start, uint32_t parameters_size) {
+    return true;
+  }
+  bool OnParameter(uint32_t name_idx) {
+    return true;
+  }
+  bool OnOp(const DexDebugOp& op) {
+    return true;
+  }
+};
+
+// Runs the state machine of the debug_info_item at p, calling OnHeader, then
+// OnParameter for each parameter name and OnOp for each opcode up to and
+// including DBG_END_SEQUENCE. Returns false if the visitor stopped it or it
+// ran into end first. p is left after the last opcode.
+template <typename Visitor>
+static bool DecodeDebugInfo(const char*& p, const char* end, Visitor* visitor) {
+  uint32_t line_start = ReadULEB128(p, end);
+  uint32_t parameters_size = ReadULEB128(p, end);
+  if (!visitor->OnHeader(line_start, parameters_size)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < parameters_size; ++i) {
+    if (!visitor->OnParameter(ReadULEB128P1(p, end))) {
+      return false;
+    }
+  }
+  DexDebugOp op;
+  op.address = 0;
+  op.line = line_start;
+  while (p < end) {
+    op.op = *p++;
+    op.register_num = 0;
+    op.addr_diff = 0;
+    op.line_diff = 0;
+    op.name_idx = NO_INDEX;
+    op.type_idx = NO_INDEX;
+    op.sig_idx = NO_INDEX;
+    switch (op.op) {
+      case DBG_END_SEQUENCE:
+        return visitor->OnOp(op);
+      case DBG_ADVANCE_PC:
+        op.addr_diff = ReadULEB128(p, end);
+        op.address += op.addr_diff;
+        break;
+      case DBG_ADVANCE_LINE:
+        op.line_diff = ReadLEB128(p, end);
+        op.line += op.line_diff;
+        break;
+      case DBG_START_LOCAL:
+      case DBG_START_LOCAL_EXTENDED:
+        op.register_num = ReadULEB128(p, end);
+        op.name_idx = ReadULEB128P1(p, end);
+        op.type_idx = ReadULEB128P1(p, end);
+        if (op.op == DBG_START_LOCAL_EXTENDED) {
+          op.sig_idx = ReadULEB128P1(p, end);
+        }
+        break;
+      case DBG_END_LOCAL:
+      case DBG_RESTART_LOCAL:
+        op.register_num = ReadULEB128(p, end);
+        break;
+      case DBG_SET_PROLOGUE_END:
+      case DBG_SET_EPILOGUE_BEGIN:
+        break;
+      case DBG_SET_FILE:
+        op.name_idx = ReadULEB128P1(p, end);
+        break;
+      default: {
+        uint8_t adjusted_opcode = op.op - DBG_FIRST_SPECIAL;
+        op.line_diff = -4 + (adjusted_opcode % 15);
+        op.addr_diff = adjusted_opcode / 15;
+        op.line += op.line_diff;
+        op.address += op.addr_diff;
+        break;
+      }
+    }
+    if (!visitor->OnOp(op)) {
+      return false;
+    }
+  }
+  return false;
+}
+
+static constexpr uint32_t DEX_HEADER_SIZE = 0x70;
+
+static DEX_FORMAT GetDexFormat(uint8_t op) {
+  return (DEX_FORMAT)DEX_OPCODES[op].format;
+}
+
+// Width of an instruction in 16-bit code units, 0 for unused opcodes.
+static uint32_t GetDexFormatWidth(DEX_FORMAT format) {
+  switch (format) {
+    case DEX_FORMAT_UNUSED:
+      return 0;
+    case DEX_FORMAT_10X: case DEX_FORMAT_12X: case DEX_FORMAT_11N: case DEX_FORMAT_11X:
+    case DEX_FORMAT_10T:
+      return 1;
+    case DEX_FORMAT_32X: case DEX_FORMAT_30T: case DEX_FORMAT_31T: case DEX_FORMAT_31I:
+    case DEX_FORMAT_31C: case DEX_FORMAT_35C: case DEX_FORMAT_3RC:
+      return 3;
+    case DEX_FORMAT_51L:
+      return 5;
+    default:
+      return 2;
+  }
+}
+
+// A method defined in a class_data_item.
+struct DexMethod {
+  uint32_t method_idx;
+  uint32_t access_flags;
+  uint32_t code_off;
+};
+
+// A field or method of a class_data_item, with its index made absolute.
+struct DexClassMember {
+  uint32_t idx;
+  uint32_t access_flags;
+  // Always 0 for fields.
+  uint32_t code_off;
+};
+
+// A class_data_item with its uleb128 fields decoded.
+struct DexClassData {
+  uint32_t static_fields_size;
+  uint32_t instance_fields_size;
+  uint32_t direct_methods_size;
+  uint32_t virtual_methods_size;
+  // Static fields, instance fields, direct methods and virtual methods.
+  const DexClassMember* members;
+};
+
+// Precomputed tables that replace uleb128 decoding when a DexCache is
+// attached to the DexFile.
+struct DexStringIndex {
+  // Offset of the MUTF-8 data, past its utf16_size.
+  uint32_t data_off;
+  uint32_t utf16_size;
+};
+
+struct DexClassIndex {
+  uint32_t static_fields_size;
+  uint32_t instance_fields_size;
+  uint32_t direct_methods_size;
+  uint32_t virtual_methods_size;
+  // Index of the first member in the member table.
+  uint32_t members_start;
+};
+
+// The header and id tables of a dex file, shared by the dumper and the
+// passes that analyze the file. The data is not copied.
+class DexFile {
+ public:
+  DexFile(const char* filename, const char* data, size_t size)
+      : filename_(filename), data_(data), size_(size), end_(data + size),
+        string_index_(nullptr), class_index_(nullptr), member_index_(nullptr) {
+  }
+
+  // Uses precomputed tables instead of decoding strings and class_data_items.
+  // The tables must stay alive as long as the DexFile is used.
+  void SetIndex(const DexStringIndex* strings, const DexClassIndex* classes,
+                const DexClassMember* members) {
+    string_index_ = strings;
+    class_index_ = classes;
+    member_index_ = members;
+  }
+
+  // Reads the header without printing anything. Returns false if the data is
+  // not a dex file, an id table lies outside of it or an id in the id tables is
+  // out of range.
+  bool Init() {
+    if (size_ < DEX_HEADER_SIZE || strncmp(data_, "dex\n", 4) != 0) {
+      return false;
+    }
+    const char* p = data_ + 8;
+    Read(p, end_, checksum_);
+    signature_ = p;
+    p += 20;
+    Read(p, end_, file_size_);
+    Read(p, end_, header_size_);
+    Read(p, end_, endian_tag_);
+    Read(p, end_, link_size_);
+    Read(p, end_, link_off_);
+    Read(p, end_, map_off_);
+    Read(p, end_, string_ids_size_);
+    Read(p, end_, string_ids_off_);
+    Read(p, end_, type_ids_size_);
+    Read(p, end_, type_ids_off_);
+    Read(p, end_, proto_ids_size_);
+    Read(p, end_, proto_ids_off_);
+    Read(p, end_, field_ids_size_);
+    Read(p, end_, field_ids_off_);
+    Read(p, end_, method_ids_size_);
+    Read(p, end_, method_ids_off_);
+    Read(p, end_, class_defs_size_);
+    Read(p, end_, class_defs_off_);
+    Read(p, end_, data_sec_size_);
+    Read(p, end_, data_sec_off_);
+    if (!CheckTable(string_ids_off_, string_ids_size_, sizeof(string_id_item)) ||
+        !CheckTable(type_ids_off_, type_ids_size_, sizeof(type_id_item)) ||
+        !CheckTable(proto_ids_off_, proto_ids_size_, sizeof(proto_id_item)) ||
+        !CheckTable(field_ids_off_, field_ids_size_, sizeof(field_id_item)) ||
+        !CheckTable(method_ids_off_, method_ids_size_, sizeof(method_id_item)) ||
+        !CheckTable(class_defs_off_, class_defs_size_, sizeof(class_def_item))) {
+      return false;
+    }
+    string_ids_ = (const string_id_item*)(data_ + string_ids_off_);
+    type_ids_ = (const type_id_item*)(data_ + type_ids_off_);
+    proto_ids_ = (const proto_id_item*)(data_ + proto_ids_off_);
+    field_ids_ = (const field_id_item*)(data_ + field_ids_off_);
+    method_ids_ = (const method_id_item*)(data_ + method_ids_off_);
+    class_defs_ = (const class_def_item*)(data_ + class_defs_off_);
+    return CheckIds();
+  }
+
+  const char* GetString(uint32_t string_id) const {
+    uint32_t utf16_size;
+    return GetStringData(string_id, &utf16_size);
+  }
+
+  const char* GetStringData(uint32_t string_id, uint32_t* utf16_size) const {
+    CHECK(string_id < string_ids_size_);
+    STATS_ADD(STATS_STRINGS_RESOLVED, 1);
+    if (string_index_ != nullptr) {
+      *utf16_size = string_index_[string_id].utf16_size;
+      return data_ + string_index_[string_id].data_off;
+    }
+    uint32_t string_off = string_ids_[string_id].string_data_off;
+    const char* p = data_ + string_off;
+    *utf16_size = ReadULEB128(p, end_);
+    return p;
+  }
+
+  const char* GetType(uint32_t type_id) const {
+    CHECK(type_id < type_ids_size_);
+    return GetString(type_ids_[type_id].descriptor_idx);
+  }
+
+  // Handles of strings in the global StringPool, which are equal across dex
+  // files exactly when the strings are.
+  StringHandle GetStringHandle(uint32_t string_id) const {
+    uint32_t utf16_size;
+    const char* data = GetStringData(string_id, &utf16_size);
+    return StringPool::Global().Intern(data, strlen(data));
+  }
+
+  StringHandle GetTypeHandle(uint32_t type_id) const {
+    CHECK(type_id < type_ids_size_);
+    return GetStringHandle(type_ids_[type_id].descriptor_idx);
+  }
+
+  // Checks that every string_data_item is NUL-terminated modified UTF-8 whose
+  // length matches its utf16_size. Strings are checked in parallel batches;
+  // the error names the first bad string.
+  bool CheckStrings(std::string* error) const {
+    static const size_t BATCH_SIZE = 1024;
+    size_t batches = (string_ids_size_ + BATCH_SIZE - 1) / BATCH_SIZE;
+    std::vector<std::string> errors(batches);
+    ParallelFor(batches, [&](size_t batch) {
+      uint32_t start = batch * BATCH_SIZE;
+      uint32_t end = std::min<uint64_t>(string_ids_size_, start + BATCH_SIZE);
+      for (uint32_t i = start; i < end && errors[batch].empty(); ++i) {
+        uint32_t string_off = string_ids_[i].string_data_off;
+        if (string_off >= size_) {
+          errors[batch] = StringPrintf("string #%u: string_data_off 0x%x out of range", i,
+                                       string_off);
+          break;
+        }
+        const char* p = data_ + string_off;
+        uint32_t utf16_size = ReadULEB128(p, end_);
+        const char* nul = (const char*)memchr(p, '\0', end_ - p);
+        size_t utf16_length;
+        if (nul == nullptr) {
+          errors[batch] = StringPrintf("string #%u is not terminated", i);
+        } else if (!ValidateMutf8(p, nul - p, &utf16_length)) {
+          errors[batch] = StringPrintf("string #%u is not valid modified UTF-8", i);
+        } else if (utf16_length != utf16_size) {
+          errors[batch] = StringPrintf("string #%u has %zu UTF-16 code units, utf16_size is %u",
+                                       i, utf16_length, utf16_size);
+        }
+      }
+    });
+    for (const std::string& e : errors) {
+      if (!e.empty()) {
+        *error = e;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::string GetProto(uint32_t proto_id) const {
+    CHECK(proto_id < proto_ids_size_);
+    const proto_id_item& id = proto_ids_[proto_id];
+    std::string result = GetType(id.return_type_idx);
+    result += " (";
+    if (id.parameters_off != 0) {
+      result += GetTypeList(id.parameters_off);
+    }
+    result.push_back(')');
+    return result;
+  }
+
+  std::string GetTypeList(uint32_t data_off) const {
+    std::string result;
+    const char* p = data_ + data_off;
+    uint32_t size;
+    Read(p, end_, size);
+    for (uint32_t i = 0; i < size; ++i) {
+      uint16_t type_idx;
+      Read(p, end_, type_idx);
+      if (i > 0) {
+        result += ", ";
+      }
+      result += GetType(type_idx);
+    }
+    return result;
+  }
+
+  // Appends the type ids of the type_list at data_off, e.g. the interfaces of
+  // a class.
+  void GetTypeIds(uint32_t data_off, std::vector<uint16_t>* type_ids) const {
+    if (data_off == 0) {
+      return;
+    }
+    const char* p = data_ + data_off;
+    uint32_t size;
+    Read(p, end_, size);
+    for (uint32_t i = 0; i < size; ++i) {
+      uint16_t type_idx;
+      Read(p, end_, type_idx);
+      type_ids->push_back(type_idx);
+    }
+  }
+
+  // Appends the descriptors of the parameters of a proto.
+  void GetParameterTypes(uint32_t proto_id, std::vector<const char*>* types) const {
+    CHECK(proto_id < proto_ids_size_);
+    uint32_t data_off = proto_ids_[proto_id].parameters_off;
+    if (data_off == 0) {
+      return;
+    }
+    const char* p = data_ + data_off;
+    uint32_t size;
+    Read(p, end_, size);
+    for (uint32_t i = 0; i < size; ++i) {
+      uint16_t type_idx;
+      Read(p, end_, type_idx);
+      types->push_back(GetType(type_idx));
+    }
+  }
+
+  std::string GetField(uint32_t field_id) const {
+    CHECK(field_id < field_ids_size_);
+    const field_id_item& field = field_ids_[field_id];
+    return StringPrintf("(class %s, type %s, name %s)",
+        GetType(field.class_idx), GetType(field.type_idx), GetString(field.name_idx));
+  }
+
+  std::string GetMethod(uint32_t method_id) const {
+    CHECK(method_id < method_ids_size_);
+    const method_id_item& method = method_ids_[method_id];
+    return StringPrintf("(class %s, proto %s, name %s)",
+        GetType(method.class_idx),
+        GetProto(method.proto_idx).c_str(),
+        GetString(method.name_idx));
+  }
+
+  // string_ids are sorted by content and type_ids by string id, so both are
+  // found by binary search. Comparing modified UTF-8 bytes matches the
+  // UTF-16 order of the dex format except around U+0000 and supplementary
+  // characters, which descriptors and member names don't use. Return
+  // NO_INDEX if there is no such string or type.
+  uint32_t FindString(const char* s) const {
+    uint32_t low = 0;
+    uint32_t high = string_ids_size_;
+    while (low < high) {
+      uint32_t mid = low + (high - low) / 2;
+      int cmp = strcmp(GetString(mid), s);
+      if (cmp == 0) {
+        return mid;
+      } else if (cmp < 0) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return NO_INDEX;
+  }
+
+  uint32_t FindType(const char* descriptor) const {
+    uint32_t string_id = FindString(descriptor);
+    if (string_id == NO_INDEX) {
+      return NO_INDEX;
+    }
+    const type_id_item* end = type_ids_ + type_ids_size_;
+    const type_id_item* it = std::lower_bound(
+        type_ids_, end, string_id,
+        [](const type_id_item& item, uint32_t id) { return item.descriptor_idx < id; });
+    return (it != end && it->descriptor_idx == string_id) ? it - type_ids_ : NO_INDEX;
+  }
+
+  // Finds the insns array of the code_item at code_off. Returns false if the
+  // code_item runs past the end of the file.
+  bool GetCodeInsns(uint32_t code_off, const char** insns, uint32_t* insns_size) const {
+    if (code_off > size_ || size_ - code_off < 16) {
+      return false;
+    }
+    uint32_t count;
+    memcpy(&count, data_ + code_off + 12, 4);
+    if (count > (size_ - code_off - 16) / 2) {
+      return false;
+    }
+    *insns = data_ + code_off + 16;
+    *insns_size = count;
+    return true;
+  }
+
+  // Appends the position entries of the debug_info_item of the code_item at
+  // code_off as (address, line) pairs, in the order the state machine emits
+  // them. Appends nothing if there is no debug_info_item.
+  void GetDebugLines(uint32_t code_off, std::vector<std::pair<uint32_t, uint32_t>>* lines) const {
+    uint32_t debug_info_off;
+    if (code_off == 0 || code_off > size_ || size_ - code_off < 16) {
+      return;
+    }
+    memcpy(&debug_info_off, data_ + code_off + 8, 4);
+    if (debug_info_off == 0 || debug_info_off >= size_) {
+      return;
+    }
+    struct LineVisitor : DexDebugInfoVisitor {
+      std::vector<std::pair<uint32_t, uint32_t>>* lines;
+      bool OnOp(const DexDebugOp& op) {
+        if (op.op >= DBG_FIRST_SPECIAL) {
+          lines->emplace_back(op.address, op.line);
+        }
+        return true;
+      }
+    } visitor;
+    visitor.lines = lines;
+    const char* p = data_ + debug_info_off;
+    DecodeDebugInfo(p, end_, &visitor);
+  }
+
+  // Decodes the class_data_item of a class. members points into storage
+  // unless a DexCache is attached.
+  void GetClassData(uint32_t class_def_idx, DexClassData* class_data,
+                    std::vector<DexClassMember>* storage) const {
+    CHECK(class_def_idx < class_defs_size_);
+    memset(class_data, 0, sizeof(*class_data));
+    if (class_index_ != nullptr) {
+      const DexClassIndex& index = class_index_[class_def_idx];
+      class_data->static_fields_size = index.static_fields_size;
+      class_data->instance_fields_size = index.instance_fields_size;
+      class_data->direct_methods_size = index.direct_methods_size;
+      class_data->virtual_methods_size = index.virtual_methods_size;
+      class_data->members = member_index_ + index.members_start;
+      return;
+    }
+    uint32_t class_data_off = class_defs_[class_def_idx].class_data_off;
+    if (class_data_off == 0) {
+      return;
+    }
+    const char* p = data_ + class_data_off;
+    class_data->static_fields_size = ReadULEB128(p, end_);
+    class_data->instance_fields_size = ReadULEB128(p, end_);
+    class_data->direct_methods_size = ReadULEB128(p, end_);
+    class_data->virtual_methods_size = ReadULEB128(p, end_);
+    uint32_t sizes[] = {class_data->static_fields_size, class_data->instance_fields_size,
+                        class_data->direct_methods_size, class_data->virtual_methods_size};
+    storage->clear();
+    for (int list = 0; list < 4; ++list) {
+      uint32_t idx = 0;
+      for (uint32_t i = 0; i < sizes[list]; ++i) {
+        DexClassMember member;
+        idx += ReadULEB128(p, end_);
+        member.idx = idx;
+        member.access_flags = ReadULEB128(p, end_);
+        member.code_off = (list >= 2) ? ReadULEB128(p, end_) : 0;
+        storage->push_back(member);
+      }
+    }
+    class_data->members = storage->data();
+  }
+
+  // Appends the direct and virtual methods of a class, skipping its fields.
+  void GetClassMethods(uint32_t class_def_idx, std::vector<DexMethod>* methods) const {
+    DexClassData class_data;
+    std::vector<DexClassMember> storage;
+    GetClassData(class_def_idx, &class_data, &storage);
+    uint32_t fields_size = class_data.static_fields_size + class_data.instance_fields_size;
+    uint32_t methods_size = class_data.direct_methods_size + class_data.virtual_methods_size;
+    for (uint32_t i = 0; i < methods_size; ++i) {
+      const DexClassMember& member = class_data.members[fields_size + i];
+      DexMethod method;
+      method.method_idx = member.idx;
+      method.access_flags = member.access_flags;
+      method.code_off = member.code_off;
+      methods->push_back(method);
+    }
+  }
+
+  const char* data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  uint32_t checksum() const {
+    return checksum_;
+  }
+
+  const char* signature() const {
+    return signature_;
+  }
+
+  uint32_t file_size() const {
+    return file_size_;
+  }
+
+  uint32_t string_ids_size() const {
+    return string_ids_size_;
+  }
+
+  uint32_t type_ids_size() const {
+    return type_ids_size_;
+  }
+
+  uint32_t proto_ids_size() const {
+    return proto_ids_size_;
+  }
+
+  uint32_t field_ids_size() const {
+    return field_ids_size_;
+  }
+
+  uint32_t method_ids_size() const {
+    return method_ids_size_;
+  }
+
+  uint32_t class_defs_size() const {
+    return class_defs_size_;
+  }
+
+  const type_id_item& type_id(uint32_t i) const {
+    return type_ids_[i];
+  }
+
+  const proto_id_item& proto_id(uint32_t i) const {
+    return proto_ids_[i];
+  }
+
+  const field_id_item& field_id(uint32_t i) const {
+    return field_ids_[i];
+  }
+
+  const method_id_item& method_id(uint32_t i) const {
+    return method_ids_[i];
+  }
+
+  const class_def_item& class_def(uint32_t i) const {
+    return class_defs_[i];
+  }
+
+ protected:
+  bool CheckTable(uint32_t off, uint32_t count, size_t item_size) const {
+    return count == 0 || (off <= size_ && count <= (size_ - off) / item_size);
+  }
+
+  // Checks that the ids in the id tables and class_defs, and in the type_lists
+  // they refer to, are in range, so resolving them never aborts.
+  bool CheckIds() const {
+    for (uint32_t i = 0; i < type_ids_size_; ++i) {
+      if (type_ids_[i].descriptor_idx >= string_ids_size_) {
+        return false;
+      }
+    }
+    for (uint32_t i = 0; i < proto_ids_size_; ++i) {
+      const proto_id_item& id = proto_ids_[i];
+      if (id.shorty_idx >= string_ids_size_ || id.return_type_idx >= type_ids_size_ ||
+          !CheckTypeList(id.parameters_off)) {
+        return false;
+      }
+    }
+    for (uint32_t i = 0; i < field_ids_size_; ++i) {
+      const field_id_item& id = field_ids_[i];
+      if (id.class_idx >= type_ids_size_ || id.type_idx >= type_ids_size_ ||
+          id.name_idx >= string_ids_size_) {
+        return false;
+      }
+    }
+    for (uint32_t i = 0; i < method_ids_size_; ++i) {
+      const method_id_item& id = method_ids_[i];
+      if (id.class_idx >= type_ids_size_ || id.proto_idx >= proto_ids_size_ ||
+          id.name_idx >= string_ids_size_) {
+        return false;
+      }
+    }
+    for (uint32_t i = 0; i < class_defs_size_; ++i) {
+      const class_def_item& def = class_defs_[i];
+      if (def.class_idx >= type_ids_size_ ||
+          (def.superclass_idx != NO_INDEX && def.superclass_idx >= type_ids_size_) ||
+          (def.source_file_idx != NO_INDEX && def.source_file_idx >= string_ids_size_) ||
+          !CheckTypeList(def.interfaces_off)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Checks the type_list at data_off, where 0 stands for an empty list.
+  bool CheckTypeList(uint32_t data_off) const {
+    if (data_off == 0) {
+      return true;
+    }
+    if (data_off > size_ || size_ - data_off < 4) {
+      return false;
+    }
+    uint32_t count;
+    memcpy(&count, data_ + data_off, 4);
+    if (count > (size_ - data_off - 4) / 2) {
+      return false;
+    }
+    const char* p = data_ + data_off + 4;
+    for (uint32_t i = 0; i < count; ++i, p += 2) {
+      uint16_t type_idx;
+      memcpy(&type_idx, p, 2);
+      if (type_idx >= type_ids_size_) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const char* filename_;
+  const char* data_;
+  size_t size_;
+  const char* end_;
+
+  uint32_t checksum_;
+  const char* signature_;
+  uint32_t file_size_;
+  uint32_t header_size_;
+  uint32_t endian_tag_;
+  uint32_t link_size_;
+  uint32_t link_off_;
+  uint32_t map_off_;
+
+  uint32_t string_ids_off_;
+  uint32_t string_ids_size_;
+  const string_id_item* string_ids_;
+
+  uint32_t type_ids_off_;
+  uint32_t type_ids_size_;
+  const type_id_item* type_ids_;
+
+  uint32_t proto_ids_off_;
+  uint32_t proto_ids_size_;
+  const proto_id_item* proto_ids_;
+
+  uint32_t field_ids_off_;
+  uint32_t field_ids_size_;
+  const field_id_item* field_ids_;
+
+  uint32_t method_ids_off_;
+  uint32_t method_ids_size_;
+  const method_id_item* method_ids_;
+
+  uint32_t class_defs_off_;
+  uint32_t class_defs_size_;
+  const class_def_item* class_defs_;
+
+  uint32_t data_sec_off_;
+  uint32_t data_sec_size_;
+
+  const DexStringIndex* string_index_;
+  const DexClassIndex* class_index_;
+  const DexClassMember* member_index_;
+};
+
+#endif  // DEX_FILE_H_
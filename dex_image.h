@@ -0,0 +1,338 @@
+#ifndef DEX_IMAGE_H_
+#define DEX_IMAGE_H_
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dex.h"
+#include "dex_file.h"
+#include "utils.h"
+
+// An image holds what is otherwise computed from a dex file at startup: the
+// strings, the linked class table with superclasses and vtables, and the
+// verified bit of each method. All offsets are relative to the start of the
+// image, so it can be mapped at any address and used without relocation.
+static const char DEX_IMAGE_MAGIC[8] = {'d', 'e', 'x', 'i', 'm', 'g', '1', '\0'};
+
+struct DexImageHeader {
+  char magic[8];
+  // Signature of the dex file the image was built from.
+  char signature[20];
+  uint32_t image_size;
+  uint32_t string_ids_size;
+  // string_ids_size offsets of NUL-terminated MUTF-8 strings.
+  uint32_t strings_off;
+  uint32_t classes_size;
+  uint32_t classes_off;
+  // A power of two; each bucket is a class index + 1, or 0 if empty.
+  uint32_t class_buckets_size;
+  uint32_t class_buckets_off;
+  // method_idx of each vtable entry.
+  uint32_t vtable_entries_size;
+  uint32_t vtables_off;
+  uint32_t method_ids_size;
+  // One bit per method id.
+  uint32_t verified_off;
+};
+
+// One class_def_item, linked against the other classes of the dex file.
+// Superclasses defined outside the dex file contribute nothing to the vtable.
+struct DexImageClass {
+  uint32_t class_def_idx;
+  uint32_t descriptor_idx;
+  // Index of the superclass in the class table, or NO_INDEX.
+  uint32_t super_index;
+  uint32_t access_flags;
+  uint32_t vtable_start;
+  uint32_t vtable_size;
+};
+
+static uint32_t HashDescriptor(const char* s) {
+  uint32_t hash = 2166136261u;
+  for (; *s != '\0'; ++s) {
+    hash = (hash ^ (uint8_t)*s) * 16777619u;
+  }
+  return hash;
+}
+
+class DexImageWriter {
+ public:
+  explicit DexImageWriter(const DexFile& dex) : dex_(dex) {
+  }
+
+  bool Write(const char* filename, const std::vector<uint8_t>& verified) {
+    LinkClasses();
+    std::vector<char> image(sizeof(DexImageHeader));
+    DexImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DEX_IMAGE_MAGIC, sizeof(header.magic));
+    memcpy(header.signature, dex_.signature(), sizeof(header.signature));
+
+    header.string_ids_size = dex_.string_ids_size();
+    std::vector<uint32_t> string_offsets(header.string_ids_size);
+    std::vector<char> string_data;
+    for (uint32_t i = 0; i < header.string_ids_size; ++i) {
+      const char* s = dex_.GetString(i);
+      string_offsets[i] = string_data.size();
+      string_data.insert(string_data.end(), s, s + strlen(s) + 1);
+    }
+    header.strings_off = Append(&image, string_offsets);
+    uint32_t string_data_off = Append(&image, string_data);
+    for (uint32_t i = 0; i < header.string_ids_size; ++i) {
+      uint32_t off = string_data_off + string_offsets[i];
+      memcpy(&image[header.strings_off + i * 4], &off, 4);
+    }
+
+    header.classes_size = classes_.size();
+    header.classes_off = Append(&image, classes_);
+    header.class_buckets_size = 1;
+    while (header.class_buckets_size < classes_.size() * 2) {
+      header.class_buckets_size *= 2;
+    }
+    std::vector<uint32_t> buckets(header.class_buckets_size, 0);
+    for (uint32_t i = 0; i < classes_.size(); ++i) {
+      uint32_t mask = header.class_buckets_size - 1;
+      uint32_t b = HashDescriptor(dex_.GetString(classes_[i].descriptor_idx)) & mask;
+      while (buckets[b] != 0) {
+        b = (b + 1) & mask;
+      }
+      buckets[b] = i + 1;
+    }
+    header.class_buckets_off = Append(&image, buckets);
+    header.vtable_entries_size = vtable_entries_.size();
+    header.vtables_off = Append(&image, vtable_entries_);
+
+    header.method_ids_size = dex_.method_ids_size();
+    std::vector<uint8_t> bits((header.method_ids_size + 7) / 8);
+    for (uint32_t i = 0; i < header.method_ids_size; ++i) {
+      if (verified[i]) {
+        bits[i / 8] |= 1 << (i % 8);
+      }
+    }
+    header.verified_off = Append(&image, bits);
+    header.image_size = image.size();
+    memcpy(image.data(), &header, sizeof(header));
+
+    FILE* fp = fopen(filename, "wb");
+    if (fp == nullptr) {
+      fprintf(stderr, "failed to open %s\n", filename);
+      return false;
+    }
+    bool ok = fwrite(image.data(), image.size(), 1, fp) == 1;
+    if (fclose(fp) != 0 || !ok) {
+      fprintf(stderr, "failed to write %s\n", filename);
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  // Appends items at the next 4-byte boundary and returns their offset.
+  template <typename T>
+  static uint32_t Append(std::vector<char>* image, const std::vector<T>& items) {
+    image->resize((image->size() + 3) & ~3u);
+    uint32_t off = image->size();
+    const char* p = (const char*)items.data();
+    image->insert(image->end(), p, p + items.size() * sizeof(T));
+    return off;
+  }
+
+  void LinkClasses() {
+    std::unordered_map<StringHandle, uint32_t> class_index;
+    for (uint32_t i = 0; i < dex_.class_defs_size(); ++i) {
+      const class_def_item& cls = dex_.class_def(i);
+      DexImageClass image_class;
+      image_class.class_def_idx = i;
+      image_class.descriptor_idx = dex_.type_id(cls.class_idx).descriptor_idx;
+      image_class.super_index = NO_INDEX;
+      image_class.access_flags = cls.access_flags;
+      image_class.vtable_start = 0;
+      image_class.vtable_size = 0;
+      class_index[dex_.GetTypeHandle(cls.class_idx)] = classes_.size();
+      classes_.push_back(image_class);
+    }
+    for (DexImageClass& image_class : classes_) {
+      const class_def_item& cls = dex_.class_def(image_class.class_def_idx);
+      if (cls.superclass_idx != NO_INDEX) {
+        auto it = class_index.find(dex_.GetTypeHandle(cls.superclass_idx));
+        if (it != class_index.end()) {
+          image_class.super_index = it->second;
+        }
+      }
+    }
+    link_state_.assign(classes_.size(), 0);
+    vtables_.resize(classes_.size());
+    for (uint32_t i = 0; i < classes_.size(); ++i) {
+      LinkVtable(i);
+    }
+    for (uint32_t i = 0; i < classes_.size(); ++i) {
+      classes_[i].vtable_start = vtable_entries_.size();
+      classes_[i].vtable_size = vtables_[i].size();
+      vtable_entries_.insert(vtable_entries_.end(), vtables_[i].begin(), vtables_[i].end());
+    }
+  }
+
+  // The vtable of a class is the vtable of its superclass, with methods of the
+  // same name and proto overridden and new virtual methods appended.
+  void LinkVtable(uint32_t i) {
+    if (link_state_[i] != 0) {
+      return;
+    }
+    link_state_[i] = 1;
+    std::vector<uint32_t>& vtable = vtables_[i];
+    uint32_t super_index = classes_[i].super_index;
+    if (super_index != NO_INDEX) {
+      LinkVtable(super_index);
+      // A superclass still being linked means the hierarchy has a cycle.
+      if (link_state_[super_index] == 2) {
+        vtable = vtables_[super_index];
+      }
+    }
+    std::vector<DexMethod> methods;
+    dex_.GetClassMethods(classes_[i].class_def_idx, &methods);
+    for (const DexMethod& method : methods) {
+      if ((method.access_flags &
+           (METHOD_ACC_STATIC | METHOD_ACC_PRIVATE | METHOD_ACC_CONSTRUCTOR)) != 0 ||
+          method.method_idx >= dex_.method_ids_size()) {
+        continue;
+      }
+      const method_id_item& id = dex_.method_id(method.method_idx);
+      bool overridden = false;
+      for (uint32_t& entry : vtable) {
+        const method_id_item& other = dex_.method_id(entry);
+        if (other.name_idx == id.name_idx && other.proto_idx == id.proto_idx) {
+          entry = method.method_idx;
+          overridden = true;
+          break;
+        }
+      }
+      if (!overridden) {
+        vtable.push_back(method.method_idx);
+      }
+    }
+    link_state_[i] = 2;
+  }
+
+  const DexFile& dex_;
+  std::vector<DexImageClass> classes_;
+  std::vector<uint8_t> link_state_;
+  std::vector<std::vector<uint32_t>> vtables_;
+  std::vector<uint32_t> vtable_entries_;
+};
+
+// A read-only mapping of an image built for one dex file.
+class DexImage {
+ public:
+  DexImage() : base_(nullptr), size_(0), header_(nullptr) {
+  }
+
+  ~DexImage() {
+    if (base_ != nullptr) {
+      munmap((void*)base_, size_);
+    }
+  }
+
+  // Returns false if the file is not an image of dex, so the caller can fall
+  // back to decoding the dex file itself.
+  bool Open(const char* filename, const DexFile& dex) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(DexImageHeader)) {
+      close(fd);
+      return false;
+    }
+    void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+      return false;
+    }
+    base_ = (const char*)base;
+    size_ = st.st_size;
+    header_ = (const DexImageHeader*)base_;
+    const DexImageHeader& h = *header_;
+    if (memcmp(h.magic, DEX_IMAGE_MAGIC, sizeof(h.magic)) != 0 ||
+        memcmp(h.signature, dex.signature(), sizeof(h.signature)) != 0 || h.image_size != size_ ||
+        h.string_ids_size != dex.string_ids_size() || h.method_ids_size != dex.method_ids_size() ||
+        !CheckSection(h.strings_off, h.string_ids_size, 4) ||
+        !CheckSection(h.classes_off, h.classes_size, sizeof(DexImageClass)) ||
+        !CheckSection(h.class_buckets_off, h.class_buckets_size, 4) ||
+        (h.class_buckets_size & (h.class_buckets_size - 1)) != 0 ||
+        !CheckSection(h.vtables_off, h.vtable_entries_size, 4) ||
+        !CheckSection(h.verified_off, (h.method_ids_size + 7) / 8, 1)) {
+      munmap(base, size_);
+      base_ = nullptr;
+      return false;
+    }
+    return true;
+  }
+
+  const char* GetString(uint32_t string_id) const {
+    CHECK(string_id < header_->string_ids_size);
+    uint32_t off = U4(header_->strings_off + string_id * 4);
+    CHECK(off < size_);
+    return base_ + off;
+  }
+
+  uint32_t classes_size() const {
+    return header_->classes_size;
+  }
+
+  const DexImageClass& GetClass(uint32_t i) const {
+    CHECK(i < header_->classes_size);
+    return ((const DexImageClass*)(base_ + header_->classes_off))[i];
+  }
+
+  // Returns the index of the class with the given descriptor, or NO_INDEX.
+  uint32_t FindClass(const char* descriptor) const {
+    uint32_t mask = header_->class_buckets_size - 1;
+    uint32_t b = HashDescriptor(descriptor) & mask;
+    for (uint32_t i = 0; i < header_->class_buckets_size; ++i, b = (b + 1) & mask) {
+      uint32_t entry = U4(header_->class_buckets_off + b * 4);
+      if (entry == 0) {
+        break;
+      }
+      if (strcmp(GetString(GetClass(entry - 1).descriptor_idx), descriptor) == 0) {
+        return entry - 1;
+      }
+    }
+    return NO_INDEX;
+  }
+
+  uint32_t GetVtableEntry(const DexImageClass& cls, uint32_t i) const {
+    CHECK(i < cls.vtable_size && cls.vtable_start + i < header_->vtable_entries_size);
+    return U4(header_->vtables_off + (cls.vtable_start + i) * 4);
+  }
+
+  bool IsVerified(uint32_t method_idx) const {
+    CHECK(method_idx < header_->method_ids_size);
+    return (base_[header_->verified_off + method_idx / 8] >> (method_idx % 8)) & 1;
+  }
+
+ private:
+  bool CheckSection(uint32_t off, uint64_t count, uint64_t item_size) const {
+    return off <= size_ && count * item_size <= size_ - off && (item_size == 1 || (off & 3) == 0);
+  }
+
+  uint32_t U4(uint32_t off) const {
+    uint32_t value;
+    memcpy(&value, base_ + off, 4);
+    return value;
+  }
+
+  const char* base_;
+  size_t size_;
+  const DexImageHeader* header_;
+};
+
+#endif  // DEX_IMAGE_H_
@@ -0,0 +1,239 @@
+#ifndef DEX_INSNS_H_
+#define DEX_INSNS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "dex.h"
+#include "dex_file.h"
+
+// One instruction of an insns array with its operands decoded, or one
+// payload pseudo-instruction. Offsets and widths are in 16-bit code units.
+struct DexInsn {
+  uint32_t pc;
+  uint32_t width;
+  // The opcode, or the DEX_PAYLOAD_IDENT of a payload.
+  uint16_t op;
+  // Which of a, b, c and literal are set depends on the format: registers
+  // come first, then the index (b for 21c/31c/35c/3rc, c for 22c), then
+  // the first register of a range (c for 3rc). Branch offsets and
+  // constants are in literal. For 35c, a is the argument count and args
+  // holds the argument registers.
+  //
+  // For payloads, a is the number of entries and, for fill-array-data, b is
+  // the element width.
+  uint32_t a;
+  uint32_t b;
+  uint32_t c;
+  int64_t literal;
+  uint32_t args[5];
+};
+
+static uint16_t GetDexUnit(const char* insns, uint32_t pc) {
+  uint16_t unit;
+  memcpy(&unit, insns + pc * 2, 2);
+  return unit;
+}
+
+static uint32_t GetDexUnit32(const char* insns, uint32_t pc) {
+  return GetDexUnit(insns, pc) | ((uint32_t)GetDexUnit(insns, pc + 1) << 16);
+}
+
+static bool IsDexPayload(uint16_t unit) {
+  return unit == PACKED_SWITCH_PAYLOAD || unit == SPARSE_SWITCH_PAYLOAD ||
+         unit == FILL_ARRAY_DATA_PAYLOAD;
+}
+
+// Width of the instruction or payload at pc, which may run past insns_size.
+// Returns 0 for an unused opcode or a payload whose header runs past the code.
+static uint64_t GetDexInsnWidth(const char* insns, uint32_t insns_size, uint32_t pc) {
+  uint16_t unit = GetDexUnit(insns, pc);
+  if (!IsDexPayload(unit)) {
+    return GetDexFormatWidth((DEX_FORMAT)DEX_OPCODES[unit & 0xff].format);
+  }
+  if ((uint64_t)pc + (unit == FILL_ARRAY_DATA_PAYLOAD ? 4 : 2) > insns_size) {
+    return 0;
+  }
+  if (unit == PACKED_SWITCH_PAYLOAD) {
+    return 4 + (uint64_t)GetDexUnit(insns, pc + 1) * 2;
+  } else if (unit == SPARSE_SWITCH_PAYLOAD) {
+    return 2 + (uint64_t)GetDexUnit(insns, pc + 1) * 4;
+  }
+  uint64_t element_width = GetDexUnit(insns, pc + 1);
+  uint64_t size = GetDexUnit32(insns, pc + 2);
+  return 4 + (size * element_width + 1) / 2;
+}
+
+// Decodes the instruction at pc, whose width must already be known to fit in
+// the code. Returns false for a 35c instruction with more than 5 arguments.
+static bool DecodeDexInsn(const char* insns, uint32_t pc, uint32_t width, DexInsn* insn) {
+  uint16_t inst = GetDexUnit(insns, pc);
+  uint32_t aa = inst >> 8;
+  STATS_INSN(IsDexPayload(inst) ? inst : inst & 0xff);
+  STATS_ADD(STATS_BYTES_TOUCHED, width * 2);
+  insn->pc = pc;
+  insn->width = width;
+  insn->a = insn->b = insn->c = 0;
+  insn->literal = 0;
+  if (IsDexPayload(inst)) {
+    insn->op = inst;
+    insn->a = GetDexUnit(insns, pc + 1);
+    if (inst == FILL_ARRAY_DATA_PAYLOAD) {
+      insn->b = insn->a;
+      insn->a = GetDexUnit32(insns, pc + 2);
+    }
+    return true;
+  }
+  insn->op = inst & 0xff;
+  switch (DEX_OPCODES[insn->op].format) {
+    case DEX_FORMAT_12X:
+      insn->a = aa & 0xf;
+      insn->b = inst >> 12;
+      break;
+    case DEX_FORMAT_11N:
+      insn->a = aa & 0xf;
+      insn->literal = (int16_t)inst >> 12;
+      break;
+    case DEX_FORMAT_11X:
+      insn->a = aa;
+      break;
+    case DEX_FORMAT_10T:
+      insn->literal = (int8_t)aa;
+      break;
+    case DEX_FORMAT_20T:
+      insn->literal = (int16_t)GetDexUnit(insns, pc + 1);
+      break;
+    case DEX_FORMAT_22X:
+      insn->a = aa;
+      insn->b = GetDexUnit(insns, pc + 1);
+      break;
+    case DEX_FORMAT_21T:
+    case DEX_FORMAT_21S:
+    case DEX_FORMAT_21H:
+      // For 21h the literal is unshifted.
+      insn->a = aa;
+      insn->literal = (int16_t)GetDexUnit(insns, pc + 1);
+      break;
+    case DEX_FORMAT_21C:
+      insn->a = aa;
+      insn->b = GetDexUnit(insns, pc + 1);
+      break;
+    case DEX_FORMAT_23X:
+      insn->a = aa;
+      insn->b = GetDexUnit(insns, pc + 1) & 0xff;
+      insn->c = GetDexUnit(insns, pc + 1) >> 8;
+      break;
+    case DEX_FORMAT_22B:
+      insn->a = aa;
+      insn->b = GetDexUnit(insns, pc + 1) & 0xff;
+      insn->literal = (int8_t)(GetDexUnit(insns, pc + 1) >> 8);
+      break;
+    case DEX_FORMAT_22T:
+    case DEX_FORMAT_22S:
+      insn->a = aa & 0xf;
+      insn->b = inst >> 12;
+      insn->literal = (int16_t)GetDexUnit(insns, pc + 1);
+      break;
+    case DEX_FORMAT_22C:
+      insn->a = aa & 0xf;
+      insn->b = inst >> 12;
+      insn->c = GetDexUnit(insns, pc + 1);
+      break;
+    case DEX_FORMAT_32X:
+      insn->a = GetDexUnit(insns, pc + 1);
+      insn->b = GetDexUnit(insns, pc + 2);
+      break;
+    case DEX_FORMAT_30T:
+    case DEX_FORMAT_31T:
+    case DEX_FORMAT_31I:
+      insn->a = aa;
+      insn->literal = (int32_t)GetDexUnit32(insns, pc + 1);
+      break;
+    case DEX_FORMAT_31C:
+      insn->a = aa;
+      insn->b = GetDexUnit32(insns, pc + 1);
+      break;
+    case DEX_FORMAT_35C: {
+      uint16_t regs = GetDexUnit(insns, pc + 2);
+      insn->a = inst >> 12;
+      insn->b = GetDexUnit(insns, pc + 1);
+      insn->args[0] = regs & 0xf;
+      insn->args[1] = (regs >> 4) & 0xf;
+      insn->args[2] = (regs >> 8) & 0xf;
+      insn->args[3] = regs >> 12;
+      insn->args[4] = aa & 0xf;
+      if (insn->a > 5) {
+        return false;
+      }
+      break;
+    }
+    case DEX_FORMAT_3RC:
+      insn->a = aa;
+      insn->b = GetDexUnit(insns, pc + 1);
+      insn->c = GetDexUnit(insns, pc + 2);
+      break;
+    case DEX_FORMAT_51L:
+      insn->a = aa;
+      insn->literal = (int64_t)((uint64_t)GetDexUnit32(insns, pc + 1) |
+                                ((uint64_t)GetDexUnit32(insns, pc + 3) << 32));
+      break;
+    default:
+      break;
+  }
+  return true;
+}
+
+// Walks the insns array of a code_item, decoding instructions and payloads
+// in order into a caller's buffer:
+//
+//   DexInsn buf[64];
+//   DexInsnScanner scanner(insns, insns_size);
+//   while (size_t n = scanner.Next(buf, 64)) {
+//     ...
+//   }
+//   if (scanner.error() != nullptr) ...
+class DexInsnScanner {
+ public:
+  DexInsnScanner(const char* insns, uint32_t insns_size)
+      : insns_(insns), insns_size_(insns_size), pc_(0), error_(nullptr) {
+  }
+
+  // Decodes up to capacity instructions and returns how many. Stops before a
+  // malformed instruction, which error() then describes; returns 0 once
+  // there is nothing more to decode.
+  size_t Next(DexInsn* out, size_t capacity) {
+    size_t count = 0;
+    while (count < capacity && pc_ < insns_size_ && error_ == nullptr) {
+      uint64_t width = GetDexInsnWidth(insns_, insns_size_, pc_);
+      if (width == 0 && !IsDexPayload(GetDexUnit(insns_, pc_))) {
+        error_ = "unused opcode";
+      } else if (width == 0 || width > insns_size_ - pc_) {
+        error_ = "instruction runs past the end of the code";
+      } else if (!DecodeDexInsn(insns_, pc_, width, &out[count])) {
+        error_ = "invalid argument count";
+      } else {
+        pc_ += width;
+        count++;
+      }
+    }
+    return count;
+  }
+
+  // Where scanning goes on, or the pc of the bad instruction.
+  uint32_t pc() const {
+    return pc_;
+  }
+
+  const char* error() const {
+    return error_;
+  }
+
+ private:
+  const char* insns_;
+  uint32_t insns_size_;
+  uint32_t pc_;
+  const char* error_;
+};
+
+#endif  // DEX_INSNS_H_
@@ -0,0 +1,691 @@
+#ifndef DEX_MERGER_H_
+#define DEX_MERGER_H_
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "dex.h"
+#include "dex_checksum.h"
+#include "dex_file.h"
+#include "dex_insns.h"
+#include "dex_model.h"
+#include "dex_writer.h"
+#include "mutf8.h"
+#include "utils.h"
+
+// Merges dex files into as few dex files as the 16-bit id limits allow.
+//
+// The id tables of each input are already sorted, so the merged tables come
+// from k-way merges that also yield, for every input, an array mapping its
+// ids to merged ones; nothing is sorted again. Classes are then handed out
+// to outputs in input order, starting a new output when the ids a class
+// needs would push the current one past a limit. Only one output is held in
+// memory at a time: its classes are loaded from the mapped inputs with their
+// ids mapped straight to the output's, instructions included, and written
+// before the next output is started.
+
+// A dex file mapped into memory.
+class DexMergeInput {
+ public:
+  ~DexMergeInput() {
+    if (data_ != nullptr) {
+      munmap((void*)data_, size_);
+    }
+  }
+
+  bool Open(const char* path, std::string* error) {
+    path_ = path;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+      *error = "failed to open";
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      *error = "failed to read";
+      return false;
+    }
+    void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+      *error = "failed to map";
+      return false;
+    }
+    data_ = (const char*)base;
+    size_ = st.st_size;
+    dex_.reset(new DexFile(path_.c_str(), data_, size_));
+    if (!dex_->Init()) {
+      *error = "not a dex file";
+      return false;
+    }
+    return dex_->CheckStrings(error) && CheckIds(error);
+  }
+
+  const DexFile& dex() const {
+    return *dex_;
+  }
+
+  const char* path() const {
+    return path_.c_str();
+  }
+
+ private:
+  // The merge indexes tables with the ids of the inputs, so they must be in
+  // range.
+  bool CheckIds(std::string* error) const {
+    const DexFile& dex = *dex_;
+    auto bad = [&](const char* what, uint32_t i) {
+      *error = StringPrintf("bad %s %u", what, i);
+      return false;
+    };
+    for (uint32_t i = 0; i < dex.type_ids_size(); ++i) {
+      if (dex.type_id(i).descriptor_idx >= dex.string_ids_size()) {
+        return bad("type_id", i);
+      }
+    }
+    std::vector<uint16_t> type_ids;
+    for (uint32_t i = 0; i < dex.proto_ids_size(); ++i) {
+      const proto_id_item& item = dex.proto_id(i);
+      type_ids.clear();
+      dex.GetTypeIds(item.parameters_off, &type_ids);
+      bool ok = item.shorty_idx < dex.string_ids_size() &&
+                item.return_type_idx < dex.type_ids_size();
+      for (uint16_t type_idx : type_ids) {
+        ok = ok && type_idx < dex.type_ids_size();
+      }
+      if (!ok) {
+        return bad("proto_id", i);
+      }
+    }
+    for (uint32_t i = 0; i < dex.field_ids_size(); ++i) {
+      const field_id_item& item = dex.field_id(i);
+      if (item.class_idx >= dex.type_ids_size() || item.type_idx >= dex.type_ids_size() ||
+          item.name_idx >= dex.string_ids_size()) {
+        return bad("field_id", i);
+      }
+    }
+    for (uint32_t i = 0; i < dex.method_ids_size(); ++i) {
+      const method_id_item& item = dex.method_id(i);
+      if (item.class_idx >= dex.type_ids_size() || item.proto_idx >= dex.proto_ids_size() ||
+          item.name_idx >= dex.string_ids_size()) {
+        return bad("method_id", i);
+      }
+    }
+    for (uint32_t i = 0; i < dex.class_defs_size(); ++i) {
+      if (dex.class_def(i).class_idx >= dex.type_ids_size()) {
+        return bad("class_def", i);
+      }
+    }
+    return true;
+  }
+
+  std::string path_;
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  std::unique_ptr<DexFile> dex_;
+};
+
+class DexMerger {
+ public:
+  // max_ids limits the type, proto, field and method ids of each output;
+  // lower it to split earlier.
+  explicit DexMerger(uint32_t max_ids) : max_ids_(max_ids) {
+  }
+
+  bool AddInput(const char* path, std::string* error) {
+    inputs_.emplace_back(new DexMergeInput);
+    if (!inputs_.back()->Open(path, error)) {
+      *error = StringPrintf("%s: %s", path, error->c_str());
+      return false;
+    }
+    return true;
+  }
+
+  // Writes the first output to path and the next ones to path with 2, 3, ...
+  // before its ".dex", like classes2.dex. outputs gets the paths written.
+  bool Merge(const std::string& path, std::vector<std::string>* outputs, std::string* error) {
+    if (!MergeIds(error)) {
+      return false;
+    }
+    path_ = path;
+    outputs_ = outputs;
+    outputs_->clear();
+    for (int table = 0; table < TABLES; ++table) {
+      used_[table].assign(ids_[table].size(), false);
+      counts_[table] = 0;
+    }
+    std::vector<bool> defined(ids_[TYPES].size(), false);
+    DexModel scratch;
+    std::vector<uint32_t> class_ids[TABLES];
+    for (uint32_t input = 0; input < inputs_.size(); ++input) {
+      const DexFile& dex = inputs_[input]->dex();
+      DexIndexMap identity;
+      identity.SetIdentity(dex.string_ids_size(), dex.type_ids_size(), dex.proto_ids_size(),
+                           dex.field_ids_size(), dex.method_ids_size());
+      for (uint32_t i = 0; i < dex.class_defs_size(); ++i) {
+        uint32_t type_idx = remaps_[input][TYPES][dex.class_def(i).class_idx];
+        if (defined[type_idx]) {
+          *error = StringPrintf("%s: class %s is defined twice", inputs_[input]->path(),
+                                dex.GetType(dex.class_def(i).class_idx));
+          return false;
+        }
+        defined[type_idx] = true;
+        // The class is loaded once to find the ids it needs, and again
+        // with the ids of its output when that is written.
+        scratch.classes.clear();
+        scratch.codes.clear();
+        if (!LoadDexModelClass(dex, i, identity, &scratch, error)) {
+          *error = StringPrintf("%s: %s", inputs_[input]->path(), error->c_str());
+          return false;
+        }
+        for (auto& ids : class_ids) {
+          ids.clear();
+        }
+        if (!CollectClassIds(scratch, class_ids, error)) {
+          *error = StringPrintf("%s: class %s: %s", inputs_[input]->path(),
+                                dex.GetType(dex.class_def(i).class_idx), error->c_str());
+          return false;
+        }
+        MapAndCloseIds(input, class_ids);
+        if (!Fits(class_ids)) {
+          if (classes_.empty()) {
+            *error = StringPrintf("%s: class %s needs more ids than an output can have",
+                                  inputs_[input]->path(), dex.GetType(dex.class_def(i).class_idx));
+            return false;
+          }
+          if (!WriteOutput(error)) {
+            return false;
+          }
+        }
+        for (int table = 0; table < TABLES; ++table) {
+          for (uint32_t id : class_ids[table]) {
+            if (!used_[table][id]) {
+              used_[table][id] = true;
+              counts_[table]++;
+            }
+          }
+        }
+        classes_.emplace_back(input, i);
+      }
+    }
+    return classes_.empty() || WriteOutput(error);
+  }
+
+  // The number of ids of each table after merging, for reporting.
+  size_t strings_size() const {
+    return ids_[STRINGS].size();
+  }
+
+  size_t methods_size() const {
+    return ids_[METHODS].size();
+  }
+
+  size_t fields_size() const {
+    return ids_[FIELDS].size();
+  }
+
+ private:
+  enum {
+    STRINGS,
+    TYPES,
+    PROTOS,
+    FIELDS,
+    METHODS,
+    TABLES,
+  };
+
+  // An id of one input: (input, index).
+  typedef std::pair<uint32_t, uint32_t> InputId;
+
+  uint32_t GetTableSize(uint32_t input, int table) const {
+    const DexFile& dex = inputs_[input]->dex();
+    switch (table) {
+      case STRINGS:
+        return dex.string_ids_size();
+      case TYPES:
+        return dex.type_ids_size();
+      case PROTOS:
+        return dex.proto_ids_size();
+      case FIELDS:
+        return dex.field_ids_size();
+    }
+    return dex.method_ids_size();
+  }
+
+  // Merges one table of all inputs, given how two ids compare. The ids of
+  // each input must be strictly increasing. ids_ gets the first input id
+  // of each merged id, and remaps_ the merged id of each input id.
+  template <typename Less>
+  bool MergeTable(int table, Less less, std::string* error) {
+    auto greater = [&](const InputId& a, const InputId& b) {
+      if (less(b, a)) {
+        return true;
+      }
+      // Equal ids come out in input order.
+      return !less(a, b) && a.first > b.first;
+    };
+    std::priority_queue<InputId, std::vector<InputId>, decltype(greater)> heads(greater);
+    for (uint32_t input = 0; input < inputs_.size(); ++input) {
+      remaps_[input][table].resize(GetTableSize(input, table));
+      if (!remaps_[input][table].empty()) {
+        heads.push(InputId(input, 0));
+      }
+    }
+    std::vector<InputId>& ids = ids_[table];
+    ids.clear();
+    while (!heads.empty()) {
+      InputId head = heads.top();
+      heads.pop();
+      if (ids.empty() || less(ids.back(), head)) {
+        ids.push_back(head);
+      }
+      remaps_[head.first][table][head.second] = ids.size() - 1;
+      InputId next(head.first, head.second + 1);
+      if (next.second < remaps_[head.first][table].size()) {
+        if (!less(head, next)) {
+          static const char* const NAMES[] = {"string", "type", "proto", "field", "method"};
+          *error = StringPrintf("%s: %s ids are not sorted at %u", inputs_[head.first]->path(),
+                                NAMES[table], next.second);
+          return false;
+        }
+        heads.push(next);
+      }
+    }
+    return true;
+  }
+
+  // Each table is keyed by the merged ids of the tables before it, as in
+  // the sort order of dex ids.
+  bool MergeIds(std::string* error) {
+    remaps_.resize(inputs_.size());
+    auto dex = [&](uint32_t input) -> const DexFile& {
+      return inputs_[input]->dex();
+    };
+    auto remap = [&](uint32_t input, int table, uint32_t idx) {
+      return remaps_[input][table][idx];
+    };
+    bool ok = MergeTable(STRINGS, [&](const InputId& a, const InputId& b) {
+      const char* x = dex(a.first).GetString(a.second);
+      const char* y = dex(b.first).GetString(b.second);
+      return CompareMutf8(x, strlen(x), y, strlen(y)) < 0;
+    }, error);
+    ok = ok && MergeTable(TYPES, [&](const InputId& a, const InputId& b) {
+      return remap(a.first, STRINGS, dex(a.first).type_id(a.second).descriptor_idx) <
+             remap(b.first, STRINGS, dex(b.first).type_id(b.second).descriptor_idx);
+    }, error);
+    std::vector<uint16_t> a_types;
+    std::vector<uint16_t> b_types;
+    ok = ok && MergeTable(PROTOS, [&](const InputId& a, const InputId& b) {
+      const proto_id_item& x = dex(a.first).proto_id(a.second);
+      const proto_id_item& y = dex(b.first).proto_id(b.second);
+      uint32_t x_return = remap(a.first, TYPES, x.return_type_idx);
+      uint32_t y_return = remap(b.first, TYPES, y.return_type_idx);
+      if (x_return != y_return) {
+        return x_return < y_return;
+      }
+      a_types.clear();
+      b_types.clear();
+      dex(a.first).GetTypeIds(x.parameters_off, &a_types);
+      dex(b.first).GetTypeIds(y.parameters_off, &b_types);
+      for (size_t i = 0; i < a_types.size() && i < b_types.size(); ++i) {
+        uint32_t x_type = remap(a.first, TYPES, a_types[i]);
+        uint32_t y_type = remap(b.first, TYPES, b_types[i]);
+        if (x_type != y_type) {
+          return x_type < y_type;
+        }
+      }
+      return a_types.size() < b_types.size();
+    }, error);
+    ok = ok && MergeTable(FIELDS, [&](const InputId& a, const InputId& b) {
+      const field_id_item& x = dex(a.first).field_id(a.second);
+      const field_id_item& y = dex(b.first).field_id(b.second);
+      return std::make_tuple(remap(a.first, TYPES, x.class_idx),
+                             remap(a.first, STRINGS, x.name_idx),
+                             remap(a.first, TYPES, x.type_idx)) <
+             std::make_tuple(remap(b.first, TYPES, y.class_idx),
+                             remap(b.first, STRINGS, y.name_idx),
+                             remap(b.first, TYPES, y.type_idx));
+    }, error);
+    ok = ok && MergeTable(METHODS, [&](const InputId& a, const InputId& b) {
+      const method_id_item& x = dex(a.first).method_id(a.second);
+      const method_id_item& y = dex(b.first).method_id(b.second);
+      return std::make_tuple(remap(a.first, TYPES, x.class_idx),
+                             remap(a.first, STRINGS, x.name_idx),
+                             remap(a.first, PROTOS, x.proto_idx)) <
+             std::make_tuple(remap(b.first, TYPES, y.class_idx),
+                             remap(b.first, STRINGS, y.name_idx),
+                             remap(b.first, PROTOS, y.proto_idx));
+    }, error);
+    return ok;
+  }
+
+  // An index map for the walkers of dex_model.h that leaves every id as it
+  // is and appends it to its table in ids, so walking collects the ids.
+  struct IdCollector {
+    std::vector<uint32_t>* ids;
+
+    bool Map(uint8_t index_type, uint32_t idx, uint32_t* result) const {
+      *result = idx;
+      if (idx == NO_INDEX) {
+        return true;
+      }
+      switch (index_type) {
+        case DEX_INDEX_STRING:
+          ids[STRINGS].push_back(idx);
+          break;
+        case DEX_INDEX_TYPE:
+          ids[TYPES].push_back(idx);
+          break;
+        case DEX_INDEX_FIELD:
+          ids[FIELDS].push_back(idx);
+          break;
+        case DEX_INDEX_METHOD:
+          ids[METHODS].push_back(idx);
+          break;
+        case DEX_INDEX_PROTO:
+          ids[PROTOS].push_back(idx);
+          break;
+      }
+      return true;
+    }
+  };
+
+  // Collects the ids a class loaded into model with input ids refers to.
+  static bool CollectClassIds(const DexModel& model, std::vector<uint32_t>* ids,
+                              std::string* error) {
+    const DexModelClass& cls = model.classes.back();
+    ids[TYPES].push_back(cls.class_idx);
+    if (cls.superclass_idx != NO_INDEX) {
+      ids[TYPES].push_back(cls.superclass_idx);
+    }
+    if (cls.source_file_idx != NO_INDEX) {
+      ids[STRINGS].push_back(cls.source_file_idx);
+    }
+    ids[TYPES].insert(ids[TYPES].end(), cls.interfaces.begin(), cls.interfaces.end());
+    for (const auto* list : {&cls.static_fields, &cls.instance_fields}) {
+      for (const DexModelMember& member : *list) {
+        ids[FIELDS].push_back(member.idx);
+      }
+    }
+    for (const auto* list : {&cls.direct_methods, &cls.virtual_methods}) {
+      for (const DexModelMember& member : *list) {
+        ids[METHODS].push_back(member.idx);
+      }
+    }
+    IdCollector collector = {ids};
+    // What the walkers copy is thrown away.
+    std::string copy;
+    bool ok = true;
+    auto add_set = [&](const DexModelAnnotationSet& set) {
+      for (const DexModelAnnotation& annotation : set) {
+        const char* p = annotation.encoded.data();
+        copy.clear();
+        ok = ok && RewriteEncodedAnnotation(p, p + annotation.encoded.size(), collector, &copy,
+                                            error);
+      }
+    };
+    add_set(cls.annotations);
+    for (const auto& entry : cls.field_annotations) {
+      ids[FIELDS].push_back(entry.first);
+      add_set(entry.second);
+    }
+    for (const auto& entry : cls.method_annotations) {
+      ids[METHODS].push_back(entry.first);
+      add_set(entry.second);
+    }
+    for (const auto& entry : cls.parameter_annotations) {
+      ids[METHODS].push_back(entry.first);
+      for (const DexModelAnnotationSet& set : entry.second) {
+        add_set(set);
+      }
+    }
+    if (!cls.static_values.empty()) {
+      const char* p = cls.static_values.data();
+      ok = ok && RewriteEncodedArray(p, p + cls.static_values.size(), collector, &copy, error);
+    }
+    if (!ok) {
+      return false;
+    }
+    DexInsn buf[64];
+    for (const DexModelCode& code : model.codes) {
+      DexInsnScanner scanner((const char*)code.insns.data(), code.insns.size());
+      while (size_t count = scanner.Next(buf, 64)) {
+        for (size_t i = 0; i < count; ++i) {
+          const DexInsn& insn = buf[i];
+          if (insn.op > 0xff) {
+            continue;
+          }
+          const DexOpcodeInfo& info = DEX_OPCODES[insn.op];
+          uint32_t idx = info.format == DEX_FORMAT_22C ? insn.c : insn.b;
+          collector.Map(info.index_type, idx, &idx);
+        }
+      }
+      for (const DexModelTry& item : code.tries) {
+        for (const DexModelCatch& handler : item.handlers) {
+          if (handler.type_idx != NO_INDEX) {
+            ids[TYPES].push_back(handler.type_idx);
+          }
+        }
+      }
+      if (!code.debug_info.empty()) {
+        const char* p = code.debug_info.data();
+        copy.clear();
+        if (!RewriteDebugInfo(p, p + code.debug_info.size(), collector, &copy, error)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // Maps the ids of a class to merged ids and adds the ids those refer to,
+  // like the name and proto of a method, without duplicates.
+  void MapAndCloseIds(uint32_t input, std::vector<uint32_t>* ids) {
+    for (int table = 0; table < TABLES; ++table) {
+      for (uint32_t& id : ids[table]) {
+        id = remaps_[input][table][id];
+      }
+    }
+    std::vector<uint16_t> type_ids;
+    for (uint32_t id : ids[METHODS]) {
+      const InputId& source = ids_[METHODS][id];
+      const method_id_item& item = inputs_[source.first]->dex().method_id(source.second);
+      ids[TYPES].push_back(remaps_[source.first][TYPES][item.class_idx]);
+      ids[STRINGS].push_back(remaps_[source.first][STRINGS][item.name_idx]);
+      ids[PROTOS].push_back(remaps_[source.first][PROTOS][item.proto_idx]);
+    }
+    for (uint32_t id : ids[FIELDS]) {
+      const InputId& source = ids_[FIELDS][id];
+      const field_id_item& item = inputs_[source.first]->dex().field_id(source.second);
+      ids[TYPES].push_back(remaps_[source.first][TYPES][item.class_idx]);
+      ids[TYPES].push_back(remaps_[source.first][TYPES][item.type_idx]);
+      ids[STRINGS].push_back(remaps_[source.first][STRINGS][item.name_idx]);
+    }
+    for (uint32_t id : ids[PROTOS]) {
+      const InputId& source = ids_[PROTOS][id];
+      const DexFile& dex = inputs_[source.first]->dex();
+      const proto_id_item& item = dex.proto_id(source.second);
+      ids[STRINGS].push_back(remaps_[source.first][STRINGS][item.shorty_idx]);
+      ids[TYPES].push_back(remaps_[source.first][TYPES][item.return_type_idx]);
+      type_ids.clear();
+      dex.GetTypeIds(item.parameters_off, &type_ids);
+      for (uint16_t type_idx : type_ids) {
+        ids[TYPES].push_back(remaps_[source.first][TYPES][type_idx]);
+      }
+    }
+    for (uint32_t id : ids[TYPES]) {
+      const InputId& source = ids_[TYPES][id];
+      ids[STRINGS].push_back(
+          remaps_[source.first][STRINGS][inputs_[source.first]->dex().type_id(source.second)
+                                             .descriptor_idx]);
+    }
+    for (int table = 0; table < TABLES; ++table) {
+      std::sort(ids[table].begin(), ids[table].end());
+      ids[table].erase(std::unique(ids[table].begin(), ids[table].end()), ids[table].end());
+    }
+  }
+
+  // Whether the current output can take a class with ids. String ids are
+  // 32-bit and have no limit of their own.
+  bool Fits(const std::vector<uint32_t>* ids) const {
+    for (int table = TYPES; table < TABLES; ++table) {
+      uint32_t count = counts_[table];
+      for (uint32_t id : ids[table]) {
+        count += used_[table][id] ? 0 : 1;
+      }
+      if (count > max_ids_) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::string GetOutputPath(size_t n) const {
+    if (n == 1) {
+      return path_;
+    }
+    size_t dot = path_.size() >= 4 && path_.compare(path_.size() - 4, 4, ".dex") == 0
+                     ? path_.size() - 4
+                     : path_.size();
+    return path_.substr(0, dot) + std::to_string(n) + path_.substr(dot);
+  }
+
+  // Writes the classes handed out so far with the ids they use, then starts
+  // a new output.
+  bool WriteOutput(std::string* error) {
+    DexModel model;
+    model.version = "035";
+    // Merged ids in order stay in order, so the writer has nothing to sort.
+    std::vector<uint32_t> local[TABLES];
+    for (int table = 0; table < TABLES; ++table) {
+      local[table].assign(ids_[table].size(), NO_INDEX);
+      uint32_t next = 0;
+      for (uint32_t id = 0; id < ids_[table].size(); ++id) {
+        if (used_[table][id]) {
+          local[table][id] = next++;
+        }
+      }
+    }
+    auto map_id = [&](uint32_t input, int table, uint32_t idx) {
+      return local[table][remaps_[input][table][idx]];
+    };
+    std::vector<uint16_t> type_ids;
+    for (uint32_t id = 0; id < ids_[STRINGS].size(); ++id) {
+      if (used_[STRINGS][id]) {
+        const InputId& source = ids_[STRINGS][id];
+        model.strings.push_back(inputs_[source.first]->dex().GetString(source.second));
+      }
+    }
+    for (uint32_t id = 0; id < ids_[TYPES].size(); ++id) {
+      if (used_[TYPES][id]) {
+        const InputId& source = ids_[TYPES][id];
+        const type_id_item& item = inputs_[source.first]->dex().type_id(source.second);
+        model.types.push_back(map_id(source.first, STRINGS, item.descriptor_idx));
+      }
+    }
+    for (uint32_t id = 0; id < ids_[PROTOS].size(); ++id) {
+      if (used_[PROTOS][id]) {
+        const InputId& source = ids_[PROTOS][id];
+        const DexFile& dex = inputs_[source.first]->dex();
+        const proto_id_item& item = dex.proto_id(source.second);
+        DexModelProto proto;
+        proto.shorty_idx = map_id(source.first, STRINGS, item.shorty_idx);
+        proto.return_type_idx = map_id(source.first, TYPES, item.return_type_idx);
+        type_ids.clear();
+        dex.GetTypeIds(item.parameters_off, &type_ids);
+        for (uint16_t type_idx : type_ids) {
+          proto.parameters.push_back(map_id(source.first, TYPES, type_idx));
+        }
+        model.protos.push_back(proto);
+      }
+    }
+    for (uint32_t id = 0; id < ids_[FIELDS].size(); ++id) {
+      if (used_[FIELDS][id]) {
+        const InputId& source = ids_[FIELDS][id];
+        const field_id_item& item = inputs_[source.first]->dex().field_id(source.second);
+        model.fields.push_back(DexModelField{map_id(source.first, TYPES, item.class_idx),
+                                             map_id(source.first, TYPES, item.type_idx),
+                                             map_id(source.first, STRINGS, item.name_idx)});
+      }
+    }
+    for (uint32_t id = 0; id < ids_[METHODS].size(); ++id) {
+      if (used_[METHODS][id]) {
+        const InputId& source = ids_[METHODS][id];
+        const method_id_item& item = inputs_[source.first]->dex().method_id(source.second);
+        model.methods.push_back(DexModelMethod{map_id(source.first, TYPES, item.class_idx),
+                                               map_id(source.first, PROTOS, item.proto_idx),
+                                               map_id(source.first, STRINGS, item.name_idx)});
+      }
+    }
+
+    // Each input gets a map from its ids to the ids of this output, built
+    // when its first class comes up.
+    DexIndexMap map;
+    uint32_t map_input = NO_INDEX;
+    for (const InputId& cls : classes_) {
+      const DexFile& dex = inputs_[cls.first]->dex();
+      if (cls.first != map_input) {
+        map_input = cls.first;
+        std::vector<uint32_t>* tables[] = {&map.strings, &map.types, &map.protos, &map.fields,
+                                           &map.methods};
+        for (int table = 0; table < TABLES; ++table) {
+          const std::vector<uint32_t>& remap = remaps_[cls.first][table];
+          tables[table]->resize(remap.size());
+          for (size_t i = 0; i < remap.size(); ++i) {
+            (*tables[table])[i] = local[table][remap[i]];
+          }
+        }
+        // The newest format of the inputs covers all of them.
+        std::string version(dex.data() + 4, 3);
+        model.version = std::max(model.version, version);
+      }
+      if (!LoadDexModelClass(dex, cls.second, map, &model, error)) {
+        *error = StringPrintf("%s: %s", inputs_[cls.first]->path(), error->c_str());
+        return false;
+      }
+    }
+    std::string path = GetOutputPath(outputs_->size() + 1);
+    DexWriter writer(model);
+    if (!writer.WriteFile(path.c_str(), error)) {
+      *error = StringPrintf("%s: %s", path.c_str(), error->c_str());
+      return false;
+    }
+    outputs_->push_back(path);
+    classes_.clear();
+    for (int table = 0; table < TABLES; ++table) {
+      std::fill(used_[table].begin(), used_[table].end(), false);
+      counts_[table] = 0;
+    }
+    return true;
+  }
+
+  uint32_t max_ids_;
+  std::vector<std::unique_ptr<DexMergeInput>> inputs_;
+  // Merged id -> the first input id that has it.
+  std::vector<InputId> ids_[TABLES];
+  // Input -> table -> input id -> merged id.
+  std::vector<std::array<std::vector<uint32_t>, TABLES>> remaps_;
+
+  // The output being built.
+  std::string path_;
+  std::vector<std::string>* outputs_;
+  std::vector<InputId> classes_;
+  std::vector<bool> used_[TABLES];
+  uint32_t counts_[TABLES];
+};
+
+#endif  // DEX_MERGER_H_
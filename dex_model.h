@@ -0,0 +1,720 @@
+#ifndef DEX_MODEL_H_
+#define DEX_MODEL_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dex.h"
+#include "dex_file.h"
+#include "dex_insns.h"
+#include "utils.h"
+
+// An editable copy of a dex file, for DexWriter. Items refer to each other
+// by index into the tables of the model, which may hold duplicates and need
+// not be sorted. Encoded values, annotations and debug info are kept as
+// bytes, with their indices into the model tables.
+
+struct DexModelProto {
+  uint32_t shorty_idx;
+  uint32_t return_type_idx;
+  std::vector<uint32_t> parameters;
+};
+
+struct DexModelField {
+  uint32_t class_idx;
+  uint32_t type_idx;
+  uint32_t name_idx;
+};
+
+struct DexModelMethod {
+  uint32_t class_idx;
+  uint32_t proto_idx;
+  uint32_t name_idx;
+};
+
+// type_idx is NO_INDEX for a catch-all handler.
+struct DexModelCatch {
+  uint32_t type_idx;
+  uint32_t address;
+};
+
+struct DexModelTry {
+  uint32_t start_addr;
+  uint16_t insn_count;
+  std::vector<DexModelCatch> handlers;
+};
+
+struct DexModelCode {
+  uint16_t registers_size;
+  uint16_t ins_size;
+  uint16_t outs_size;
+  std::vector<uint16_t> insns;
+  std::vector<DexModelTry> tries;
+  // A debug_info_item, empty if there is none.
+  std::string debug_info;
+};
+
+// A field or method of a class. code is an index into DexModel::codes, or
+// NO_INDEX.
+struct DexModelMember {
+  uint32_t idx;
+  uint32_t access_flags;
+  uint32_t code;
+};
+
+struct DexModelAnnotation {
+  uint8_t visibility;
+  // An encoded_annotation.
+  std::string encoded;
+};
+
+typedef std::vector<DexModelAnnotation> DexModelAnnotationSet;
+
+struct DexModelClass {
+  uint32_t class_idx;
+  uint32_t access_flags;
+  uint32_t superclass_idx;
+  uint32_t source_file_idx;
+  std::vector<uint32_t> interfaces;
+  DexModelAnnotationSet annotations;
+  std::vector<std::pair<uint32_t, DexModelAnnotationSet>> field_annotations;
+  std::vector<std::pair<uint32_t, DexModelAnnotationSet>> method_annotations;
+  std::vector<std::pair<uint32_t, std::vector<DexModelAnnotationSet>>> parameter_annotations;
+  // An encoded_array, empty if there are no static values.
+  std::string static_values;
+  std::vector<DexModelMember> static_fields;
+  std::vector<DexModelMember> instance_fields;
+  std::vector<DexModelMember> direct_methods;
+  std::vector<DexModelMember> virtual_methods;
+};
+
+struct DexModel {
+  // The version in the magic, like "035".
+  std::string version = "035";
+  // Modified UTF-8 contents.
+  std::vector<std::string> strings;
+  // Type id -> string id of its descriptor.
+  std::vector<uint32_t> types;
+  std::vector<DexModelProto> protos;
+  std::vector<DexModelField> fields;
+  std::vector<DexModelMethod> methods;
+  std::vector<DexModelClass> classes;
+  std::vector<DexModelCode> codes;
+
+  // Appends items and returns their indices. Nothing is deduplicated here;
+  // DexWriter merges equal items.
+  uint32_t AddString(const std::string& s) {
+    strings.push_back(s);
+    return strings.size() - 1;
+  }
+
+  uint32_t AddType(const std::string& descriptor) {
+    types.push_back(AddString(descriptor));
+    return types.size() - 1;
+  }
+};
+
+// Maps the indices of one set of tables to another. Each table maps an old
+// index to a new one; an old index past the end of its table is an error.
+struct DexIndexMap {
+  std::vector<uint32_t> strings;
+  std::vector<uint32_t> types;
+  std::vector<uint32_t> protos;
+  std::vector<uint32_t> fields;
+  std::vector<uint32_t> methods;
+
+  // Maps every index to itself.
+  void SetIdentity(size_t strings_size, size_t types_size, size_t protos_size,
+                   size_t fields_size, size_t methods_size) {
+    for (auto table : {std::make_pair(&strings, strings_size), std::make_pair(&types, types_size),
+                       std::make_pair(&protos, protos_size), std::make_pair(&fields, fields_size),
+                       std::make_pair(&methods, methods_size)}) {
+      table.first->resize(table.second);
+      for (size_t i = 0; i < table.second; ++i) {
+        (*table.first)[i] = i;
+      }
+    }
+  }
+
+  // Maps an index of the given DEX_INDEX_TYPE.
+  bool Map(uint8_t index_type, uint32_t idx, uint32_t* result) const {
+    const std::vector<uint32_t>* table;
+    switch (index_type) {
+      case DEX_INDEX_STRING:
+        table = &strings;
+        break;
+      case DEX_INDEX_TYPE:
+        table = &types;
+        break;
+      case DEX_INDEX_FIELD:
+        table = &fields;
+        break;
+      case DEX_INDEX_METHOD:
+        table = &methods;
+        break;
+      case DEX_INDEX_PROTO:
+        table = &protos;
+        break;
+      default:
+        return false;
+    }
+    return MapIn(*table, idx, result);
+  }
+
+  // NO_INDEX maps to itself.
+  static bool MapIn(const std::vector<uint32_t>& table, uint32_t idx, uint32_t* result) {
+    if (idx == NO_INDEX) {
+      *result = NO_INDEX;
+      return true;
+    }
+    if (idx >= table.size()) {
+      return false;
+    }
+    *result = table[idx];
+    return true;
+  }
+};
+
+// Maps the indices in instructions. Indices keep their width, so a
+// const-string whose string id no longer fits in 16 bits is an error.
+static bool RemapDexInsns(std::vector<uint16_t>* insns, const DexIndexMap& map,
+                          std::string* error) {
+  DexInsn buf[64];
+  DexInsnScanner scanner((const char*)insns->data(), insns->size());
+  while (size_t count = scanner.Next(buf, 64)) {
+    for (size_t i = 0; i < count; ++i) {
+      const DexInsn& insn = buf[i];
+      if (insn.op > 0xff || DEX_OPCODES[insn.op].index_type == DEX_INDEX_NONE) {
+        continue;
+      }
+      const DexOpcodeInfo& info = DEX_OPCODES[insn.op];
+      uint32_t idx = info.format == DEX_FORMAT_22C ? insn.c : insn.b;
+      uint32_t new_idx;
+      if (!map.Map(info.index_type, idx, &new_idx)) {
+        *error = StringPrintf("bad index %u in %s at 0x%x", idx, info.name, insn.pc);
+        return false;
+      }
+      if (info.format == DEX_FORMAT_31C) {
+        (*insns)[insn.pc + 1] = new_idx & 0xffff;
+        (*insns)[insn.pc + 2] = new_idx >> 16;
+      } else if (new_idx > 0xffff) {
+        *error = StringPrintf("index %u doesn't fit in %s at 0x%x", new_idx, info.name,
+                              insn.pc);
+        return false;
+      } else {
+        (*insns)[insn.pc + 1] = new_idx;
+      }
+    }
+  }
+  if (scanner.error() != nullptr) {
+    *error = StringPrintf("%s at 0x%x", scanner.error(), scanner.pc());
+    return false;
+  }
+  return true;
+}
+
+// Writes an index or other unsigned value as an encoded_value payload of
+// the fewest bytes.
+static void WriteEncodedUnsigned(std::string* out, uint8_t value_type, uint32_t value) {
+  int size = 1;
+  while (size < 4 && (value >> (size * 8)) != 0) {
+    size++;
+  }
+  out->push_back((char)(((size - 1) << 5) | value_type));
+  for (int i = 0; i < size; ++i) {
+    out->push_back((char)(value >> (i * 8)));
+  }
+}
+
+// The walkers below copy encoded values and debug_info_items, mapping the ids
+// in them with map.Map(index_type, idx, &new_idx), as DexIndexMap::Map does.
+// A map that only records the ids it is asked for turns them into walkers
+// that collect ids.
+
+template <typename IndexMap>
+static bool RewriteEncodedAnnotation(const char*& p, const char* end, const IndexMap& map,
+                                     std::string* out, std::string* error);
+
+// Copies one encoded_value from p to out, mapping its indices. Elements of
+// annotations are put in name order for the new string ids.
+template <typename IndexMap>
+static bool RewriteEncodedValue(const char*& p, const char* end, const IndexMap& map,
+                                std::string* out, std::string* error) {
+  if (p >= end) {
+    *error = "encoded value runs past the end of the file";
+    return false;
+  }
+  uint8_t value_arg = (*p & 0xff) >> 5;
+  uint8_t value_type = *p & 0x1f;
+  uint8_t index_type = DEX_INDEX_NONE;
+  switch (value_type) {
+    case ENCODED_VALUE_STRING:
+      index_type = DEX_INDEX_STRING;
+      break;
+    case ENCODED_VALUE_TYPE:
+      index_type = DEX_INDEX_TYPE;
+      break;
+    case ENCODED_VALUE_FIELD:
+    case ENCODED_VALUE_ENUM:
+      index_type = DEX_INDEX_FIELD;
+      break;
+    case ENCODED_VALUE_METHOD:
+      index_type = DEX_INDEX_METHOD;
+      break;
+    case ENCODED_VALUE_METHOD_TYPE:
+      index_type = DEX_INDEX_PROTO;
+      break;
+    case ENCODED_VALUE_ARRAY: {
+      out->push_back(*p++);
+      uint32_t size = ReadULEB128(p, end);
+      WriteULEB128(out, size);
+      for (uint32_t i = 0; i < size; ++i) {
+        if (!RewriteEncodedValue(p, end, map, out, error)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case ENCODED_VALUE_ANNOTATION:
+      out->push_back(*p++);
+      return RewriteEncodedAnnotation(p, end, map, out, error);
+    case ENCODED_VALUE_NULL:
+    case ENCODED_VALUE_BOOLEAN:
+      out->push_back(*p++);
+      return true;
+    case ENCODED_VALUE_BYTE:
+    case ENCODED_VALUE_SHORT:
+    case ENCODED_VALUE_CHAR:
+    case ENCODED_VALUE_INT:
+    case ENCODED_VALUE_LONG:
+    case ENCODED_VALUE_FLOAT:
+    case ENCODED_VALUE_DOUBLE:
+      break;
+    default:
+      *error = StringPrintf("unsupported encoded value type 0x%x", value_type);
+      return false;
+  }
+  if (value_arg + 2 > end - p) {
+    *error = "encoded value runs past the end of the file";
+    return false;
+  }
+  if (index_type == DEX_INDEX_NONE) {
+    out->append(p, value_arg + 2);
+    p += value_arg + 2;
+    return true;
+  }
+  if (value_arg > 3) {
+    *error = StringPrintf("bad size %u of index in encoded value", value_arg + 1);
+    return false;
+  }
+  p++;
+  uint32_t idx = 0;
+  ReadEncodedValue(p, value_arg, idx, false);
+  uint32_t new_idx;
+  if (idx == NO_INDEX || !map.Map(index_type, idx, &new_idx)) {
+    *error = StringPrintf("bad index %u in encoded value", idx);
+    return false;
+  }
+  WriteEncodedUnsigned(out, value_type, new_idx);
+  return true;
+}
+
+template <typename IndexMap>
+static bool RewriteEncodedAnnotation(const char*& p, const char* end, const IndexMap& map,
+                                     std::string* out, std::string* error) {
+  uint32_t type_idx = ReadULEB128(p, end);
+  uint32_t size = ReadULEB128(p, end);
+  if (!map.Map(DEX_INDEX_TYPE, type_idx, &type_idx) || type_idx == NO_INDEX) {
+    *error = "bad annotation type";
+    return false;
+  }
+  std::vector<std::pair<uint32_t, std::string>> elements(size);
+  for (auto& element : elements) {
+    uint32_t name_idx = ReadULEB128(p, end);
+    if (name_idx == NO_INDEX || !map.Map(DEX_INDEX_STRING, name_idx, &element.first)) {
+      *error = "bad annotation element name";
+      return false;
+    }
+    if (!RewriteEncodedValue(p, end, map, &element.second, error)) {
+      return false;
+    }
+  }
+  std::stable_sort(elements.begin(), elements.end(),
+                   [](const std::pair<uint32_t, std::string>& a,
+                      const std::pair<uint32_t, std::string>& b) { return a.first < b.first; });
+  WriteULEB128(out, type_idx);
+  WriteULEB128(out, size);
+  for (auto& element : elements) {
+    WriteULEB128(out, element.first);
+    out->append(element.second);
+  }
+  return true;
+}
+
+template <typename IndexMap>
+static bool RewriteEncodedArray(const char*& p, const char* end, const IndexMap& map,
+                                std::string* out, std::string* error) {
+  uint32_t size = ReadULEB128(p, end);
+  WriteULEB128(out, size);
+  for (uint32_t i = 0; i < size; ++i) {
+    if (!RewriteEncodedValue(p, end, map, out, error)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Copies a debug_info_item, mapping the string and type ids it names.
+template <typename IndexMap>
+static bool RewriteDebugInfo(const char*& p, const char* end, const IndexMap& map,
+                             std::string* out, std::string* error) {
+  struct RewriteVisitor : DexDebugInfoVisitor {
+    const IndexMap* map;
+    std::string* out;
+    std::string* error;
+    bool bad_index = false;
+
+    bool WriteIndex(uint8_t index_type, uint32_t idx) {
+      uint32_t new_idx;
+      if (!map->Map(index_type, idx, &new_idx)) {
+        *error = StringPrintf("bad index %u in debug info", idx);
+        bad_index = true;
+        return false;
+      }
+      WriteULEB128P1(out, new_idx);
+      return true;
+    }
+
+    bool OnHeader(uint32_t line_start, uint32_t parameters_size) {
+      WriteULEB128(out, line_start);
+      WriteULEB128(out, parameters_size);
+      return true;
+    }
+
+    bool OnParameter(uint32_t name_idx) {
+      return WriteIndex(DEX_INDEX_STRING, name_idx);
+    }
+
+    bool OnOp(const DexDebugOp& op) {
+      out->push_back((char)op.op);
+      switch (op.op) {
+        case DBG_ADVANCE_PC:
+          WriteULEB128(out, op.addr_diff);
+          break;
+        case DBG_ADVANCE_LINE:
+          WriteLEB128(out, op.line_diff);
+          break;
+        case DBG_START_LOCAL:
+        case DBG_START_LOCAL_EXTENDED:
+          WriteULEB128(out, op.register_num);
+          return WriteIndex(DEX_INDEX_STRING, op.name_idx) &&
+                 WriteIndex(DEX_INDEX_TYPE, op.type_idx) &&
+                 (op.op == DBG_START_LOCAL || WriteIndex(DEX_INDEX_STRING, op.sig_idx));
+        case DBG_END_LOCAL:
+        case DBG_RESTART_LOCAL:
+          WriteULEB128(out, op.register_num);
+          break;
+        case DBG_SET_FILE:
+          return WriteIndex(DEX_INDEX_STRING, op.name_idx);
+      }
+      return true;
+    }
+  } visitor;
+  visitor.map = &map;
+  visitor.out = out;
+  visitor.error = error;
+  if (!DecodeDebugInfo(p, end, &visitor)) {
+    if (!visitor.bad_index) {
+      *error = "debug info runs past the end of the file";
+    }
+    return false;
+  }
+  return true;
+}
+
+// Reads the code_item at off, mapping the ids it refers to.
+static bool LoadDexModelCode(const DexFile& dex, uint32_t off, const DexIndexMap& map,
+                             DexModelCode* code, std::string* error) {
+  const char* end = dex.data() + dex.size();
+  const char* insns;
+  uint32_t insns_size;
+  if (!dex.GetCodeInsns(off, &insns, &insns_size)) {
+    *error = StringPrintf("bad code_item at 0x%x", off);
+    return false;
+  }
+  const char* p = dex.data() + off;
+  uint16_t tries_size;
+  uint32_t debug_info_off;
+  Read(p, end, code->registers_size);
+  Read(p, end, code->ins_size);
+  Read(p, end, code->outs_size);
+  Read(p, end, tries_size);
+  Read(p, end, debug_info_off);
+  code->insns.resize(insns_size);
+  memcpy(code->insns.data(), insns, insns_size * 2);
+  if (!RemapDexInsns(&code->insns, map, error)) {
+    *error = StringPrintf("code_item at 0x%x: %s", off, error->c_str());
+    return false;
+  }
+  p = insns + insns_size * 2;
+  if (tries_size != 0 && (insns_size & 1)) {
+    p += 2;
+  }
+  const char* handlers = p + tries_size * 8;
+  code->tries.resize(tries_size);
+  for (DexModelTry& item : code->tries) {
+    uint16_t handler_off;
+    Read(p, end, item.start_addr);
+    Read(p, end, item.insn_count);
+    Read(p, end, handler_off);
+    const char* q = handlers + handler_off;
+    if (q >= end) {
+      *error = StringPrintf("bad handler_off in code_item at 0x%x", off);
+      return false;
+    }
+    int32_t size = ReadLEB128(q, end);
+    for (int32_t i = 0; i < abs(size); ++i) {
+      DexModelCatch handler;
+      handler.type_idx = ReadULEB128(q, end);
+      handler.address = ReadULEB128(q, end);
+      if (handler.type_idx == NO_INDEX ||
+          !DexIndexMap::MapIn(map.types, handler.type_idx, &handler.type_idx)) {
+        *error = StringPrintf("bad catch type in code_item at 0x%x", off);
+        return false;
+      }
+      item.handlers.push_back(handler);
+    }
+    if (size <= 0) {
+      DexModelCatch handler;
+      handler.type_idx = NO_INDEX;
+      handler.address = ReadULEB128(q, end);
+      item.handlers.push_back(handler);
+    }
+  }
+  if (debug_info_off != 0) {
+    if (debug_info_off >= dex.size()) {
+      *error = StringPrintf("bad debug_info_off in code_item at 0x%x", off);
+      return false;
+    }
+    const char* q = dex.data() + debug_info_off;
+    if (!RewriteDebugInfo(q, end, map, &code->debug_info, error)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool LoadDexModelAnnotationSet(const DexFile& dex, uint32_t off, const DexIndexMap& map,
+                                      DexModelAnnotationSet* set, std::string* error) {
+  if (off == 0) {
+    return true;
+  }
+  const char* end = dex.data() + dex.size();
+  if (off >= dex.size()) {
+    *error = StringPrintf("bad annotation_set_item offset 0x%x", off);
+    return false;
+  }
+  const char* p = dex.data() + off;
+  uint32_t size;
+  Read(p, end, size);
+  for (uint32_t i = 0; i < size; ++i) {
+    uint32_t annotation_off;
+    Read(p, end, annotation_off);
+    if (annotation_off >= dex.size()) {
+      *error = StringPrintf("bad annotation_item offset 0x%x", annotation_off);
+      return false;
+    }
+    const char* q = dex.data() + annotation_off;
+    DexModelAnnotation annotation;
+    annotation.visibility = *q++;
+    if (!RewriteEncodedAnnotation(q, end, map, &annotation.encoded, error)) {
+      return false;
+    }
+    set->push_back(annotation);
+  }
+  return true;
+}
+
+static bool LoadDexModelAnnotations(const DexFile& dex, uint32_t off, const DexIndexMap& map,
+                                    DexModelClass* cls, std::string* error) {
+  const char* end = dex.data() + dex.size();
+  if (off >= dex.size()) {
+    *error = StringPrintf("bad annotations_off 0x%x", off);
+    return false;
+  }
+  const char* p = dex.data() + off;
+  uint32_t class_annotations_off;
+  uint32_t fields_size;
+  uint32_t annotated_methods_size;
+  uint32_t annotated_parameters_size;
+  Read(p, end, class_annotations_off);
+  Read(p, end, fields_size);
+  Read(p, end, annotated_methods_size);
+  Read(p, end, annotated_parameters_size);
+  if (!LoadDexModelAnnotationSet(dex, class_annotations_off, map, &cls->annotations, error)) {
+    return false;
+  }
+  for (int list = 0; list < 2; ++list) {
+    auto& annotations = list == 0 ? cls->field_annotations : cls->method_annotations;
+    uint32_t size = list == 0 ? fields_size : annotated_methods_size;
+    annotations.resize(size);
+    const std::vector<uint32_t>& table = list == 0 ? map.fields : map.methods;
+    for (auto& annotation : annotations) {
+      uint32_t set_off;
+      Read(p, end, annotation.first);
+      Read(p, end, set_off);
+      if (!DexIndexMap::MapIn(table, annotation.first, &annotation.first)) {
+        *error = StringPrintf("bad member %u in annotations_directory_item", annotation.first);
+        return false;
+      }
+      if (!LoadDexModelAnnotationSet(dex, set_off, map, &annotation.second, error)) {
+        return false;
+      }
+    }
+  }
+  cls->parameter_annotations.resize(annotated_parameters_size);
+  for (auto& annotation : cls->parameter_annotations) {
+    uint32_t list_off;
+    Read(p, end, annotation.first);
+    Read(p, end, list_off);
+    if (!DexIndexMap::MapIn(map.methods, annotation.first, &annotation.first)) {
+      *error = StringPrintf("bad method %u in annotations_directory_item", annotation.first);
+      return false;
+    }
+    if (list_off >= dex.size()) {
+      *error = StringPrintf("bad annotation_set_ref_list offset 0x%x", list_off);
+      return false;
+    }
+    const char* q = dex.data() + list_off;
+    uint32_t size;
+    Read(q, end, size);
+    annotation.second.resize(size);
+    for (DexModelAnnotationSet& set : annotation.second) {
+      uint32_t set_off;
+      Read(q, end, set_off);
+      if (!LoadDexModelAnnotationSet(dex, set_off, map, &set, error)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Appends class_def class_def_idx of dex to model, with its code, mapping
+// its ids through map into the tables of model.
+static bool LoadDexModelClass(const DexFile& dex, uint32_t class_def_idx, const DexIndexMap& map,
+                              DexModel* model, std::string* error) {
+  const char* end = dex.data() + dex.size();
+  const class_def_item& item = dex.class_def(class_def_idx);
+  model->classes.emplace_back();
+  DexModelClass& cls = model->classes.back();
+  cls.access_flags = item.access_flags;
+  std::vector<uint16_t> type_ids;
+  dex.GetTypeIds(item.interfaces_off, &type_ids);
+  cls.interfaces.resize(type_ids.size());
+  bool ok = item.class_idx != NO_INDEX &&
+            DexIndexMap::MapIn(map.types, item.class_idx, &cls.class_idx) &&
+            DexIndexMap::MapIn(map.types, item.superclass_idx, &cls.superclass_idx) &&
+            DexIndexMap::MapIn(map.strings, item.source_file_idx, &cls.source_file_idx);
+  for (size_t i = 0; ok && i < type_ids.size(); ++i) {
+    ok = DexIndexMap::MapIn(map.types, type_ids[i], &cls.interfaces[i]);
+  }
+  if (!ok) {
+    *error = StringPrintf("bad id in class_def %u", class_def_idx);
+    return false;
+  }
+  if (item.annotations_off != 0 &&
+      !LoadDexModelAnnotations(dex, item.annotations_off, map, &cls, error)) {
+    return false;
+  }
+  if (item.static_values_off != 0) {
+    if (item.static_values_off >= dex.size()) {
+      *error = StringPrintf("bad static_values_off 0x%x", item.static_values_off);
+      return false;
+    }
+    const char* p = dex.data() + item.static_values_off;
+    if (!RewriteEncodedArray(p, end, map, &cls.static_values, error)) {
+      return false;
+    }
+  }
+  DexClassData class_data;
+  std::vector<DexClassMember> storage;
+  dex.GetClassData(class_def_idx, &class_data, &storage);
+  std::vector<DexModelMember>* lists[] = {&cls.static_fields, &cls.instance_fields,
+                                          &cls.direct_methods, &cls.virtual_methods};
+  uint32_t sizes[] = {class_data.static_fields_size, class_data.instance_fields_size,
+                      class_data.direct_methods_size, class_data.virtual_methods_size};
+  const DexClassMember* member = class_data.members;
+  for (int list = 0; list < 4; ++list) {
+    for (uint32_t j = 0; j < sizes[list]; ++j, ++member) {
+      DexModelMember model_member;
+      if (!DexIndexMap::MapIn(list < 2 ? map.fields : map.methods, member->idx,
+                              &model_member.idx)) {
+        *error = StringPrintf("bad member %u in class_def %u", member->idx, class_def_idx);
+        return false;
+      }
+      model_member.access_flags = member->access_flags;
+      model_member.code = NO_INDEX;
+      if (member->code_off != 0) {
+        model->codes.emplace_back();
+        if (!LoadDexModelCode(dex, member->code_off, map, &model->codes.back(), error)) {
+          return false;
+        }
+        model_member.code = model->codes.size() - 1;
+      }
+      lists[list]->push_back(model_member);
+    }
+  }
+  return true;
+}
+
+// Copies everything a dex file defines into model, with the same indices.
+// dex must be initialized.
+static bool LoadDexModel(const DexFile& dex, DexModel* model, std::string* error) {
+  model->version.assign(dex.data() + 4, 3);
+  DexIndexMap identity;
+  identity.SetIdentity(dex.string_ids_size(), dex.type_ids_size(), dex.proto_ids_size(),
+                       dex.field_ids_size(), dex.method_ids_size());
+  model->strings.resize(dex.string_ids_size());
+  for (uint32_t i = 0; i < dex.string_ids_size(); ++i) {
+    model->strings[i] = dex.GetString(i);
+  }
+  model->types.resize(dex.type_ids_size());
+  for (uint32_t i = 0; i < dex.type_ids_size(); ++i) {
+    model->types[i] = dex.type_id(i).descriptor_idx;
+  }
+  model->protos.resize(dex.proto_ids_size());
+  std::vector<uint16_t> type_ids;
+  for (uint32_t i = 0; i < dex.proto_ids_size(); ++i) {
+    const proto_id_item& item = dex.proto_id(i);
+    DexModelProto& proto = model->protos[i];
+    proto.shorty_idx = item.shorty_idx;
+    proto.return_type_idx = item.return_type_idx;
+    type_ids.clear();
+    dex.GetTypeIds(item.parameters_off, &type_ids);
+    proto.parameters.assign(type_ids.begin(), type_ids.end());
+  }
+  model->fields.resize(dex.field_ids_size());
+  for (uint32_t i = 0; i < dex.field_ids_size(); ++i) {
+    const field_id_item& item = dex.field_id(i);
+    model->fields[i] = DexModelField{item.class_idx, item.type_idx, item.name_idx};
+  }
+  model->methods.resize(dex.method_ids_size());
+  for (uint32_t i = 0; i < dex.method_ids_size(); ++i) {
+    const method_id_item& item = dex.method_id(i);
+    model->methods[i] = DexModelMethod{item.class_idx, item.proto_idx, item.name_idx};
+  }
+  for (uint32_t i = 0; i < dex.class_defs_size(); ++i) {
+    if (!LoadDexModelClass(dex, i, identity, model, error)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif  // DEX_MODEL_H_
@@ -0,0 +1,498 @@
+#ifndef DEX_REACHABILITY_H_
+#define DEX_REACHABILITY_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "csr.h"
+#include "dex.h"
+#include "dex_file.h"
+#include "dex_insns.h"
+#include "opcode_info.h"
+#include "utils.h"
+
+// Finds the classes and methods of a dex file that can't be reached from a
+// set of roots, following invokes, field accesses and type references in
+// code. Virtual and interface invokes reach the overriding methods of every
+// reached class that is a subtype of the invoked class. Classes extending a
+// class or interface from outside the dex file other than java.lang.Object
+// keep all their virtual methods, since the framework may call any of them.
+//
+// Reached methods are scanned in rounds, each round decoding its methods in
+// parallel and then marking what they reference for the next round.
+class DexReachability {
+ public:
+  explicit DexReachability(const DexFile& dex)
+      : dex_(dex), object_type_(NO_INDEX), clinit_name_(NO_INDEX) {
+  }
+
+  // Indexes the classes and methods. Must be called before adding roots.
+  void Init() {
+    uint32_t class_defs_size = dex_.class_defs_size();
+    type_class_defs_.assign(dex_.type_ids_size(), NO_INDEX);
+    method_code_offs_.assign(dex_.method_ids_size(), 0);
+    method_defined_.assign(dex_.method_ids_size(), 0);
+    reached_types_.assign(dex_.type_ids_size(), 0);
+    reached_methods_.assign(dex_.method_ids_size(), 0);
+    supertypes_.resize(class_defs_size);
+    std::vector<std::pair<uint32_t, uint32_t>> direct;
+    std::vector<std::pair<uint32_t, uint32_t>> virtuals;
+    std::vector<DexMethod> methods;
+    for (uint32_t i = 0; i < class_defs_size; ++i) {
+      const class_def_item& cls = dex_.class_def(i);
+      if (cls.class_idx < dex_.type_ids_size() && type_class_defs_[cls.class_idx] == NO_INDEX) {
+        type_class_defs_[cls.class_idx] = i;
+      }
+      methods.clear();
+      dex_.GetClassMethods(i, &methods);
+      for (const DexMethod& method : methods) {
+        if (method.method_idx >= dex_.method_ids_size()) {
+          continue;
+        }
+        method_defined_[method.method_idx] = 1;
+        method_code_offs_[method.method_idx] = method.code_off;
+        if (IsVirtual(method.access_flags)) {
+          virtuals.emplace_back(i, method.method_idx);
+          virtual_by_signature_[GetSignature(method.method_idx)].push_back(method.method_idx);
+        } else {
+          direct.emplace_back(i, method.method_idx);
+        }
+      }
+    }
+    direct_methods_.Build(class_defs_size, direct);
+    virtual_methods_.Build(class_defs_size, virtuals);
+    object_type_ = dex_.FindType("Ljava/lang/Object;");
+    clinit_name_ = dex_.FindString("<clinit>");
+  }
+
+  // Keeps a class with all of its methods.
+  void AddRootClass(uint32_t type_idx) {
+    ReachType(type_idx);
+    uint32_t class_def_idx = type_class_defs_[type_idx];
+    if (class_def_idx != NO_INDEX) {
+      for (const Csr* methods : {&direct_methods_, &virtual_methods_}) {
+        for (uint32_t method_idx : methods->Get(class_def_idx)) {
+          ReachMethod(method_idx);
+        }
+      }
+    }
+  }
+
+  void AddRootMethod(uint32_t method_idx) {
+    ReachMethod(method_idx);
+  }
+
+  // Adds the usual entry points of an app: static main(String[]) methods,
+  // subclasses of the Android component classes the framework instantiates,
+  // and classes and methods annotated with an annotation named Keep.
+  void AddDefaultRoots() {
+    static const char* const kComponents[] = {
+        "Landroid/app/Activity;",          "Landroid/app/Application;",
+        "Landroid/app/Service;",           "Landroid/content/BroadcastReceiver;",
+        "Landroid/content/ContentProvider;", "Landroid/app/backup/BackupAgent;",
+        "Landroid/app/Instrumentation;",
+    };
+    for (const char* component : kComponents) {
+      uint32_t type_idx = dex_.FindType(component);
+      if (type_idx == NO_INDEX) {
+        continue;
+      }
+      for (uint32_t i = 0; i < dex_.class_defs_size(); ++i) {
+        uint32_t class_idx = dex_.class_def(i).class_idx;
+        if (class_idx < dex_.type_ids_size() && IsSubtype(class_idx, type_idx)) {
+          AddRootClass(class_idx);
+        }
+      }
+    }
+    // main is void main(String[]), matched by ids rather than by formatting
+    // the proto of every direct method.
+    uint32_t main_name = dex_.FindString("main");
+    uint32_t void_type = dex_.FindType("V");
+    uint32_t args_type = dex_.FindType("[Ljava/lang/String;");
+    bool has_main = main_name != NO_INDEX && void_type != NO_INDEX && args_type != NO_INDEX;
+    std::vector<uint16_t> params;
+    for (uint32_t i = 0; has_main && i < dex_.class_defs_size(); ++i) {
+      for (uint32_t method_idx : direct_methods_.Get(i)) {
+        const method_id_item& method = dex_.method_id(method_idx);
+        if (method.name_idx != main_name) {
+          continue;
+        }
+        const proto_id_item& proto = dex_.proto_id(method.proto_idx);
+        params.clear();
+        dex_.GetTypeIds(proto.parameters_off, &params);
+        if (proto.return_type_idx == void_type && params.size() == 1 && params[0] == args_type) {
+          ReachMethod(method_idx);
+        }
+      }
+    }
+    AddAnnotatedRoots();
+  }
+
+  // Follows everything reachable from the roots.
+  void Run() {
+    std::vector<uint32_t> frontier;
+    std::vector<std::vector<Reference>> refs;
+    while (!worklist_.empty()) {
+      frontier.swap(worklist_);
+      worklist_.clear();
+      refs.assign(frontier.size(), std::vector<Reference>());
+      ParallelFor(frontier.size(), [&](size_t i) {
+        ScanMethod(frontier[i], &refs[i]);
+      });
+      for (const std::vector<Reference>& method_refs : refs) {
+        for (const Reference& ref : method_refs) {
+          if (ref.index_type == DEX_INDEX_TYPE) {
+            ReachType(ref.id);
+          } else if (ref.index_type == DEX_INDEX_FIELD) {
+            ReachType(dex_.field_id(ref.id).class_idx);
+          } else if (ref.index_type == DEX_INDEX_METHOD) {
+            ReachMethod(ref.id);
+            if (ref.is_virtual) {
+              ReachOverrides(ref.id);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  bool IsTypeReachable(uint32_t type_idx) const {
+    return reached_types_[type_idx] != 0;
+  }
+
+  bool IsMethodReachable(uint32_t method_idx) const {
+    return reached_methods_[method_idx] != 0;
+  }
+
+  bool IsMethodDefined(uint32_t method_idx) const {
+    return method_defined_[method_idx] != 0;
+  }
+
+  // Size in bytes of the instructions of a method defined in the dex file.
+  uint32_t GetCodeSize(uint32_t method_idx) const {
+    const char* insns;
+    uint32_t insns_size;
+    uint32_t code_off = method_code_offs_[method_idx];
+    if (code_off == 0 || !dex_.GetCodeInsns(code_off, &insns, &insns_size)) {
+      return 0;
+    }
+    return insns_size * 2;
+  }
+
+  // The direct and virtual methods a class defines.
+  CsrRow GetDirectMethods(uint32_t class_def_idx) const {
+    return direct_methods_.Get(class_def_idx);
+  }
+
+  CsrRow GetVirtualMethods(uint32_t class_def_idx) const {
+    return virtual_methods_.Get(class_def_idx);
+  }
+
+ private:
+  struct Reference {
+    uint8_t index_type;
+    bool is_virtual;
+    uint32_t id;
+  };
+
+  static bool IsVirtual(uint32_t access_flags) {
+    return (access_flags & (METHOD_ACC_STATIC | METHOD_ACC_PRIVATE | METHOD_ACC_CONSTRUCTOR)) == 0;
+  }
+
+  static bool IsVirtualInvoke(uint16_t op) {
+    return op == DEX_OP_INVOKE_VIRTUAL || op == DEX_OP_INVOKE_VIRTUAL_RANGE ||
+           op == DEX_OP_INVOKE_INTERFACE || op == DEX_OP_INVOKE_INTERFACE_RANGE;
+  }
+
+  uint64_t GetSignature(uint32_t method_idx) const {
+    const method_id_item& method = dex_.method_id(method_idx);
+    return ((uint64_t)method.name_idx << 32) | method.proto_idx;
+  }
+
+  // Appends the superclasses and interfaces of type_idx, and type_idx itself,
+  // as far as they are defined in the dex file; the first type from outside
+  // it on each path is included too.
+  void GetSupertypes(uint32_t type_idx, std::vector<uint32_t>* types) const {
+    std::vector<uint32_t> worklist(1, type_idx);
+    std::vector<uint16_t> interfaces;
+    while (!worklist.empty()) {
+      uint32_t type = worklist.back();
+      worklist.pop_back();
+      if (type >= dex_.type_ids_size() ||
+          std::find(types->begin(), types->end(), type) != types->end()) {
+        continue;
+      }
+      types->push_back(type);
+      uint32_t class_def_idx = type_class_defs_[type];
+      if (class_def_idx == NO_INDEX) {
+        continue;
+      }
+      const class_def_item& cls = dex_.class_def(class_def_idx);
+      worklist.push_back(cls.superclass_idx);
+      interfaces.clear();
+      dex_.GetTypeIds(cls.interfaces_off, &interfaces);
+      worklist.insert(worklist.end(), interfaces.begin(), interfaces.end());
+    }
+  }
+
+  bool IsSubtype(uint32_t type_idx, uint32_t super_idx) const {
+    std::vector<uint32_t> supertypes;
+    GetSupertypes(type_idx, &supertypes);
+    return std::find(supertypes.begin(), supertypes.end(), super_idx) != supertypes.end();
+  }
+
+  void ReachType(uint32_t type_idx) {
+    if (type_idx >= dex_.type_ids_size() || reached_types_[type_idx]) {
+      return;
+    }
+    reached_types_[type_idx] = 1;
+    const char* descriptor = dex_.GetType(type_idx);
+    if (descriptor[0] == '[') {
+      while (*descriptor == '[') {
+        descriptor++;
+      }
+      ReachType(dex_.FindType(descriptor));
+      return;
+    }
+    uint32_t class_def_idx = type_class_defs_[type_idx];
+    if (class_def_idx == NO_INDEX) {
+      return;
+    }
+    std::vector<uint32_t>& supertypes = supertypes_[class_def_idx];
+    GetSupertypes(type_idx, &supertypes);
+    bool has_library_supertype = false;
+    for (uint32_t super_idx : supertypes) {
+      ReachType(super_idx);
+      if (type_class_defs_[super_idx] == NO_INDEX && super_idx != object_type_) {
+        has_library_supertype = true;
+      }
+    }
+    // Static initializers run when the class is first used.
+    for (uint32_t method_idx : direct_methods_.Get(class_def_idx)) {
+      if (clinit_name_ != NO_INDEX && dex_.method_id(method_idx).name_idx == clinit_name_) {
+        ReachMethod(method_idx);
+      }
+    }
+    for (uint32_t method_idx : virtual_methods_.Get(class_def_idx)) {
+      if (has_library_supertype || IsInvoked(method_idx, supertypes)) {
+        ReachMethod(method_idx);
+      }
+    }
+  }
+
+  // Whether a virtual invoke of the signature of method_idx names one of
+  // supertypes.
+  bool IsInvoked(uint32_t method_idx, const std::vector<uint32_t>& supertypes) const {
+    auto it = invoked_.find(GetSignature(method_idx));
+    if (it == invoked_.end()) {
+      return false;
+    }
+    for (uint32_t type_idx : it->second) {
+      if (std::find(supertypes.begin(), supertypes.end(), type_idx) != supertypes.end()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Finds the definition of a method reference in its class or a superclass.
+  uint32_t ResolveMethod(uint32_t method_idx) const {
+    if (method_defined_[method_idx]) {
+      return method_idx;
+    }
+    const method_id_item& ref = dex_.method_id(method_idx);
+    uint32_t type_idx = ref.class_idx;
+    for (int depth = 0; depth < 256 && type_idx < dex_.type_ids_size(); ++depth) {
+      uint32_t class_def_idx = type_class_defs_[type_idx];
+      if (class_def_idx == NO_INDEX) {
+        break;
+      }
+      for (const Csr* methods : {&virtual_methods_, &direct_methods_}) {
+        for (uint32_t other_idx : methods->Get(class_def_idx)) {
+          const method_id_item& other = dex_.method_id(other_idx);
+          if (other.name_idx == ref.name_idx && other.proto_idx == ref.proto_idx) {
+            return other_idx;
+          }
+        }
+      }
+      type_idx = dex_.class_def(class_def_idx).superclass_idx;
+    }
+    return method_idx;
+  }
+
+  void ReachMethod(uint32_t method_idx) {
+    if (method_idx >= dex_.method_ids_size()) {
+      return;
+    }
+    method_idx = ResolveMethod(method_idx);
+    if (reached_methods_[method_idx]) {
+      return;
+    }
+    reached_methods_[method_idx] = 1;
+    ReachType(dex_.method_id(method_idx).class_idx);
+    if (method_code_offs_[method_idx] != 0) {
+      worklist_.push_back(method_idx);
+    }
+  }
+
+  // Records a virtual invoke and reaches the overriding methods of reached
+  // subtypes of the invoked class.
+  void ReachOverrides(uint32_t method_idx) {
+    const method_id_item& method = dex_.method_id(method_idx);
+    uint64_t signature = GetSignature(method_idx);
+    std::vector<uint32_t>& types = invoked_[signature];
+    if (std::find(types.begin(), types.end(), method.class_idx) != types.end()) {
+      return;
+    }
+    types.push_back(method.class_idx);
+    auto it = virtual_by_signature_.find(signature);
+    if (it == virtual_by_signature_.end()) {
+      return;
+    }
+    for (uint32_t other_idx : it->second) {
+      uint32_t class_idx = dex_.method_id(other_idx).class_idx;
+      if (reached_methods_[other_idx] || !reached_types_[class_idx]) {
+        continue;
+      }
+      const std::vector<uint32_t>& supertypes = supertypes_[type_class_defs_[class_idx]];
+      if (std::find(supertypes.begin(), supertypes.end(), method.class_idx) != supertypes.end()) {
+        ReachMethod(other_idx);
+      }
+    }
+  }
+
+  void ScanMethod(uint32_t method_idx, std::vector<Reference>* refs) const {
+    const char* insns;
+    uint32_t insns_size;
+    if (!dex_.GetCodeInsns(method_code_offs_[method_idx], &insns, &insns_size)) {
+      return;
+    }
+    DexInsn buf[64];
+    DexInsnScanner scanner(insns, insns_size);
+    while (size_t count = scanner.Next(buf, 64)) {
+      for (size_t i = 0; i < count; ++i) {
+        const DexInsn& insn = buf[i];
+        if (insn.op > 0xff) {
+          continue;
+        }
+        const DexOpcodeInfo& info = DEX_OPCODES[insn.op];
+        Reference ref;
+        ref.index_type = info.index_type;
+        ref.is_virtual = IsVirtualInvoke(insn.op);
+        ref.id = info.format == DEX_FORMAT_22C ? insn.c : insn.b;
+        if ((ref.index_type == DEX_INDEX_TYPE && ref.id < dex_.type_ids_size()) ||
+            (ref.index_type == DEX_INDEX_FIELD && ref.id < dex_.field_ids_size()) ||
+            (ref.index_type == DEX_INDEX_METHOD && ref.id < dex_.method_ids_size())) {
+          refs->push_back(ref);
+        }
+      }
+    }
+  }
+
+  // Appends the types of the annotations in an annotation_set_item.
+  void GetAnnotationTypes(uint32_t set_off, std::vector<uint32_t>* types) const {
+    const char* end = dex_.data() + dex_.size();
+    const char* p = dex_.data() + set_off;
+    uint32_t size;
+    Read(p, end, size);
+    for (uint32_t i = 0; i < size; ++i) {
+      uint32_t annotation_off;
+      Read(p, end, annotation_off);
+      if (annotation_off >= dex_.size()) {
+        continue;
+      }
+      // Skip the visibility byte of the annotation_item.
+      const char* q = dex_.data() + annotation_off + 1;
+      types->push_back(ReadULEB128(q, end));
+    }
+  }
+
+  bool HasKeepAnnotation(uint32_t set_off) const {
+    if (set_off == 0 || set_off >= dex_.size()) {
+      return false;
+    }
+    std::vector<uint32_t> types;
+    GetAnnotationTypes(set_off, &types);
+    for (uint32_t type_idx : types) {
+      if (type_idx >= dex_.type_ids_size()) {
+        continue;
+      }
+      const char* descriptor = dex_.GetType(type_idx);
+      size_t length = strlen(descriptor);
+      if (length >= 6 && strcmp(descriptor + length - 6, "/Keep;") == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void AddAnnotatedRoots() {
+    const char* end = dex_.data() + dex_.size();
+    for (uint32_t i = 0; i < dex_.class_defs_size(); ++i) {
+      const class_def_item& cls = dex_.class_def(i);
+      if (cls.annotations_off == 0 || cls.annotations_off >= dex_.size()) {
+        continue;
+      }
+      const char* p = dex_.data() + cls.annotations_off;
+      uint32_t class_annotations_off;
+      uint32_t fields_size;
+      uint32_t annotated_methods_size;
+      uint32_t annotated_parameters_size;
+      Read(p, end, class_annotations_off);
+      Read(p, end, fields_size);
+      Read(p, end, annotated_methods_size);
+      Read(p, end, annotated_parameters_size);
+      if (HasKeepAnnotation(class_annotations_off) && cls.class_idx < dex_.type_ids_size()) {
+        AddRootClass(cls.class_idx);
+      }
+      for (uint32_t j = 0; j < fields_size; ++j) {
+        uint32_t field_idx;
+        uint32_t annotations_off;
+        Read(p, end, field_idx);
+        Read(p, end, annotations_off);
+        if (field_idx < dex_.field_ids_size() && HasKeepAnnotation(annotations_off)) {
+          ReachType(dex_.field_id(field_idx).class_idx);
+        }
+      }
+      for (uint32_t j = 0; j < annotated_methods_size; ++j) {
+        uint32_t method_idx;
+        uint32_t annotations_off;
+        Read(p, end, method_idx);
+        Read(p, end, annotations_off);
+        if (method_idx < dex_.method_ids_size() && HasKeepAnnotation(annotations_off)) {
+          ReachMethod(method_idx);
+        }
+      }
+    }
+  }
+
+  const DexFile& dex_;
+  uint32_t object_type_;
+  // The string id of "<clinit>", or NO_INDEX.
+  uint32_t clinit_name_;
+  // Type id -> the class_def defining it, or NO_INDEX.
+  std::vector<uint32_t> type_class_defs_;
+  std::vector<uint32_t> method_code_offs_;
+  std::vector<uint8_t> method_defined_;
+  // Class def -> methods it defines.
+  Csr direct_methods_;
+  Csr virtual_methods_;
+  // Name and proto -> virtual methods defined with them.
+  std::unordered_map<uint64_t, std::vector<uint32_t>> virtual_by_signature_;
+  // Name and proto -> classes named by virtual invokes of them.
+  std::unordered_map<uint64_t, std::vector<uint32_t>> invoked_;
+  // Class def -> its supertypes, set when the class is reached.
+  std::vector<std::vector<uint32_t>> supertypes_;
+  std::vector<uint8_t> reached_types_;
+  std::vector<uint8_t> reached_methods_;
+  // Reached methods whose code is not scanned yet.
+  std::vector<uint32_t> worklist_;
+};
+
+#endif  // DEX_REACHABILITY_H_
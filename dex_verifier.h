@@ -0,0 +1,1218 @@
+#ifndef DEX_VERIFIER_H_
+#define DEX_VERIFIER_H_
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dex.h"
+#include "dex_file.h"
+#include "dex_insns.h"
+#include "profiler.h"
+#include "string_pool.h"
+#include "utils.h"
+
+enum REG_TYPE_TAG {
+  RT_CONFLICT,
+  // The constant 0, usable as an int, a float or null.
+  RT_ZERO,
+  // Any other 32-bit constant, usable as an int or a float.
+  RT_CONST,
+  RT_INTEGER,
+  RT_FLOAT,
+  // Halves of a 64-bit constant, usable as a long or a double.
+  RT_WIDE_CONST_LO,
+  RT_WIDE_CONST_HI,
+  RT_LONG_LO,
+  RT_LONG_HI,
+  RT_DOUBLE_LO,
+  RT_DOUBLE_HI,
+  RT_UNINITIALIZED_THIS,
+  // value is the pc of the new-instance instruction.
+  RT_UNINITIALIZED,
+  // value is the StringHandle of the descriptor.
+  RT_REFERENCE,
+};
+
+struct RegType {
+  uint8_t tag;
+  uint32_t value;
+
+  bool operator==(const RegType& other) const {
+    return tag == other.tag && value == other.value;
+  }
+  bool operator!=(const RegType& other) const {
+    return !(*this == other);
+  }
+};
+
+// Verifies the code_item of one method by a dataflow pass over the types of
+// its registers. A DexVerifier is not shared between threads; verifying
+// methods in parallel uses one verifier per method.
+//
+// As in MethodVerifier, the class hierarchy is not loaded, so an assignment
+// between two class types is always accepted. Register bounds, ins_size against
+// the prototype, invoke arguments against the shorty of the callee, branch and
+// switch targets, payloads, object initialization and catch handlers are
+// checked.
+class DexVerifier {
+ public:
+  DexVerifier(const DexFile& dex, const DexMethod& method)
+      : dex_(dex), method_(method), pc_(0) {
+  }
+
+  bool Verify() {
+    bool is_abstract = (method_.access_flags & (METHOD_ACC_ABSTRACT | METHOD_ACC_NATIVE)) != 0;
+    if (method_.code_off == 0) {
+      return is_abstract ? true : Fail("missing code_item");
+    }
+    if (is_abstract) {
+      return Fail("abstract or native method has a code_item");
+    }
+    if (method_.method_idx >= dex_.method_ids_size()) {
+      return Fail("method_idx %u out of range", method_.method_idx);
+    }
+    return ParseCodeItem() && ScanInstructions() && DecodeTries() && Run();
+  }
+
+  const std::string& error() const {
+    return error_;
+  }
+
+ private:
+  enum {
+    INSN_START = 1,
+    INSN_PAYLOAD = 2,
+  };
+
+  enum Kind {
+    K_INT,
+    K_FLOAT,
+    K_LONG,
+    K_DOUBLE,
+    K_REF,
+  };
+
+  struct TryItem {
+    uint32_t start;
+    uint32_t end;
+    std::vector<uint32_t> handlers;
+  };
+
+  bool Fail(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    char buf[256];
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    error_ = StringPrintf("pc 0x%x: %s", pc_, buf);
+    return false;
+  }
+
+  uint16_t Unit(uint32_t pc) {
+    return GetDexUnit(insns_, pc);
+  }
+
+  uint32_t Unit32(uint32_t pc) {
+    return GetDexUnit32(insns_, pc);
+  }
+
+  bool ParseCodeItem() {
+    const char* end = dex_.data() + dex_.size();
+    if (method_.code_off > dex_.size() || dex_.size() - method_.code_off < 16) {
+      return Fail("code_item out of range");
+    }
+    const char* p = dex_.data() + method_.code_off;
+    uint32_t debug_info_off;
+    Read(p, end, registers_size_);
+    Read(p, end, ins_size_);
+    Read(p, end, outs_size_);
+    Read(p, end, tries_size_);
+    Read(p, end, debug_info_off);
+    Read(p, end, insns_size_);
+    if (insns_size_ == 0) {
+      return Fail("empty code");
+    }
+    if (insns_size_ > (uint64_t)(end - p) / 2) {
+      return Fail("insns_size %u runs past the end of the file", insns_size_);
+    }
+    if (ins_size_ > registers_size_) {
+      return Fail("ins_size %u exceeds registers_size %u", ins_size_, registers_size_);
+    }
+    insns_ = p;
+    tries_ = p + insns_size_ * 2;
+    if (tries_size_ != 0 && (insns_size_ & 1)) {
+      tries_ += 2;
+    }
+    return true;
+  }
+
+  bool ScanInstructions() {
+    insn_flags_.assign(insns_size_, 0);
+    uint32_t pc = 0;
+    while (pc < insns_size_) {
+      pc_ = pc;
+      uint16_t inst = Unit(pc);
+      uint64_t width = GetDexInsnWidth(insns_, insns_size_, pc);
+      if (IsDexPayload(inst)) {
+        insn_flags_[pc] = INSN_PAYLOAD;
+      } else {
+        if (width == 0) {
+          return Fail("unused opcode 0x%02x", inst & 0xff);
+        }
+        insn_flags_[pc] = INSN_START;
+      }
+      if (width == 0 || width > insns_size_ - pc) {
+        return Fail("instruction runs past the end of the code");
+      }
+      pc += width;
+    }
+    pc_ = 0;
+    return true;
+  }
+
+  bool IsInstruction(uint64_t pc) {
+    return pc < insns_size_ && (insn_flags_[pc] & INSN_START);
+  }
+
+  bool DecodeTries() {
+    if (tries_size_ == 0) {
+      return true;
+    }
+    const char* end = dex_.data() + dex_.size();
+    if ((uint64_t)(end - tries_) < tries_size_ * 8u) {
+      return Fail("try_items run past the end of the file");
+    }
+    const char* handlers = tries_ + tries_size_ * 8;
+    const char* p = tries_;
+    for (uint32_t i = 0; i < tries_size_; ++i) {
+      uint32_t start_addr;
+      uint16_t insn_count;
+      uint16_t handler_off;
+      Read(p, end, start_addr);
+      Read(p, end, insn_count);
+      Read(p, end, handler_off);
+      TryItem item;
+      item.start = start_addr;
+      item.end = start_addr + insn_count;
+      if (!IsInstruction(item.start) ||
+          (item.end != insns_size_ && !IsInstruction(item.end)) || item.end > insns_size_) {
+        return Fail("try[%u] range [0x%x-0x%x] does not cover whole instructions", i,
+                    item.start, item.end);
+      }
+      if (handler_off >= end - handlers) {
+        return Fail("try[%u] handler_off 0x%x out of range", i, handler_off);
+      }
+      const char* h = handlers + handler_off;
+      int64_t size = ReadLEB128(h, end);
+      bool has_catch_all = (size <= 0);
+      size = (size < 0) ? -size : size;
+      for (int64_t j = 0; j <= size; ++j) {
+        const char* catch_type;
+        if (j < size) {
+          uint64_t type_idx = ReadULEB128(h, end);
+          if (type_idx >= dex_.type_ids_size()) {
+            return Fail("try[%u] catch type %" PRIu64 " out of range", i, type_idx);
+          }
+          catch_type = dex_.GetType(type_idx);
+        } else if (has_catch_all) {
+          catch_type = "Ljava/lang/Throwable;";
+        } else {
+          break;
+        }
+        uint64_t addr = ReadULEB128(h, end);
+        if (!IsInstruction(addr)) {
+          return Fail("try[%u] handler 0x%" PRIx64 " is not an instruction", i, addr);
+        }
+        RegType type = Reference(catch_type);
+        auto it = catch_types_.find(addr);
+        if (it == catch_types_.end()) {
+          catch_types_[addr] = type;
+        } else if (it->second != type) {
+          it->second = Reference("Ljava/lang/Throwable;");
+        }
+        item.handlers.push_back(addr);
+      }
+      try_items_.push_back(item);
+    }
+    return true;
+  }
+
+  bool Decode(uint32_t pc, DexInsn* insn) {
+    uint32_t width = GetDexFormatWidth(GetDexFormat(Unit(pc) & 0xff));
+    if (!DecodeDexInsn(insns_, pc, width, insn)) {
+      return Fail("invalid argument count %u", insn->a);
+    }
+    return true;
+  }
+
+
+  RegType Type(uint8_t tag, uint32_t value = 0) {
+    RegType type;
+    type.tag = tag;
+    type.value = value;
+    return type;
+  }
+
+  RegType Reference(const char* descriptor) {
+    return Type(RT_REFERENCE, InternString(descriptor));
+  }
+
+  RegType Reference(const std::string& descriptor) {
+    return Type(RT_REFERENCE, InternString(descriptor));
+  }
+
+  static const char* Descriptor(RegType type) {
+    return GetInternedString(type.value);
+  }
+
+  static bool IsWide(const char* descriptor) {
+    return descriptor[0] == 'J' || descriptor[0] == 'D';
+  }
+
+  static bool IsReferenceDescriptor(const char* descriptor) {
+    return descriptor[0] == 'L' || descriptor[0] == '[';
+  }
+
+  Kind DescriptorKind(const char* descriptor) {
+    switch (descriptor[0]) {
+      case 'F':
+        return K_FLOAT;
+      case 'J':
+        return K_LONG;
+      case 'D':
+        return K_DOUBLE;
+      case 'L':
+      case '[':
+        return K_REF;
+      default:
+        return K_INT;
+    }
+  }
+
+  // Class types are assignable to each other, see the class comment.
+  bool IsAssignable(const char* from, const char* to) {
+    if (to[0] == 'L') {
+      if (from[0] == 'L') {
+        return true;
+      }
+      return strcmp(to, "Ljava/lang/Object;") == 0 || strcmp(to, "Ljava/lang/Cloneable;") == 0 ||
+             strcmp(to, "Ljava/io/Serializable;") == 0;
+    }
+    if (from[0] != '[') {
+      return false;
+    }
+    if (IsReferenceDescriptor(to + 1) && IsReferenceDescriptor(from + 1)) {
+      return IsAssignable(from + 1, to + 1);
+    }
+    return strcmp(from + 1, to + 1) == 0;
+  }
+
+  bool CheckReg(uint32_t reg, uint32_t count = 1) {
+    if ((uint64_t)reg + count > registers_size_) {
+      return Fail("register v%u out of range, registers_size is %u", reg + count - 1,
+                  registers_size_);
+    }
+    return true;
+  }
+
+  bool Use(const std::vector<RegType>& line, uint32_t reg, Kind kind) {
+    if (!CheckReg(reg, (kind == K_LONG || kind == K_DOUBLE) ? 2 : 1)) {
+      return false;
+    }
+    uint8_t tag = line[reg].tag;
+    bool ok;
+    if (kind == K_INT) {
+      ok = (tag == RT_ZERO || tag == RT_CONST || tag == RT_INTEGER);
+    } else if (kind == K_FLOAT) {
+      ok = (tag == RT_ZERO || tag == RT_CONST || tag == RT_FLOAT);
+    } else if (kind == K_REF) {
+      ok = (tag == RT_ZERO || tag == RT_REFERENCE);
+    } else {
+      uint8_t lo = (kind == K_LONG) ? RT_LONG_LO : RT_DOUBLE_LO;
+      uint8_t hi_tag = line[reg + 1].tag;
+      ok = (tag == lo && hi_tag == lo + 1) || (tag == RT_WIDE_CONST_LO && hi_tag == RT_WIDE_CONST_HI);
+    }
+    if (!ok) {
+      static const char* kind_names[] = {"an int", "a float", "a long", "a double", "a reference"};
+      return Fail("v%u is not %s", reg, kind_names[kind]);
+    }
+    return true;
+  }
+
+  bool UseDescriptor(const std::vector<RegType>& line, uint32_t reg, const char* descriptor) {
+    Kind kind = DescriptorKind(descriptor);
+    if (!Use(line, reg, kind)) {
+      return false;
+    }
+    if (kind == K_REF && line[reg].tag == RT_REFERENCE &&
+        !IsAssignable(Descriptor(line[reg]), descriptor)) {
+      return Fail("v%u of type %s is not assignable to %s", reg, Descriptor(line[reg]),
+                  descriptor);
+    }
+    return true;
+  }
+
+  // Overwriting either half of a wide value invalidates the other half.
+  void Kill(std::vector<RegType>& line, uint32_t reg) {
+    uint8_t tag = line[reg].tag;
+    if ((tag == RT_WIDE_CONST_LO || tag == RT_LONG_LO || tag == RT_DOUBLE_LO) &&
+        reg + 1 < registers_size_) {
+      line[reg + 1] = Type(RT_CONFLICT);
+    } else if ((tag == RT_WIDE_CONST_HI || tag == RT_LONG_HI || tag == RT_DOUBLE_HI) && reg > 0) {
+      line[reg - 1] = Type(RT_CONFLICT);
+    }
+  }
+
+  void Set(std::vector<RegType>& line, uint32_t reg, RegType type) {
+    Kill(line, reg);
+    line[reg] = type;
+  }
+
+  void SetWide(std::vector<RegType>& line, uint32_t reg, RegType lo, RegType hi) {
+    Kill(line, reg);
+    Kill(line, reg + 1);
+    line[reg] = lo;
+    line[reg + 1] = hi;
+  }
+
+  bool Def(std::vector<RegType>& line, uint32_t reg, Kind kind) {
+    if (kind == K_LONG || kind == K_DOUBLE) {
+      if (!CheckReg(reg, 2)) {
+        return false;
+      }
+      uint8_t lo = (kind == K_LONG) ? RT_LONG_LO : RT_DOUBLE_LO;
+      SetWide(line, reg, Type(lo), Type(lo + 1));
+      return true;
+    }
+    if (!CheckReg(reg)) {
+      return false;
+    }
+    Set(line, reg, Type(kind == K_INT ? RT_INTEGER : RT_FLOAT));
+    return true;
+  }
+
+  bool DefDescriptor(std::vector<RegType>& line, uint32_t reg, const char* descriptor) {
+    if (IsReferenceDescriptor(descriptor)) {
+      if (!CheckReg(reg)) {
+        return false;
+      }
+      Set(line, reg, Reference(descriptor));
+      return true;
+    }
+    return Def(line, reg, DescriptorKind(descriptor));
+  }
+
+  bool InitialRegisters(std::vector<RegType>* line) {
+    const method_id_item& id = dex_.method_id(method_.method_idx);
+    if (id.proto_idx >= dex_.proto_ids_size()) {
+      return Fail("proto_idx %u out of range", id.proto_idx);
+    }
+    class_descriptor_ = dex_.GetType(id.class_idx);
+    is_constructor_ = strcmp(dex_.GetString(id.name_idx), "<init>") == 0;
+    return_type_ = dex_.GetType(dex_.proto_id(id.proto_idx).return_type_idx);
+    line->assign(registers_size_ + 2, Type(RT_CONFLICT));
+    uint32_t reg = registers_size_ - ins_size_;
+    if ((method_.access_flags & METHOD_ACC_STATIC) == 0) {
+      if (reg >= registers_size_) {
+        return Fail("ins_size %u does not match the prototype", ins_size_);
+      }
+      if (is_constructor_ && class_descriptor_ != "Ljava/lang/Object;") {
+        (*line)[reg++] = Type(RT_UNINITIALIZED_THIS);
+      } else {
+        (*line)[reg++] = Reference(class_descriptor_);
+      }
+    }
+    std::vector<const char*> params;
+    dex_.GetParameterTypes(id.proto_idx, &params);
+    for (const char* param : params) {
+      uint32_t width = IsWide(param) ? 2 : 1;
+      if (reg + width > registers_size_) {
+        return Fail("ins_size %u does not match the prototype", ins_size_);
+      }
+      DefDescriptor(*line, reg, param);
+      reg += width;
+    }
+    if (reg != registers_size_) {
+      return Fail("ins_size %u does not match the prototype", ins_size_);
+    }
+    return true;
+  }
+
+  std::string MergeReferenceName(const char* a, const char* b) {
+    if (a[0] == '[' && b[0] == '[' && IsReferenceDescriptor(a + 1) &&
+        IsReferenceDescriptor(b + 1)) {
+      return "[" + MergeReferenceName(a + 1, b + 1);
+    }
+    if (strcmp(a, b) == 0) {
+      return a;
+    }
+    return "Ljava/lang/Object;";
+  }
+
+  RegType MergeType(RegType a, RegType b) {
+    if (a == b) {
+      return a;
+    }
+    if (a.tag > b.tag) {
+      std::swap(a, b);
+    }
+    switch (a.tag) {
+      case RT_ZERO:
+        if (b.tag == RT_CONST || b.tag == RT_INTEGER || b.tag == RT_FLOAT || b.tag == RT_REFERENCE) {
+          return b;
+        }
+        break;
+      case RT_CONST:
+        if (b.tag == RT_INTEGER || b.tag == RT_FLOAT) {
+          return b;
+        }
+        break;
+      case RT_WIDE_CONST_LO:
+        if (b.tag == RT_LONG_LO || b.tag == RT_DOUBLE_LO) {
+          return b;
+        }
+        break;
+      case RT_WIDE_CONST_HI:
+        if (b.tag == RT_LONG_HI || b.tag == RT_DOUBLE_HI) {
+          return b;
+        }
+        break;
+      case RT_REFERENCE:
+        return Reference(MergeReferenceName(Descriptor(a), Descriptor(b)));
+    }
+    return Type(RT_CONFLICT);
+  }
+
+  bool MergeInto(uint32_t target, const std::vector<RegType>& line) {
+    if (!IsInstruction(target)) {
+      return Fail("branch target 0x%x is not an instruction", target);
+    }
+    std::vector<RegType>& old = lines_[target];
+    bool changed = false;
+    if (old.empty()) {
+      old = line;
+      changed = true;
+    } else {
+      for (size_t i = 0; i < old.size(); ++i) {
+        RegType merged = MergeType(old[i], line[i]);
+        if (merged != old[i]) {
+          old[i] = merged;
+          changed = true;
+        }
+      }
+    }
+    if (changed && !in_worklist_[target]) {
+      in_worklist_[target] = true;
+      worklist_.push_back(target);
+    }
+    return true;
+  }
+
+  bool Branch(uint32_t pc, int64_t offset, const std::vector<RegType>& line) {
+    int64_t target = (int64_t)pc + offset;
+    if (target < 0 || target >= insns_size_) {
+      return Fail("branch target 0x%" PRIx64 " out of range", target);
+    }
+    return MergeInto(target, line);
+  }
+
+  static bool CanThrow(uint8_t op) {
+    return (DEX_OPCODES[op].flags & OPCODE_THROW) != 0;
+  }
+
+  // Checks that pc + offset holds a payload of the given kind.
+  bool CheckPayload(uint32_t pc, int64_t offset, uint16_t ident, uint32_t* payload) {
+    int64_t target = (int64_t)pc + offset;
+    if (target < 0 || target >= insns_size_ || (target & 1) ||
+        !(insn_flags_[target] & INSN_PAYLOAD) || Unit(target) != ident) {
+      return Fail("no payload of type 0x%04x at 0x%" PRIx64, ident, target);
+    }
+    *payload = target;
+    return true;
+  }
+
+  bool Switch(uint32_t pc, const DexInsn& insn, const std::vector<RegType>& line) {
+    if (!Use(line, insn.a, K_INT)) {
+      return false;
+    }
+    uint32_t payload;
+    bool packed = (insn.op == DEX_OP_PACKED_SWITCH);
+    if (!CheckPayload(pc, insn.literal,
+                      packed ? PACKED_SWITCH_PAYLOAD : SPARSE_SWITCH_PAYLOAD, &payload)) {
+      return false;
+    }
+    uint32_t size = Unit(payload + 1);
+    uint32_t targets = packed ? payload + 4 : payload + 2 + size * 2;
+    for (uint32_t i = 0; i < size; ++i) {
+      if (!packed && i > 0 && (int32_t)Unit32(payload + 2 + i * 2) <=
+                              (int32_t)Unit32(payload + i * 2)) {
+        return Fail("sparse-switch keys are not sorted");
+      }
+      if (!Branch(pc, (int32_t)Unit32(targets + i * 2), line)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool FillArrayData(uint32_t pc, const DexInsn& insn, const std::vector<RegType>& line) {
+    uint32_t payload;
+    if (!Use(line, insn.a, K_REF) ||
+        !CheckPayload(pc, insn.literal, FILL_ARRAY_DATA_PAYLOAD, &payload)) {
+      return false;
+    }
+    if (line[insn.a].tag == RT_ZERO) {
+      return true;
+    }
+    const char* array = Descriptor(line[insn.a]);
+    static const char* element_types = "ZBCSIFJD";
+    static const uint16_t element_widths[] = {1, 1, 2, 2, 4, 4, 8, 8};
+    const char* element = (array[0] == '[' && array[1] != '\0' && array[2] == '\0')
+                              ? strchr(element_types, array[1]) : nullptr;
+    if (element == nullptr) {
+      return Fail("fill-array-data on %s", array);
+    }
+    if (Unit(payload + 1) != element_widths[element - element_types]) {
+      return Fail("fill-array-data element width %u does not match %s", Unit(payload + 1),
+                  array);
+    }
+    return true;
+  }
+
+  bool CheckIndex(uint32_t index, uint32_t size, const char* what) {
+    if (index >= size) {
+      return Fail("%s index %u out of range", what, index);
+    }
+    return true;
+  }
+
+  // Element descriptors accepted by each of the seven aget/aput variants.
+  static bool MatchArrayVariant(uint32_t variant, const char* element) {
+    static const char* variant_elements[] = {"IF", "JD", "L[", "Z", "B", "C", "S"};
+    return element[0] != '\0' && strchr(variant_elements[variant], element[0]) != nullptr;
+  }
+
+  bool ArrayAccess(const DexInsn& insn, std::vector<RegType>& line, bool is_put) {
+    uint32_t variant = insn.op - (is_put ? DEX_OP_APUT : DEX_OP_AGET);
+    if (!Use(line, insn.c, K_INT) || !Use(line, insn.b, K_REF)) {
+      return false;
+    }
+    static const Kind variant_kinds[] = {K_INT, K_LONG, K_REF, K_INT, K_INT, K_INT, K_INT};
+    if (line[insn.b].tag == RT_ZERO) {
+      // The access throws, but the value register still has to make sense.
+      if (is_put) {
+        if (variant == 0) {
+          return Use(line, insn.a, K_INT) || Use(line, insn.a, K_FLOAT);
+        }
+        return Use(line, insn.a, variant == 1 ? K_LONG : variant_kinds[variant]);
+      }
+      if (variant == 1) {
+        if (!CheckReg(insn.a, 2)) {
+          return false;
+        }
+        SetWide(line, insn.a, Type(RT_WIDE_CONST_LO), Type(RT_WIDE_CONST_HI));
+      } else if (CheckReg(insn.a)) {
+        Set(line, insn.a, Type(variant == 0 ? RT_CONST : variant == 2 ? RT_ZERO : RT_INTEGER));
+      } else {
+        return false;
+      }
+      return true;
+    }
+    const char* array = Descriptor(line[insn.b]);
+    if (array[0] != '[') {
+      return Fail("v%u of type %s is not an array", insn.b, array);
+    }
+    const char* element = array + 1;
+    if (!MatchArrayVariant(variant, element)) {
+      return Fail("array access of the wrong kind on %s", array);
+    }
+    if (!is_put) {
+      return DefDescriptor(line, insn.a, element);
+    }
+    if (variant == 2) {
+      // The element type is checked at runtime by aput-object.
+      return Use(line, insn.a, K_REF);
+    }
+    return UseDescriptor(line, insn.a, element);
+  }
+
+  bool FieldAccess(const DexInsn& insn, std::vector<RegType>& line, bool is_static,
+                   bool is_put) {
+    uint32_t base = is_static ? (is_put ? DEX_OP_SPUT : DEX_OP_SGET)
+                              : (is_put ? DEX_OP_IPUT : DEX_OP_IGET);
+    uint32_t variant = insn.op - base;
+    uint32_t field_idx = is_static ? insn.b : insn.c;
+    if (!CheckIndex(field_idx, dex_.field_ids_size(), "field")) {
+      return false;
+    }
+    const field_id_item& field = dex_.field_id(field_idx);
+    const char* type = dex_.GetType(field.type_idx);
+    if (!MatchArrayVariant(variant, type)) {
+      return Fail("field access of the wrong kind on a field of type %s", type);
+    }
+    if (!is_static) {
+      const char* owner = dex_.GetType(field.class_idx);
+      if (!CheckReg(insn.b)) {
+        return false;
+      }
+      // A constructor may store its own fields before calling the super
+      // constructor.
+      bool init_store = is_put && line[insn.b].tag == RT_UNINITIALIZED_THIS &&
+                        class_descriptor_ == owner;
+      if (!init_store && !UseDescriptor(line, insn.b, owner)) {
+        return false;
+      }
+    }
+    if (is_put) {
+      return UseDescriptor(line, insn.a, type);
+    }
+    return DefDescriptor(line, insn.a, type);
+  }
+
+  bool Invoke(const DexInsn& insn, std::vector<RegType>& line) {
+    bool is_range = (insn.op >= DEX_OP_INVOKE_VIRTUAL_RANGE);
+    uint8_t kind = is_range ? insn.op - (DEX_OP_INVOKE_VIRTUAL_RANGE - DEX_OP_INVOKE_VIRTUAL)
+                            : insn.op;
+    uint32_t count = insn.a;
+    std::vector<uint32_t> regs(count);
+    for (uint32_t i = 0; i < count; ++i) {
+      regs[i] = is_range ? insn.c + i : insn.args[i];
+    }
+    if (!CheckIndex(insn.b, dex_.method_ids_size(), "method")) {
+      return false;
+    }
+    const method_id_item& callee = dex_.method_id(insn.b);
+    if (callee.proto_idx >= dex_.proto_ids_size()) {
+      return Fail("method %u has proto_idx %u out of range", insn.b, callee.proto_idx);
+    }
+    const char* name = dex_.GetString(callee.name_idx);
+    bool is_init = strcmp(name, "<init>") == 0;
+    if (name[0] == '<' && (!is_init || kind != DEX_OP_INVOKE_DIRECT)) {
+      return Fail("cannot invoke %s this way", name);
+    }
+    std::vector<const char*> params;
+    dex_.GetParameterTypes(callee.proto_idx, &params);
+    bool is_static = (kind == DEX_OP_INVOKE_STATIC);
+    uint32_t expected = is_static ? 0 : 1;
+    for (const char* param : params) {
+      expected += IsWide(param) ? 2 : 1;
+    }
+    if (count != expected) {
+      return Fail("invoke passes %u registers, the prototype needs %u", count, expected);
+    }
+    if (count > outs_size_) {
+      return Fail("invoke passes %u registers, outs_size is %u", count, outs_size_);
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+      if (!CheckReg(regs[i])) {
+        return false;
+      }
+    }
+    uint32_t i = 0;
+    if (!is_static) {
+      const char* owner = dex_.GetType(callee.class_idx);
+      RegType receiver = line[regs[0]];
+      if (is_init && (receiver.tag == RT_UNINITIALIZED_THIS || receiver.tag == RT_UNINITIALIZED)) {
+        RegType initialized;
+        if (receiver.tag == RT_UNINITIALIZED_THIS) {
+          initialized = Reference(class_descriptor_);
+        } else {
+          const char* created = dex_.GetType(Unit(receiver.value + 1));
+          if (strcmp(created, owner) != 0) {
+            return Fail("calling <init> of %s on a new %s", owner, created);
+          }
+          initialized = Reference(created);
+        }
+        for (uint32_t reg = 0; reg < registers_size_; ++reg) {
+          if (line[reg] == receiver) {
+            line[reg] = initialized;
+          }
+        }
+      } else if (is_init) {
+        return Fail("calling <init> on v%u, which is not an uninitialized object", regs[0]);
+      } else if (!UseDescriptor(line, regs[0], owner)) {
+        return false;
+      }
+      i = 1;
+    }
+    for (const char* param : params) {
+      if (IsWide(param) && !is_range && regs[i + 1] != regs[i] + 1) {
+        return Fail("wide argument in v%u and v%u", regs[i], regs[i + 1]);
+      }
+      if (!UseDescriptor(line, regs[i], param)) {
+        return false;
+      }
+      i += IsWide(param) ? 2 : 1;
+    }
+    const char* return_type = dex_.GetType(dex_.proto_id(callee.proto_idx).return_type_idx);
+    SetResult(line, return_type);
+    return true;
+  }
+
+  void SetResult(std::vector<RegType>& line, const char* descriptor) {
+    RegType* result = &line[registers_size_];
+    if (descriptor[0] == 'V') {
+      return;
+    } else if (IsReferenceDescriptor(descriptor)) {
+      result[0] = Reference(descriptor);
+    } else if (IsWide(descriptor)) {
+      result[0] = Type(descriptor[0] == 'J' ? RT_LONG_LO : RT_DOUBLE_LO);
+      result[1] = Type(descriptor[0] == 'J' ? RT_LONG_HI : RT_DOUBLE_HI);
+    } else {
+      result[0] = Type(descriptor[0] == 'F' ? RT_FLOAT : RT_INTEGER);
+    }
+  }
+
+  bool FilledNewArray(const DexInsn& insn, std::vector<RegType>& line) {
+    bool is_range = (insn.op == DEX_OP_FILLED_NEW_ARRAY_RANGE);
+    if (!CheckIndex(insn.b, dex_.type_ids_size(), "type")) {
+      return false;
+    }
+    const char* type = dex_.GetType(insn.b);
+    if (type[0] != '[' || !(type[1] == 'I' || IsReferenceDescriptor(type + 1))) {
+      return Fail("filled-new-array of %s", type);
+    }
+    for (uint32_t i = 0; i < insn.a; ++i) {
+      uint32_t reg = is_range ? insn.c + i : insn.args[i];
+      if (!UseDescriptor(line, reg, type + 1)) {
+        return false;
+      }
+    }
+    SetResult(line, type);
+    return true;
+  }
+
+  bool Return(const DexInsn& insn, const std::vector<RegType>& line) {
+    if (insn.op == DEX_OP_RETURN_VOID) {
+      if (return_type_[0] != 'V') {
+        return Fail("return-void in a method returning %s", return_type_);
+      }
+      if (is_constructor_) {
+        for (uint32_t reg = 0; reg < registers_size_; ++reg) {
+          if (line[reg].tag == RT_UNINITIALIZED_THIS) {
+            return Fail("constructor returns before calling the super constructor");
+          }
+        }
+      }
+      return true;
+    }
+    Kind kind = DescriptorKind(return_type_);
+    bool ok;
+    if (insn.op == DEX_OP_RETURN) {
+      ok = (kind == K_INT || kind == K_FLOAT) && return_type_[0] != 'V';
+    } else if (insn.op == DEX_OP_RETURN_WIDE) {
+      ok = (kind == K_LONG || kind == K_DOUBLE);
+    } else {
+      ok = (kind == K_REF);
+    }
+    if (!ok) {
+      return Fail("wrong return instruction for %s", return_type_);
+    }
+    return UseDescriptor(line, insn.a, return_type_);
+  }
+
+  static Kind UnaryKind(uint8_t op, bool is_dest) {
+    static const Kind kinds[][2] = {
+      {K_INT, K_INT}, {K_INT, K_INT}, {K_LONG, K_LONG}, {K_LONG, K_LONG},
+      {K_FLOAT, K_FLOAT}, {K_DOUBLE, K_DOUBLE}, {K_INT, K_LONG}, {K_INT, K_FLOAT},
+      {K_INT, K_DOUBLE}, {K_LONG, K_INT}, {K_LONG, K_FLOAT}, {K_LONG, K_DOUBLE},
+      {K_FLOAT, K_INT}, {K_FLOAT, K_LONG}, {K_FLOAT, K_DOUBLE}, {K_DOUBLE, K_INT},
+      {K_DOUBLE, K_LONG}, {K_DOUBLE, K_FLOAT}, {K_INT, K_INT}, {K_INT, K_INT},
+      {K_INT, K_INT},
+    };
+    return kinds[op - DEX_OP_NEG_INT][is_dest ? 1 : 0];
+  }
+
+  // Kind of the result and first operand of binop and binop/2addr.
+  static Kind BinaryKind(uint8_t op) {
+    if (op >= DEX_OP_ADD_INT_2ADDR) {
+      op -= DEX_OP_ADD_INT_2ADDR - DEX_OP_ADD_INT;
+    }
+    if (op <= DEX_OP_USHR_INT) {
+      return K_INT;
+    } else if (op <= DEX_OP_USHR_LONG) {
+      return K_LONG;
+    } else if (op <= DEX_OP_REM_FLOAT) {
+      return K_FLOAT;
+    }
+    return K_DOUBLE;
+  }
+
+  static bool IsLongShift(uint8_t op) {
+    return (op >= DEX_OP_SHL_LONG && op <= DEX_OP_USHR_LONG) ||
+           (op >= DEX_OP_SHL_LONG_2ADDR && op <= DEX_OP_USHR_LONG_2ADDR);
+  }
+
+  bool Execute(uint32_t pc, std::vector<RegType>& line) {
+    pc_ = pc;
+    SetProfilePc(pc);
+    DexInsn insn;
+    if (!Decode(pc, &insn)) {
+      return false;
+    }
+    uint8_t op = insn.op;
+    RegType result[2] = {line[registers_size_], line[registers_size_ + 1]};
+    line[registers_size_] = line[registers_size_ + 1] = Type(RT_CONFLICT);
+    if (CanThrow(op)) {
+      for (const TryItem& item : try_items_) {
+        if (pc >= item.start && pc < item.end) {
+          for (uint32_t handler : item.handlers) {
+            if (!MergeInto(handler, line)) {
+              return false;
+            }
+          }
+        }
+      }
+    }
+    bool falls_through = true;
+    if (op == DEX_OP_NOP) {
+    } else if (op >= DEX_OP_MOVE && op <= DEX_OP_MOVE_OBJECT_16) {
+      uint32_t width = (op >= DEX_OP_MOVE_WIDE && op <= DEX_OP_MOVE_WIDE_16) ? 2 : 1;
+      if (!CheckReg(insn.a, width) || !CheckReg(insn.b, width)) {
+        return false;
+      }
+      RegType lo = line[insn.b];
+      if (width == 2) {
+        RegType hi = line[insn.b + 1];
+        bool ok = (lo.tag == RT_WIDE_CONST_LO || lo.tag == RT_LONG_LO || lo.tag == RT_DOUBLE_LO) &&
+                  hi.tag == lo.tag + 1;
+        if (!ok) {
+          return Fail("v%u is not a wide value", insn.b);
+        }
+        SetWide(line, insn.a, lo, hi);
+      } else {
+        bool is_object = (op >= DEX_OP_MOVE_OBJECT);
+        bool ok = is_object ? (lo.tag == RT_ZERO || lo.tag >= RT_UNINITIALIZED_THIS)
+                            : (lo.tag >= RT_ZERO && lo.tag <= RT_FLOAT);
+        if (!ok) {
+          return Fail("v%u is not %s", insn.b, is_object ? "a reference" : "a 32-bit value");
+        }
+        Set(line, insn.a, lo);
+      }
+    } else if (op >= DEX_OP_MOVE_RESULT && op <= DEX_OP_MOVE_RESULT_OBJECT) {
+      bool ok;
+      if (op == DEX_OP_MOVE_RESULT) {
+        ok = (result[0].tag == RT_INTEGER || result[0].tag == RT_FLOAT);
+      } else if (op == DEX_OP_MOVE_RESULT_WIDE) {
+        ok = (result[0].tag == RT_LONG_LO || result[0].tag == RT_DOUBLE_LO);
+      } else {
+        ok = (result[0].tag == RT_REFERENCE);
+      }
+      if (!ok) {
+        return Fail("move-result does not match the preceding instruction");
+      }
+      if (op == DEX_OP_MOVE_RESULT_WIDE) {
+        if (!CheckReg(insn.a, 2)) {
+          return false;
+        }
+        SetWide(line, insn.a, result[0], result[1]);
+      } else if (CheckReg(insn.a)) {
+        Set(line, insn.a, result[0]);
+      } else {
+        return false;
+      }
+    } else if (op == DEX_OP_MOVE_EXCEPTION) {
+      auto it = catch_types_.find(pc);
+      if (it == catch_types_.end()) {
+        return Fail("move-exception outside of a catch handler");
+      }
+      if (!CheckReg(insn.a)) {
+        return false;
+      }
+      Set(line, insn.a, it->second);
+    } else if (op >= DEX_OP_RETURN_VOID && op <= DEX_OP_RETURN_OBJECT) {
+      if (!Return(insn, line)) {
+        return false;
+      }
+      falls_through = false;
+    } else if (op >= DEX_OP_CONST_4 && op <= DEX_OP_CONST_HIGH16) {
+      if (!CheckReg(insn.a)) {
+        return false;
+      }
+      Set(line, insn.a, Type(insn.literal == 0 ? RT_ZERO : RT_CONST));
+    } else if (op >= DEX_OP_CONST_WIDE_16 && op <= DEX_OP_CONST_WIDE_HIGH16) {
+      if (!CheckReg(insn.a, 2)) {
+        return false;
+      }
+      SetWide(line, insn.a, Type(RT_WIDE_CONST_LO), Type(RT_WIDE_CONST_HI));
+    } else if (op == DEX_OP_CONST_STRING || op == DEX_OP_CONST_STRING_JUMBO) {
+      if (!CheckIndex(insn.b, dex_.string_ids_size(), "string") || !CheckReg(insn.a)) {
+        return false;
+      }
+      Set(line, insn.a, Reference("Ljava/lang/String;"));
+    } else if (op == DEX_OP_CONST_CLASS) {
+      if (!CheckIndex(insn.b, dex_.type_ids_size(), "type") || !CheckReg(insn.a)) {
+        return false;
+      }
+      Set(line, insn.a, Reference("Ljava/lang/Class;"));
+    } else if (op == DEX_OP_MONITOR_ENTER || op == DEX_OP_MONITOR_EXIT) {
+      if (!Use(line, insn.a, K_REF)) {
+        return false;
+      }
+    } else if (op == DEX_OP_CHECK_CAST || op == DEX_OP_INSTANCE_OF) {
+      uint32_t type_idx = (op == DEX_OP_CHECK_CAST) ? insn.b : insn.c;
+      uint32_t object = (op == DEX_OP_CHECK_CAST) ? insn.a : insn.b;
+      if (!CheckIndex(type_idx, dex_.type_ids_size(), "type") || !Use(line, object, K_REF)) {
+        return false;
+      }
+      const char* type = dex_.GetType(type_idx);
+      if (!IsReferenceDescriptor(type)) {
+        return Fail("%s of primitive type %s", op == DEX_OP_CHECK_CAST ? "check-cast" : "instance-of",
+                    type);
+      }
+      if (op == DEX_OP_CHECK_CAST) {
+        Set(line, insn.a, Reference(type));
+      } else if (!Def(line, insn.a, K_INT)) {
+        return false;
+      }
+    } else if (op == DEX_OP_ARRAY_LENGTH) {
+      if (!Use(line, insn.b, K_REF)) {
+        return false;
+      }
+      if (line[insn.b].tag == RT_REFERENCE && Descriptor(line[insn.b])[0] != '[') {
+        return Fail("array-length on %s", Descriptor(line[insn.b]));
+      }
+      if (!Def(line, insn.a, K_INT)) {
+        return false;
+      }
+    } else if (op == DEX_OP_NEW_INSTANCE) {
+      if (!CheckIndex(insn.b, dex_.type_ids_size(), "type") || !CheckReg(insn.a)) {
+        return false;
+      }
+      const char* type = dex_.GetType(insn.b);
+      if (type[0] != 'L') {
+        return Fail("new-instance of %s", type);
+      }
+      // An object left over from an earlier pass through this instruction is
+      // no longer usable.
+      RegType created = Type(RT_UNINITIALIZED, pc);
+      for (uint32_t reg = 0; reg < registers_size_; ++reg) {
+        if (line[reg] == created) {
+          line[reg] = Type(RT_CONFLICT);
+        }
+      }
+      Set(line, insn.a, created);
+    } else if (op == DEX_OP_NEW_ARRAY) {
+      if (!CheckIndex(insn.c, dex_.type_ids_size(), "type") || !Use(line, insn.b, K_INT)) {
+        return false;
+      }
+      const char* type = dex_.GetType(insn.c);
+      if (type[0] != '[') {
+        return Fail("new-array of %s", type);
+      }
+      if (!DefDescriptor(line, insn.a, type)) {
+        return false;
+      }
+    } else if (op == DEX_OP_FILLED_NEW_ARRAY || op == DEX_OP_FILLED_NEW_ARRAY_RANGE) {
+      if (!FilledNewArray(insn, line)) {
+        return false;
+      }
+    } else if (op == DEX_OP_FILL_ARRAY_DATA) {
+      if (!FillArrayData(pc, insn, line)) {
+        return false;
+      }
+    } else if (op == DEX_OP_THROW) {
+      if (!UseDescriptor(line, insn.a, "Ljava/lang/Throwable;")) {
+        return false;
+      }
+      falls_through = false;
+    } else if (op >= DEX_OP_GOTO && op <= DEX_OP_GOTO_32) {
+      if (insn.literal == 0 && op != DEX_OP_GOTO_32) {
+        return Fail("branch offset of zero");
+      }
+      if (!Branch(pc, insn.literal, line)) {
+        return false;
+      }
+      falls_through = false;
+    } else if (op == DEX_OP_PACKED_SWITCH || op == DEX_OP_SPARSE_SWITCH) {
+      if (!Switch(pc, insn, line)) {
+        return false;
+      }
+    } else if (op >= DEX_OP_CMPL_FLOAT && op <= DEX_OP_CMP_LONG) {
+      Kind kind = (op <= DEX_OP_CMPG_FLOAT) ? K_FLOAT : (op <= DEX_OP_CMPG_DOUBLE) ? K_DOUBLE : K_LONG;
+      if (!Use(line, insn.b, kind) || !Use(line, insn.c, kind) || !Def(line, insn.a, K_INT)) {
+        return false;
+      }
+    } else if (op >= DEX_OP_IF_EQ && op <= DEX_OP_IF_LEZ) {
+      bool is_zero = (op >= DEX_OP_IF_EQZ);
+      bool is_equality = (op == DEX_OP_IF_EQ || op == DEX_OP_IF_NE || op == DEX_OP_IF_EQZ ||
+                          op == DEX_OP_IF_NEZ);
+      if (insn.literal == 0) {
+        return Fail("branch offset of zero");
+      }
+      if (!CheckReg(insn.a) || (!is_zero && !CheckReg(insn.b))) {
+        return false;
+      }
+      uint8_t a = line[insn.a].tag;
+      uint8_t b = is_zero ? RT_ZERO : line[insn.b].tag;
+      bool ints = (a >= RT_ZERO && a <= RT_INTEGER) && (b >= RT_ZERO && b <= RT_INTEGER);
+      bool refs = (a == RT_ZERO || a == RT_REFERENCE) && (b == RT_ZERO || b == RT_REFERENCE);
+      if (!ints && !(is_equality && refs)) {
+        return Fail("if-test on incompatible registers");
+      }
+      if (!Branch(pc, insn.literal, line)) {
+        return false;
+      }
+    } else if (op >= DEX_OP_AGET && op <= DEX_OP_APUT_SHORT) {
+      if (!ArrayAccess(insn, line, op >= DEX_OP_APUT)) {
+        return false;
+      }
+    } else if (op >= DEX_OP_IGET && op <= DEX_OP_SPUT_SHORT) {
+      bool is_static = (op >= DEX_OP_SGET);
+      bool is_put = is_static ? (op >= DEX_OP_SPUT) : (op >= DEX_OP_IPUT);
+      if (!FieldAccess(insn, line, is_static, is_put)) {
+        return false;
+      }
+    } else if (op >= DEX_OP_INVOKE_VIRTUAL && op <= DEX_OP_INVOKE_INTERFACE_RANGE) {
+      if (!Invoke(insn, line)) {
+        return false;
+      }
+    } else if (op >= DEX_OP_NEG_INT && op <= DEX_OP_INT_TO_SHORT) {
+      if (!Use(line, insn.b, UnaryKind(op, false)) || !Def(line, insn.a, UnaryKind(op, true))) {
+        return false;
+      }
+    } else if (op >= DEX_OP_ADD_INT && op <= DEX_OP_REM_DOUBLE) {
+      Kind kind = BinaryKind(op);
+      if (!Use(line, insn.b, kind) || !Use(line, insn.c, IsLongShift(op) ? K_INT : kind) ||
+          !Def(line, insn.a, kind)) {
+        return false;
+      }
+    } else if (op >= DEX_OP_ADD_INT_2ADDR && op <= DEX_OP_REM_DOUBLE_2ADDR) {
+      Kind kind = BinaryKind(op);
+      if (!Use(line, insn.a, kind) || !Use(line, insn.b, IsLongShift(op) ? K_INT : kind) ||
+          !Def(line, insn.a, kind)) {
+        return false;
+      }
+    } else if (op >= DEX_OP_ADD_INT_LIT16 && op <= DEX_OP_USHR_INT_LIT8) {
+      if (!Use(line, insn.b, K_INT) || !Def(line, insn.a, K_INT)) {
+        return false;
+      }
+    } else {
+      return Fail("unused opcode 0x%02x", op);
+    }
+    if (falls_through) {
+      uint32_t next = pc + insn.width;
+      if (next >= insns_size_) {
+        return Fail("falling off the end of the code");
+      }
+      if (!IsInstruction(next)) {
+        return Fail("falling into a payload");
+      }
+      return MergeInto(next, line);
+    }
+    return true;
+  }
+
+  bool Run() {
+    std::vector<RegType> line;
+    if (!InitialRegisters(&line)) {
+      return false;
+    }
+    lines_.assign(insns_size_, std::vector<RegType>());
+    in_worklist_.assign(insns_size_, false);
+    if (!MergeInto(0, line)) {
+      return false;
+    }
+    while (!worklist_.empty()) {
+      uint32_t pc = worklist_.back();
+      worklist_.pop_back();
+      in_worklist_[pc] = false;
+      line = lines_[pc];
+      if (!Execute(pc, line)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const DexFile& dex_;
+  const DexMethod& method_;
+  uint32_t pc_;
+  std::string error_;
+
+  uint16_t registers_size_;
+  uint16_t ins_size_;
+  uint16_t outs_size_;
+  uint16_t tries_size_;
+  uint32_t insns_size_;
+  const char* insns_;
+  const char* tries_;
+
+  std::string class_descriptor_;
+  const char* return_type_;
+  bool is_constructor_;
+
+  std::vector<uint8_t> insn_flags_;
+  std::vector<TryItem> try_items_;
+  // Handler pc -> type of the caught exception.
+  std::unordered_map<uint32_t, RegType> catch_types_;
+
+  // Register types before each instruction; the two registers past
+  // registers_size_ hold the result of the previous invoke or
+  // filled-new-array.
+  std::vector<std::vector<RegType>> lines_;
+  std::vector<uint32_t> worklist_;
+  std::vector<bool> in_worklist_;
+};
+
+// A verified-methods file remembers which methods of one dex file passed
+// verification, so that a later run only verifies the others. It holds
+// DEX_VERIFIED_MAGIC, the signature of the dex file, method_ids_size and one
+// bit per method id.
+static const char DEX_VERIFIED_MAGIC[8] = {'d', 'e', 'x', 'v', 'r', 'f', 'y', '\0'};
+
+// Leaves verified untouched if the file is missing or belongs to another dex
+// file.
+static void LoadVerifiedMethods(const char* filename, const DexFile& dex,
+                                std::vector<uint8_t>* verified) {
+  FILE* fp = fopen(filename, "rb");
+  if (fp == nullptr) {
+    return;
+  }
+  char header[32];
+  uint32_t method_ids_size;
+  std::vector<uint8_t> bits((dex.method_ids_size() + 7) / 8);
+  if (fread(header, sizeof(header), 1, fp) == 1 &&
+      memcmp(header, DEX_VERIFIED_MAGIC, 8) == 0 &&
+      memcmp(header + 8, dex.signature(), 20) == 0 &&
+      (memcpy(&method_ids_size, header + 28, 4), method_ids_size == dex.method_ids_size()) &&
+      (bits.empty() || fread(bits.data(), bits.size(), 1, fp) == 1)) {
+    for (uint32_t i = 0; i < method_ids_size; ++i) {
+      (*verified)[i] = (bits[i / 8] >> (i % 8)) & 1;
+    }
+  }
+  fclose(fp);
+}
+
+static bool SaveVerifiedMethods(const char* filename, const DexFile& dex,
+                                const std::vector<uint8_t>& verified) {
+  FILE* fp = fopen(filename, "wb");
+  if (fp == nullptr) {
+    fprintf(stderr, "failed to open %s\n", filename);
+    return false;
+  }
+  uint32_t method_ids_size = dex.method_ids_size();
+  std::vector<uint8_t> bits((method_ids_size + 7) / 8);
+  for (uint32_t i = 0; i < method_ids_size; ++i) {
+    if (verified[i]) {
+      bits[i / 8] |= 1 << (i % 8);
+    }
+  }
+  bool ok = fwrite(DEX_VERIFIED_MAGIC, 8, 1, fp) == 1 &&
+            fwrite(dex.signature(), 20, 1, fp) == 1 &&
+            fwrite(&method_ids_size, 4, 1, fp) == 1 &&
+            (bits.empty() || fwrite(bits.data(), bits.size(), 1, fp) == 1);
+  if (fclose(fp) != 0 || !ok) {
+    fprintf(stderr, "failed to write %s\n", filename);
+    return false;
+  }
+  return true;
+}
+
+#endif  // DEX_VERIFIER_H_
@@ -0,0 +1,829 @@
+#ifndef DEX_WRITER_H_
+#define DEX_WRITER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "dex.h"
+#include "dex_checksum.h"
+#include "dex_file.h"
+#include "dex_model.h"
+#include "mutf8.h"
+#include "utils.h"
+
+// Lays out a DexModel as a dex file. The id tables are sorted and equal ids
+// merged, as the format requires; so are equal type lists, annotations and
+// static values. Data items of one kind are written in class_def order, so
+// the code and class data of a class end up next to each other.
+class DexWriter {
+ public:
+  explicit DexWriter(const DexModel& model) : model_(model) {
+  }
+
+  // Returns false with error set if the model can't be written, such as for
+  // too many ids or code that doesn't decode.
+  bool Write(std::string* out, std::string* error) {
+    out_.clear();
+    sections_.clear();
+    if (!SortIds(error) || !SortClasses(error)) {
+      return false;
+    }
+    uint32_t string_ids_off = DEX_HEADER_SIZE;
+    uint32_t type_ids_off = string_ids_off + strings_.size() * sizeof(string_id_item);
+    uint32_t proto_ids_off = type_ids_off + types_.size() * sizeof(type_id_item);
+    uint32_t field_ids_off = proto_ids_off + protos_.size() * sizeof(proto_id_item);
+    uint32_t method_ids_off = field_ids_off + fields_.size() * sizeof(field_id_item);
+    uint32_t class_defs_off = method_ids_off + methods_.size() * sizeof(method_id_item);
+    uint32_t data_off = class_defs_off + classes_.size() * sizeof(class_def_item);
+    out_.assign(data_off, '\0');
+
+    std::vector<uint32_t> code_offs;
+    std::vector<uint32_t> type_list_offs;
+    std::vector<uint32_t> string_data_offs;
+    std::vector<uint32_t> annotations_offs;
+    std::vector<uint32_t> static_values_offs;
+    std::vector<uint32_t> class_data_offs;
+    if (!WriteCodeItems(&code_offs, error)) {
+      return false;
+    }
+    WriteTypeLists(&type_list_offs);
+    WriteStringData(&string_data_offs);
+    if (!WriteAnnotations(&annotations_offs, error) ||
+        !WriteStaticValues(&static_values_offs, error) ||
+        !WriteClassData(code_offs, &class_data_offs, error)) {
+      return false;
+    }
+    uint32_t map_off = WriteMapList();
+
+    // The id tables.
+    for (uint32_t i = 0; i < strings_.size(); ++i) {
+      PutAt(string_ids_off + i * sizeof(string_id_item), string_data_offs[i]);
+    }
+    for (uint32_t i = 0; i < types_.size(); ++i) {
+      PutAt(type_ids_off + i * sizeof(type_id_item), map_.strings[model_.types[types_[i]]]);
+    }
+    for (uint32_t i = 0; i < protos_.size(); ++i) {
+      const DexModelProto& proto = model_.protos[protos_[i]];
+      proto_id_item item;
+      item.shorty_idx = map_.strings[proto.shorty_idx];
+      item.return_type_idx = map_.types[proto.return_type_idx];
+      item.parameters_off = type_list_offs[i];
+      PutAt(proto_ids_off + i * sizeof(proto_id_item), item);
+    }
+    for (uint32_t i = 0; i < fields_.size(); ++i) {
+      const DexModelField& field = model_.fields[fields_[i]];
+      field_id_item item;
+      item.class_idx = map_.types[field.class_idx];
+      item.type_idx = map_.types[field.type_idx];
+      item.name_idx = map_.strings[field.name_idx];
+      PutAt(field_ids_off + i * sizeof(field_id_item), item);
+    }
+    for (uint32_t i = 0; i < methods_.size(); ++i) {
+      const DexModelMethod& method = model_.methods[methods_[i]];
+      method_id_item item;
+      item.class_idx = map_.types[method.class_idx];
+      item.proto_idx = map_.protos[method.proto_idx];
+      item.name_idx = map_.strings[method.name_idx];
+      PutAt(method_ids_off + i * sizeof(method_id_item), item);
+    }
+    for (uint32_t i = 0; i < classes_.size(); ++i) {
+      const DexModelClass& cls = model_.classes[classes_[i]];
+      class_def_item item;
+      item.class_idx = map_.types[cls.class_idx];
+      item.access_flags = cls.access_flags;
+      DexIndexMap::MapIn(map_.types, cls.superclass_idx, &item.superclass_idx);
+      item.interfaces_off = type_list_offs[protos_.size() + i];
+      DexIndexMap::MapIn(map_.strings, cls.source_file_idx, &item.source_file_idx);
+      item.annotations_off = annotations_offs[i];
+      item.class_data_off = class_data_offs[i];
+      item.static_values_off = static_values_offs[i];
+      PutAt(class_defs_off + i * sizeof(class_def_item), item);
+    }
+
+    // The header, then the signature and checksum over everything after them.
+    memcpy(&out_[0], "dex\n", 4);
+    memcpy(&out_[4], model_.version.c_str(), 3);
+    PutAt(32, (uint32_t)out_.size());
+    PutAt(36, DEX_HEADER_SIZE);
+    PutAt(40, (uint32_t)0x12345678);
+    PutAt(52, map_off);
+    uint32_t tables[][2] = {
+        {(uint32_t)strings_.size(), string_ids_off}, {(uint32_t)types_.size(), type_ids_off},
+        {(uint32_t)protos_.size(), proto_ids_off},   {(uint32_t)fields_.size(), field_ids_off},
+        {(uint32_t)methods_.size(), method_ids_off}, {(uint32_t)classes_.size(), class_defs_off},
+    };
+    for (int i = 0; i < 6; ++i) {
+      PutAt(56 + i * 8, tables[i][0]);
+      PutAt(60 + i * 8, tables[i][0] == 0 ? 0 : tables[i][1]);
+    }
+    PutAt(104, (uint32_t)(out_.size() - data_off));
+    PutAt(108, data_off);
+    Sha1(out_.data() + 32, out_.size() - 32, (uint8_t*)&out_[12]);
+    PutAt(8, Adler32(out_.data() + 12, out_.size() - 12));
+    out->swap(out_);
+    return true;
+  }
+
+  bool WriteFile(const char* path, std::string* error) {
+    std::string data;
+    if (!Write(&data, error)) {
+      return false;
+    }
+    FILE* fp = fopen(path, "wb");
+    if (fp == nullptr) {
+      *error = StringPrintf("failed to open %s", path);
+      return false;
+    }
+    bool ok = fwrite(data.data(), data.size(), 1, fp) == 1;
+    if (fclose(fp) != 0 || !ok) {
+      *error = StringPrintf("failed to write %s", path);
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  struct Section {
+    uint16_t type;
+    uint32_t size;
+    uint32_t offset;
+  };
+
+  // Sorts 0 .. size - 1 by less and merges equal neighbours. order gets the
+  // first model index of each new index, and map the new index of each
+  // model index.
+  template <typename Less>
+  static void SortUnique(uint32_t size, Less less, std::vector<uint32_t>* order,
+                         std::vector<uint32_t>* map) {
+    std::vector<uint32_t> sorted(size);
+    std::iota(sorted.begin(), sorted.end(), 0);
+    std::stable_sort(sorted.begin(), sorted.end(), less);
+    order->clear();
+    map->assign(size, 0);
+    for (uint32_t idx : sorted) {
+      if (order->empty() || less(order->back(), idx)) {
+        order->push_back(idx);
+      }
+      (*map)[idx] = order->size() - 1;
+    }
+  }
+
+  bool SortIds(std::string* error) {
+    for (const std::string& s : model_.strings) {
+      size_t utf16_length;
+      if (!ValidateMutf8(s.data(), s.size(), &utf16_length)) {
+        *error = StringPrintf("string \"%s\" is not modified UTF-8", s.c_str());
+        return false;
+      }
+    }
+    const DexModel& m = model_;
+    SortUnique(m.strings.size(), [&](uint32_t a, uint32_t b) {
+      return CompareMutf8(m.strings[a], m.strings[b]) < 0;
+    }, &strings_, &map_.strings);
+
+    for (uint32_t descriptor_idx : m.types) {
+      if (descriptor_idx >= m.strings.size()) {
+        *error = StringPrintf("bad descriptor string %u", descriptor_idx);
+        return false;
+      }
+    }
+    SortUnique(m.types.size(), [&](uint32_t a, uint32_t b) {
+      return map_.strings[m.types[a]] < map_.strings[m.types[b]];
+    }, &types_, &map_.types);
+
+    // A proto is keyed by its return type and then its parameters.
+    std::vector<std::vector<uint32_t>> keys(m.protos.size());
+    for (uint32_t i = 0; i < m.protos.size(); ++i) {
+      const DexModelProto& proto = m.protos[i];
+      keys[i].push_back(proto.return_type_idx);
+      keys[i].insert(keys[i].end(), proto.parameters.begin(), proto.parameters.end());
+      for (uint32_t& type_idx : keys[i]) {
+        if (type_idx >= m.types.size()) {
+          *error = StringPrintf("bad type %u in proto %u", type_idx, i);
+          return false;
+        }
+        type_idx = map_.types[type_idx];
+      }
+      if (proto.shorty_idx >= m.strings.size()) {
+        *error = StringPrintf("bad shorty string in proto %u", i);
+        return false;
+      }
+    }
+    SortUnique(m.protos.size(), [&](uint32_t a, uint32_t b) {
+      return keys[a] < keys[b];
+    }, &protos_, &map_.protos);
+
+    for (const DexModelField& field : m.fields) {
+      if (field.class_idx >= m.types.size() || field.type_idx >= m.types.size() ||
+          field.name_idx >= m.strings.size()) {
+        *error = "bad field";
+        return false;
+      }
+    }
+    SortUnique(m.fields.size(), [&](uint32_t a, uint32_t b) {
+      const DexModelField& x = m.fields[a];
+      const DexModelField& y = m.fields[b];
+      return std::make_tuple(map_.types[x.class_idx], map_.strings[x.name_idx],
+                             map_.types[x.type_idx]) <
+             std::make_tuple(map_.types[y.class_idx], map_.strings[y.name_idx],
+                             map_.types[y.type_idx]);
+    }, &fields_, &map_.fields);
+
+    for (const DexModelMethod& method : m.methods) {
+      if (method.class_idx >= m.types.size() || method.proto_idx >= m.protos.size() ||
+          method.name_idx >= m.strings.size()) {
+        *error = "bad method";
+        return false;
+      }
+    }
+    SortUnique(m.methods.size(), [&](uint32_t a, uint32_t b) {
+      const DexModelMethod& x = m.methods[a];
+      const DexModelMethod& y = m.methods[b];
+      return std::make_tuple(map_.types[x.class_idx], map_.strings[x.name_idx],
+                             map_.protos[x.proto_idx]) <
+             std::make_tuple(map_.types[y.class_idx], map_.strings[y.name_idx],
+                             map_.protos[y.proto_idx]);
+    }, &methods_, &map_.methods);
+
+    // Instructions and field and method ids hold 16-bit indices.
+    if (types_.size() > 0x10000 || protos_.size() > 0x10000 || fields_.size() > 0x10000 ||
+        methods_.size() > 0x10000) {
+      *error = StringPrintf("too many ids: %zu types, %zu protos, %zu fields, %zu methods",
+                            types_.size(), protos_.size(), fields_.size(), methods_.size());
+      return false;
+    }
+    return true;
+  }
+
+  // Orders the classes so that superclasses and interfaces come first.
+  bool SortClasses(std::string* error) {
+    std::vector<uint32_t> type_classes(types_.size(), NO_INDEX);
+    for (uint32_t i = 0; i < model_.classes.size(); ++i) {
+      uint32_t class_idx = model_.classes[i].class_idx;
+      if (class_idx >= model_.types.size()) {
+        *error = StringPrintf("bad type of class %u", i);
+        return false;
+      }
+      uint32_t type_idx = map_.types[class_idx];
+      if (type_classes[type_idx] != NO_INDEX) {
+        *error = StringPrintf("class %s is defined twice", GetDescriptor(class_idx));
+        return false;
+      }
+      type_classes[type_idx] = i;
+    }
+    // 0 unvisited, 1 being visited, 2 done.
+    std::vector<uint8_t> state(model_.classes.size(), 0);
+    classes_.clear();
+    std::function<bool(uint32_t)> visit = [&](uint32_t i) {
+      if (state[i] == 2) {
+        return true;
+      }
+      const DexModelClass& cls = model_.classes[i];
+      if (state[i] == 1) {
+        *error = StringPrintf("class %s is its own supertype", GetDescriptor(cls.class_idx));
+        return false;
+      }
+      state[i] = 1;
+      std::vector<uint32_t> supertypes(cls.interfaces);
+      if (cls.superclass_idx != NO_INDEX) {
+        supertypes.insert(supertypes.begin(), cls.superclass_idx);
+      }
+      for (uint32_t super_idx : supertypes) {
+        if (super_idx >= model_.types.size()) {
+          *error = StringPrintf("bad supertype of class %s", GetDescriptor(cls.class_idx));
+          return false;
+        }
+        uint32_t super_class = type_classes[map_.types[super_idx]];
+        if (super_class != NO_INDEX && !visit(super_class)) {
+          return false;
+        }
+      }
+      state[i] = 2;
+      classes_.push_back(i);
+      return true;
+    };
+    for (uint32_t i = 0; i < model_.classes.size(); ++i) {
+      if (!visit(i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const char* GetDescriptor(uint32_t type_idx) const {
+    return model_.strings[model_.types[type_idx]].c_str();
+  }
+
+  template <typename T>
+  static void Put(std::string* out, const T& value) {
+    out->append((const char*)&value, sizeof(T));
+  }
+
+  template <typename T>
+  void PutAt(uint32_t off, const T& value) {
+    memcpy(&out_[off], &value, sizeof(T));
+  }
+
+  void Align(uint32_t alignment) {
+    out_.resize((out_.size() + alignment - 1) / alignment * alignment, '\0');
+  }
+
+  void AddSection(uint16_t type, uint32_t size, uint32_t offset) {
+    if (size != 0) {
+      sections_.push_back(Section{type, size, offset});
+    }
+  }
+
+  // The members of a class with their new indices, sorted by them.
+  bool SortMembers(const std::vector<DexModelMember>& members, const std::vector<uint32_t>& map,
+                   std::vector<DexModelMember>* sorted, std::string* error) const {
+    sorted->clear();
+    for (DexModelMember member : members) {
+      if (!DexIndexMap::MapIn(map, member.idx, &member.idx) || member.idx == NO_INDEX) {
+        *error = StringPrintf("bad member index %u", member.idx);
+        return false;
+      }
+      sorted->push_back(member);
+    }
+    std::sort(sorted->begin(), sorted->end(),
+              [](const DexModelMember& a, const DexModelMember& b) { return a.idx < b.idx; });
+    for (size_t i = 1; i < sorted->size(); ++i) {
+      if ((*sorted)[i].idx == (*sorted)[i - 1].idx) {
+        *error = StringPrintf("member %u is defined twice", (*sorted)[i].idx);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Appends the tries and handlers of a code_item.
+  bool WriteTries(const DexModelCode& code, std::string* error) {
+    // Equal handler lists are shared.
+    std::vector<std::string> handlers;
+    std::vector<uint32_t> try_handlers;
+    for (const DexModelTry& item : code.tries) {
+      std::string encoded;
+      bool has_catch_all = !item.handlers.empty() && item.handlers.back().type_idx == NO_INDEX;
+      int32_t size = item.handlers.size() - has_catch_all;
+      WriteLEB128(&encoded, has_catch_all ? -size : size);
+      for (const DexModelCatch& handler : item.handlers) {
+        uint32_t type_idx;
+        if (&handler != &item.handlers.back() || !has_catch_all) {
+          if (handler.type_idx == NO_INDEX ||
+              !DexIndexMap::MapIn(map_.types, handler.type_idx, &type_idx)) {
+            *error = StringPrintf("bad catch type %u", handler.type_idx);
+            return false;
+          }
+          WriteULEB128(&encoded, type_idx);
+        }
+        WriteULEB128(&encoded, handler.address);
+      }
+      size_t j = std::find(handlers.begin(), handlers.end(), encoded) - handlers.begin();
+      if (j == handlers.size()) {
+        handlers.push_back(encoded);
+      }
+      try_handlers.push_back(j);
+    }
+    std::string list;
+    WriteULEB128(&list, handlers.size());
+    std::vector<uint32_t> handler_offs;
+    for (const std::string& handler : handlers) {
+      handler_offs.push_back(list.size());
+      list.append(handler);
+    }
+    if (list.size() > 0xffff) {
+      *error = "catch handlers too large";
+      return false;
+    }
+    for (size_t i = 0; i < code.tries.size(); ++i) {
+      Put(&out_, code.tries[i].start_addr);
+      Put(&out_, code.tries[i].insn_count);
+      Put(&out_, (uint16_t)handler_offs[try_handlers[i]]);
+    }
+    out_.append(list);
+    return true;
+  }
+
+  // The code items of the methods of each class, then their debug info.
+  bool WriteCodeItems(std::vector<uint32_t>* code_offs, std::string* error) {
+    code_offs->assign(model_.codes.size(), 0);
+    std::vector<uint32_t> codes;
+    std::vector<DexModelMember> members;
+    for (uint32_t class_index : classes_) {
+      const DexModelClass& cls = model_.classes[class_index];
+      for (const std::vector<DexModelMember>* list : {&cls.direct_methods, &cls.virtual_methods}) {
+        if (!SortMembers(*list, map_.methods, &members, error)) {
+          return false;
+        }
+        for (const DexModelMember& member : members) {
+          if (member.code != NO_INDEX) {
+            if (member.code >= model_.codes.size() || (*code_offs)[member.code] != 0) {
+              *error = StringPrintf("bad code of method %u", member.idx);
+              return false;
+            }
+            // Marks the code as taken until it is written.
+            (*code_offs)[member.code] = 1;
+            codes.push_back(member.code);
+          }
+        }
+      }
+    }
+    Align(4);
+    uint32_t section_off = out_.size();
+    std::vector<uint32_t> debug_info_offs;
+    for (uint32_t code_index : codes) {
+      const DexModelCode& code = model_.codes[code_index];
+      Align(4);
+      (*code_offs)[code_index] = out_.size();
+      Put(&out_, code.registers_size);
+      Put(&out_, code.ins_size);
+      Put(&out_, code.outs_size);
+      Put(&out_, (uint16_t)code.tries.size());
+      debug_info_offs.push_back(out_.size());
+      Put(&out_, (uint32_t)0);
+      Put(&out_, (uint32_t)code.insns.size());
+      std::vector<uint16_t> insns(code.insns);
+      if (!RemapDexInsns(&insns, map_, error)) {
+        *error = StringPrintf("code of method %s: %s", GetCodeOwner(code_index).c_str(),
+                              error->c_str());
+        return false;
+      }
+      out_.append((const char*)insns.data(), insns.size() * 2);
+      if (!code.tries.empty()) {
+        if (insns.size() & 1) {
+          Put(&out_, (uint16_t)0);
+        }
+        if (!WriteTries(code, error)) {
+          return false;
+        }
+      }
+    }
+    AddSection(TYPE_CODE_ITEM, codes.size(), section_off);
+
+    section_off = out_.size();
+    uint32_t debug_infos = 0;
+    for (size_t i = 0; i < codes.size(); ++i) {
+      const DexModelCode& code = model_.codes[codes[i]];
+      if (code.debug_info.empty()) {
+        continue;
+      }
+      PutAt(debug_info_offs[i], (uint32_t)out_.size());
+      const char* p = code.debug_info.data();
+      if (!RewriteDebugInfo(p, p + code.debug_info.size(), map_, &out_, error)) {
+        return false;
+      }
+      debug_infos++;
+    }
+    AddSection(TYPE_DEBUG_INFO_ITEM, debug_infos, section_off);
+    return true;
+  }
+
+  std::string GetCodeOwner(uint32_t code_index) const {
+    for (const DexModelClass& cls : model_.classes) {
+      for (const std::vector<DexModelMember>* list : {&cls.direct_methods, &cls.virtual_methods}) {
+        for (const DexModelMember& member : *list) {
+          if (member.code == code_index && member.idx < model_.methods.size()) {
+            const DexModelMethod& method = model_.methods[member.idx];
+            return std::string(GetDescriptor(method.class_idx)) + "->" +
+                   model_.strings[method.name_idx];
+          }
+        }
+      }
+    }
+    return "?";
+  }
+
+  // The parameters of each proto, then the interfaces of each class; offs
+  // holds 0 for empty lists.
+  void WriteTypeLists(std::vector<uint32_t>* offs) {
+    std::vector<std::vector<uint16_t>> lists;
+    for (uint32_t proto_index : protos_) {
+      lists.emplace_back();
+      for (uint32_t type_idx : model_.protos[proto_index].parameters) {
+        lists.back().push_back(map_.types[type_idx]);
+      }
+    }
+    for (uint32_t class_index : classes_) {
+      lists.emplace_back();
+      for (uint32_t type_idx : model_.classes[class_index].interfaces) {
+        lists.back().push_back(map_.types[type_idx]);
+      }
+    }
+    std::map<std::vector<uint16_t>, uint32_t> written;
+    Align(4);
+    uint32_t section_off = out_.size();
+    for (const std::vector<uint16_t>& list : lists) {
+      if (list.empty()) {
+        offs->push_back(0);
+        continue;
+      }
+      auto it = written.find(list);
+      if (it == written.end()) {
+        Align(4);
+        it = written.insert(std::make_pair(list, (uint32_t)out_.size())).first;
+        Put(&out_, (uint32_t)list.size());
+        out_.append((const char*)list.data(), list.size() * 2);
+      }
+      offs->push_back(it->second);
+    }
+    AddSection(TYPE_TYPE_LIST, written.size(), section_off);
+  }
+
+  void WriteStringData(std::vector<uint32_t>* offs) {
+    uint32_t section_off = out_.size();
+    for (uint32_t string_index : strings_) {
+      const std::string& s = model_.strings[string_index];
+      size_t utf16_length = 0;
+      ValidateMutf8(s.data(), s.size(), &utf16_length);
+      offs->push_back(out_.size());
+      WriteULEB128(&out_, utf16_length);
+      out_.append(s.c_str(), s.size() + 1);
+    }
+    AddSection(TYPE_STRING_DATA_ITEM, strings_.size(), section_off);
+  }
+
+  // Writes the annotation items, sets and set ref lists of every class and
+  // then its annotations_directory_item; offs holds 0 for classes without
+  // annotations.
+  bool WriteAnnotations(std::vector<uint32_t>* offs, std::string* error) {
+    // The rewritten annotation items, and the sets as indices into them.
+    std::map<std::string, uint32_t> items;
+    std::vector<std::pair<uint32_t, std::string>> item_list;
+    std::map<std::vector<uint32_t>, uint32_t> sets;
+    std::vector<std::vector<uint32_t>> set_list;
+    auto add_set = [&](const DexModelAnnotationSet& set, uint32_t* set_index) {
+      std::vector<uint32_t> set_items;
+      for (const DexModelAnnotation& annotation : set) {
+        std::string item(1, (char)annotation.visibility);
+        const char* p = annotation.encoded.data();
+        if (!RewriteEncodedAnnotation(p, p + annotation.encoded.size(), map_, &item, error)) {
+          return false;
+        }
+        auto it = items.insert(std::make_pair(item, (uint32_t)item_list.size())).first;
+        if (it->second == item_list.size()) {
+          const char* q = item.data() + 1;
+          uint32_t type_idx = ReadULEB128(q, item.data() + item.size());
+          item_list.push_back(std::make_pair(type_idx, item));
+        }
+        set_items.push_back(it->second);
+      }
+      // Set entries are sorted by annotation type.
+      std::sort(set_items.begin(), set_items.end(), [&](uint32_t a, uint32_t b) {
+        return item_list[a].first < item_list[b].first;
+      });
+      auto it = sets.insert(std::make_pair(set_items, (uint32_t)set_list.size())).first;
+      if (it->second == set_list.size()) {
+        set_list.push_back(set_items);
+      }
+      *set_index = it->second;
+      return true;
+    };
+
+    // A directory as set indices, NO_INDEX for an absent set.
+    struct Directory {
+      uint32_t class_set;
+      std::vector<std::pair<uint32_t, uint32_t>> fields;
+      std::vector<std::pair<uint32_t, uint32_t>> methods;
+      std::vector<std::pair<uint32_t, std::vector<uint32_t>>> parameters;
+    };
+    std::vector<Directory> directories(classes_.size());
+    for (uint32_t i = 0; i < classes_.size(); ++i) {
+      const DexModelClass& cls = model_.classes[classes_[i]];
+      Directory& directory = directories[i];
+      directory.class_set = NO_INDEX;
+      if (!cls.annotations.empty() && !add_set(cls.annotations, &directory.class_set)) {
+        return false;
+      }
+      for (int list = 0; list < 2; ++list) {
+        const auto& annotations = list == 0 ? cls.field_annotations : cls.method_annotations;
+        const std::vector<uint32_t>& map = list == 0 ? map_.fields : map_.methods;
+        auto& entries = list == 0 ? directory.fields : directory.methods;
+        for (const auto& annotation : annotations) {
+          uint32_t idx;
+          uint32_t set_index;
+          if (!DexIndexMap::MapIn(map, annotation.first, &idx) || idx == NO_INDEX) {
+            *error = StringPrintf("bad annotated member %u", annotation.first);
+            return false;
+          }
+          if (!annotation.second.empty()) {
+            if (!add_set(annotation.second, &set_index)) {
+              return false;
+            }
+            entries.push_back(std::make_pair(idx, set_index));
+          }
+        }
+        std::sort(entries.begin(), entries.end());
+      }
+      for (const auto& annotation : cls.parameter_annotations) {
+        uint32_t idx;
+        if (!DexIndexMap::MapIn(map_.methods, annotation.first, &idx) || idx == NO_INDEX) {
+          *error = StringPrintf("bad annotated method %u", annotation.first);
+          return false;
+        }
+        // Parameters without annotations get an empty set rather than 0, as
+        // dx and d8 write them.
+        std::vector<uint32_t> set_indices(annotation.second.size());
+        for (size_t j = 0; j < annotation.second.size(); ++j) {
+          if (!add_set(annotation.second[j], &set_indices[j])) {
+            return false;
+          }
+        }
+        directory.parameters.push_back(std::make_pair(idx, set_indices));
+      }
+      std::sort(directory.parameters.begin(), directory.parameters.end());
+    }
+
+    uint32_t section_off = out_.size();
+    std::vector<uint32_t> item_offs;
+    for (const auto& item : item_list) {
+      item_offs.push_back(out_.size());
+      out_.append(item.second);
+    }
+    AddSection(TYPE_ANNOTATION_ITEM, item_list.size(), section_off);
+
+    Align(4);
+    section_off = out_.size();
+    std::vector<uint32_t> set_offs;
+    for (const std::vector<uint32_t>& set : set_list) {
+      set_offs.push_back(out_.size());
+      Put(&out_, (uint32_t)set.size());
+      for (uint32_t item_index : set) {
+        Put(&out_, item_offs[item_index]);
+      }
+    }
+    AddSection(TYPE_ANNOTATION_SET_ITEM, set_list.size(), section_off);
+    auto set_off = [&](uint32_t set_index) {
+      return set_index == NO_INDEX ? 0 : set_offs[set_index];
+    };
+
+    section_off = out_.size();
+    std::map<std::vector<uint32_t>, uint32_t> ref_lists;
+    std::vector<std::vector<uint32_t>> parameter_offs(classes_.size());
+    for (uint32_t i = 0; i < classes_.size(); ++i) {
+      for (const auto& parameters : directories[i].parameters) {
+        std::vector<uint32_t> list;
+        for (uint32_t set_index : parameters.second) {
+          list.push_back(set_off(set_index));
+        }
+        auto it = ref_lists.find(list);
+        if (it == ref_lists.end()) {
+          it = ref_lists.insert(std::make_pair(list, (uint32_t)out_.size())).first;
+          Put(&out_, (uint32_t)list.size());
+          out_.append((const char*)list.data(), list.size() * 4);
+        }
+        parameter_offs[i].push_back(it->second);
+      }
+    }
+    AddSection(TYPE_ANNOTATION_SET_REF_LIST, ref_lists.size(), section_off);
+
+    section_off = out_.size();
+    uint32_t directories_size = 0;
+    for (uint32_t i = 0; i < classes_.size(); ++i) {
+      const Directory& directory = directories[i];
+      if (directory.class_set == NO_INDEX && directory.fields.empty() &&
+          directory.methods.empty() && directory.parameters.empty()) {
+        offs->push_back(0);
+        continue;
+      }
+      offs->push_back(out_.size());
+      Put(&out_, set_off(directory.class_set));
+      Put(&out_, (uint32_t)directory.fields.size());
+      Put(&out_, (uint32_t)directory.methods.size());
+      Put(&out_, (uint32_t)directory.parameters.size());
+      for (const auto& entries : {directory.fields, directory.methods}) {
+        for (const auto& entry : entries) {
+          Put(&out_, entry.first);
+          Put(&out_, set_offs[entry.second]);
+        }
+      }
+      for (size_t j = 0; j < directory.parameters.size(); ++j) {
+        Put(&out_, directory.parameters[j].first);
+        Put(&out_, parameter_offs[i][j]);
+      }
+      directories_size++;
+    }
+    AddSection(TYPE_ANNOTATIONS_DIRECTORY_ITEM, directories_size, section_off);
+    return true;
+  }
+
+  bool WriteStaticValues(std::vector<uint32_t>* offs, std::string* error) {
+    std::map<std::string, uint32_t> written;
+    uint32_t section_off = out_.size();
+    for (uint32_t class_index : classes_) {
+      const std::string& values = model_.classes[class_index].static_values;
+      if (values.empty()) {
+        offs->push_back(0);
+        continue;
+      }
+      std::string array;
+      const char* p = values.data();
+      if (!RewriteEncodedArray(p, p + values.size(), map_, &array, error)) {
+        return false;
+      }
+      auto it = written.find(array);
+      if (it == written.end()) {
+        it = written.insert(std::make_pair(array, (uint32_t)out_.size())).first;
+        out_.append(array);
+      }
+      offs->push_back(it->second);
+    }
+    AddSection(TYPE_ENCODED_ARRAY_ITEM, written.size(), section_off);
+    return true;
+  }
+
+  bool WriteClassData(const std::vector<uint32_t>& code_offs, std::vector<uint32_t>* offs,
+                      std::string* error) {
+    uint32_t section_off = out_.size();
+    uint32_t class_data_size = 0;
+    std::vector<DexModelMember> members;
+    for (uint32_t class_index : classes_) {
+      const DexModelClass& cls = model_.classes[class_index];
+      const std::vector<DexModelMember>* lists[] = {&cls.static_fields, &cls.instance_fields,
+                                                    &cls.direct_methods, &cls.virtual_methods};
+      if (lists[0]->empty() && lists[1]->empty() && lists[2]->empty() && lists[3]->empty()) {
+        offs->push_back(0);
+        continue;
+      }
+      offs->push_back(out_.size());
+      for (const std::vector<DexModelMember>* list : lists) {
+        WriteULEB128(&out_, list->size());
+      }
+      for (int list = 0; list < 4; ++list) {
+        if (!SortMembers(*lists[list], list < 2 ? map_.fields : map_.methods, &members, error)) {
+          return false;
+        }
+        uint32_t prev_idx = 0;
+        for (const DexModelMember& member : members) {
+          WriteULEB128(&out_, member.idx - prev_idx);
+          WriteULEB128(&out_, member.access_flags);
+          if (list >= 2) {
+            WriteULEB128(&out_, member.code == NO_INDEX ? 0 : code_offs[member.code]);
+          }
+          prev_idx = member.idx;
+        }
+      }
+      class_data_size++;
+    }
+    AddSection(TYPE_CLASS_DATA_ITEM, class_data_size, section_off);
+    return true;
+  }
+
+  uint32_t WriteMapList() {
+    Align(4);
+    uint32_t map_off = out_.size();
+    std::vector<Section> sections;
+    sections.push_back(Section{TYPE_HEADER_ITEM, 1, 0});
+    uint32_t off = DEX_HEADER_SIZE;
+    uint32_t tables[][3] = {
+        {TYPE_STRING_ID_ITEM, (uint32_t)strings_.size(), sizeof(string_id_item)},
+        {TYPE_TYPE_ID_ITEM, (uint32_t)types_.size(), sizeof(type_id_item)},
+        {TYPE_PROTO_ID_ITEM, (uint32_t)protos_.size(), sizeof(proto_id_item)},
+        {TYPE_FIELD_ID_ITEM, (uint32_t)fields_.size(), sizeof(field_id_item)},
+        {TYPE_METHOD_ID_ITEM, (uint32_t)methods_.size(), sizeof(method_id_item)},
+        {TYPE_CLASS_DEF_ITEM, (uint32_t)classes_.size(), sizeof(class_def_item)},
+    };
+    for (auto& table : tables) {
+      if (table[1] != 0) {
+        sections.push_back(Section{(uint16_t)table[0], table[1], off});
+      }
+      off += table[1] * table[2];
+    }
+    sections.insert(sections.end(), sections_.begin(), sections_.end());
+    sections.push_back(Section{TYPE_MAP_LIST, 1, map_off});
+    Put(&out_, (uint32_t)sections.size());
+    for (const Section& section : sections) {
+      Put(&out_, section.type);
+      Put(&out_, (uint16_t)0);
+      Put(&out_, section.size);
+      Put(&out_, section.offset);
+    }
+    return map_off;
+  }
+
+  const DexModel& model_;
+  // Model index -> file index.
+  DexIndexMap map_;
+  // File index -> the first model index merged into it.
+  std::vector<uint32_t> strings_;
+  std::vector<uint32_t> types_;
+  std::vector<uint32_t> protos_;
+  std::vector<uint32_t> fields_;
+  std::vector<uint32_t> methods_;
+  // Model class indices in file order.
+  std::vector<uint32_t> classes_;
+  // Data sections written so far, in file order.
+  std::vector<Section> sections_;
+  std::string out_;
+};
+
+#endif  // DEX_WRITER_H_
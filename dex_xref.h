@@ -0,0 +1,319 @@
+#ifndef DEX_XREF_H_
+#define DEX_XREF_H_
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "csr.h"
+#include "dex.h"
+#include "dex_file.h"
+#include "dex_insns.h"
+#include "opcode_info.h"
+#include "utils.h"
+
+// A code location is method_idx << 32 | pc, so that locations sort by method
+// and then by pc.
+typedef uint64_t DexCodeLocation;
+
+static DexCodeLocation MakeDexCodeLocation(uint32_t method_idx, uint32_t pc) {
+  return ((uint64_t)method_idx << 32) | pc;
+}
+
+static uint32_t GetLocationMethod(DexCodeLocation location) {
+  return location >> 32;
+}
+
+static uint32_t GetLocationPc(DexCodeLocation location) {
+  return (uint32_t)location;
+}
+
+typedef BasicCsrRow<DexCodeLocation> DexXrefRow;
+
+// Xrefs are kept for string, type, field and method ids, in the order of
+// DEX_INDEX_TYPE.
+static const int DEX_XREF_KINDS = DEX_INDEX_METHOD - DEX_INDEX_STRING + 1;
+
+// An xref file holds the posting lists of DexXref for one dex file, so that
+// lookups in a large app map them instead of scanning all code again.
+static const char DEX_XREF_MAGIC[8] = {'d', 'e', 'x', 'x', 'r', 'f', '1', '\0'};
+
+struct DexXrefSection {
+  // Number of ids; the section has rows + 1 offsets.
+  uint32_t rows;
+  // uint32_t[rows + 1].
+  uint32_t offsets_off;
+  uint32_t locations_size;
+  // DexCodeLocation[locations_size], 8-byte aligned.
+  uint32_t locations_off;
+};
+
+struct DexXrefHeader {
+  char magic[8];
+  char signature[20];
+  uint32_t file_size;
+  DexXrefSection sections[DEX_XREF_KINDS];
+};
+
+// Every code location that references each string, type, field and method
+// id, as one sorted posting list per id. Finding the uses of an id is an
+// array lookup, and finding them within one method is a binary search.
+// The lists are built by scanning all code, or mapped from an xref file.
+class DexXref {
+ public:
+  explicit DexXref(const DexFile& dex) : dex_(dex), base_(nullptr), size_(0), bad_methods_(0) {
+    memset(rows_, 0, sizeof(rows_));
+    memset(offsets_, 0, sizeof(offsets_));
+    memset(locations_, 0, sizeof(locations_));
+  }
+
+  ~DexXref() {
+    if (base_ != nullptr) {
+      munmap((void*)base_, size_);
+    }
+  }
+
+  // Scans the classes in parallel. Methods whose code can't be decoded
+  // contribute the references before the bad instruction and are counted in
+  // bad_methods().
+  void Build() {
+    uint32_t class_defs_size = dex_.class_defs_size();
+    std::vector<std::vector<Reference>> refs(class_defs_size);
+    std::vector<uint32_t> bad(class_defs_size, 0);
+    ParallelFor(class_defs_size, [&](size_t i) {
+      bad[i] = ScanClass(i, &refs[i]);
+    });
+    std::vector<std::pair<uint32_t, DexCodeLocation>> edges[DEX_XREF_KINDS];
+    for (uint32_t i = 0; i < class_defs_size; ++i) {
+      for (const Reference& ref : refs[i]) {
+        edges[ref.kind].emplace_back(ref.id, ref.location);
+      }
+      bad_methods_ += bad[i];
+    }
+    for (int kind = 0; kind < DEX_XREF_KINDS; ++kind) {
+      lists_[kind].Build(GetIdsSize(kind), edges[kind]);
+      rows_[kind] = lists_[kind].rows();
+      offsets_[kind] = lists_[kind].offsets().data();
+      locations_[kind] = lists_[kind].values().data();
+    }
+  }
+
+  // Maps the xref file at path. Returns false if it is missing or doesn't
+  // belong to the dex file.
+  bool Open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(DexXrefHeader)) {
+      close(fd);
+      return false;
+    }
+    void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+      return false;
+    }
+    const DexXrefHeader& h = *(const DexXrefHeader*)base;
+    size_t size = st.st_size;
+    bool ok = memcmp(h.magic, DEX_XREF_MAGIC, sizeof(h.magic)) == 0 &&
+              memcmp(h.signature, dex_.signature(), sizeof(h.signature)) == 0 &&
+              h.file_size == dex_.size();
+    for (int kind = 0; ok && kind < DEX_XREF_KINDS; ++kind) {
+      ok = CheckSection(base, size, h.sections[kind], GetIdsSize(kind));
+    }
+    if (!ok) {
+      munmap(base, size);
+      return false;
+    }
+    if (base_ != nullptr) {
+      munmap((void*)base_, size_);
+    }
+    base_ = (const char*)base;
+    size_ = size;
+    for (int kind = 0; kind < DEX_XREF_KINDS; ++kind) {
+      const DexXrefSection& section = h.sections[kind];
+      rows_[kind] = section.rows;
+      offsets_[kind] = (const uint32_t*)(base_ + section.offsets_off);
+      locations_[kind] = (const DexCodeLocation*)(base_ + section.locations_off);
+    }
+    return true;
+  }
+
+  // Writes to a temporary file and renames it, like DexCache.
+  bool Write(const char* path) const {
+    DexXrefHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DEX_XREF_MAGIC, sizeof(header.magic));
+    memcpy(header.signature, dex_.signature(), sizeof(header.signature));
+    header.file_size = dex_.size();
+    uint32_t off = sizeof(header);
+    for (int kind = 0; kind < DEX_XREF_KINDS; ++kind) {
+      DexXrefSection& section = header.sections[kind];
+      section.rows = rows_[kind];
+      section.offsets_off = off;
+      off = Align8(off + (section.rows + 1) * sizeof(uint32_t));
+      section.locations_size = offsets_[kind][rows_[kind]];
+      section.locations_off = off;
+      off += section.locations_size * sizeof(DexCodeLocation);
+    }
+
+    std::string tmp_path = StringPrintf("%s.%d.tmp", path, (int)getpid());
+    FILE* fp = fopen(tmp_path.c_str(), "wb");
+    if (fp == nullptr) {
+      fprintf(stderr, "failed to open %s\n", tmp_path.c_str());
+      return false;
+    }
+    static const char padding[8] = {0};
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (int kind = 0; ok && kind < DEX_XREF_KINDS; ++kind) {
+      const DexXrefSection& section = header.sections[kind];
+      size_t offsets_size = (section.rows + 1) * sizeof(uint32_t);
+      size_t padding_size = section.locations_off - section.offsets_off - offsets_size;
+      ok = fwrite(offsets_[kind], offsets_size, 1, fp) == 1 &&
+           (padding_size == 0 || fwrite(padding, padding_size, 1, fp) == 1) &&
+           (section.locations_size == 0 ||
+            fwrite(locations_[kind], sizeof(DexCodeLocation), section.locations_size, fp) ==
+                section.locations_size);
+    }
+    if (fclose(fp) != 0 || !ok || rename(tmp_path.c_str(), path) != 0) {
+      fprintf(stderr, "failed to write %s\n", path);
+      unlink(tmp_path.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  // Code locations that reference id, an index of type index_type.
+  DexXrefRow Get(uint8_t index_type, uint32_t id) const {
+    int kind = index_type - DEX_INDEX_STRING;
+    CHECK(kind >= 0 && kind < DEX_XREF_KINDS && id < rows_[kind]);
+    DexXrefRow result;
+    result.begin_ = locations_[kind] + offsets_[kind][id];
+    result.end_ = locations_[kind] + offsets_[kind][id + 1];
+    return result;
+  }
+
+  // Code locations in method_idx that reference id.
+  DexXrefRow GetInMethod(uint8_t index_type, uint32_t id, uint32_t method_idx) const {
+    DexXrefRow row = Get(index_type, id);
+    row.begin_ = std::lower_bound(row.begin_, row.end_, MakeDexCodeLocation(method_idx, 0));
+    row.end_ = std::lower_bound(row.begin_, row.end_, ((uint64_t)method_idx + 1) << 32);
+    return row;
+  }
+
+  uint32_t bad_methods() const {
+    return bad_methods_;
+  }
+
+ private:
+  struct Reference {
+    int kind;
+    uint32_t id;
+    DexCodeLocation location;
+  };
+
+  uint32_t GetIdsSize(int kind) const {
+    switch (kind + DEX_INDEX_STRING) {
+      case DEX_INDEX_STRING:
+        return dex_.string_ids_size();
+      case DEX_INDEX_TYPE:
+        return dex_.type_ids_size();
+      case DEX_INDEX_FIELD:
+        return dex_.field_ids_size();
+      default:
+        return dex_.method_ids_size();
+    }
+  }
+
+  static uint32_t Align8(uint32_t off) {
+    return (off + 7) & ~7u;
+  }
+
+  // Offsets must be in bounds and ascending, so that lookups need no checks.
+  static bool CheckSection(const void* base, size_t size, const DexXrefSection& section,
+                           uint32_t ids_size) {
+    uint64_t offsets_size = ((uint64_t)section.rows + 1) * sizeof(uint32_t);
+    uint64_t locations_size = (uint64_t)section.locations_size * sizeof(DexCodeLocation);
+    if (section.rows != ids_size || section.offsets_off > size ||
+        offsets_size > size - section.offsets_off || (section.offsets_off & 3) != 0 ||
+        section.locations_off > size || locations_size > size - section.locations_off ||
+        (section.locations_off & 7) != 0) {
+      return false;
+    }
+    const uint32_t* offsets = (const uint32_t*)((const char*)base + section.offsets_off);
+    if (offsets[0] != 0 || offsets[section.rows] != section.locations_size) {
+      return false;
+    }
+    for (uint32_t i = 0; i < section.rows; ++i) {
+      if (offsets[i] > offsets[i + 1]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Returns the number of methods of the class whose code is malformed.
+  uint32_t ScanClass(uint32_t class_def_idx, std::vector<Reference>* refs) {
+    std::vector<DexMethod> methods;
+    dex_.GetClassMethods(class_def_idx, &methods);
+    uint32_t bad = 0;
+    DexInsn buf[64];
+    for (const DexMethod& method : methods) {
+      const char* insns;
+      uint32_t insns_size;
+      if (method.code_off == 0) {
+        continue;
+      }
+      if (method.method_idx >= dex_.method_ids_size() ||
+          !dex_.GetCodeInsns(method.code_off, &insns, &insns_size)) {
+        bad++;
+        continue;
+      }
+      DexInsnScanner scanner(insns, insns_size);
+      while (size_t count = scanner.Next(buf, 64)) {
+        for (size_t i = 0; i < count; ++i) {
+          const DexInsn& insn = buf[i];
+          if (insn.op > 0xff || DEX_OPCODES[insn.op].index_type == DEX_INDEX_NONE) {
+            continue;
+          }
+          const DexOpcodeInfo& info = DEX_OPCODES[insn.op];
+          int kind = info.index_type - DEX_INDEX_STRING;
+          uint32_t id = info.format == DEX_FORMAT_22C ? insn.c : insn.b;
+          if (id < GetIdsSize(kind)) {
+            Reference ref;
+            ref.kind = kind;
+            ref.id = id;
+            ref.location = MakeDexCodeLocation(method.method_idx, insn.pc);
+            refs->push_back(ref);
+          }
+        }
+      }
+      if (scanner.error() != nullptr) {
+        bad++;
+      }
+    }
+    return bad;
+  }
+
+  const DexFile& dex_;
+  // The lists when built rather than mapped.
+  BasicCsr<DexCodeLocation> lists_[DEX_XREF_KINDS];
+  uint32_t rows_[DEX_XREF_KINDS];
+  const uint32_t* offsets_[DEX_XREF_KINDS];
+  const DexCodeLocation* locations_[DEX_XREF_KINDS];
+  const char* base_;
+  size_t size_;
+  uint32_t bad_methods_;
+};
+
+#endif  // DEX_XREF_H_
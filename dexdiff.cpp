@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dex.h"
+#include "dex_file.h"
+#include "dex_insns.h"
+#include "diff.h"
+#include "utils.h"
+
+// Compares two dex files, or two class files, by structure: classes are
+// matched by descriptor and methods by name and descriptor, through hash
+// maps of interned strings, and a method has changed if its access flags or
+// the hash of its code differ. Everything is one pass over each input, so
+// the time is linear in their sizes, and the report is in the order of the
+// new file, then the removed entities in the order of the old one.
+
+// Hashes what the index operand of an instruction names.
+static void HashDexIndex(const DexFile& dex, uint8_t index_type, uint32_t idx,
+                         CodeHasher* hasher) {
+  hasher->AddValue(index_type);
+  switch (index_type) {
+    case DEX_INDEX_STRING:
+      if (idx < dex.string_ids_size()) {
+        hasher->AddString(dex.GetString(idx));
+      }
+      break;
+    case DEX_INDEX_TYPE:
+      if (idx < dex.type_ids_size()) {
+        hasher->AddString(dex.GetType(idx));
+      }
+      break;
+    case DEX_INDEX_FIELD:
+      if (idx < dex.field_ids_size()) {
+        const field_id_item& field = dex.field_id(idx);
+        hasher->AddString(dex.GetType(field.class_idx));
+        hasher->AddString(dex.GetString(field.name_idx));
+        hasher->AddString(dex.GetType(field.type_idx));
+      }
+      break;
+    case DEX_INDEX_METHOD:
+      if (idx < dex.method_ids_size()) {
+        const method_id_item& method = dex.method_id(idx);
+        hasher->AddString(dex.GetType(method.class_idx));
+        hasher->AddString(dex.GetString(method.name_idx));
+        hasher->AddString(dex.GetProto(method.proto_idx).c_str());
+      }
+      break;
+  }
+}
+
+// Hashes the code_item at code_off: the frame sizes, the instructions with
+// their index operands replaced by what they name, and the try blocks with
+// their handlers. Handlers are hashed through each try block, since their
+// offsets in the handler list change with the size of the type indices.
+static bool HashDexCode(const DexFile& dex, uint32_t code_off, CodeHasher* hasher,
+                        uint32_t* code_size, std::string* error) {
+  const char* insns;
+  uint32_t insns_size;
+  if (!dex.GetCodeInsns(code_off, &insns, &insns_size)) {
+    *error = StringPrintf("bad code_item at 0x%x", code_off);
+    return false;
+  }
+  const char* end = dex.data() + dex.size();
+  const char* p = dex.data() + code_off;
+  uint16_t registers_size;
+  uint16_t ins_size;
+  uint16_t outs_size;
+  uint16_t tries_size;
+  Read(p, end, registers_size);
+  Read(p, end, ins_size);
+  Read(p, end, outs_size);
+  Read(p, end, tries_size);
+  hasher->AddValue(registers_size);
+  hasher->AddValue(ins_size);
+  hasher->AddValue(outs_size);
+  hasher->AddValue(tries_size);
+  *code_size = insns_size * 2;
+  DexInsn buf[64];
+  DexInsnScanner scanner(insns, insns_size);
+  while (size_t count = scanner.Next(buf, 64)) {
+    for (size_t i = 0; i < count; ++i) {
+      const DexInsn& insn = buf[i];
+      const char* unit = insns + insn.pc * 2;
+      uint8_t index_type =
+          IsDexPayload(insn.op) ? (uint8_t)DEX_INDEX_NONE : DEX_OPCODES[insn.op].index_type;
+      if (index_type == DEX_INDEX_NONE) {
+        hasher->Add(unit, insn.width * 2);
+        continue;
+      }
+      // The index is the second code unit, or the second and third for 31c.
+      uint32_t index_units = DEX_OPCODES[insn.op].format == DEX_FORMAT_31C ? 2 : 1;
+      uint32_t idx = GetDexUnit(insns, insn.pc + 1);
+      if (index_units == 2) {
+        idx = GetDexUnit32(insns, insn.pc + 1);
+      }
+      hasher->Add(unit, 2);
+      HashDexIndex(dex, index_type, idx, hasher);
+      hasher->Add(unit + 2 + index_units * 2, (insn.width - 1 - index_units) * 2);
+    }
+  }
+  if (scanner.error() != nullptr) {
+    *error = StringPrintf("code_item at 0x%x: %s at 0x%x", code_off, scanner.error(),
+                          scanner.pc());
+    return false;
+  }
+  if (tries_size == 0) {
+    return true;
+  }
+  const char* tries = insns + insns_size * 2 + (insns_size & 1) * 2;
+  const char* handlers = tries + tries_size * 8;
+  if (handlers > end) {
+    *error = StringPrintf("code_item at 0x%x: tries run past the end of the file", code_off);
+    return false;
+  }
+  for (uint16_t i = 0; i < tries_size; ++i) {
+    const char* t = tries + i * 8;
+    uint32_t start_addr;
+    uint16_t insn_count;
+    uint16_t handler_off;
+    Read(t, end, start_addr);
+    Read(t, end, insn_count);
+    Read(t, end, handler_off);
+    hasher->AddValue(start_addr);
+    hasher->AddValue(insn_count);
+    const char* h = handlers + handler_off;
+    int32_t size = ReadLEB128(h, end);
+    hasher->AddValue(size);
+    for (int32_t j = 0; j < (size < 0 ? -size : size); ++j) {
+      uint32_t type_idx = ReadULEB128(h, end);
+      HashDexIndex(dex, DEX_INDEX_TYPE, type_idx, hasher);
+      hasher->AddValue((uint32_t)ReadULEB128(h, end));
+    }
+    if (size <= 0) {
+      hasher->AddValue((uint32_t)ReadULEB128(h, end));
+    }
+  }
+  return true;
+}
+
+static bool LoadDexFileDiff(const char* data, size_t size, DiffFile* file, std::string* error) {
+  DexFile dex("", data, size);
+  if (!dex.Init()) {
+    *error = "malformed dex file";
+    return false;
+  }
+  StringPool& pool = StringPool::Global();
+  std::vector<DexMethod> methods;
+  for (uint32_t i = 0; i < dex.class_defs_size(); ++i) {
+    file->classes.emplace_back();
+    DiffClass& diff_class = file->classes.back();
+    diff_class.descriptor = dex.GetTypeHandle(dex.class_def(i).class_idx);
+    methods.clear();
+    dex.GetClassMethods(i, &methods);
+    for (const DexMethod& method : methods) {
+      if (method.method_idx >= dex.method_ids_size()) {
+        *error = StringPrintf("method_idx %u out of range", method.method_idx);
+        return false;
+      }
+      const method_id_item& id = dex.method_id(method.method_idx);
+      std::vector<const char*> parameters;
+      dex.GetParameterTypes(id.proto_idx, &parameters);
+      std::string signature = dex.GetString(id.name_idx);
+      signature.push_back('(');
+      for (const char* parameter : parameters) {
+        signature += parameter;
+      }
+      signature.push_back(')');
+      signature += dex.GetType(dex.proto_id(id.proto_idx).return_type_idx);
+      DiffMethod diff_method;
+      diff_method.signature = pool.Intern(signature.data(), signature.size());
+      diff_method.access_flags = method.access_flags;
+      diff_method.code_size = 0;
+      CodeHasher hasher;
+      if (method.code_off != 0 &&
+          !HashDexCode(dex, method.code_off, &hasher, &diff_method.code_size, error)) {
+        return false;
+      }
+      diff_method.code_hash = hasher.hash();
+      diff_class.methods.push_back(diff_method);
+    }
+  }
+  return true;
+}
+
+static bool LoadFile(const char* filename, std::vector<char>* buf, DiffFile* file) {
+  FILE* fp = fopen(filename, "rb");
+  if (fp == nullptr) {
+    fprintf(stderr, "failed to open %s\n", filename);
+    return false;
+  }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  buf->resize(size);
+  bool ok = size == 0 || fread(buf->data(), size, 1, fp) == 1;
+  fclose(fp);
+  if (!ok) {
+    fprintf(stderr, "failed to read %s\n", filename);
+    return false;
+  }
+  std::string error;
+  if (size >= 4 && memcmp(buf->data(), "dex\n", 4) == 0) {
+    ok = LoadDexFileDiff(buf->data(), size, file, &error);
+  } else if (size >= 4 && memcmp(buf->data(), "\xca\xfe\xba\xbe", 4) == 0) {
+    ok = LoadClassFileDiff(buf->data(), size, file, &error);
+  } else {
+    ok = false;
+    error = "not a dex or class file";
+  }
+  if (!ok) {
+    fprintf(stderr, "%s: %s\n", filename, error.c_str());
+  }
+  return ok;
+}
+
+struct DiffCounts {
+  uint64_t added = 0;
+  uint64_t removed = 0;
+  uint64_t changed = 0;
+  uint64_t unchanged = 0;
+};
+
+static std::string GetSizeDelta(int64_t old_size, int64_t new_size) {
+  return StringPrintf("%+ld", (long)(new_size - old_size));
+}
+
+class FileDiff {
+ public:
+  FileDiff(const DiffFile& old_file, const DiffFile& new_file)
+      : old_(old_file), new_(new_file) {
+  }
+
+  // Prints the added, removed and changed classes and methods after a
+  // summary. With summary_only, prints just the summary.
+  void Print(bool summary_only) {
+    std::unordered_map<StringHandle, const DiffClass*> old_classes;
+    for (const DiffClass& cls : old_.classes) {
+      old_classes[cls.descriptor] = &cls;
+    }
+    std::unordered_map<StringHandle, const DiffClass*> new_classes;
+    for (const DiffClass& cls : new_.classes) {
+      new_classes[cls.descriptor] = &cls;
+    }
+    std::string report;
+    for (const DiffClass& cls : new_.classes) {
+      auto it = old_classes.find(cls.descriptor);
+      if (it == old_classes.end()) {
+        classes_.added++;
+        methods_.added += cls.methods.size();
+        report += StringPrintf("+ class %s: %zu methods, %lu code bytes\n", GetName(cls.descriptor),
+                               cls.methods.size(), (unsigned long)cls.code_size());
+      } else {
+        DiffClasses(*it->second, cls, &report);
+      }
+    }
+    for (const DiffClass& cls : old_.classes) {
+      if (new_classes.count(cls.descriptor) == 0) {
+        classes_.removed++;
+        methods_.removed += cls.methods.size();
+        report += StringPrintf("- class %s: %zu methods, %lu code bytes\n", GetName(cls.descriptor),
+                               cls.methods.size(), (unsigned long)cls.code_size());
+      }
+    }
+    uint64_t old_size = 0;
+    for (const DiffClass& cls : old_.classes) {
+      old_size += cls.code_size();
+    }
+    uint64_t new_size = 0;
+    for (const DiffClass& cls : new_.classes) {
+      new_size += cls.code_size();
+    }
+    PrintCounts("classes", classes_);
+    PrintCounts("methods", methods_);
+    printf("code bytes: %lu -> %lu (%s)\n", (unsigned long)old_size, (unsigned long)new_size,
+           GetSizeDelta(old_size, new_size).c_str());
+    if (!summary_only) {
+      fputs(report.c_str(), stdout);
+    }
+  }
+
+ private:
+  static const char* GetName(StringHandle handle) {
+    return StringPool::Global().GetString(handle);
+  }
+
+  static void PrintCounts(const char* kind, const DiffCounts& counts) {
+    printf("%s: %lu added, %lu removed, %lu changed, %lu unchanged\n", kind,
+           (unsigned long)counts.added, (unsigned long)counts.removed,
+           (unsigned long)counts.changed, (unsigned long)counts.unchanged);
+  }
+
+  // Appends the methods of a class in both files that differ to report, after
+  // a line for the class if any do.
+  void DiffClasses(const DiffClass& old_class, const DiffClass& new_class, std::string* report) {
+    std::unordered_map<StringHandle, const DiffMethod*> old_methods;
+    for (const DiffMethod& method : old_class.methods) {
+      old_methods[method.signature] = &method;
+    }
+    std::unordered_map<StringHandle, const DiffMethod*> new_methods;
+    for (const DiffMethod& method : new_class.methods) {
+      new_methods[method.signature] = &method;
+    }
+    std::string lines;
+    for (const DiffMethod& method : new_class.methods) {
+      auto it = old_methods.find(method.signature);
+      if (it == old_methods.end()) {
+        methods_.added++;
+        lines += StringPrintf("  + %s: %u code bytes\n", GetName(method.signature),
+                              method.code_size);
+        continue;
+      }
+      const DiffMethod& old_method = *it->second;
+      if (old_method.code_hash == method.code_hash &&
+          old_method.access_flags == method.access_flags) {
+        methods_.unchanged++;
+        continue;
+      }
+      methods_.changed++;
+      lines += StringPrintf("  ~ %s: %u -> %u code bytes (%s)", GetName(method.signature),
+                            old_method.code_size, method.code_size,
+                            GetSizeDelta(old_method.code_size, method.code_size).c_str());
+      if (old_method.access_flags != method.access_flags) {
+        lines += StringPrintf(", access_flags 0x%x -> 0x%x", old_method.access_flags,
+                              method.access_flags);
+      }
+      if (old_method.code_hash == method.code_hash) {
+        lines += ", same code";
+      }
+      lines.push_back('\n');
+    }
+    for (const DiffMethod& method : old_class.methods) {
+      if (new_methods.count(method.signature) == 0) {
+        methods_.removed++;
+        lines += StringPrintf("  - %s: %u code bytes\n", GetName(method.signature),
+                              method.code_size);
+      }
+    }
+    if (lines.empty()) {
+      classes_.unchanged++;
+      return;
+    }
+    classes_.changed++;
+    *report += StringPrintf("~ class %s: %lu -> %lu code bytes (%s)\n",
+                            GetName(new_class.descriptor), (unsigned long)old_class.code_size(),
+                            (unsigned long)new_class.code_size(),
+                            GetSizeDelta(old_class.code_size(), new_class.code_size()).c_str());
+    *report += lines;
+  }
+
+  const DiffFile& old_;
+  const DiffFile& new_;
+  DiffCounts classes_;
+  DiffCounts methods_;
+};
+
+int main(int argc, char** argv) {
+  bool summary_only = false;
+  const char* filenames[2] = {nullptr, nullptr};
+  int count = 0;
+  bool usage_error = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--summary") == 0) {
+      summary_only = true;
+    } else if (count < 2) {
+      filenames[count++] = argv[i];
+    } else {
+      usage_error = true;
+    }
+  }
+  if (count != 2 || usage_error) {
+    fprintf(stderr, "dexdiff [--summary] <old_dex_or_class_file> <new_dex_or_class_file>\n");
+    return 1;
+  }
+  std::vector<char> old_buf;
+  std::vector<char> new_buf;
+  DiffFile old_file;
+  DiffFile new_file;
+  if (!LoadFile(filenames[0], &old_buf, &old_file) ||
+      !LoadFile(filenames[1], &new_buf, &new_file)) {
+    return 1;
+  }
+  if ((memcmp(old_buf.data(), "dex\n", 4) == 0) != (memcmp(new_buf.data(), "dex\n", 4) == 0)) {
+    fprintf(stderr, "can't compare a dex file with a class file\n");
+    return 1;
+  }
+  FileDiff diff(old_file, new_file);
+  diff.Print(summary_only);
+  return 0;
+}
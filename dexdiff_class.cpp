@@ -0,0 +1,126 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+#include "class_insns.h"
+#include "class_members.h"
+#include "diff.h"
+#include "utils.h"
+
+// Hashes the constant at index by what it names, following references to
+// other constants. Bootstrap method indices are hashed as they are.
+static void HashConstant(const DexerConstantPool& pool, uint16_t index, CodeHasher* hasher,
+                         int depth = 0) {
+  uint8_t tag = pool.GetTag(index);
+  hasher->AddValue(tag);
+  if (tag == 0 || depth > 4) {
+    return;
+  }
+  const char* p = pool.entries()[index] + 1;
+  uint16_t first = GetClassU2(p, 0);
+  uint16_t second = GetClassU2(p + 2, 0);
+  switch (tag) {
+    case CONSTANT_Utf8:
+      hasher->Add(p + 2, first);
+      break;
+    case CONSTANT_Integer:
+    case CONSTANT_Float:
+      hasher->Add(p, 4);
+      break;
+    case CONSTANT_Long:
+    case CONSTANT_Double:
+      hasher->Add(p, 8);
+      break;
+    case CONSTANT_Class:
+    case CONSTANT_String:
+    case CONSTANT_MethodType:
+      HashConstant(pool, first, hasher, depth + 1);
+      break;
+    case CONSTANT_MethodHandle:
+      hasher->AddValue((uint8_t)*p);
+      HashConstant(pool, GetClassU2(p + 1, 0), hasher, depth + 1);
+      break;
+    case CONSTANT_InvokeDynamic:
+      hasher->AddValue(first);
+      HashConstant(pool, second, hasher, depth + 1);
+      break;
+    default:
+      // Fieldref, Methodref, InterfaceMethodref and NameAndType.
+      HashConstant(pool, first, hasher, depth + 1);
+      HashConstant(pool, second, hasher, depth + 1);
+      break;
+  }
+}
+
+static bool HashCode(const ClassMembers& cls, const ClassMethodInfo& method, CodeHasher* hasher,
+                     std::string* error) {
+  hasher->AddValue(method.max_stack);
+  hasher->AddValue(method.max_locals);
+  ClassInsn buf[64];
+  ClassInsnScanner scanner(method.code, method.code_length);
+  while (size_t count = scanner.Next(buf, 64)) {
+    for (size_t i = 0; i < count; ++i) {
+      const ClassInsn& insn = buf[i];
+      const char* p = method.code + insn.pc;
+      uint32_t index_size = 0;
+      switch (insn.wide ? CLASS_OPERANDS_WIDE : CLASS_OPCODES[insn.op].operands) {
+        case CLASS_OPERANDS_CONSTANT_U1:
+          index_size = 1;
+          break;
+        case CLASS_OPERANDS_CONSTANT:
+        case CLASS_OPERANDS_INVOKEINTERFACE:
+        case CLASS_OPERANDS_INVOKEDYNAMIC:
+        case CLASS_OPERANDS_MULTIANEWARRAY:
+          index_size = 2;
+          break;
+      }
+      hasher->Add(p, 1);
+      if (index_size != 0) {
+        HashConstant(cls.pool, insn.a, hasher);
+      }
+      hasher->Add(p + 1 + index_size, insn.length - 1 - index_size);
+    }
+  }
+  if (scanner.error() != nullptr) {
+    *error = StringPrintf("%s%s: %s at %u", method.name.c_str(), method.descriptor.c_str(),
+                          scanner.error(), scanner.pc());
+    return false;
+  }
+  const char* p = method.exception_table;
+  for (uint16_t i = 0; i < method.exception_table_length; ++i, p += 8) {
+    hasher->Add(p, 6);
+    uint16_t catch_type = GetClassU2(p + 6, 0);
+    if (catch_type != 0) {
+      HashConstant(cls.pool, catch_type, hasher);
+    }
+  }
+  return true;
+}
+
+bool LoadClassFileDiff(const char* data, size_t size, DiffFile* file, std::string* error) {
+  ClassMembers cls;
+  if (!ReadClassMembers(data, size, &cls)) {
+    *error = "malformed class file";
+    return false;
+  }
+  StringPool& pool = StringPool::Global();
+  std::string descriptor = "L" + cls.this_class + ";";
+  file->classes.emplace_back();
+  DiffClass& diff_class = file->classes.back();
+  diff_class.descriptor = pool.Intern(descriptor.data(), descriptor.size());
+  for (const ClassMethodInfo& method : cls.methods) {
+    std::string signature = method.name + method.descriptor;
+    DiffMethod diff_method;
+    diff_method.signature = pool.Intern(signature.data(), signature.size());
+    diff_method.access_flags = method.access_flags;
+    diff_method.code_size = method.has_code ? method.code_length : 0;
+    CodeHasher hasher;
+    if (method.has_code && !HashCode(cls, method, &hasher, error)) {
+      return false;
+    }
+    diff_method.code_hash = hasher.hash();
+    diff_class.methods.push_back(diff_method);
+  }
+  return true;
+}
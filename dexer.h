@@ -0,0 +1,113 @@
+#ifndef DEXER_H_
+#define DEXER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "opcode_info.h"
+
+// The result of converting one class file to dex, passed from the class file
+// side of the dexer to the dex side. java_class.h and dex.h can't be included
+// together, so ids are referenced by name here and only become indices when
+// the dex side adds the class to a DexModel.
+
+// A string, type, field or method id, by name.
+struct DexerRef {
+  // A DEX_INDEX_TYPE.
+  uint8_t index_type;
+  // The string, the type descriptor, or the name of a field or method.
+  std::string name;
+  // The descriptor of the class declaring a field or method.
+  std::string class_descriptor;
+  // The type descriptor of a field, or the JVM descriptor like "(IJ)V" of a
+  // method.
+  std::string descriptor;
+
+  bool operator<(const DexerRef& other) const {
+    if (index_type != other.index_type) {
+      return index_type < other.index_type;
+    }
+    if (name != other.name) {
+      return name < other.name;
+    }
+    if (class_descriptor != other.class_descriptor) {
+      return class_descriptor < other.class_descriptor;
+    }
+    return descriptor < other.descriptor;
+  }
+};
+
+// type is empty for a catch-all handler.
+struct DexerCatch {
+  std::string type;
+  uint32_t address;
+};
+
+struct DexerTry {
+  uint32_t start_addr;
+  uint16_t insn_count;
+  std::vector<DexerCatch> handlers;
+};
+
+struct DexerCode {
+  uint16_t registers_size;
+  uint16_t ins_size;
+  uint16_t outs_size;
+  // Index operands are zero until the ids are known.
+  std::vector<uint16_t> insns;
+  // (position in insns, index into DexerClass::refs) of each 16-bit index
+  // operand.
+  std::vector<std::pair<uint32_t, uint32_t>> fixups;
+  std::vector<DexerTry> tries;
+  // (address, line) from the LineNumberTable, sorted by address.
+  std::vector<std::pair<uint32_t, uint32_t>> lines;
+};
+
+struct DexerField {
+  uint32_t access_flags;
+  std::string name;
+  std::string descriptor;
+  // The ConstantValue of a static field: the bits of a primitive value, or a
+  // string for a String field.
+  bool has_value;
+  uint64_t value;
+  std::string string_value;
+};
+
+struct DexerMethod {
+  // Dex access flags, with ACC_CONSTRUCTOR and ACC_DECLARED_SYNCHRONIZED.
+  uint32_t access_flags;
+  std::string name;
+  std::string descriptor;
+  bool is_direct;
+  bool has_code;
+  DexerCode code;
+};
+
+struct DexerClass {
+  std::string descriptor;
+  uint32_t access_flags;
+  // Empty for java.lang.Object.
+  std::string superclass;
+  std::vector<std::string> interfaces;
+  // Empty if there is no SourceFile attribute.
+  std::string source_file;
+  std::vector<DexerField> static_fields;
+  std::vector<DexerField> instance_fields;
+  std::vector<DexerMethod> methods;
+  // The ids the code refers to, without duplicates.
+  std::vector<DexerRef> refs;
+  // Set if the class needs dex version 037, for default and static interface
+  // methods.
+  bool needs_default_methods;
+};
+
+// Converts the class file in data. Defined in class_dexer.cpp, which is built
+// apart from the dex side.
+bool DexClassFile(const char* data, size_t size, DexerClass* cls, std::string* error);
+
+#endif  // DEXER_H_
@@ -0,0 +1,377 @@
+#ifndef DEXER_MODEL_H_
+#define DEXER_MODEL_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "dex.h"
+#include "dex_model.h"
+#include "dexer.h"
+#include "mutf8.h"
+#include "utils.h"
+
+// The dex side of the dexer: adds converted classes to a DexModel. Ids are
+// interned as they are added, so that the 16-bit index operands of the
+// instructions hold model indices that DexWriter can map.
+class DexerModelBuilder {
+ public:
+  explicit DexerModelBuilder(DexModel* model) : model_(model) {
+  }
+
+  bool AddClass(const DexerClass& cls, std::string* error) {
+    std::vector<uint32_t> ref_indices(cls.refs.size());
+    for (size_t i = 0; i < cls.refs.size(); ++i) {
+      if (!AddRef(cls.refs[i], &ref_indices[i], error)) {
+        return false;
+      }
+    }
+    DexModelClass model_class;
+    model_class.class_idx = AddType(cls.descriptor);
+    model_class.access_flags = cls.access_flags;
+    model_class.superclass_idx = cls.superclass.empty() ? NO_INDEX : AddType(cls.superclass);
+    model_class.source_file_idx = cls.source_file.empty() ? NO_INDEX : AddString(cls.source_file);
+    for (const std::string& interface : cls.interfaces) {
+      model_class.interfaces.push_back(AddType(interface));
+    }
+    for (const DexerField& field : cls.static_fields) {
+      model_class.static_fields.push_back(
+          DexModelMember{AddField(cls.descriptor, field.name, field.descriptor),
+                         field.access_flags, NO_INDEX});
+    }
+    for (const DexerField& field : cls.instance_fields) {
+      model_class.instance_fields.push_back(
+          DexModelMember{AddField(cls.descriptor, field.name, field.descriptor),
+                         field.access_flags, NO_INDEX});
+    }
+    EncodeStaticValues(cls.static_fields, &model_class.static_values);
+    for (const DexerMethod& method : cls.methods) {
+      uint32_t method_idx;
+      if (!AddMethod(cls.descriptor, method.name, method.descriptor, &method_idx)) {
+        *error = StringPrintf("%s: bad descriptor of method %s", cls.descriptor.c_str(),
+                              method.name.c_str());
+        return false;
+      }
+      DexModelMember member{method_idx, method.access_flags, NO_INDEX};
+      if (method.has_code) {
+        model_->codes.emplace_back();
+        if (!AddCode(method, ref_indices, &model_->codes.back(), error)) {
+          *error = StringPrintf("%s.%s: %s", cls.descriptor.c_str(), method.name.c_str(),
+                                error->c_str());
+          return false;
+        }
+        member.code = model_->codes.size() - 1;
+      }
+      (method.is_direct ? model_class.direct_methods : model_class.virtual_methods)
+          .push_back(member);
+    }
+    if (cls.needs_default_methods && model_->version < "037") {
+      model_->version = "037";
+    }
+    model_->classes.push_back(std::move(model_class));
+    return true;
+  }
+
+ private:
+  uint32_t AddString(const std::string& s) {
+    auto it = strings_.find(s);
+    if (it != strings_.end()) {
+      return it->second;
+    }
+    uint32_t idx = model_->AddString(s);
+    strings_.emplace(s, idx);
+    return idx;
+  }
+
+  uint32_t AddType(const std::string& descriptor) {
+    auto it = types_.find(descriptor);
+    if (it != types_.end()) {
+      return it->second;
+    }
+    model_->types.push_back(AddString(descriptor));
+    uint32_t idx = model_->types.size() - 1;
+    types_.emplace(descriptor, idx);
+    return idx;
+  }
+
+  uint32_t AddField(const std::string& class_descriptor, const std::string& name,
+                    const std::string& type) {
+    auto key = std::make_tuple(AddType(class_descriptor), AddString(name), AddType(type));
+    auto it = fields_.find(key);
+    if (it != fields_.end()) {
+      return it->second;
+    }
+    model_->fields.push_back(
+        DexModelField{std::get<0>(key), std::get<2>(key), std::get<1>(key)});
+    uint32_t idx = model_->fields.size() - 1;
+    fields_.emplace(key, idx);
+    return idx;
+  }
+
+  // Takes a JVM method descriptor, which has the types of a dex proto.
+  bool AddProto(const std::string& descriptor, uint32_t* idx) {
+    if (descriptor.empty() || descriptor[0] != '(') {
+      return false;
+    }
+    std::string shorty;
+    std::vector<uint32_t> key(1);
+    size_t pos = 1;
+    while (pos < descriptor.size() && descriptor[pos] != ')') {
+      size_t start = pos;
+      while (pos < descriptor.size() && descriptor[pos] == '[') {
+        pos++;
+      }
+      if (pos < descriptor.size() && descriptor[pos] == 'L') {
+        pos = descriptor.find(';', pos);
+        if (pos == std::string::npos) {
+          return false;
+        }
+      }
+      if (pos >= descriptor.size()) {
+        return false;
+      }
+      pos++;
+      shorty.push_back(descriptor[start] == '[' ? 'L' : descriptor[start]);
+      key.push_back(AddType(descriptor.substr(start, pos - start)));
+    }
+    if (pos + 1 >= descriptor.size()) {
+      return false;
+    }
+    std::string return_type = descriptor.substr(pos + 1);
+    shorty.insert(shorty.begin(), return_type[0] == '[' ? 'L' : return_type[0]);
+    key[0] = AddType(return_type);
+    auto it = protos_.find(key);
+    if (it != protos_.end()) {
+      *idx = it->second;
+      return true;
+    }
+    DexModelProto proto;
+    proto.shorty_idx = AddString(shorty);
+    proto.return_type_idx = key[0];
+    proto.parameters.assign(key.begin() + 1, key.end());
+    model_->protos.push_back(proto);
+    *idx = model_->protos.size() - 1;
+    protos_.emplace(key, *idx);
+    return true;
+  }
+
+  bool AddMethod(const std::string& class_descriptor, const std::string& name,
+                 const std::string& descriptor, uint32_t* idx) {
+    uint32_t proto_idx;
+    if (!AddProto(descriptor, &proto_idx)) {
+      return false;
+    }
+    auto key = std::make_tuple(AddType(class_descriptor), AddString(name), proto_idx);
+    auto it = methods_.find(key);
+    if (it != methods_.end()) {
+      *idx = it->second;
+      return true;
+    }
+    model_->methods.push_back(
+        DexModelMethod{std::get<0>(key), std::get<2>(key), std::get<1>(key)});
+    *idx = model_->methods.size() - 1;
+    methods_.emplace(key, *idx);
+    return true;
+  }
+
+  bool AddRef(const DexerRef& ref, uint32_t* idx, std::string* error) {
+    switch (ref.index_type) {
+      case DEX_INDEX_STRING:
+        *idx = AddString(ref.name);
+        return true;
+      case DEX_INDEX_TYPE:
+        *idx = AddType(ref.name);
+        return true;
+      case DEX_INDEX_FIELD:
+        *idx = AddField(ref.class_descriptor, ref.name, ref.descriptor);
+        return true;
+      case DEX_INDEX_METHOD:
+        if (AddMethod(ref.class_descriptor, ref.name, ref.descriptor, idx)) {
+          return true;
+        }
+        break;
+    }
+    *error = StringPrintf("bad reference to %s", ref.name.c_str());
+    return false;
+  }
+
+  bool AddCode(const DexerMethod& method, const std::vector<uint32_t>& ref_indices,
+               DexModelCode* code, std::string* error) {
+    const DexerCode& dexer_code = method.code;
+    code->registers_size = dexer_code.registers_size;
+    code->ins_size = dexer_code.ins_size;
+    code->outs_size = dexer_code.outs_size;
+    code->insns = dexer_code.insns;
+    for (const auto& fixup : dexer_code.fixups) {
+      uint32_t idx = ref_indices[fixup.second];
+      if (idx > 0xffff) {
+        *error = StringPrintf("index %u doesn't fit in the instruction at 0x%x", idx,
+                              fixup.first);
+        return false;
+      }
+      code->insns[fixup.first] = idx;
+    }
+    for (const DexerTry& dexer_try : dexer_code.tries) {
+      DexModelTry item;
+      item.start_addr = dexer_try.start_addr;
+      item.insn_count = dexer_try.insn_count;
+      for (const DexerCatch& c : dexer_try.handlers) {
+        item.handlers.push_back(
+            DexModelCatch{c.type.empty() ? NO_INDEX : AddType(c.type), c.address});
+      }
+      code->tries.push_back(item);
+    }
+    EncodeDebugInfo(method, &code->debug_info);
+    return true;
+  }
+
+  // A debug_info_item with the line table and no parameter names or locals.
+  static void EncodeDebugInfo(const DexerMethod& method, std::string* out) {
+    const auto& lines = method.code.lines;
+    if (lines.empty()) {
+      return;
+    }
+    uint32_t parameters_size = 0;
+    for (size_t pos = 1; pos < method.descriptor.size() && method.descriptor[pos] != ')';) {
+      while (method.descriptor[pos] == '[') {
+        pos++;
+      }
+      pos = method.descriptor[pos] == 'L' ? method.descriptor.find(';', pos) + 1 : pos + 1;
+      parameters_size++;
+    }
+    WriteULEB128(out, lines[0].second);
+    WriteULEB128(out, parameters_size);
+    for (uint32_t i = 0; i < parameters_size; ++i) {
+      WriteULEB128P1(out, NO_INDEX);
+    }
+    uint32_t address = 0;
+    int64_t line = lines[0].second;
+    for (const auto& entry : lines) {
+      uint32_t address_diff = entry.first - address;
+      int64_t line_diff = (int64_t)entry.second - line;
+      if (line_diff < -4 || line_diff > 10) {
+        out->push_back(DBG_ADVANCE_LINE);
+        WriteLEB128(out, (int32_t)line_diff);
+        line_diff = 0;
+      }
+      uint32_t opcode = (line_diff + 4) + address_diff * 15 + DBG_FIRST_SPECIAL;
+      if (opcode > 0xff) {
+        out->push_back(DBG_ADVANCE_PC);
+        WriteULEB128(out, address_diff);
+        opcode = (line_diff + 4) + DBG_FIRST_SPECIAL;
+      }
+      out->push_back((char)opcode);
+      address = entry.first;
+      line = entry.second;
+    }
+    out->push_back(DBG_END_SEQUENCE);
+  }
+
+  // Writes value as an encoded_value of the fewest bytes; float and double
+  // drop zero bytes at the right instead of the left.
+  static void WriteEncodedValue(std::string* out, uint8_t value_type, uint64_t value,
+                                int max_size) {
+    int size = max_size;
+    if (value_type == ENCODED_VALUE_FLOAT || value_type == ENCODED_VALUE_DOUBLE) {
+      while (size > 1 && (value & 0xff) == 0) {
+        value >>= 8;
+        size--;
+      }
+    } else if (value_type == ENCODED_VALUE_CHAR) {
+      while (size > 1 && (value >> ((size - 1) * 8)) == 0) {
+        size--;
+      }
+    } else {
+      // Sign-extended: drop bytes that only repeat the sign bit.
+      int64_t v = value_type == ENCODED_VALUE_LONG ? (int64_t)value : (int32_t)value;
+      while (size > 1) {
+        int64_t rest = v >> ((size - 1) * 8 - 1);
+        if (rest != 0 && rest != -1) {
+          break;
+        }
+        size--;
+      }
+    }
+    out->push_back((char)(((size - 1) << 5) | value_type));
+    for (int i = 0; i < size; ++i) {
+      out->push_back((char)(value >> (i * 8)));
+    }
+  }
+
+  void EncodeValue(const DexerField& field, std::string* out) {
+    uint64_t value = field.has_value ? field.value : 0;
+    switch (field.descriptor[0]) {
+      case 'Z':
+        out->push_back((char)((value != 0 ? 1 : 0) << 5 | ENCODED_VALUE_BOOLEAN));
+        return;
+      case 'B':
+        WriteEncodedValue(out, ENCODED_VALUE_BYTE, value, 1);
+        return;
+      case 'S':
+        WriteEncodedValue(out, ENCODED_VALUE_SHORT, (int16_t)value, 2);
+        return;
+      case 'C':
+        WriteEncodedValue(out, ENCODED_VALUE_CHAR, (uint16_t)value, 2);
+        return;
+      case 'I':
+        WriteEncodedValue(out, ENCODED_VALUE_INT, value, 4);
+        return;
+      case 'J':
+        WriteEncodedValue(out, ENCODED_VALUE_LONG, value, 8);
+        return;
+      case 'F':
+        WriteEncodedValue(out, ENCODED_VALUE_FLOAT, value, 4);
+        return;
+      case 'D':
+        WriteEncodedValue(out, ENCODED_VALUE_DOUBLE, value, 8);
+        return;
+    }
+    if (field.has_value) {
+      WriteEncodedUnsigned(out, ENCODED_VALUE_STRING, AddString(field.string_value));
+    } else {
+      out->push_back(ENCODED_VALUE_NULL);
+    }
+  }
+
+  // The values are in the order DexWriter puts the fields in: by name and
+  // then by type. Fields past the last ConstantValue keep their defaults
+  // implicitly.
+  void EncodeStaticValues(const std::vector<DexerField>& fields, std::string* out) {
+    std::vector<const DexerField*> sorted;
+    for (const DexerField& field : fields) {
+      sorted.push_back(&field);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const DexerField* a, const DexerField* b) {
+      int result = CompareMutf8(a->name, b->name);
+      return result != 0 ? result < 0 : CompareMutf8(a->descriptor, b->descriptor) < 0;
+    });
+    size_t size = 0;
+    for (size_t i = 0; i < sorted.size(); ++i) {
+      if (sorted[i]->has_value) {
+        size = i + 1;
+      }
+    }
+    if (size == 0) {
+      return;
+    }
+    WriteULEB128(out, size);
+    for (size_t i = 0; i < size; ++i) {
+      EncodeValue(*sorted[i], out);
+    }
+  }
+
+  DexModel* model_;
+  std::unordered_map<std::string, uint32_t> strings_;
+  std::unordered_map<std::string, uint32_t> types_;
+  std::map<std::vector<uint32_t>, uint32_t> protos_;
+  std::map<std::tuple<uint32_t, uint32_t, uint32_t>, uint32_t> fields_;
+  std::map<std::tuple<uint32_t, uint32_t, uint32_t>, uint32_t> methods_;
+};
+
+#endif  // DEXER_MODEL_H_
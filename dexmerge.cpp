@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "dex_merger.h"
+
+// Merges dex files, splitting the result into classes.dex, classes2.dex, ...
+// when it doesn't fit the id limits of one file.
+
+int main(int argc, char** argv) {
+  const char* output = nullptr;
+  uint32_t max_ids = 0x10000;
+  std::vector<const char*> inputs;
+  bool usage_error = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else if (strcmp(argv[i], "--max-ids") == 0 && i + 1 < argc) {
+      max_ids = strtoul(argv[++i], nullptr, 0);
+    } else if (argv[i][0] == '-') {
+      usage_error = true;
+    } else {
+      inputs.push_back(argv[i]);
+    }
+  }
+  if (output == nullptr || inputs.empty() || usage_error || max_ids == 0 || max_ids > 0x10000) {
+    fprintf(stderr, "dexmerge -o <dex_file> [--max-ids <n>] <dex_file>...\n");
+    return 1;
+  }
+  DexMerger merger(max_ids);
+  std::string error;
+  for (const char* input : inputs) {
+    if (!merger.AddInput(input, &error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+  }
+  std::vector<std::string> outputs;
+  if (!merger.Merge(output, &outputs, &error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  printf("merged %zu strings, %zu fields and %zu methods into", merger.strings_size(),
+         merger.fields_size(), merger.methods_size());
+  for (const std::string& path : outputs) {
+    printf(" %s", path.c_str());
+  }
+  printf("\n");
+  return 0;
+}
@@ -0,0 +1,86 @@
+#ifndef DIFF_H_
+#define DIFF_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "string_pool.h"
+
+// What dexdiff compares of a dex or class file: its classes, and for each
+// method its access flags and a hash and size of its code. Descriptors and
+// signatures are interned in the global StringPool, so the two files are
+// aligned by comparing handles.
+
+// FNV-1a over the bytes of a method's code.
+class CodeHasher {
+ public:
+  CodeHasher() : hash_(14695981039346656037ull) {
+  }
+
+  void Add(const void* data, size_t size) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i) {
+      hash_ = (hash_ ^ p[i]) * 1099511628211ull;
+    }
+  }
+
+  // Adds s with its terminating NUL, so consecutive strings don't run
+  // together.
+  void AddString(const char* s) {
+    Add(s, strlen(s) + 1);
+  }
+
+  template <typename T>
+  void AddValue(T value) {
+    Add(&value, sizeof(value));
+  }
+
+  uint64_t hash() const {
+    return hash_;
+  }
+
+ private:
+  uint64_t hash_;
+};
+
+struct DiffMethod {
+  // Name and descriptor, e.g. "run(I)V".
+  StringHandle signature;
+  uint32_t access_flags;
+  // Bytes of bytecode, 0 if the method has no code.
+  uint32_t code_size;
+  // Covers the bytecode, with the constants and ids it refers to hashed by
+  // what they name rather than by index, so that code that only moved in the
+  // pool or the id tables hashes the same, and the frame sizes and
+  // exception handlers. Line and local variable information is left out.
+  uint64_t code_hash;
+};
+
+struct DiffClass {
+  // A type descriptor, e.g. "Lcom/example/Foo;", for class files too.
+  StringHandle descriptor;
+  std::vector<DiffMethod> methods;
+
+  uint64_t code_size() const {
+    uint64_t size = 0;
+    for (const DiffMethod& method : methods) {
+      size += method.code_size;
+    }
+    return size;
+  }
+};
+
+// The classes of one input, in file order.
+struct DiffFile {
+  std::vector<DiffClass> classes;
+};
+
+// Reads the class file in data into file. Defined in dexdiff_class.cpp,
+// because java_class.h and dex.h can't be included together.
+bool LoadClassFileDiff(const char* data, size_t size, DiffFile* file, std::string* error);
+
+#endif  // DIFF_H_
@@ -0,0 +1,90 @@
+#!/usr/bin/python3
+#
+# Generates the constexpr opcode tables class_opcodes.h and dex_opcodes.h.
+# Line i of class_inst_list and dex_inst_list describes opcode i:
+#
+#   class_inst_list: <name> <length> <operands> <flags>
+#   dex_inst_list:   <name> <format> <index type> <flags>
+#
+# '-' stands for no operands, no index or no flags, and flags are separated
+# by commas. Opcodes past the end of a list, and dex lines named 'unused',
+# get an empty entry.
+
+import sys
+
+HEADER = '''\
+// Generated by inst_gen.py from %s, do not edit.
+
+#ifndef %s
+#define %s
+
+%s
+
+'''
+
+FOOTER = '''\
+};
+
+#endif  // %s
+'''
+
+
+def load_insts(inst_list_file):
+  with open(inst_list_file, 'r') as f:
+    data = [line.split() for line in f if line.strip()]
+  if len(data) > 256:
+    sys.exit('%s has more than 256 opcodes' % inst_list_file)
+  return data
+
+
+def flags_expr(flags):
+  if flags == '-':
+    return '0'
+  return ' | '.join('OPCODE_%s' % flag.upper() for flag in flags.split(','))
+
+
+def write_table(out_file, list_file, includes, decl, entries):
+  guard = out_file.upper().replace('.', '_') + '_'
+  with open(out_file, 'w') as f:
+    f.write(HEADER % (list_file, guard, guard, includes))
+    f.write('%s = {\n' % decl)
+    for i, entry in enumerate(entries):
+      f.write('    /* 0x%02x */ {%s},\n' % (i, entry))
+    f.write(FOOTER % guard)
+
+
+def gen_class_opcodes():
+  insts = load_insts('class_inst_list')
+  entries = []
+  for i in range(256):
+    if i >= len(insts):
+      entries.append('"", 0, CLASS_OPERANDS_NONE, 0')
+      continue
+    name, length, operands, flags = insts[i]
+    if operands == '-':
+      operands = 'none'
+    entries.append('"%s", %s, CLASS_OPERANDS_%s, %s' %
+                   (name, length, operands.upper(), flags_expr(flags)))
+  write_table('class_opcodes.h', 'class_inst_list', '#include "opcode_info.h"',
+              'static constexpr ClassOpcodeInfo CLASS_OPCODES[256]', entries)
+
+
+def gen_dex_opcodes():
+  insts = load_insts('dex_inst_list')
+  entries = []
+  for i in range(256):
+    if i >= len(insts) or insts[i][0] == 'unused':
+      entries.append('"", DEX_FORMAT_UNUSED, DEX_INDEX_NONE, 0')
+      continue
+    name, format, index_type, flags = insts[i]
+    if index_type == '-':
+      index_type = 'none'
+    entries.append('"%s", DEX_FORMAT_%s, DEX_INDEX_%s, %s' %
+                   (name, format.upper(), index_type.upper(), flags_expr(flags)))
+  write_table('dex_opcodes.h', 'dex_inst_list', '#include "dex.h"\n#include "opcode_info.h"',
+              'static constexpr DexOpcodeInfo DEX_OPCODES[256]', entries)
+
+
+if __name__ == '__main__':
+  gen_class_opcodes()
+  gen_dex_opcodes()
@@ -3,6 +3,24 @@
 
 #include <inttypes.h>
 
+#include <type_traits>
+
+#include "utils.h"
+
+// Class files are big-endian.
+template <typename T>
+static void Read(const char*& p, const char* end, T& value) {
+  static_assert(std::is_standard_layout<T>::value, "...");
+  if (p + sizeof(T) > end) {
+    Abort("data not enough for Read()\n");
+  }
+  value = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    value = (value << 8) | *(const uint8_t*)p;
+    p++;
+  }
+}
+
 enum CONSTANT_POOL_TAGS {
   CONSTANT_Class = 7,
   CONSTANT_Fieldref = 9,
@@ -0,0 +1,153 @@
+#ifndef LINE_TABLE_H_
+#define LINE_TABLE_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "utils.h"
+
+// (pc, line) pairs of a method, as decoded from a dex debug_info_item or a
+// LineNumberTable.
+typedef std::vector<std::pair<uint32_t, uint32_t>> LineEntries;
+
+// Every LINE_TABLE_STRIDE-th entry of a LineTable is kept as a checkpoint.
+static constexpr uint32_t LINE_TABLE_STRIDE = 16;
+
+// The pc to line table of one method. Entries are sorted by pc and stored
+// as LEB128 (pc delta, line delta) pairs, with every LINE_TABLE_STRIDE-th
+// entry also kept in full in a checkpoint array. Find binary searches the
+// checkpoints and decodes at most LINE_TABLE_STRIDE - 1 pairs after one, so
+// it takes O(log n) time and allocates nothing.
+class LineTable {
+ public:
+  // Builds the table from entries, in any order. Where entries share a pc,
+  // the last one wins, as a later position entry in debug_info does.
+  explicit LineTable(LineEntries* entries) : size_(0) {
+    std::stable_sort(entries->begin(), entries->end(),
+                     [](const std::pair<uint32_t, uint32_t>& a,
+                        const std::pair<uint32_t, uint32_t>& b) { return a.first < b.first; });
+    uint32_t prev_pc = 0;
+    uint32_t prev_line = 0;
+    for (size_t i = 0; i < entries->size(); ++i) {
+      uint32_t pc = (*entries)[i].first;
+      uint32_t line = (*entries)[i].second;
+      if (i + 1 < entries->size() && (*entries)[i + 1].first == pc) {
+        continue;
+      }
+      if (size_ % LINE_TABLE_STRIDE == 0) {
+        checkpoints_.push_back(Checkpoint{pc, line, (uint32_t)deltas_.size()});
+      } else {
+        WriteULEB128(&deltas_, pc - prev_pc);
+        WriteLEB128(&deltas_, (int32_t)(line - prev_line));
+      }
+      prev_pc = pc;
+      prev_line = line;
+      size_++;
+    }
+    deltas_.shrink_to_fit();
+    checkpoints_.shrink_to_fit();
+  }
+
+  // Returns the line of the last entry at or before pc, or 0 if there is
+  // none.
+  uint32_t Find(uint32_t pc) const {
+    auto it = std::upper_bound(checkpoints_.begin(), checkpoints_.end(), pc,
+                               [](uint32_t pc, const Checkpoint& c) { return pc < c.pc; });
+    if (it == checkpoints_.begin()) {
+      return 0;
+    }
+    --it;
+    uint32_t first = (it - checkpoints_.begin()) * LINE_TABLE_STRIDE;
+    uint32_t count = std::min(LINE_TABLE_STRIDE, size_ - first) - 1;
+    uint32_t entry_pc = it->pc;
+    uint32_t line = it->line;
+    const char* p = deltas_.data() + it->offset;
+    const char* end = deltas_.data() + deltas_.size();
+    for (uint32_t i = 0; i < count; ++i) {
+      entry_pc += ReadULEB128(p, end);
+      if (entry_pc > pc) {
+        break;
+      }
+      line += ReadLEB128(p, end);
+    }
+    return line;
+  }
+
+  uint32_t size() const {
+    return size_;
+  }
+
+ private:
+  struct Checkpoint {
+    uint32_t pc;
+    uint32_t line;
+    // Where the pairs of the entries after this one start in deltas_.
+    uint32_t offset;
+  };
+
+  uint32_t size_;
+  std::vector<Checkpoint> checkpoints_;
+  std::string deltas_;
+};
+
+// The line tables of the methods of one file, each built on the first
+// lookup in its method and kept for the life of the cache. Once a table is
+// built, lookups from any thread are lock-free and allocate nothing; two
+// threads that race to build the same table both build it and one keeps it.
+class LineTableCache {
+ public:
+  // decode(method, entries) appends the line entries of method, an index
+  // below size.
+  LineTableCache(size_t size, const std::function<void(uint32_t, LineEntries*)>& decode)
+      : size_(size), tables_(new std::atomic<LineTable*>[size]), decode_(decode) {
+    for (size_t i = 0; i < size; ++i) {
+      tables_[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  ~LineTableCache() {
+    for (size_t i = 0; i < size_; ++i) {
+      delete tables_[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  LineTableCache(const LineTableCache&) = delete;
+  LineTableCache& operator=(const LineTableCache&) = delete;
+
+  // Returns the line of pc in method, or 0 if it has none.
+  uint32_t FindLine(uint32_t method, uint32_t pc) {
+    if (method >= size_) {
+      return 0;
+    }
+    return GetTable(method)->Find(pc);
+  }
+
+  const LineTable* GetTable(uint32_t method) {
+    LineTable* table = tables_[method].load(std::memory_order_acquire);
+    if (table != nullptr) {
+      return table;
+    }
+    LineEntries entries;
+    decode_(method, &entries);
+    LineTable* built = new LineTable(&entries);
+    if (tables_[method].compare_exchange_strong(table, built, std::memory_order_acq_rel)) {
+      return built;
+    }
+    delete built;
+    return table;
+  }
+
+ private:
+  size_t size_;
+  std::unique_ptr<std::atomic<LineTable*>[]> tables_;
+  std::function<void(uint32_t, LineEntries*)> decode_;
+};
+
+#endif  // LINE_TABLE_H_
@@ -0,0 +1,180 @@
+#ifndef MUTF8_H_
+#define MUTF8_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MUTF8_X86 1
+#endif
+
+// Modified UTF-8, as used by class and dex files: no NUL bytes (U+0000 is
+// written as C0 80), no four-byte forms (supplementary characters are written
+// as two three-byte surrogates), and no other overlong forms.
+
+// Decodes one character at p. Returns its length in bytes, or 0 if it is not
+// valid modified UTF-8.
+static size_t DecodeMutf8Char(const uint8_t* p, const uint8_t* end) {
+  uint8_t c = p[0];
+  if (c >= 0x01 && c < 0x80) {
+    return 1;
+  }
+  if (c >= 0xc0 && c < 0xe0) {
+    if (end - p < 2 || (p[1] & 0xc0) != 0x80) {
+      return 0;
+    }
+    // Of the overlong forms only C0 80 is allowed.
+    if (c < 0xc2 && !(c == 0xc0 && p[1] == 0x80)) {
+      return 0;
+    }
+    return 2;
+  }
+  if (c >= 0xe0 && c < 0xf0) {
+    if (end - p < 3 || (p[1] & 0xc0) != 0x80 || (p[2] & 0xc0) != 0x80 ||
+        (c == 0xe0 && p[1] < 0xa0)) {
+      return 0;
+    }
+    return 3;
+  }
+  return 0;
+}
+
+static bool ValidateMutf8Scalar(const uint8_t* p, const uint8_t* end, size_t* utf16_length) {
+  size_t length = 0;
+  while (p < end) {
+    size_t n = DecodeMutf8Char(p, end);
+    if (n == 0) {
+      return false;
+    }
+    p += n;
+    length++;
+  }
+  *utf16_length = length;
+  return true;
+}
+
+#ifdef MUTF8_X86
+
+// Strings in class and dex files are nearly all ASCII, so whole blocks of
+// ASCII without NUL are skipped with vector compares, and anything else is
+// decoded one character at a time.
+__attribute__((target("avx2")))
+static bool ValidateMutf8Avx2(const uint8_t* p, const uint8_t* end, size_t* utf16_length) {
+  size_t length = 0;
+  const __m256i zero = _mm256_setzero_si256();
+  while (p < end) {
+    if (end - p >= 32) {
+      __m256i bytes = _mm256_loadu_si256((const __m256i*)p);
+      uint32_t special = (uint32_t)_mm256_movemask_epi8(bytes) |
+                         (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, zero));
+      if (special == 0) {
+        p += 32;
+        length += 32;
+        continue;
+      }
+      // Skip the ASCII prefix up to the first special byte.
+      uint32_t ascii = __builtin_ctz(special);
+      p += ascii;
+      length += ascii;
+    }
+    size_t n = DecodeMutf8Char(p, end);
+    if (n == 0) {
+      return false;
+    }
+    p += n;
+    length++;
+  }
+  *utf16_length = length;
+  return true;
+}
+
+__attribute__((target("sse2")))
+static bool ValidateMutf8Sse2(const uint8_t* p, const uint8_t* end, size_t* utf16_length) {
+  size_t length = 0;
+  const __m128i zero = _mm_setzero_si128();
+  while (p < end) {
+    if (end - p >= 16) {
+      __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+      uint32_t special = (uint32_t)_mm_movemask_epi8(bytes) |
+                         (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero));
+      if (special == 0) {
+        p += 16;
+        length += 16;
+        continue;
+      }
+      uint32_t ascii = __builtin_ctz(special);
+      p += ascii;
+      length += ascii;
+    }
+    size_t n = DecodeMutf8Char(p, end);
+    if (n == 0) {
+      return false;
+    }
+    p += n;
+    length++;
+  }
+  *utf16_length = length;
+  return true;
+}
+
+#endif  // MUTF8_X86
+
+// Decodes the UTF-16 code unit of the valid modified UTF-8 character at p and
+// advances p past it.
+static uint16_t ReadMutf8Unit(const uint8_t*& p) {
+  uint8_t c = *p++;
+  if (c < 0x80) {
+    return c;
+  }
+  if (c < 0xe0) {
+    return ((c & 0x1f) << 6) | (*p++ & 0x3f);
+  }
+  uint16_t unit = ((c & 0x0f) << 12) | ((p[0] & 0x3f) << 6) | (p[1] & 0x3f);
+  p += 2;
+  return unit;
+}
+
+// Compares two valid modified UTF-8 strings by their UTF-16 code units, the
+// order of dex string_ids. This is byte order except for U+0000, which is
+// written as C0 80.
+static int CompareMutf8(const char* a, size_t a_size, const char* b, size_t b_size) {
+  const uint8_t* p = (const uint8_t*)a;
+  const uint8_t* p_end = p + a_size;
+  const uint8_t* q = (const uint8_t*)b;
+  const uint8_t* q_end = q + b_size;
+  while (p < p_end && q < q_end) {
+    if (*p == *q && *p < 0x80) {
+      p++;
+      q++;
+      continue;
+    }
+    uint16_t x = ReadMutf8Unit(p);
+    uint16_t y = ReadMutf8Unit(q);
+    if (x != y) {
+      return x < y ? -1 : 1;
+    }
+  }
+  return (p < p_end) - (q < q_end);
+}
+
+static int CompareMutf8(const std::string& a, const std::string& b) {
+  return CompareMutf8(a.data(), a.size(), b.data(), b.size());
+}
+
+// Checks that [p, p + size) is modified UTF-8 and counts its UTF-16 code units.
+static bool ValidateMutf8(const char* p, size_t size, size_t* utf16_length) {
+  typedef bool (*Validator)(const uint8_t*, const uint8_t*, size_t*);
+  static const Validator validator =
+#ifdef MUTF8_X86
+      __builtin_cpu_supports("avx2") ? ValidateMutf8Avx2 : ValidateMutf8Sse2;
+#else
+      ValidateMutf8Scalar;
+#endif
+  const uint8_t* begin = (const uint8_t*)p;
+  return validator(begin, begin + size, utf16_length);
+}
+
+#endif  // MUTF8_H_
@@ -0,0 +1,84 @@
+#ifndef OPCODE_INFO_H_
+#define OPCODE_INFO_H_
+
+#include <stdint.h>
+
+// Per-opcode metadata of the class and dex instruction sets. The tables in
+// class_opcodes.h and dex_opcodes.h are generated by inst_gen.py from
+// class_inst_list and dex_inst_list, have one entry for each of the 256
+// opcodes, and are constexpr, so looking up an opcode is one indexed load.
+
+enum OPCODE_FLAGS {
+  // Execution can go on to the next instruction.
+  OPCODE_CONTINUE = 0x01,
+  // Has a branch offset operand.
+  OPCODE_BRANCH = 0x02,
+  OPCODE_SWITCH = 0x04,
+  OPCODE_INVOKE = 0x08,
+  OPCODE_THROW = 0x10,
+  OPCODE_RETURN = 0x20,
+};
+
+// How the operands of a class file instruction are encoded.
+enum CLASS_OPERANDS {
+  CLASS_OPERANDS_NONE,
+  // u1 local variable index.
+  CLASS_OPERANDS_LOCAL,
+  // s1 immediate.
+  CLASS_OPERANDS_BYTE,
+  // s2 immediate.
+  CLASS_OPERANDS_SHORT,
+  // u1 constant pool index.
+  CLASS_OPERANDS_CONSTANT_U1,
+  // u2 constant pool index.
+  CLASS_OPERANDS_CONSTANT,
+  // s2 branch offset.
+  CLASS_OPERANDS_BRANCH,
+  // s4 branch offset.
+  CLASS_OPERANDS_BRANCH_W,
+  // u1 local variable index, s1 increment.
+  CLASS_OPERANDS_IINC,
+  // u2 constant pool index, u1 count, u1 0.
+  CLASS_OPERANDS_INVOKEINTERFACE,
+  // u2 constant pool index, u2 0.
+  CLASS_OPERANDS_INVOKEDYNAMIC,
+  // u1 array type.
+  CLASS_OPERANDS_NEWARRAY,
+  // u2 constant pool index, u1 dimensions.
+  CLASS_OPERANDS_MULTIANEWARRAY,
+  // The variable length instructions; length is 0 in their entries.
+  CLASS_OPERANDS_TABLESWITCH,
+  CLASS_OPERANDS_LOOKUPSWITCH,
+  CLASS_OPERANDS_WIDE,
+};
+
+struct ClassOpcodeInfo {
+  // "" for opcodes the JVM spec doesn't define.
+  const char* name;
+  // In bytes, 0 for variable length and undefined opcodes.
+  uint8_t length;
+  uint8_t operands;
+  uint8_t flags;
+};
+
+// What the index operand of a dex instruction refers to.
+enum DEX_INDEX_TYPE {
+  DEX_INDEX_NONE,
+  DEX_INDEX_STRING,
+  DEX_INDEX_TYPE,
+  DEX_INDEX_FIELD,
+  DEX_INDEX_METHOD,
+  // Not used by instructions, only by encoded values.
+  DEX_INDEX_PROTO,
+};
+
+struct DexOpcodeInfo {
+  // "" for unused opcodes.
+  const char* name;
+  // A DEX_FORMAT.
+  uint8_t format;
+  uint8_t index_type;
+  uint8_t flags;
+};
+
+#endif  // OPCODE_INFO_H_
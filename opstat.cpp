@@ -0,0 +1,321 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "class_opcodes.h"
+#include "dex.h"
+#include "dex_file.h"
+#include "dex_insns.h"
+#include "opstat.h"
+#include "utils.h"
+
+// Counts opcodes, opcode pairs and instruction formats over the code of
+// many dex and class files, without printing it. Files are spread over all
+// cores; each thread counts into its own histograms, which are merged once
+// every file is done.
+
+static const char* const DEX_FORMAT_NAMES[] = {
+    "unused", "10x", "12x", "11n", "11x", "10t", "20t", "22x", "21t", "21s", "21h", "21c", "23x",
+    "22b",    "22t", "22s", "22c", "32x", "30t", "31t", "31i", "31c", "35c", "3rc", "51l",
+};
+
+static constexpr uint32_t DEX_FORMAT_COUNT = sizeof(DEX_FORMAT_NAMES) / sizeof(DEX_FORMAT_NAMES[0]);
+
+static const char* const CLASS_OPERANDS_NAMES[] = {
+    "none",          "local",           "byte",          "short",
+    "constant_u1",   "constant",        "branch",        "branch_w",
+    "iinc",          "invokeinterface", "invokedynamic", "newarray",
+    "multianewarray", "tableswitch",    "lookupswitch",  "wide",
+};
+
+struct OpHistograms {
+  OpHistogram dex;
+  OpHistogram cls;
+};
+
+// The histograms of every thread that has counted a file.
+static std::mutex histograms_mutex;
+static std::vector<std::unique_ptr<OpHistograms>> all_histograms;
+
+static OpHistograms* GetThreadHistograms() {
+  static thread_local OpHistograms* histograms = nullptr;
+  if (histograms == nullptr) {
+    std::lock_guard<std::mutex> lock(histograms_mutex);
+    all_histograms.emplace_back(new OpHistograms);
+    histograms = all_histograms.back().get();
+  }
+  return histograms;
+}
+
+static bool AddDexFileHistogram(const char* data, size_t size, OpHistogram* histogram,
+                                std::string* error) {
+  DexFile dex("", data, size);
+  if (!dex.Init()) {
+    *error = "malformed dex file";
+    return false;
+  }
+  std::vector<DexMethod> methods;
+  for (uint32_t i = 0; i < dex.class_defs_size(); ++i) {
+    dex.GetClassMethods(i, &methods);
+  }
+  DexInsn buf[64];
+  for (const DexMethod& method : methods) {
+    const char* code;
+    uint32_t code_size;
+    if (method.code_off == 0) {
+      continue;
+    }
+    if (!dex.GetCodeInsns(method.code_off, &code, &code_size)) {
+      *error = StringPrintf("bad code_item at 0x%x", method.code_off);
+      return false;
+    }
+    histogram->methods++;
+    uint32_t prev = OPSTAT_NO_OPCODE;
+    DexInsnScanner scanner(code, code_size);
+    while (size_t count = scanner.Next(buf, 64)) {
+      for (size_t i = 0; i < count; ++i) {
+        uint16_t op = buf[i].op;
+        if (IsDexPayload(op)) {
+          histogram->AddInsn(OPSTAT_NO_OPCODE, 0xff + (op >> 8), DEX_FORMAT_COUNT);
+          prev = OPSTAT_NO_OPCODE;
+        } else {
+          histogram->AddInsn(prev, op, DEX_OPCODES[op].format);
+          prev = op;
+        }
+      }
+    }
+    if (scanner.error() != nullptr) {
+      *error = StringPrintf("code_item at 0x%x: %s at 0x%x", method.code_off, scanner.error(),
+                            scanner.pc());
+      return false;
+    }
+  }
+  histogram->files++;
+  return true;
+}
+
+static bool ReadFile(const char* filename, std::vector<char>* buf) {
+  FILE* fp = fopen(filename, "rb");
+  if (fp == nullptr) {
+    return false;
+  }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  buf->resize(size);
+  bool ok = size == 0 || fread(buf->data(), size, 1, fp) == 1;
+  fclose(fp);
+  return ok;
+}
+
+static bool AddFile(const std::string& filename, std::string* error) {
+  std::vector<char> buf;
+  if (!ReadFile(filename.c_str(), &buf)) {
+    *error = "failed to read";
+    return false;
+  }
+  OpHistograms* histograms = GetThreadHistograms();
+  if (buf.size() >= 4 && memcmp(buf.data(), "dex\n", 4) == 0) {
+    return AddDexFileHistogram(buf.data(), buf.size(), &histograms->dex, error);
+  }
+  if (buf.size() >= 4 && memcmp(buf.data(), "\xca\xfe\xba\xbe", 4) == 0) {
+    return AddClassFileHistogram(buf.data(), buf.size(), &histograms->cls, error);
+  }
+  *error = "not a dex or class file";
+  return false;
+}
+
+// Adds path, or the .dex and .class files under it if it is a directory.
+static void FindInputs(const std::string& path, std::vector<std::string>* inputs) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+    inputs->push_back(path);
+    return;
+  }
+  DIR* dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    return;
+  }
+  std::vector<std::string> names;
+  while (dirent* entry = readdir(dir)) {
+    names.push_back(entry->d_name);
+  }
+  closedir(dir);
+  // Sorted, so the inputs and the order of any errors don't depend on the
+  // file system.
+  std::sort(names.begin(), names.end());
+  for (const std::string& name : names) {
+    if (name == "." || name == "..") {
+      continue;
+    }
+    std::string child = path + "/" + name;
+    auto has_suffix = [&](const char* suffix) {
+      size_t length = strlen(suffix);
+      return name.size() > length && name.compare(name.size() - length, length, suffix) == 0;
+    };
+    if (stat(child.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+      FindInputs(child, inputs);
+    } else if (has_suffix(".dex") || has_suffix(".class")) {
+      inputs->push_back(child);
+    }
+  }
+}
+
+// Indices of the non-zero counts, most frequent first.
+static std::vector<uint32_t> SortCounts(const std::vector<uint64_t>& counts, size_t top) {
+  std::vector<uint32_t> order;
+  for (uint32_t i = 0; i < counts.size(); ++i) {
+    if (counts[i] != 0) {
+      order.push_back(i);
+    }
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&](uint32_t a, uint32_t b) { return counts[a] > counts[b]; });
+  if (top != 0 && order.size() > top) {
+    order.resize(top);
+  }
+  return order;
+}
+
+struct OpNames {
+  const char* (*opcode)(uint32_t);
+  const char* (*format)(uint32_t);
+};
+
+static const char* GetDexOpcodeName(uint32_t op) {
+  static const char* const PAYLOAD_NAMES[] = {"packed_switch_payload", "sparse_switch_payload",
+                                              "fill_array_data_payload"};
+  return op < 0x100 ? DEX_OPCODES[op].name : PAYLOAD_NAMES[op - 0x100];
+}
+
+static const char* GetDexFormatName(uint32_t format) {
+  return format < DEX_FORMAT_COUNT ? DEX_FORMAT_NAMES[format] : "payload";
+}
+
+static const char* GetClassOpcodeName(uint32_t op) {
+  return CLASS_OPCODES[op].name;
+}
+
+static const char* GetClassFormatName(uint32_t format) {
+  return CLASS_OPERANDS_NAMES[format];
+}
+
+static void PrintTable(const char* kind, const OpHistogram& histogram, const OpNames& names,
+                       size_t top) {
+  printf("%s: %lu files, %lu methods, %lu instructions\n", kind, (unsigned long)histogram.files,
+         (unsigned long)histogram.methods, (unsigned long)histogram.insns);
+  double total = histogram.insns;
+  printf("  %-48s %12s %8s\n", "opcode", "count", "percent");
+  for (uint32_t op : SortCounts(histogram.opcodes, 0)) {
+    printf("  %-48s %12lu %8.3f\n", names.opcode(op), (unsigned long)histogram.opcodes[op],
+           histogram.opcodes[op] * 100 / total);
+  }
+  printf("  %-48s %12s %8s\n", "opcode pair", "count", "percent");
+  for (uint32_t pair : SortCounts(histogram.pairs, top)) {
+    std::string name = std::string(names.opcode(pair / OPSTAT_OPCODES)) + " " +
+                       names.opcode(pair % OPSTAT_OPCODES);
+    printf("  %-48s %12lu %8.3f\n", name.c_str(), (unsigned long)histogram.pairs[pair],
+           histogram.pairs[pair] * 100 / total);
+  }
+  printf("  %-48s %12s %8s\n", "format", "count", "percent");
+  for (uint32_t format : SortCounts(histogram.formats, 0)) {
+    printf("  %-48s %12lu %8.3f\n", names.format(format),
+           (unsigned long)histogram.formats[format], histogram.formats[format] * 100 / total);
+  }
+}
+
+static void PrintJsonCounts(const char* key, const std::vector<uint64_t>& counts,
+                            const std::vector<uint32_t>& order,
+                            const std::function<std::string(uint32_t)>& name) {
+  printf("\"%s\": {", key);
+  for (size_t i = 0; i < order.size(); ++i) {
+    printf("%s\"%s\": %lu", i ? ", " : "", name(order[i]).c_str(),
+           (unsigned long)counts[order[i]]);
+  }
+  printf("}");
+}
+
+static void PrintJson(const char* kind, const OpHistogram& histogram, const OpNames& names,
+                      size_t top) {
+  printf("\"%s\": {\"files\": %lu, \"methods\": %lu, \"insns\": %lu, ", kind,
+         (unsigned long)histogram.files, (unsigned long)histogram.methods,
+         (unsigned long)histogram.insns);
+  PrintJsonCounts("opcodes", histogram.opcodes, SortCounts(histogram.opcodes, 0),
+                  [&](uint32_t op) { return std::string(names.opcode(op)); });
+  printf(", ");
+  PrintJsonCounts("pairs", histogram.pairs, SortCounts(histogram.pairs, top), [&](uint32_t pair) {
+    return std::string(names.opcode(pair / OPSTAT_OPCODES)) + " " +
+           names.opcode(pair % OPSTAT_OPCODES);
+  });
+  printf(", ");
+  PrintJsonCounts("formats", histogram.formats, SortCounts(histogram.formats, 0),
+                  [&](uint32_t format) { return std::string(names.format(format)); });
+  printf("}");
+}
+
+int main(int argc, char** argv) {
+  size_t top = 50;
+  bool json = false;
+  std::vector<std::string> inputs;
+  bool usage_error = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+      top = strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+      const char* format = argv[++i];
+      json = strcmp(format, "json") == 0;
+      usage_error |= !json && strcmp(format, "table") != 0;
+    } else if (argv[i][0] == '-') {
+      usage_error = true;
+    } else {
+      FindInputs(argv[i], &inputs);
+    }
+  }
+  if (inputs.empty() || usage_error) {
+    fprintf(stderr, "opstat [--top <pairs>] [--format table|json] <dex_or_class_file_or_dir>...\n");
+    return 1;
+  }
+  std::vector<std::string> errors(inputs.size());
+  ParallelFor(inputs.size(), [&](size_t i) {
+    AddFile(inputs[i], &errors[i]);
+  });
+  bool ok = true;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (!errors[i].empty()) {
+      fprintf(stderr, "%s: %s\n", inputs[i].c_str(), errors[i].c_str());
+      ok = false;
+    }
+  }
+  OpHistograms total;
+  for (const auto& histograms : all_histograms) {
+    total.dex.Add(histograms->dex);
+    total.cls.Add(histograms->cls);
+  }
+  OpNames dex_names{GetDexOpcodeName, GetDexFormatName};
+  OpNames class_names{GetClassOpcodeName, GetClassFormatName};
+  if (json) {
+    printf("{");
+    PrintJson("dex", total.dex, dex_names, top);
+    printf(", ");
+    PrintJson("class", total.cls, class_names, top);
+    printf("}\n");
+  } else {
+    if (total.dex.files != 0) {
+      PrintTable("dex", total.dex, dex_names, top);
+    }
+    if (total.cls.files != 0) {
+      PrintTable("class", total.cls, class_names, top);
+    }
+  }
+  return ok ? 0 : 1;
+}
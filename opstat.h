@@ -0,0 +1,69 @@
+#ifndef OPSTAT_H_
+#define OPSTAT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Opcode counts for one instruction set over many files. Dex opcodes
+// 0x00-0xff are counted by opcode and the three payloads after them; class
+// file instructions are counted by the opcode byte an interpreter dispatches
+// on, so wide iload counts as wide. Pairs are of instructions next to each
+// other in a method, leaving out dex payloads, which never run. A
+// malformed file adds what was decoded before the error but doesn't count
+// as a file.
+
+static constexpr uint32_t OPSTAT_OPCODES = 259;
+static constexpr uint32_t OPSTAT_FORMATS = 32;
+// The opcode before the first instruction of a method.
+static constexpr uint32_t OPSTAT_NO_OPCODE = 0xffffffff;
+
+struct OpHistogram {
+  uint64_t files = 0;
+  uint64_t methods = 0;
+  uint64_t insns = 0;
+  std::vector<uint64_t> opcodes;
+  // pairs[first * OPSTAT_OPCODES + second].
+  std::vector<uint64_t> pairs;
+  // By DEX_FORMAT, with payloads after the last format, or by
+  // CLASS_OPERANDS.
+  std::vector<uint64_t> formats;
+
+  OpHistogram()
+      : opcodes(OPSTAT_OPCODES), pairs(OPSTAT_OPCODES * OPSTAT_OPCODES), formats(OPSTAT_FORMATS) {
+  }
+
+  void AddInsn(uint32_t prev, uint32_t op, uint32_t format) {
+    insns++;
+    opcodes[op]++;
+    formats[format]++;
+    if (prev != OPSTAT_NO_OPCODE) {
+      pairs[prev * OPSTAT_OPCODES + op]++;
+    }
+  }
+
+  void Add(const OpHistogram& other) {
+    files += other.files;
+    methods += other.methods;
+    insns += other.insns;
+    for (size_t i = 0; i < opcodes.size(); ++i) {
+      opcodes[i] += other.opcodes[i];
+    }
+    for (size_t i = 0; i < pairs.size(); ++i) {
+      pairs[i] += other.pairs[i];
+    }
+    for (size_t i = 0; i < formats.size(); ++i) {
+      formats[i] += other.formats[i];
+    }
+  }
+};
+
+// Adds the code of the class file in data to histogram. Defined in
+// opstat_class.cpp, because java_class.h and dex.h can't be included
+// together.
+bool AddClassFileHistogram(const char* data, size_t size, OpHistogram* histogram,
+                           std::string* error);
+
+#endif  // OPSTAT_H_
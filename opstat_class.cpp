@@ -0,0 +1,40 @@
+#include <stdint.h>
+
+#include <string>
+
+#include "class_insns.h"
+#include "class_members.h"
+#include "opstat.h"
+#include "utils.h"
+
+bool AddClassFileHistogram(const char* data, size_t size, OpHistogram* histogram,
+                           std::string* error) {
+  ClassMembers cls;
+  if (!ReadClassMembers(data, size, &cls)) {
+    *error = "malformed class file";
+    return false;
+  }
+  ClassInsn buf[64];
+  for (const ClassMethodInfo& method : cls.methods) {
+    if (!method.has_code) {
+      continue;
+    }
+    histogram->methods++;
+    uint32_t prev = OPSTAT_NO_OPCODE;
+    ClassInsnScanner scanner(method.code, method.code_length);
+    while (size_t count = scanner.Next(buf, 64)) {
+      for (size_t i = 0; i < count; ++i) {
+        uint32_t op = buf[i].wide ? INST_WIDE : buf[i].op;
+        histogram->AddInsn(prev, op, CLASS_OPCODES[op].operands);
+        prev = op;
+      }
+    }
+    if (scanner.error() != nullptr) {
+      *error = StringPrintf("%s%s: %s at %u", method.name.c_str(), method.descriptor.c_str(),
+                            scanner.error(), scanner.pc());
+      return false;
+    }
+  }
+  histogram->files++;
+  return true;
+}
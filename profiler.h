@@ -0,0 +1,332 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "utils.h"
+
+// A sampling profiler for the code that walks bytecode. Whatever is running
+// a method (today the verifiers) keeps profile_frame up to date; a
+// CPU-time timer raises SIGPROF, and the handler copies the frame of the
+// interrupted thread into a lock-free ring, which a background thread
+// drains. Samples are symbolized after the timer is stopped, so the handler
+// never allocates, locks or calls into the symbolizer.
+
+static constexpr uint32_t PROFILE_NO_METHOD = 0xffffffff;
+
+// The method and pc being run by a thread. Only that thread writes it and
+// only a signal handler on that thread reads it, so volatile is enough.
+struct ProfileFrame {
+  volatile uint32_t method;
+  volatile uint32_t pc;
+};
+
+// Initial-exec TLS in the executable, which is safe to read in a handler.
+static thread_local ProfileFrame profile_frame = {PROFILE_NO_METHOD, 0};
+
+static inline void SetProfilePc(uint32_t pc) {
+  profile_frame.pc = pc;
+}
+
+// Marks the calling thread as running method for the life of the scope.
+class ProfileMethodScope {
+ public:
+  explicit ProfileMethodScope(uint32_t method) : saved_method_(profile_frame.method),
+                                                 saved_pc_(profile_frame.pc) {
+    profile_frame.pc = 0;
+    profile_frame.method = method;
+  }
+
+  ~ProfileMethodScope() {
+    profile_frame.method = saved_method_;
+    profile_frame.pc = saved_pc_;
+  }
+
+ private:
+  uint32_t saved_method_;
+  uint32_t saved_pc_;
+};
+
+struct ProfileSample {
+  uint32_t method;
+  uint32_t pc;
+};
+
+// A fixed-size ring of samples that any number of signal handlers can write
+// at once. Each writer claims a position with one fetch_add and publishes
+// the slot by storing its position in seq; a slot whose seq doesn't match
+// was overwritten or is still being written, and is skipped by Drain. Only
+// one thread drains. Once more than PROFILE_RING_SIZE samples are pending
+// the oldest are lost.
+static constexpr uint32_t PROFILE_RING_SIZE = 1 << 16;
+
+class ProfileRing {
+ public:
+  ProfileRing() : head_(0), tail_(0), slots_(PROFILE_RING_SIZE) {
+    for (Slot& slot : slots_) {
+      slot.seq.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void Push(uint32_t method, uint32_t pc) {
+    uint64_t pos = head_.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots_[pos & (PROFILE_RING_SIZE - 1)];
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    slot.method = method;
+    slot.pc = pc;
+    slot.seq.store(pos + 1, std::memory_order_release);
+  }
+
+  // Appends the samples pushed since the last Drain and returns how many
+  // were lost.
+  uint64_t Drain(std::vector<ProfileSample>* samples) {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t lost = 0;
+    if (head - tail_ > PROFILE_RING_SIZE) {
+      lost = head - tail_ - PROFILE_RING_SIZE;
+      tail_ = head - PROFILE_RING_SIZE;
+    }
+    for (; tail_ < head; ++tail_) {
+      Slot& slot = slots_[tail_ & (PROFILE_RING_SIZE - 1)];
+      if (slot.seq.load(std::memory_order_acquire) != tail_ + 1) {
+        lost++;
+        continue;
+      }
+      ProfileSample sample = {slot.method, slot.pc};
+      if (slot.seq.load(std::memory_order_acquire) != tail_ + 1) {
+        lost++;
+        continue;
+      }
+      samples->push_back(sample);
+    }
+    return lost;
+  }
+
+ private:
+  struct Slot {
+    std::atomic<uint64_t> seq;
+    volatile uint32_t method;
+    volatile uint32_t pc;
+  };
+
+  std::atomic<uint64_t> head_;
+  uint64_t tail_;
+  std::vector<Slot> slots_;
+};
+
+static ProfileRing* profile_ring = nullptr;
+
+static void HandleProfileSignal(int) {
+  ProfileRing* ring = profile_ring;
+  if (ring != nullptr) {
+    ring->Push(profile_frame.method, profile_frame.pc);
+  }
+}
+
+// Samples the process hz times per second of CPU time, summed over its
+// threads, from Start to Stop. The kernel sends SIGPROF to the thread that
+// used up the interval, so busy threads are sampled in proportion to their
+// CPU time. The kernel checks CPU timers on its tick, so rates above
+// CONFIG_HZ give fewer samples than asked for. Only one Profiler may run at
+// a time.
+class Profiler {
+ public:
+  Profiler() : running_(false), stopping_(false), lost_(0) {
+  }
+
+  ~Profiler() {
+    Stop();
+  }
+
+  bool Start(uint32_t hz, std::string* error) {
+    profile_ring = &ring_;
+    struct sigaction action = {};
+    action.sa_handler = HandleProfileSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &old_action_) != 0) {
+      *error = "failed to install the SIGPROF handler";
+      return false;
+    }
+    struct sigevent event = {};
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGPROF;
+    if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &event, &timer_) != 0) {
+      sigaction(SIGPROF, &old_action_, nullptr);
+      *error = "failed to create the profiling timer";
+      return false;
+    }
+    stopping_ = false;
+    drainer_ = std::thread([this]() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!stopped_.wait_for(lock, std::chrono::milliseconds(100),
+                                [this]() { return stopping_; })) {
+        lost_ += ring_.Drain(&samples_);
+      }
+    });
+    struct itimerspec spec = {};
+    spec.it_interval.tv_sec = hz == 1 ? 1 : 0;
+    spec.it_interval.tv_nsec = hz == 1 ? 0 : 1000000000 / hz;
+    spec.it_value = spec.it_interval;
+    timer_settime(timer_, 0, &spec, nullptr);
+    running_ = true;
+    return true;
+  }
+
+  // Stops sampling and drains the samples that are left.
+  void Stop() {
+    if (!running_) {
+      return;
+    }
+    timer_delete(timer_);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    stopped_.notify_one();
+    drainer_.join();
+    sigaction(SIGPROF, &old_action_, nullptr);
+    running_ = false;
+    lost_ += ring_.Drain(&samples_);
+    profile_ring = nullptr;
+  }
+
+  // Valid once stopped.
+  const std::vector<ProfileSample>& samples() const {
+    return samples_;
+  }
+
+  uint64_t lost() const {
+    return lost_;
+  }
+
+ private:
+  bool running_;
+  timer_t timer_;
+  struct sigaction old_action_;
+  ProfileRing ring_;
+  std::thread drainer_;
+  std::mutex mutex_;
+  std::condition_variable stopped_;
+  bool stopping_;
+  std::vector<ProfileSample> samples_;
+  uint64_t lost_;
+};
+
+// The name of a method and the line of a pc in it, for a folded stack. line
+// is 0 if the method has no line information for the pc.
+struct ProfileSymbol {
+  std::string method;
+  uint32_t line;
+};
+
+// Appends the Java name of the type descriptor at d, e.g. "int[]" for "[I",
+// and advances d past it.
+static void AppendJavaTypeName(const char*& d, std::string* out) {
+  int dims = 0;
+  while (*d == '[') {
+    dims++;
+    d++;
+  }
+  static const std::pair<char, const char*> PRIMITIVES[] = {
+      {'Z', "boolean"}, {'B', "byte"}, {'S', "short"}, {'C', "char"}, {'I', "int"},
+      {'J', "long"},    {'F', "float"}, {'D', "double"}, {'V', "void"},
+  };
+  if (*d == 'L') {
+    for (d++; *d != '\0' && *d != ';'; d++) {
+      out->push_back(*d == '/' ? '.' : *d);
+    }
+    if (*d == ';') {
+      d++;
+    }
+  } else if (*d != '\0') {
+    for (const auto& primitive : PRIMITIVES) {
+      if (primitive.first == *d) {
+        *out += primitive.second;
+      }
+    }
+    d++;
+  }
+  for (int i = 0; i < dims; ++i) {
+    *out += "[]";
+  }
+}
+
+// "com.example.Foo.bar(int, java.lang.String)" for class "Lcom/example/Foo;"
+// or "com/example/Foo", name "bar" and descriptor "(ILjava/lang/String;)V".
+// The result has no ';', which separates the frames of a folded stack.
+static std::string GetJavaMethodName(const std::string& class_name, const std::string& name,
+                                     const std::string& descriptor) {
+  std::string result;
+  const char* d = class_name.c_str();
+  if (*d == 'L') {
+    AppendJavaTypeName(d, &result);
+  } else {
+    for (; *d != '\0'; d++) {
+      result.push_back(*d == '/' ? '.' : *d);
+    }
+  }
+  result.push_back('.');
+  result += name;
+  result.push_back('(');
+  d = descriptor.c_str();
+  if (*d == '(') {
+    d++;
+  }
+  while (*d != '\0' && *d != ')') {
+    if (result.back() != '(') {
+      result += ", ";
+    }
+    AppendJavaTypeName(d, &result);
+  }
+  result.push_back(')');
+  return result;
+}
+
+// Writes samples as folded stacks, "<method>;<method>:<line> <count>", the
+// input of flamegraph.pl. Each distinct method and pc is symbolized once.
+// Samples taken outside any method are counted under "[no method]".
+static void WriteFoldedStacks(
+    FILE* fp, const std::vector<ProfileSample>& samples,
+    const std::function<ProfileSymbol(uint32_t method, uint32_t pc)>& symbolize) {
+  std::map<std::pair<uint32_t, uint32_t>, uint64_t> counts;
+  for (const ProfileSample& sample : samples) {
+    uint32_t pc = sample.method == PROFILE_NO_METHOD ? 0 : sample.pc;
+    counts[std::make_pair(sample.method, pc)]++;
+  }
+  std::map<std::string, uint64_t> stacks;
+  for (const auto& entry : counts) {
+    uint32_t method = entry.first.first;
+    uint32_t pc = entry.first.second;
+    std::string stack;
+    if (method == PROFILE_NO_METHOD) {
+      stack = "[no method]";
+    } else {
+      ProfileSymbol symbol = symbolize(method, pc);
+      stack = symbol.method + ";" + symbol.method;
+      stack += symbol.line != 0 ? StringPrintf(":%u", symbol.line) : StringPrintf("+0x%x", pc);
+    }
+    stacks[stack] += entry.second;
+  }
+  for (const auto& entry : stacks) {
+    fprintf(fp, "%s %lu\n", entry.first.c_str(), (unsigned long)entry.second);
+  }
+}
+
+#endif  // PROFILER_H_
@@ -4,26 +4,40 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <memory>
+#include <string>
 #include <vector>
 
+#include "class_insns.h"
+#include "class_opcodes.h"
+#include "class_verifier.h"
 #include "java_class.h"
 #include "java_class_namemap.h"
+#include "line_table.h"
+#include "mutf8.h"
+#include "profiler.h"
+#include "record_writer.h"
 #include "utils.h"
 
 constexpr uint32_t CLASS_MAGIC = 0xCAFEBABE;
 
-template <typename T>
-void Read(const char*& p, const char* end, T& value) {
-  static_assert(std::is_standard_layout<T>::value, "...");
-  if (p + sizeof(T) > end) {
-    Abort("data not enough for Read()\n");
-  }
-  value = 0;
-  for (size_t i = 0; i < sizeof(T); ++i) {
-    value = (value << 8) | *(const uint8_t*)p;
-    p++;
-  }
-}
+struct ClassFieldSummary {
+  uint16_t access_flags;
+  std::string name;
+  std::string descriptor;
+};
+
+// What JavaClass::Scan() reads of a class: everything but its attributes.
+struct ClassSummary {
+  uint16_t minor_version;
+  uint16_t major_version;
+  uint16_t access_flags;
+  uint16_t this_class;
+  uint16_t super_class;
+  std::vector<uint16_t> interfaces;
+  std::vector<ClassFieldSummary> fields;
+  std::vector<ClassMethodInfo> methods;
+};
 
 class JavaClass {
  public:
@@ -52,6 +66,18 @@ class JavaClass {
     Read(p_, end_, constant_pool_count_);
     printf("constant_pool_count: %u\n", constant_pool_count_);
     printf("constant pool:\n");
+    if (!IndexConstantPool()) {
+      return false;
+    }
+    for (uint16_t i = 1; i < constant_pool_count_; ++i) {
+      if (constant_pool_[i] != nullptr) {
+        PrintConstantPoolEntry(0, i);
+      }
+    }
+    return true;
+  }
+
+  bool IndexConstantPool() {
     constant_pool_.resize(constant_pool_count_ + 1, nullptr);
     for (uint16_t i = 1; i < constant_pool_count_; ++i) {
       constant_pool_[i] = p_;
@@ -70,6 +96,7 @@ class JavaClass {
       case CONSTANT_Integer:
       case CONSTANT_Float:
       case CONSTANT_NameAndType:
+      case CONSTANT_InvokeDynamic:
         p_ += 5; break;
       case CONSTANT_Long:
       case CONSTANT_Double:
@@ -78,6 +105,11 @@ class JavaClass {
           const char* p = p_ + 1;
           uint16_t length;
           Read(p, end_, length);
+          size_t utf16_length;
+          if (length > end_ - p || !ValidateMutf8(p, length, &utf16_length)) {
+            fprintf(stderr, "constant #%u is not valid modified UTF-8\n", i);
+            return false;
+          }
           p_ += 3 + length;
           break;
         }
@@ -86,11 +118,6 @@ class JavaClass {
         return false;
       }
     }
-    for (uint16_t i = 1; i < constant_pool_count_; ++i) {
-      if (constant_pool_[i] != nullptr) {
-        PrintConstantPoolEntry(0, i);
-      }
-    }
     return true;
   }
 
@@ -168,7 +195,364 @@ class JavaClass {
     return true;
   }
 
+  // Verifies every method without dumping the class. Once the constant pool
+  // is indexed the methods are independent, so they are verified in parallel.
+  bool Verify() {
+    ClassSummary summary;
+    if (!Scan(&summary)) {
+      return false;
+    }
+    const std::vector<ClassMethodInfo>& methods = summary.methods;
+    std::string this_class_name = GetConstantPoolEntryString(summary.this_class);
+    std::vector<std::string> results(methods.size());
+    std::vector<char> verified(methods.size());
+    ParallelFor(methods.size(), [&](size_t i) {
+      ProfileMethodScope profile_scope(i);
+      MethodVerifier verifier(constant_pool_, end_, this_class_name, methods[i]);
+      verified[i] = verifier.Verify(summary.major_version);
+      if (!verified[i]) {
+        results[i] = verifier.error();
+      } else if (!methods[i].has_code) {
+        results[i] = "ok (no code)";
+      } else {
+        results[i] = verifier.used_inference() ? "ok (type inference)" : "ok (type checking)";
+      }
+    });
+    size_t failed = 0;
+    for (size_t i = 0; i < methods.size(); ++i) {
+      printf("method #%zu %s%s: %s\n", i, methods[i].name.c_str(), methods[i].descriptor.c_str(),
+             results[i].c_str());
+      if (!verified[i]) {
+        failed++;
+      }
+    }
+    printf("verified %zu methods, %zu failed\n", methods.size(), failed);
+    return failed == 0;
+  }
+
+  // Writes the samples of profiler, taken while verifying, as folded stacks
+  // of method names and lines to filename.
+  bool WriteProfile(const char* filename, const Profiler& profiler) {
+    ClassSummary summary;
+    if (!Scan(&summary)) {
+      return false;
+    }
+    const std::vector<ClassMethodInfo>& methods = summary.methods;
+    std::string this_class_name = GetConstantPoolEntryString(summary.this_class);
+    FILE* fp = fopen(filename, "w");
+    if (fp == nullptr) {
+      fprintf(stderr, "failed to open %s\n", filename);
+      return false;
+    }
+    LineTableCache lines(methods.size(), [&](uint32_t method_index, LineEntries* entries) {
+      const ClassMethodInfo& method = methods[method_index];
+      const char* p = method.line_number_table;
+      for (uint16_t i = 0; method.has_code && p != nullptr && i < method.line_number_table_length;
+           ++i) {
+        uint16_t start_pc;
+        uint16_t line_number;
+        Read(p, end_, start_pc);
+        Read(p, end_, line_number);
+        entries->emplace_back(start_pc, line_number);
+      }
+    });
+    WriteFoldedStacks(fp, profiler.samples(), [&](uint32_t method_index, uint32_t pc) {
+      ProfileSymbol symbol = {"[unknown method]", 0};
+      if (method_index >= methods.size()) {
+        return symbol;
+      }
+      const ClassMethodInfo& method = methods[method_index];
+      symbol.method = GetJavaMethodName(this_class_name, method.name, method.descriptor);
+      symbol.line = lines.FindLine(method_index, pc);
+      return symbol;
+    });
+    fclose(fp);
+    fprintf(stderr, "wrote %zu samples (%lu lost) to %s\n", profiler.samples().size(),
+            (unsigned long)profiler.lost(), filename);
+    return true;
+  }
+
+  // Writes a record of the class, then records of its fields and methods,
+  // each method followed by records of its instructions. Each record starts
+  // with the fields shared with read_dex, see record_writer.h, followed by:
+  //   class: major_version, minor_version
+  //   method: max_stack, max_locals, code_length
+  //   insn: length, wide, a, b, c
+  // idx is the position in the class file, and index is the constant an
+  // instruction refers to. Class names are written as type descriptors.
+  bool WriteRecords(RecordWriter* writer) {
+    ClassSummary summary;
+    if (!Scan(&summary)) {
+      return false;
+    }
+    std::string this_class_name = GetClassDescriptor(summary.this_class);
+    std::vector<std::string> interfaces;
+    for (uint16_t interface_idx : summary.interfaces) {
+      interfaces.push_back(GetClassDescriptor(interface_idx));
+    }
+    writer->Begin(RECORD_CLASS);
+    writer->AddClassHead(this_class_name, summary.access_flags,
+                         GetClassDescriptor(summary.super_class), interfaces);
+    writer->AddInt("major_version", summary.major_version);
+    writer->AddInt("minor_version", summary.minor_version);
+    writer->End();
+    for (size_t i = 0; i < summary.fields.size(); ++i) {
+      const ClassFieldSummary& field = summary.fields[i];
+      writer->Begin(RECORD_FIELD);
+      writer->AddFieldHead(i, this_class_name, field.name, field.descriptor, field.access_flags);
+      writer->End();
+    }
+    bool ok = true;
+    for (size_t i = 0; i < summary.methods.size(); ++i) {
+      const ClassMethodInfo& method = summary.methods[i];
+      std::string return_type;
+      std::vector<std::string> parameters;
+      SplitMethodDescriptor(method.descriptor, &return_type, &parameters);
+      writer->Begin(RECORD_METHOD);
+      writer->AddMethodHead(i, this_class_name, method.name, return_type, parameters,
+                            method.access_flags);
+      writer->AddInt("max_stack", method.has_code ? method.max_stack : 0);
+      writer->AddInt("max_locals", method.has_code ? method.max_locals : 0);
+      writer->AddInt("code_length", method.has_code ? method.code_length : 0);
+      writer->End();
+      if (!method.has_code) {
+        continue;
+      }
+      ClassInsn buf[64];
+      ClassInsnScanner scanner(method.code, method.code_length);
+      while (size_t count = scanner.Next(buf, 64)) {
+        for (size_t j = 0; j < count; ++j) {
+          const ClassInsn& insn = buf[j];
+          RecordRef ref = HasConstantOperand(insn) ? GetConstantRecordRef(insn.a) : RecordRef();
+          writer->Begin(RECORD_INSN);
+          writer->AddInsnHead(i, insn.pc, CLASS_OPCODES[insn.op].name, ref);
+          writer->AddInt("length", insn.length);
+          writer->AddInt("wide", insn.wide);
+          writer->AddInt("a", insn.a);
+          writer->AddInt("b", insn.b);
+          writer->AddInt("c", insn.c);
+          writer->End();
+        }
+      }
+      if (scanner.error() != nullptr) {
+        fprintf(stderr, "%s: method %s%s: %s at 0x%x\n", filename_, method.name.c_str(),
+                method.descriptor.c_str(), scanner.error(), scanner.pc());
+        ok = false;
+      }
+    }
+    return ok;
+  }
+
  private:
+  // Reads the class without printing it, indexing the constant pool on the
+  // way.
+  bool Scan(ClassSummary* summary) {
+    p_ = data_;
+    uint32_t magic;
+    Read(p_, end_, magic);
+    if (magic != CLASS_MAGIC) {
+      fprintf(stderr, "%s is not a class file\n", filename_);
+      return false;
+    }
+    Read(p_, end_, summary->minor_version);
+    Read(p_, end_, summary->major_version);
+    Read(p_, end_, constant_pool_count_);
+    if (!IndexConstantPool()) {
+      return false;
+    }
+    uint16_t interface_count;
+    Read(p_, end_, summary->access_flags);
+    Read(p_, end_, summary->this_class);
+    Read(p_, end_, summary->super_class);
+    Read(p_, end_, interface_count);
+    summary->interfaces.resize(interface_count);
+    for (auto& interface_idx : summary->interfaces) {
+      Read(p_, end_, interface_idx);
+    }
+    auto get_name = [&](uint16_t index, std::string* name) {
+      *name = GetConstantPoolEntryString(index);
+      return true;
+    };
+    std::string error;
+    Read(p_, end_, field_count_);
+    summary->fields.resize(field_count_);
+    for (auto& field : summary->fields) {
+      uint16_t name_index;
+      uint16_t descriptor_index;
+      Read(p_, end_, field.access_flags);
+      Read(p_, end_, name_index);
+      Read(p_, end_, descriptor_index);
+      field.name = GetConstantPoolEntryString(name_index);
+      field.descriptor = GetConstantPoolEntryString(descriptor_index);
+      if (!ScanClassAttributes(p_, end_, get_name, nullptr, nullptr, &error)) {
+        fprintf(stderr, "%s: %s\n", filename_, error.c_str());
+        return false;
+      }
+    }
+    Read(p_, end_, method_count_);
+    summary->methods.resize(method_count_);
+    for (auto& method : summary->methods) {
+      uint16_t name_index;
+      uint16_t descriptor_index;
+      Read(p_, end_, method.access_flags);
+      Read(p_, end_, name_index);
+      Read(p_, end_, descriptor_index);
+      method.name = GetConstantPoolEntryString(name_index);
+      method.descriptor = GetConstantPoolEntryString(descriptor_index);
+      if (!ScanClassAttributes(p_, end_, get_name, &method, nullptr, &error)) {
+        fprintf(stderr, "%s: %s\n", filename_, error.c_str());
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static bool HasConstantOperand(const ClassInsn& insn) {
+    switch (CLASS_OPCODES[insn.op].operands) {
+      case CLASS_OPERANDS_CONSTANT_U1:
+      case CLASS_OPERANDS_CONSTANT:
+      case CLASS_OPERANDS_INVOKEINTERFACE:
+      case CLASS_OPERANDS_INVOKEDYNAMIC:
+      case CLASS_OPERANDS_MULTIANEWARRAY:
+        return true;
+    }
+    return false;
+  }
+
+  bool IsConstant(uint32_t index, uint8_t tag) const {
+    return index != 0 && index < constant_pool_count_ && constant_pool_[index] != nullptr &&
+           (uint8_t)*constant_pool_[index] == tag;
+  }
+
+  // The two u2s of the constant at index, which must exist.
+  void GetConstantU2s(uint32_t index, uint16_t* first, uint16_t* second) {
+    const char* p = constant_pool_[index] + 1;
+    Read(p, end_, *first);
+    if (second != nullptr) {
+      Read(p, end_, *second);
+    }
+  }
+
+  // The Utf8 constant at index, or "" if there is none.
+  std::string GetUtf8Constant(uint32_t index) {
+    return IsConstant(index, CONSTANT_Utf8) ? GetConstantPoolEntryString(index) : "";
+  }
+
+  // The class constant at index as a type descriptor, or "" if there is none.
+  std::string GetClassDescriptor(uint32_t index) {
+    if (!IsConstant(index, CONSTANT_Class)) {
+      return std::string();
+    }
+    uint16_t name_index;
+    GetConstantU2s(index, &name_index, nullptr);
+    std::string name = GetUtf8Constant(name_index);
+    return (name.empty() || name[0] == '[') ? name : "L" + name + ";";
+  }
+
+  // What the constant at index refers to, for the insn records. Parts that
+  // are missing from the constant pool are left empty.
+  RecordRef GetConstantRecordRef(uint32_t index) {
+    RecordRef ref;
+    ref.index = index;
+    if (index == 0 || index >= constant_pool_count_ || constant_pool_[index] == nullptr) {
+      return ref;
+    }
+    uint8_t tag = *constant_pool_[index];
+    uint16_t first;
+    uint16_t second;
+    switch (tag) {
+      case CONSTANT_String:
+        ref.kind = "string";
+        GetConstantU2s(index, &first, nullptr);
+        ref.value = GetUtf8Constant(first);
+        break;
+      case CONSTANT_Integer:
+      case CONSTANT_Float:
+      case CONSTANT_Long:
+      case CONSTANT_Double:
+        ref.kind = "constant";
+        ref.value = GetConstantPoolEntryString(index);
+        break;
+      case CONSTANT_Class:
+        ref.kind = "type";
+        ref.type = GetClassDescriptor(index);
+        break;
+      case CONSTANT_Fieldref:
+      case CONSTANT_Methodref:
+      case CONSTANT_InterfaceMethodref:
+        ref.kind = tag == CONSTANT_Fieldref ? "field" : "method";
+        GetConstantU2s(index, &first, &second);
+        ref.cls = GetClassDescriptor(first);
+        GetNameAndType(second, &ref);
+        break;
+      case CONSTANT_InvokeDynamic:
+        ref.kind = "call_site";
+        GetConstantU2s(index, &first, &second);
+        GetNameAndType(second, &ref);
+        break;
+      case CONSTANT_MethodHandle:
+      {
+        // reference_kind u1, then the index of the field or method.
+        ref.kind = "method_handle";
+        const char* p = constant_pool_[index] + 2;
+        Read(p, end_, first);
+        if (IsConstant(first, CONSTANT_Fieldref) || IsConstant(first, CONSTANT_Methodref) ||
+            IsConstant(first, CONSTANT_InterfaceMethodref)) {
+          RecordRef member = GetConstantRecordRef(first);
+          ref.cls = member.cls;
+          ref.name = member.name;
+          ref.type = member.type;
+        }
+        break;
+      }
+      case CONSTANT_MethodType:
+        ref.kind = "method_type";
+        GetConstantU2s(index, &first, nullptr);
+        ref.type = GetUtf8Constant(first);
+        break;
+    }
+    return ref;
+  }
+
+  void GetNameAndType(uint32_t index, RecordRef* ref) {
+    if (!IsConstant(index, CONSTANT_NameAndType)) {
+      return;
+    }
+    uint16_t name_index;
+    uint16_t descriptor_index;
+    GetConstantU2s(index, &name_index, &descriptor_index);
+    ref->name = GetUtf8Constant(name_index);
+    ref->type = GetUtf8Constant(descriptor_index);
+  }
+
+  // Splits a method descriptor such as "(I[Ljava/lang/String;)V" into the
+  // descriptors of its return type and its parameters. What can't be parsed
+  // is left out.
+  static void SplitMethodDescriptor(const std::string& descriptor, std::string* return_type,
+                                    std::vector<std::string>* parameters) {
+    if (descriptor.empty() || descriptor[0] != '(') {
+      return;
+    }
+    size_t pos = 1;
+    while (pos < descriptor.size() && descriptor[pos] != ')') {
+      size_t start = pos;
+      while (pos < descriptor.size() && descriptor[pos] == '[') {
+        pos++;
+      }
+      if (pos < descriptor.size() && descriptor[pos] == 'L') {
+        pos = descriptor.find(';', pos);
+      }
+      if (pos >= descriptor.size()) {
+        return;
+      }
+      pos++;
+      parameters->push_back(descriptor.substr(start, pos - start));
+    }
+    if (pos < descriptor.size()) {
+      *return_type = descriptor.substr(pos + 1);
+    }
+  }
+
   bool PrintConstantPoolEntry(int indent, int constIndex) {
     const char* p = constant_pool_[constIndex];
     uint8_t tag = *p++;
@@ -183,10 +567,8 @@ class JavaClass {
     {
       uint16_t length;
       Read(p, end_, length);
-      char buf[length + 1];
-      memcpy(buf, p, length);
-      buf[length] = '\0';
-      PrintIndented(indent, "bytes: %s\n", buf);
+      std::string bytes(p, length);
+      PrintIndented(indent, "bytes: %s\n", bytes.c_str());
       break;
     }
     case CONSTANT_String:
@@ -504,9 +886,8 @@ class JavaClass {
                                        inner_class_access_flags).c_str());
 
         }
-      } else {
-        Abort("unsupported attribute %s\n", name.c_str());
       }
+      // Attributes not decoded above are shown by name and length only.
       p = next_p;
     }
     return p;
@@ -533,7 +914,7 @@ class JavaClass {
     while (p < end) {
       uint8_t inst = *p++;
       PrintIndented(indent, "#0x%x %s ", (uint32_t)(p - start - 1),
-                    FindMap(CLASS_INST_OP_NAME_MAP, inst));
+                    CLASS_OPCODES[inst].name);
       switch (inst) {
         case INST_ALOAD:
         case INST_ASTORE:
@@ -717,7 +1098,7 @@ class JavaClass {
         case INST_WIDE:
         {
           uint8_t opcode = *p++;
-          printf("%s(0x%x) ", FindMap(CLASS_INST_OP_NAME_MAP, opcode), opcode);
+          printf("%s(0x%x) ", CLASS_OPCODES[opcode].name, opcode);
           if (opcode == INST_IINC) {
             uint16_t index;
             int16_t const_value;
@@ -754,7 +1135,11 @@ class JavaClass {
   uint16_t method_count_;
 };
 
-bool ReadClass(const char* filename) {
+// format is nullptr for the dump, or "json" or "binary" for records, see
+// JavaClass::WriteRecords. profile, if not nullptr, is the file to write
+// folded stacks of verifier samples to, see profiler.h.
+bool ReadClass(const char* filename, bool verify, const char* format, const char* profile,
+               uint32_t profile_hz) {
   FILE* fp = fopen(filename, "rb");
   if (fp == nullptr) {
     fprintf(stderr, "failed to open %s\n", filename);
@@ -762,7 +1147,9 @@ bool ReadClass(const char* filename) {
   }
   fseek(fp, 0, SEEK_END);
   long size = ftell(fp);
-  printf("size of %s is %ld\n", filename, size);
+  if (format == nullptr) {
+    printf("size of %s is %ld\n", filename, size);
+  }
   fseek(fp, 0, SEEK_SET);
   std::vector<char> buf(size);
   if (fread(buf.data(), size, 1, fp) != 1) {
@@ -771,8 +1158,28 @@ bool ReadClass(const char* filename) {
   }
   fclose(fp);
   JavaClass cls(filename, buf.data(), buf.size());
+  if (verify) {
+    Profiler profiler;
+    std::string error;
+    if (profile != nullptr && !profiler.Start(profile_hz, &error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      return false;
+    }
+    bool ok = cls.Verify();
+    if (profile != nullptr) {
+      profiler.Stop();
+      ok &= cls.WriteProfile(profile, profiler);
+    }
+    return ok;
+  }
+  if (format != nullptr) {
+    std::unique_ptr<RecordWriter> writer = NewRecordWriter(format, stdout);
+    return cls.WriteRecords(writer.get());
+  }
   cls.ParseHead();
-  cls.ParseConstantPool();
+  if (!cls.ParseConstantPool()) {
+    return false;
+  }
   cls.ParseAccessFlags();
   cls.ParseFields();
   cls.ParseMethods();
@@ -781,10 +1188,32 @@ bool ReadClass(const char* filename) {
 }
 
 int main(int argc, char** argv) {
-  if (argc != 2) {
-    fprintf(stderr, "read_class <class_file>\n");
+  bool verify = false;
+  const char* format = nullptr;
+  const char* profile = nullptr;
+  uint32_t profile_hz = 1000;
+  const char* filename = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--verify") == 0) {
+      verify = true;
+    } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+      format = argv[++i];
+    } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      profile = argv[++i];
+    } else if (strcmp(argv[i], "--profile-hz") == 0 && i + 1 < argc) {
+      profile_hz = atoi(argv[++i]);
+    } else if (filename == nullptr) {
+      filename = argv[i];
+    } else {
+      filename = nullptr;
+      break;
+    }
+  }
+  if (filename == nullptr || (format != nullptr && (verify || !IsRecordFormat(format))) ||
+      (profile != nullptr && !verify) || profile_hz == 0) {
+    fprintf(stderr, "read_class [--verify [--profile <file> [--profile-hz <n>]] | "
+            "--format json|binary] <class_file>\n");
     return 1;
   }
-  const char* filename = argv[1];
-  ReadClass(filename);
+  return ReadClass(filename, verify, format, profile, profile_hz) ? 0 : 1;
 }
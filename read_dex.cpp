@@ -1,138 +1,175 @@
+#include <fnmatch.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 
 #include <algorithm>
+#include <memory>
 #include <vector>
 
 #include "dex.h"
+#include "dex_cache.h"
+#include "dex_call_graph.h"
+#include "dex_checksum.h"
+#include "dex_file.h"
+#include "dex_image.h"
+#include "dex_insns.h"
 #include "dex_namemap.h"
+#include "dex_reachability.h"
+#include "dex_verifier.h"
+#include "dex_writer.h"
+#include "dex_xref.h"
+#include "line_table.h"
+#include "profiler.h"
+#include "record_writer.h"
 #include "utils.h"
 
-template <typename T>
-void Read(const char*& p, const char* end, T& value) {
-  static_assert(std::is_standard_layout<T>::value, "...");
-  if (p + sizeof(T) > end) {
-    Abort("data not enough for Read()\n");
+enum DEX_DUMP_SECTIONS {
+  DUMP_STRING_IDS = 0x01,
+  DUMP_TYPE_IDS = 0x02,
+  DUMP_PROTO_IDS = 0x04,
+  DUMP_FIELD_IDS = 0x08,
+  DUMP_METHOD_IDS = 0x10,
+  DUMP_CLASS_DEFS = 0x20,
+  DUMP_ALL = 0x3f,
+};
+
+static const std::vector<std::pair<int, const char*>> DUMP_SECTIONS_NAMEVECTOR = {
+  {DUMP_STRING_IDS, "strings"},
+  {DUMP_TYPE_IDS, "types"},
+  {DUMP_PROTO_IDS, "protos"},
+  {DUMP_FIELD_IDS, "fields"},
+  {DUMP_METHOD_IDS, "methods"},
+  {DUMP_CLASS_DEFS, "classes"},
+};
+
+// Parses a comma separated list of section names into DEX_DUMP_SECTIONS.
+static bool ParseDumpSections(const char* list, uint32_t* sections) {
+  *sections = 0;
+  while (*list != '\0') {
+    const char* comma = strchr(list, ',');
+    size_t length = comma == nullptr ? strlen(list) : comma - list;
+    bool found = false;
+    for (auto& section : DUMP_SECTIONS_NAMEVECTOR) {
+      if (strlen(section.second) == length && strncmp(section.second, list, length) == 0) {
+        *sections |= section.first;
+        found = true;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+    list += length + (comma != nullptr);
   }
-  memcpy(&value, p, sizeof(T));
-  p += sizeof(T);
+  return *sections != 0;
 }
 
-template <typename T>
-void ReadEncodedValue(const char*& p, int size, T& value, bool sign_extend) {
-  value = 0;
-  char* t = (char*)&value;
-  memcpy(t, p, size + 1);
-  p += size + 1;
-  t += size + 1;
-  if (sign_extend && (*(t - 1) & 0x80)) {
-    memset(t, 0xff, sizeof(T) - size - 1);
+// What the dump and the records show. Classes and methods are matched by
+// fnmatch() globs, so a prefix is written as e.g. "Landroid/support/*".
+struct DexDumpFilter {
+  uint32_t sections = DUMP_ALL;
+  // Class descriptor globs; empty for every class.
+  std::vector<const char*> classes;
+  // Method name glob; nullptr for every method. Classes without a matching
+  // method are skipped.
+  const char* method = nullptr;
+  // Whether to decode code_items, or show only the method headers.
+  bool code = true;
+
+  bool MatchClass(const char* descriptor) const {
+    if (classes.empty()) {
+      return true;
+    }
+    for (const char* pattern : classes) {
+      if (fnmatch(pattern, descriptor, 0) == 0) {
+        return true;
+      }
+    }
+    return false;
   }
-}
 
-template <typename T>
-void ReadEncodedFloatValue(const char*& p, int size, T& value) {
-  char* t = (char*)&value;
-  char* end = t + sizeof(value);
-  memset(t, '\0', sizeof(value));
-  for (int i = 0; i <= size; ++i) {
-    --end;
-    *end = *p++;
+  bool MatchMethod(const char* name) const {
+    return method == nullptr || fnmatch(method, name, 0) == 0;
   }
-}
+};
 
-class JavaDex {
+class JavaDex : public DexFile {
  public:
   JavaDex(const char* filename, const char* data, size_t size)
-      : filename_(filename), data_(data), size_(size), end_(data + size) {
+      : DexFile(filename, data, size) {
+  }
+
+  void set_filter(const DexDumpFilter& filter) {
+    filter_ = filter;
+  }
+
+  // Prints the id tables and class_defs selected by the filter. Classes
+  // that don't match are skipped without decoding their data.
+  void PrintSections() {
+    if (filter_.sections & DUMP_STRING_IDS) {
+      PrintStringIds();
+    }
+    if (filter_.sections & DUMP_TYPE_IDS) {
+      PrintTypeIds();
+    }
+    if (filter_.sections & DUMP_PROTO_IDS) {
+      PrintProtoIds();
+    }
+    if (filter_.sections & DUMP_FIELD_IDS) {
+      PrintFieldIds();
+    }
+    if (filter_.sections & DUMP_METHOD_IDS) {
+      PrintMethodIds();
+    }
+    if (filter_.sections & DUMP_CLASS_DEFS) {
+      PrintClassDefs();
+    }
   }
 
   bool ParseHead() {
-    p_ = data_;
-    const char* magic = p_;
-    p_ += 8;
-    printf("magic: %s\n", magic);
-    if (strncmp(magic, "dex\n", 4) != 0) {
+    STATS_SCOPE(STATS_PARSE_HEAD);
+    Printf("magic: %s\n", data_);
+    if (!Init()) {
       fprintf(stderr, "%s is not a dex file\n", filename_);
       return false;
     }
-    uint32_t checksum;
-    Read(p_, end_, checksum);
-    printf("checksum = 0x%x\n", checksum);
-    const char* signature = p_;
-    p_ += 20;
-    printf("signature: %s\n", GetHexString(signature, 20).c_str());
-    uint32_t file_size;
-    Read(p_, end_, file_size);
-    printf("file_size: 0x%x\n", file_size);
-    uint32_t header_size;
-    Read(p_, end_, header_size);
-    printf("header_size: 0x%x\n", header_size);
-    uint32_t endian_tag;
-    Read(p_, end_, endian_tag);
-    printf("endian_tag: 0x%x\n", endian_tag);
-    uint32_t link_size;
-    uint32_t link_off;
-    Read(p_, end_, link_size);
-    Read(p_, end_, link_off);
-    printf("link_size: 0x%x, link_off: 0x%x\n", link_size, link_off);
-    uint32_t map_off;
-    Read(p_, end_, map_off);
-    printf("map_off: 0x%x\n", map_off);
-    Read(p_, end_, string_ids_size_);
-    Read(p_, end_, string_ids_off_);
-    string_ids_ = (const string_id_item*)(data_ + string_ids_off_);
-    printf("string_ids: [0x%x-0x%x] string_ids_size %u\n", string_ids_off_,
+    Printf("checksum = 0x%x\n", checksum_);
+    Printf("signature: %s\n", GetHexString(signature_, 20).c_str());
+    Printf("file_size: 0x%x\n", file_size_);
+    Printf("header_size: 0x%x\n", header_size_);
+    Printf("endian_tag: 0x%x\n", endian_tag_);
+    Printf("link_size: 0x%x, link_off: 0x%x\n", link_size_, link_off_);
+    Printf("map_off: 0x%x\n", map_off_);
+    Printf("string_ids: [0x%x-0x%x] string_ids_size %u\n", string_ids_off_,
         (uint32_t)(string_ids_off_ + string_ids_size_ * sizeof(string_id_item)), string_ids_size_);
-
-    Read(p_, end_, type_ids_size_);
-    Read(p_, end_, type_ids_off_);
-    type_ids_ = (const type_id_item*)(data_ + type_ids_off_);
-    printf("type_ids: [0x%x-0x%x] type_ids_size %u\n", type_ids_off_,
+    Printf("type_ids: [0x%x-0x%x] type_ids_size %u\n", type_ids_off_,
         (uint32_t)(type_ids_off_ + type_ids_size_ * sizeof(type_id_item)), type_ids_size_);
-
-    Read(p_, end_, proto_ids_size_);
-    Read(p_, end_, proto_ids_off_);
-    proto_ids_ = (const proto_id_item*)(data_ + proto_ids_off_);
-    printf("proto_ids: [0x%x-0x%x] proto_ids_size %u\n", proto_ids_off_,
+    Printf("proto_ids: [0x%x-0x%x] proto_ids_size %u\n", proto_ids_off_,
         (uint32_t)(proto_ids_off_ + proto_ids_size_ * sizeof(proto_id_item)), proto_ids_size_);
-
-    Read(p_, end_, field_ids_size_);
-    Read(p_, end_, field_ids_off_);
-    field_ids_ = (const field_id_item*)(data_ + field_ids_off_);
-    printf("field_ids: [0x%x-0x%x] field_ids_size %u\n", field_ids_off_,
+    Printf("field_ids: [0x%x-0x%x] field_ids_size %u\n", field_ids_off_,
         (uint32_t)(field_ids_off_ + field_ids_size_ * sizeof(field_id_item)), field_ids_size_);
-
-    Read(p_, end_, method_ids_size_);
-    Read(p_, end_, method_ids_off_);
-    method_ids_ = (const method_id_item*)(data_ + method_ids_off_);
-    printf("method_ids: [0x%x-0x%x] method_ids_size %u\n", method_ids_off_,
+    Printf("method_ids: [0x%x-0x%x] method_ids_size %u\n", method_ids_off_,
         (uint32_t)(method_ids_off_ + method_ids_size_ * sizeof(method_id_item)), method_ids_size_);
-
-    Read(p_, end_, class_defs_size_);
-    Read(p_, end_, class_defs_off_);
-    class_defs_ = (const class_def_item*)(data_ + class_defs_off_);
-    printf("class_defs: [0x%x-0x%x] class_defs_size %u\n", class_defs_off_,
+    Printf("class_defs: [0x%x-0x%x] class_defs_size %u\n", class_defs_off_,
         (uint32_t)(class_defs_off_ + class_defs_size_ * sizeof(class_def_item)), class_defs_size_);
-
-    Read(p_, end_, data_sec_size_);
-    Read(p_, end_, data_sec_off_);
-    printf("data: [0x%x-0x%x]\n", data_sec_off_, data_sec_off_ + data_sec_size_);
+    Printf("data: [0x%x-0x%x]\n", data_sec_off_, data_sec_off_ + data_sec_size_);
     return true;
   }
 
   bool PrintStringIds() {
+    STATS_SCOPE(STATS_PRINT_STRING_IDS);
     for (uint32_t i = 0; i < string_ids_size_; ++i) {
       const string_id_item& id = string_ids_[i];
       PrintIndented(1, "string #%u: [0x%x]: ", i, id.string_data_off);
-      const char* data_p = data_ + id.string_data_off;
-      uint32_t utf16_size = ReadULEB128(data_p, end_);
-      printf("utf16_size %u, string %s\n", utf16_size, data_p);
+      uint32_t utf16_size;
+      const char* data = GetStringData(i, &utf16_size);
+      Printf("utf16_size %u, string %s\n", utf16_size, data);
     }
     return true;
   }
 
   bool PrintTypeIds() {
+    STATS_SCOPE(STATS_PRINT_TYPE_IDS);
     for (uint32_t i = 0; i < type_ids_size_; ++i) {
       PrintIndented(1, "type #%d: %s\n", i, GetType(i));
     }
@@ -140,6 +177,7 @@ class JavaDex {
   }
 
   bool PrintProtoIds() {
+    STATS_SCOPE(STATS_PRINT_PROTO_IDS);
     for (uint32_t i = 0; i < proto_ids_size_; ++i) {
       const proto_id_item& id = proto_ids_[i];
       PrintIndented(1, "proto #%d: short_desc: %s, desc %s\n", i,
@@ -149,6 +187,7 @@ class JavaDex {
   }
 
   bool PrintFieldIds() {
+    STATS_SCOPE(STATS_PRINT_FIELD_IDS);
     for (uint32_t i = 0; i < field_ids_size_; ++i) {
       PrintIndented(1, "field #%d: %s\n", i, GetField(i).c_str());
     }
@@ -156,101 +195,609 @@ class JavaDex {
   }
 
   bool PrintMethodIds() {
+    STATS_SCOPE(STATS_PRINT_METHOD_IDS);
     for (uint32_t i = 0; i < method_ids_size_; ++i) {
       PrintIndented(1, "method #%d: %s\n", i, GetMethod(i).c_str());
     }
     return true;
   }
 
+  // Classes are independent, so they are formatted in parallel and
+  // printed in order.
   bool PrintClassDefs() {
+    STATS_SCOPE(STATS_PRINT_CLASS_DEFS);
+    ParallelPrint(class_defs_size_, [&](size_t i) {
+      PrintClassDef(i);
+    });
+    return true;
+  }
+
+  // Whether the filter selects class_def i: its descriptor matches and,
+  // with a method glob, so does the name of one of its methods.
+  bool MatchClassDef(uint32_t i) const {
+    if (!filter_.MatchClass(GetType(class_defs_[i].class_idx))) {
+      return false;
+    }
+    if (filter_.method == nullptr) {
+      return true;
+    }
+    DexClassData class_data;
+    std::vector<DexClassMember> storage;
+    GetClassData(i, &class_data, &storage);
+    uint32_t fields_size = class_data.static_fields_size + class_data.instance_fields_size;
+    uint32_t methods_size = class_data.direct_methods_size + class_data.virtual_methods_size;
+    for (uint32_t j = 0; j < methods_size; ++j) {
+      uint32_t method_idx = class_data.members[fields_size + j].idx;
+      CHECK(method_idx < method_ids_size_);
+      if (filter_.MatchMethod(GetString(method_ids_[method_idx].name_idx))) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void PrintClassDef(uint32_t i) {
+    if (!MatchClassDef(i)) {
+      return;
+    }
+    const class_def_item& cls = class_defs_[i];
+    PrintIndented(1, "class #%d:\n", i);
+    PrintIndented(2, "name: %s\n", GetType(cls.class_idx));
+    PrintIndented(2, "access_flags: %s\n",
+        FindMaskVector(CLASS_ACCESS_FLAGS_NAMEVECTOR, cls.access_flags).c_str());
+    PrintIndented(2, "superclass: %s\n",
+        cls.superclass_idx == NO_INDEX ? "None" : GetType(cls.superclass_idx));
+    PrintIndented(2, "interfaces: %s\n",
+        cls.interfaces_off == 0 ? "None" : GetTypeList(cls.interfaces_off).c_str());
+    PrintIndented(2, "source_file: %s\n",
+        cls.source_file_idx == NO_INDEX ? "None" : GetString(cls.source_file_idx));
+    PrintIndented(2, "annotations_off: 0x%x\n", cls.annotations_off);
+    if (cls.annotations_off != 0) {
+      PrintAnnotationsDirectoryItem(3, cls.annotations_off);
+    }
+    PrintIndented(2, "class_data_off: 0x%x\n", cls.class_data_off);
+    if (cls.class_data_off != 0) {
+      PrintClassDataItem(3, i);
+    }
+    PrintIndented(2, "static_values_off: 0x%x\n", cls.static_values_off);
+    if (cls.static_values_off != 0) {
+      const char* p = data_ + cls.static_values_off;
+      PrintEncodedArray(3, p);
+    }
+  }
+
+  // Writes a record for each class_def, each followed by records of its
+  // fields and methods, and each method by records of its instructions.
+  // Each record starts with the fields shared with read_class, see
+  // record_writer.h, followed by:
+  //   class: idx, source_file
+  //   field: static
+  //   method: direct, code_off, registers_size, ins_size, outs_size,
+  //           insns_size
+  //   insn: width, a, b, c, literal, args
+  // idx is the class_def, field_id or method_id index, and index is the
+  // string, type, field or method id an instruction refers to. Missing
+  // strings are empty.
+  bool WriteRecords(RecordWriter* writer) {
+    STATS_SCOPE(STATS_WRITE_RECORDS);
+    bool ok = true;
+    std::vector<DexClassMember> storage;
     for (uint32_t i = 0; i < class_defs_size_; ++i) {
       const class_def_item& cls = class_defs_[i];
-      PrintIndented(1, "class #%d:\n", i);
-      PrintIndented(2, "name: %s\n", GetType(cls.class_idx));
-      PrintIndented(2, "access_flags: %s\n",
-          FindMaskVector(CLASS_ACCESS_FLAGS_NAMEVECTOR, cls.access_flags).c_str());
-      PrintIndented(2, "superclass: %s\n",
-          cls.superclass_idx == NO_INDEX ? "None" : GetType(cls.superclass_idx));
-      PrintIndented(2, "interfaces: %s\n",
-          cls.interfaces_off == 0 ? "None" : GetTypeList(cls.interfaces_off).c_str());
-      PrintIndented(2, "source_file: %s\n",
-          cls.source_file_idx == NO_INDEX ? "None" : GetString(cls.source_file_idx));
-      PrintIndented(2, "annotations_off: 0x%x\n", cls.annotations_off);
-      if (cls.annotations_off != 0) {
-        PrintAnnotationsDirectoryItem(3, cls.annotations_off);
-      }
-      PrintIndented(2, "class_data_off: 0x%x\n", cls.class_data_off);
-      if (cls.class_data_off != 0) {
-        PrintClassDataItem(3, cls.class_data_off);
-      }
-      PrintIndented(2, "static_values_off: 0x%x\n", cls.static_values_off);
-      if (cls.static_values_off != 0) {
-        const char* p = data_ + cls.static_values_off;
-        PrintEncodedArray(3, p);
+      const char* name = GetType(cls.class_idx);
+      if (!MatchClassDef(i)) {
+        continue;
+      }
+      std::vector<uint16_t> interface_ids;
+      GetTypeIds(cls.interfaces_off, &interface_ids);
+      std::vector<std::string> interfaces;
+      for (uint16_t type_idx : interface_ids) {
+        interfaces.push_back(GetType(type_idx));
+      }
+      writer->Begin(RECORD_CLASS);
+      writer->AddClassHead(name, cls.access_flags,
+          cls.superclass_idx == NO_INDEX ? "" : GetType(cls.superclass_idx), interfaces);
+      writer->AddInt("idx", i);
+      writer->AddString("source_file",
+          cls.source_file_idx == NO_INDEX ? "" : GetString(cls.source_file_idx));
+      writer->End();
+      DexClassData class_data;
+      GetClassData(i, &class_data, &storage);
+      const DexClassMember* p = class_data.members;
+      uint32_t static_fields_end = class_data.static_fields_size;
+      uint32_t fields_end = static_fields_end + class_data.instance_fields_size;
+      for (uint32_t j = 0; j < fields_end; ++j, ++p) {
+        CHECK(p->idx < field_ids_size_);
+        const field_id_item& field = field_ids_[p->idx];
+        writer->Begin(RECORD_FIELD);
+        writer->AddFieldHead(p->idx, name, GetString(field.name_idx), GetType(field.type_idx),
+                             p->access_flags);
+        writer->AddInt("static", j < static_fields_end);
+        writer->End();
+      }
+      uint32_t methods_size = class_data.direct_methods_size + class_data.virtual_methods_size;
+      for (uint32_t j = 0; j < methods_size; ++j, ++p) {
+        CHECK(p->idx < method_ids_size_);
+        if (filter_.MatchMethod(GetString(method_ids_[p->idx].name_idx))) {
+          ok = WriteMethodRecords(writer, name, *p, j < class_data.direct_methods_size) && ok;
+        }
+      }
+    }
+    return ok;
+  }
+
+  bool WriteMethodRecords(RecordWriter* writer, const char* class_name,
+                          const DexClassMember& member, bool direct) {
+    CHECK(member.idx < method_ids_size_);
+    const method_id_item& method = method_ids_[member.idx];
+    const char* insns = nullptr;
+    uint32_t insns_size = 0;
+    uint16_t code_header[3] = {0, 0, 0};
+    if (member.code_off != 0) {
+      if (!GetCodeInsns(member.code_off, &insns, &insns_size)) {
+        fprintf(stderr, "%s: code_item of %s is truncated\n", filename_,
+                GetMethod(member.idx).c_str());
+        return false;
+      }
+      memcpy(code_header, data_ + member.code_off, sizeof(code_header));
+    }
+    std::vector<const char*> parameter_types;
+    GetParameterTypes(method.proto_idx, &parameter_types);
+    writer->Begin(RECORD_METHOD);
+    writer->AddMethodHead(member.idx, class_name, GetString(method.name_idx),
+                          GetType(proto_ids_[method.proto_idx].return_type_idx),
+                          std::vector<std::string>(parameter_types.begin(), parameter_types.end()),
+                          member.access_flags);
+    writer->AddInt("direct", direct);
+    writer->AddInt("code_off", member.code_off);
+    writer->AddInt("registers_size", code_header[0]);
+    writer->AddInt("ins_size", code_header[1]);
+    writer->AddInt("outs_size", code_header[2]);
+    writer->AddInt("insns_size", insns_size);
+    writer->End();
+    if (!filter_.code) {
+      return true;
+    }
+    DexInsn buf[64];
+    DexInsnScanner scanner(insns, insns_size);
+    while (size_t count = scanner.Next(buf, 64)) {
+      for (size_t i = 0; i < count; ++i) {
+        const DexInsn& insn = buf[i];
+        writer->Begin(RECORD_INSN);
+        writer->AddInsnHead(member.idx, insn.pc, GetInsnName(insn.op), GetInsnRef(insn));
+        writer->AddInt("width", insn.width);
+        writer->AddInt("a", insn.a);
+        writer->AddInt("b", insn.b);
+        writer->AddInt("c", insn.c);
+        writer->AddInt("literal", insn.literal);
+        bool has_args = insn.op <= 0xff && DEX_OPCODES[insn.op].format == DEX_FORMAT_35C;
+        writer->AddList("args", insn.args, has_args ? insn.a : 0);
+        writer->End();
       }
     }
+    if (scanner.error() != nullptr) {
+      fprintf(stderr, "%s: %s: %s at 0x%x\n", filename_, GetMethod(member.idx).c_str(),
+              scanner.error(), scanner.pc());
+      return false;
+    }
     return true;
   }
 
- private:
-  const char* GetString(uint32_t string_id) {
-    CHECK(string_id < string_ids_size_);
-    uint32_t string_off = string_ids_[string_id].string_data_off;
-    const char* p = data_ + string_off;
-    uint32_t utf16_size = ReadULEB128(p, end_);
-    return p;
+  static const char* GetInsnName(uint16_t op) {
+    switch (op) {
+      case PACKED_SWITCH_PAYLOAD:
+        return "packed_switch_payload";
+      case SPARSE_SWITCH_PAYLOAD:
+        return "sparse_switch_payload";
+      case FILL_ARRAY_DATA_PAYLOAD:
+        return "fill_array_data_payload";
+    }
+    return DEX_OPCODES[op].name;
   }
 
-  const char* GetType(uint32_t type_id) {
-    CHECK(type_id < type_ids_size_);
-    return GetString(type_ids_[type_id].descriptor_idx);
+  // What the index operand of insn refers to. An index out of range keeps
+  // its kind and index but names nothing.
+  RecordRef GetInsnRef(const DexInsn& insn) const {
+    RecordRef ref;
+    if (insn.op > 0xff) {
+      return ref;
+    }
+    const DexOpcodeInfo& info = DEX_OPCODES[insn.op];
+    uint32_t idx = info.format == DEX_FORMAT_22C ? insn.c : insn.b;
+    switch (info.index_type) {
+      case DEX_INDEX_STRING:
+        ref.kind = "string";
+        if (idx < string_ids_size_) {
+          ref.value = GetString(idx);
+        }
+        break;
+      case DEX_INDEX_TYPE:
+        ref.kind = "type";
+        if (idx < type_ids_size_) {
+          ref.type = GetType(idx);
+        }
+        break;
+      case DEX_INDEX_FIELD:
+        ref.kind = "field";
+        if (idx < field_ids_size_) {
+          const field_id_item& field = field_ids_[idx];
+          ref.cls = GetType(field.class_idx);
+          ref.name = GetString(field.name_idx);
+          ref.type = GetType(field.type_idx);
+        }
+        break;
+      case DEX_INDEX_METHOD:
+        ref.kind = "method";
+        if (idx < method_ids_size_) {
+          const method_id_item& method = method_ids_[idx];
+          ref.cls = GetType(method.class_idx);
+          ref.name = GetString(method.name_idx);
+          ref.type = GetProtoDescriptor(method.proto_idx);
+        }
+        break;
+      default:
+        return ref;
+    }
+    ref.index = idx;
+    return ref;
   }
 
-  std::string GetProto(uint32_t proto_id) {
-    CHECK(proto_id < proto_ids_size_);
-    const proto_id_item& id = proto_ids_[proto_id];
-    std::string result = GetType(id.return_type_idx);
-    result += " (";
-    if (id.parameters_off != 0) {
-      result += GetTypeList(id.parameters_off);
+  // The proto as a method descriptor, e.g. "(ILjava/lang/String;)V".
+  std::string GetProtoDescriptor(uint32_t proto_id) const {
+    std::vector<const char*> parameter_types;
+    GetParameterTypes(proto_id, &parameter_types);
+    std::string result = "(";
+    for (const char* type : parameter_types) {
+      result += type;
     }
     result.push_back(')');
+    result += GetType(proto_ids_[proto_id].return_type_idx);
     return result;
   }
 
-  std::string GetTypeList(uint32_t data_off) {
-    std::string result;
-    const char* p = data_ + data_off;
-    uint32_t size;
-    Read(p, end_, size);
-    for (uint32_t i = 0; i < size; ++i) {
-      uint16_t type_idx;
-      Read(p, end_, type_idx);
-      if (i > 0) {
-        result += ", ";
+  // Verifies the code of every method defined in the dex file in parallel and
+  // prints the methods that fail. Methods already set in verified are
+  // skipped, and the methods that pass are set.
+  bool Verify(std::vector<uint8_t>* verified) {
+    STATS_SCOPE(STATS_VERIFY);
+    std::vector<DexMethod> methods;
+    for (uint32_t i = 0; i < class_defs_size_; ++i) {
+      GetClassMethods(i, &methods);
+    }
+    std::vector<uint8_t> skipped(methods.size(), 0);
+    std::vector<std::string> errors(methods.size());
+    ParallelFor(methods.size(), [&](size_t i) {
+      const DexMethod& method = methods[i];
+      if (method.method_idx < method_ids_size_ && (*verified)[method.method_idx]) {
+        skipped[i] = 1;
+        return;
+      }
+      ProfileMethodScope profile_scope(method.method_idx);
+      DexVerifier verifier(*this, method);
+      if (!verifier.Verify()) {
+        errors[i] = verifier.error();
+      }
+    });
+    size_t skipped_count = 0;
+    size_t failed = 0;
+    for (size_t i = 0; i < methods.size(); ++i) {
+      uint32_t method_idx = methods[i].method_idx;
+      if (skipped[i]) {
+        skipped_count++;
+      } else if (!errors[i].empty()) {
+        failed++;
+        Printf("method #%u %s: %s\n", method_idx,
+               method_idx < method_ids_size_ ? GetMethod(method_idx).c_str() : "",
+               errors[i].c_str());
+      } else {
+        (*verified)[method_idx] = 1;
       }
-      result += GetType(type_idx);
     }
-    return result;
+    Printf("verified %zu methods (%zu skipped), %zu failed\n", methods.size() - skipped_count,
+           skipped_count, failed);
+    return failed == 0;
+  }
+
+  // Writes the samples of profiler, taken while verifying, as folded stacks
+  // of method names and lines to filename.
+  bool WriteProfile(const char* filename, const Profiler& profiler) {
+    std::vector<DexMethod> methods;
+    for (uint32_t i = 0; i < class_defs_size_; ++i) {
+      GetClassMethods(i, &methods);
+    }
+    std::vector<uint32_t> code_offs(method_ids_size_, 0);
+    for (const DexMethod& method : methods) {
+      if (method.method_idx < method_ids_size_) {
+        code_offs[method.method_idx] = method.code_off;
+      }
+    }
+    LineTableCache lines(method_ids_size_, [&](uint32_t method_idx, LineEntries* entries) {
+      GetDebugLines(code_offs[method_idx], entries);
+    });
+    FILE* fp = fopen(filename, "w");
+    if (fp == nullptr) {
+      fprintf(stderr, "failed to open %s\n", filename);
+      return false;
+    }
+    WriteFoldedStacks(fp, profiler.samples(), [&](uint32_t method_idx, uint32_t pc) {
+      ProfileSymbol symbol = {"[unknown method]", 0};
+      if (method_idx >= method_ids_size_) {
+        return symbol;
+      }
+      const method_id_item& id = method_ids_[method_idx];
+      std::vector<const char*> parameters;
+      GetParameterTypes(id.proto_idx, &parameters);
+      std::string descriptor = "(";
+      for (const char* parameter : parameters) {
+        descriptor += parameter;
+      }
+      descriptor.push_back(')');
+      symbol.method = GetJavaMethodName(GetType(id.class_idx), GetString(id.name_idx), descriptor);
+      symbol.line = lines.FindLine(method_idx, pc);
+      return symbol;
+    });
+    fclose(fp);
+    fprintf(stderr, "wrote %zu samples (%lu lost) to %s\n", profiler.samples().size(),
+            (unsigned long)profiler.lost(), filename);
+    return true;
+  }
+
+  // Prints the linked class table of an image built from this dex file.
+  bool PrintImage(const DexImage& image) {
+    for (uint32_t i = 0; i < image.classes_size(); ++i) {
+      const DexImageClass& cls = image.GetClass(i);
+      PrintIndented(1, "class #%u: %s\n", i, image.GetString(cls.descriptor_idx));
+      PrintIndented(2, "superclass: %s\n", cls.super_index == NO_INDEX ? "None" :
+                    image.GetString(image.GetClass(cls.super_index).descriptor_idx));
+      PrintIndented(2, "vtable size %u\n", cls.vtable_size);
+      for (uint32_t j = 0; j < cls.vtable_size; ++j) {
+        uint32_t method_idx = image.GetVtableEntry(cls, j);
+        CHECK(method_idx < method_ids_size_);
+        PrintIndented(3, "vtable[%u]: method #%u %s%s\n", j, method_idx,
+                      image.GetString(method_ids_[method_idx].name_idx),
+                      image.IsVerified(method_idx) ? "" : " (not verified)");
+      }
+    }
+    return true;
+  }
+
+  // Finds the methods named by spec, "<class descriptor>-><name>", whatever
+  // their protos. method_ids are sorted by class, name and proto, so this is
+  // a binary search.
+  bool FindMethods(const char* spec, std::vector<uint32_t>* methods) {
+    const char* arrow = strstr(spec, "->");
+    if (arrow == nullptr) {
+      return false;
+    }
+    uint32_t class_idx = FindType(std::string(spec, arrow - spec).c_str());
+    uint32_t name_idx = FindString(arrow + 2);
+    if (class_idx == NO_INDEX || name_idx == NO_INDEX) {
+      return false;
+    }
+    const method_id_item* end = method_ids_ + method_ids_size_;
+    const method_id_item* it = std::lower_bound(
+        method_ids_, end, std::make_pair(class_idx, name_idx),
+        [](const method_id_item& item, const std::pair<uint32_t, uint32_t>& key) {
+          return std::make_pair((uint32_t)item.class_idx, item.name_idx) < key;
+        });
+    for (; it != end && it->class_idx == class_idx && it->name_idx == name_idx; ++it) {
+      methods->push_back(it - method_ids_);
+    }
+    return !methods->empty();
+  }
+
+  // Finds the fields named by spec, <class descriptor>-><name>.
+  bool FindFields(const char* spec, std::vector<uint32_t>* fields) {
+    const char* arrow = strstr(spec, "->");
+    if (arrow == nullptr) {
+      return false;
+    }
+    uint32_t class_idx = FindType(std::string(spec, arrow - spec).c_str());
+    uint32_t name_idx = FindString(arrow + 2);
+    if (class_idx == NO_INDEX || name_idx == NO_INDEX) {
+      return false;
+    }
+    const field_id_item* end = field_ids_ + field_ids_size_;
+    const field_id_item* it = std::lower_bound(
+        field_ids_, end, std::make_pair(class_idx, name_idx),
+        [](const field_id_item& item, const std::pair<uint32_t, uint32_t>& key) {
+          return std::make_pair((uint32_t)item.class_idx, item.name_idx) < key;
+        });
+    for (; it != end && it->class_idx == class_idx && it->name_idx == name_idx; ++it) {
+      fields->push_back(it - field_ids_);
+    }
+    return !fields->empty();
+  }
+
+  // Prints the code locations that reference what spec names: one of
+  // string:<string>, type:<descriptor>, field:<field> or method:<method>.
+  bool PrintXrefs(const DexXref& xref, const char* spec) {
+    const char* colon = strchr(spec, ':');
+    std::string kind = colon == nullptr ? "" : std::string(spec, colon - spec);
+    uint8_t index_type = DEX_INDEX_NONE;
+    std::vector<uint32_t> ids;
+    if (kind == "string") {
+      index_type = DEX_INDEX_STRING;
+      ids.push_back(FindString(colon + 1));
+    } else if (kind == "type") {
+      index_type = DEX_INDEX_TYPE;
+      ids.push_back(FindType(colon + 1));
+    } else if (kind == "field") {
+      index_type = DEX_INDEX_FIELD;
+      FindFields(colon + 1, &ids);
+    } else if (kind == "method") {
+      index_type = DEX_INDEX_METHOD;
+      FindMethods(colon + 1, &ids);
+    } else {
+      fprintf(stderr, "bad xref %s, expected string:, type:, field: or method:\n", spec);
+      return false;
+    }
+    if (ids.empty() || ids[0] == NO_INDEX) {
+      fprintf(stderr, "no %s\n", spec);
+      return false;
+    }
+    for (uint32_t id : ids) {
+      DexXrefRow locations = xref.Get(index_type, id);
+      switch (index_type) {
+        case DEX_INDEX_STRING:
+          Printf("references to string #%u \"%s\": %zu\n", id, GetString(id), locations.size());
+          break;
+        case DEX_INDEX_TYPE:
+          Printf("references to type #%u %s: %zu\n", id, GetType(id), locations.size());
+          break;
+        case DEX_INDEX_FIELD:
+          Printf("references to field #%u %s: %zu\n", id, GetField(id).c_str(),
+                 locations.size());
+          break;
+        default:
+          Printf("references to method #%u %s: %zu\n", id, GetMethod(id).c_str(),
+                 locations.size());
+          break;
+      }
+      for (DexCodeLocation location : locations) {
+        uint32_t method_idx = GetLocationMethod(location);
+        PrintIndented(1, "method #%u %s, pc 0x%x\n", method_idx, GetMethod(method_idx).c_str(),
+                      GetLocationPc(location));
+      }
+    }
+    return true;
+  }
+
+  // Adds the roots listed in a keep file, one class descriptor or
+  // <class descriptor>-><method name> per line. Blank lines and lines
+  // starting with # are skipped.
+  bool AddKeepRules(const char* filename, DexReachability* reachability) {
+    FILE* fp = fopen(filename, "r");
+    if (fp == nullptr) {
+      fprintf(stderr, "failed to open %s\n", filename);
+      return false;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), fp) != nullptr) {
+      line[strcspn(line, "\r\n")] = '\0';
+      if (line[0] == '\0' || line[0] == '#') {
+        continue;
+      }
+      std::vector<uint32_t> methods;
+      if (strstr(line, "->") != nullptr) {
+        if (!FindMethods(line, &methods)) {
+          fprintf(stderr, "%s: no method %s\n", filename, line);
+        }
+        for (uint32_t method_idx : methods) {
+          reachability->AddRootMethod(method_idx);
+        }
+      } else {
+        uint32_t type_idx = FindType(line);
+        if (type_idx == NO_INDEX) {
+          fprintf(stderr, "%s: no type %s\n", filename, line);
+        } else {
+          reachability->AddRootClass(type_idx);
+        }
+      }
+    }
+    fclose(fp);
+    return true;
+  }
+
+  // Prints the classes defined in the dex file that are unreachable, then
+  // the unreachable methods of reachable classes, with their code sizes.
+  void PrintDeadCode(const DexReachability& reachability) {
+    uint32_t dead_classes = 0;
+    uint32_t dead_methods = 0;
+    uint64_t dead_bytes = 0;
+    std::vector<uint32_t> methods;
+    for (int pass = 0; pass < 2; ++pass) {
+      Printf(pass == 0 ? "unreachable classes:\n" : "unreachable methods:\n");
+      for (uint32_t i = 0; i < class_defs_size_; ++i) {
+        uint32_t class_idx = class_defs_[i].class_idx;
+        if (class_idx >= type_ids_size_ ||
+            reachability.IsTypeReachable(class_idx) != (pass == 1)) {
+          continue;
+        }
+        methods.clear();
+        for (CsrRow row : {reachability.GetDirectMethods(i), reachability.GetVirtualMethods(i)}) {
+          for (uint32_t method_idx : row) {
+            if (!reachability.IsMethodReachable(method_idx)) {
+              methods.push_back(method_idx);
+            }
+          }
+        }
+        uint64_t bytes = 0;
+        for (uint32_t method_idx : methods) {
+          bytes += reachability.GetCodeSize(method_idx);
+        }
+        if (pass == 0) {
+          PrintIndented(1, "%s: %zu methods, %" PRIu64 " bytes\n", GetType(class_idx),
+                        methods.size(), bytes);
+          dead_classes++;
+        } else {
+          for (uint32_t method_idx : methods) {
+            PrintIndented(1, "method #%u %s: %u bytes\n", method_idx,
+                          GetMethod(method_idx).c_str(), reachability.GetCodeSize(method_idx));
+          }
+        }
+        dead_methods += methods.size();
+        dead_bytes += bytes;
+      }
+    }
+    Printf("%u unreachable classes, %u unreachable methods, %" PRIu64 " bytes of code\n",
+           dead_classes, dead_methods, dead_bytes);
+  }
+
+  // Prints the callers or the callees of the methods named by spec.
+  bool PrintCalls(const DexCallGraph& graph, const char* spec, bool callers) {
+    std::vector<uint32_t> methods;
+    if (!FindMethods(spec, &methods)) {
+      fprintf(stderr, "no method %s\n", spec);
+      return false;
+    }
+    for (uint32_t method_idx : methods) {
+      CsrRow calls = callers ? graph.GetCallers(method_idx) : graph.GetCallees(method_idx);
+      Printf("%s of method #%u %s: %zu\n", callers ? "callers" : "callees", method_idx,
+             GetMethod(method_idx).c_str(), calls.size());
+      for (uint32_t other_idx : calls) {
+        PrintIndented(1, "method #%u %s\n", other_idx, GetMethod(other_idx).c_str());
+      }
+    }
+    return true;
   }
 
-  std::string GetField(uint32_t field_id) {
-    CHECK(field_id < field_ids_size_);
-    const field_id_item& field = field_ids_[field_id];
-    return StringPrintf("(class %s, type %s, name %s)",
-        GetType(field.class_idx), GetType(field.type_idx), GetString(field.name_idx));
+  bool PrintOverrides(const DexCallGraph& graph, const char* spec) {
+    std::vector<uint32_t> methods;
+    if (!FindMethods(spec, &methods)) {
+      fprintf(stderr, "no method %s\n", spec);
+      return false;
+    }
+    for (uint32_t method_idx : methods) {
+      std::vector<uint32_t> overrides;
+      graph.GetOverrides(method_idx, &overrides);
+      Printf("overrides of method #%u %s: %zu\n", method_idx, GetMethod(method_idx).c_str(),
+             overrides.size());
+      for (uint32_t other_idx : overrides) {
+        PrintIndented(1, "method #%u %s\n", other_idx, GetMethod(other_idx).c_str());
+      }
+    }
+    return true;
   }
 
-  std::string GetMethod(uint32_t method_id) {
-    CHECK(method_id < method_ids_size_);
-    const method_id_item& method = method_ids_[method_id];
-    return StringPrintf("(class %s, proto %s, name %s)",
-        GetType(method.class_idx),
-        GetProto(method.proto_idx).c_str(),
-        GetString(method.name_idx));
+  bool PrintSubtypes(const DexCallGraph& graph, const char* descriptor) {
+    uint32_t type_idx = FindType(descriptor);
+    if (type_idx == NO_INDEX) {
+      fprintf(stderr, "no type %s\n", descriptor);
+      return false;
+    }
+    std::vector<uint32_t> subtypes;
+    graph.GetAllSubtypes(type_idx, &subtypes);
+    Printf("subtypes of %s: %zu\n", descriptor, subtypes.size());
+    for (uint32_t subtype : subtypes) {
+      PrintIndented(1, "%s\n", GetType(subtype));
+    }
+    return true;
   }
 
+ private:
   bool PrintAnnotationsDirectoryItem(int indent, uint32_t directory_off) {
+    STATS_SCOPE(STATS_PRINT_ANNOTATIONS);
     const char* p = data_ + directory_off;
     uint32_t class_annotations_off;
     Read(p, end_, class_annotations_off);
@@ -477,51 +1024,47 @@ class JavaDex {
     }
   }
 
-  void PrintClassDataItem(int indent, uint32_t off) {
-    const char* p = data_ + off;
-    uint32_t static_fields_size = ReadULEB128(p, end_);
-    uint32_t instance_fields_size = ReadULEB128(p, end_);
-    uint32_t direct_methods_size = ReadULEB128(p, end_);
-    uint32_t virtual_methods_size = ReadULEB128(p, end_);
-    PrintIndented(indent, "static_fields: size %u\n", static_fields_size);
-    PrintEncodedFields(indent + 1, p, static_fields_size);
-    PrintIndented(indent, "instanc_fields: size %u\n", instance_fields_size);
-    PrintEncodedFields(indent + 1, p, instance_fields_size);
-    PrintIndented(indent, "direct_methods: size %u\n", direct_methods_size);
-    PrintEncodedMethods(indent + 1, p, direct_methods_size);
-    PrintIndented(indent, "virtual_methods: size %u\n", virtual_methods_size);
-    PrintEncodedMethods(indent + 1, p, virtual_methods_size);
-  }
-
-  void PrintEncodedFields(int indent, const char*& p, uint32_t field_size) {
-    uint32_t field_idx = 0;
-    for (uint32_t i = 0; i < field_size; ++i) {
-      uint32_t field_idx_diff = ReadULEB128(p, end_);
-      field_idx += field_idx_diff;
-      uint32_t access_flags = ReadULEB128(p, end_);
-      PrintIndented(indent, "field %s, access_flags %s\n", GetField(field_idx).c_str(),
-          FindMaskVector(FIELD_ACCESS_FLAGS_NAMEVECTOR, access_flags).c_str());
-    }
-  }
-
-  void PrintEncodedMethods(int indent, const char*& p, uint32_t method_size) {
-    uint32_t method_idx = 0;
-    for (uint32_t i = 0; i < method_size; ++i) {
-      uint32_t method_idx_diff = ReadULEB128(p, end_);
-      method_idx += method_idx_diff;
-      uint32_t access_flags = ReadULEB128(p, end_);
-      uint32_t code_off = ReadULEB128(p, end_);
+  void PrintClassDataItem(int indent, uint32_t class_def_idx) {
+    STATS_SCOPE(STATS_PRINT_CLASS_DATA);
+    DexClassData class_data;
+    std::vector<DexClassMember> storage;
+    GetClassData(class_def_idx, &class_data, &storage);
+    const DexClassMember* p = class_data.members;
+    PrintIndented(indent, "static_fields: size %u\n", class_data.static_fields_size);
+    PrintEncodedFields(indent + 1, p, class_data.static_fields_size);
+    PrintIndented(indent, "instanc_fields: size %u\n", class_data.instance_fields_size);
+    PrintEncodedFields(indent + 1, p, class_data.instance_fields_size);
+    PrintIndented(indent, "direct_methods: size %u\n", class_data.direct_methods_size);
+    PrintEncodedMethods(indent + 1, p, class_data.direct_methods_size);
+    PrintIndented(indent, "virtual_methods: size %u\n", class_data.virtual_methods_size);
+    PrintEncodedMethods(indent + 1, p, class_data.virtual_methods_size);
+  }
+
+  void PrintEncodedFields(int indent, const DexClassMember*& p, uint32_t field_size) {
+    for (uint32_t i = 0; i < field_size; ++i, ++p) {
+      PrintIndented(indent, "field %s, access_flags %s\n", GetField(p->idx).c_str(),
+          FindMaskVector(FIELD_ACCESS_FLAGS_NAMEVECTOR, p->access_flags).c_str());
+    }
+  }
+
+  void PrintEncodedMethods(int indent, const DexClassMember*& p, uint32_t method_size) {
+    for (uint32_t i = 0; i < method_size; ++i, ++p) {
+      CHECK(p->idx < method_ids_size_);
+      if (!filter_.MatchMethod(GetString(method_ids_[p->idx].name_idx))) {
+        continue;
+      }
       PrintIndented(indent, "method %s, access_flags %s, code_off 0x%x\n",
-          GetMethod(method_idx).c_str(),
-          FindMaskVector(METHOD_ACCESS_FLAGS_NAMEVECTOR, access_flags).c_str(),
-          code_off);
-      if (code_off != 0) {
-        PrintCodeItem(indent + 1, code_off);
+          GetMethod(p->idx).c_str(),
+          FindMaskVector(METHOD_ACCESS_FLAGS_NAMEVECTOR, p->access_flags).c_str(),
+          p->code_off);
+      if (p->code_off != 0 && filter_.code) {
+        PrintCodeItem(indent + 1, p->code_off);
       }
     }
   }
 
   void PrintCodeItem(int indent, uint32_t off) {
+    STATS_SCOPE(STATS_PRINT_CODE_ITEM);
     const char* p = data_ + off;
     uint16_t registers_size;
     uint16_t ins_size;
@@ -582,6 +1125,8 @@ class JavaDex {
   }
 
   void PrintInstructions(int indent, const char* start, const char* end) {
+    STATS_SCOPE(STATS_PRINT_INSTRUCTIONS);
+    STATS_ADD(STATS_BYTES_TOUCHED, end - start);
     const char* p = start;
     while (p < end) {
       uint32_t offset = p - start;
@@ -593,7 +1138,8 @@ class JavaDex {
           p++;
           uint16_t size;
           Read(p, end, size);
-          printf("packed_switch_payload, size = %u\n", size);
+          Printf("packed_switch_payload, size = %u\n", size);
+          STATS_INSN(PACKED_SWITCH_PAYLOAD);
           uint32_t first_key;
           Read(p, end, first_key);
           uint32_t key = first_key;
@@ -609,7 +1155,8 @@ class JavaDex {
           p++;
           uint16_t size;
           Read(p, end, size);
-          printf("sparse_switch_payload, size = %u\n", size);
+          Printf("sparse_switch_payload, size = %u\n", size);
+          STATS_INSN(SPARSE_SWITCH_PAYLOAD);
           uint32_t keys[size];
           uint32_t targets[size];
           for (uint16_t i = 0; i < size; ++i) {
@@ -629,14 +1176,14 @@ class JavaDex {
           uint32_t size;
           Read(p, end, element_width);
           Read(p, end, size);
-          printf("fill-array-data-payload, element_width = %u, size = %u\n", element_width, size);
+          Printf("fill-array-data-payload, element_width = %u, size = %u\n", element_width, size);
+          STATS_INSN(FILL_ARRAY_DATA_PAYLOAD);
           p += element_width * size;
           continue;
         }
       }
-      std::string opstr = FindMap(DEX_OP_NAMEMAP, op);
-      std::transform(opstr.begin(), opstr.end(), opstr.begin(), tolower);
-      printf("%s ", opstr.c_str());
+      Printf("%s ", DEX_OPCODES[op].name);
+      STATS_INSN(op);
       uint16_t vA;
       uint16_t vB;
       uint16_t B;
@@ -647,186 +1194,186 @@ class JavaDex {
         p++;
       } else if (op == 0x01 || op == 0x04 || op == 0x07) {
         GetAB_4(p, vA, vB);
-        printf("v%u, v%u", vA, vB);
+        Printf("v%u, v%u", vA, vB);
       } else if (op == 0x02 || op == 0x05 || op == 0x08) {
         GetAB_8_16(p, vA, vB);
-        printf("v%u, v%u", vA, vB);
+        Printf("v%u, v%u", vA, vB);
       } else if (op == 0x03 || op == 0x06 || op == 0x09) {
         p++;
         GetAB_16_16(p, vA, vB);
-        printf("v%u, v%u", vA, vB);
+        Printf("v%u, v%u", vA, vB);
       } else if (op == 0x0a || op == 0x0b || op == 0x0c || op == 0x0d) {
         uint8_t vA = *p++;
-        printf("v%u", vA);
+        Printf("v%u", vA);
       } else if (op == 0x0e) {
         p++;
       } else if (op == 0x0f || op == 0x10 || op == 0x11) {
         uint8_t vA = *p++;
-        printf("v%u", vA);
+        Printf("v%u", vA);
       } else if (op == 0x12) {
         GetAB_4(p, vA, B);
         int8_t sB = B;
         if (sB & 0x08) {
           sB |= 0xf0;
         }
-        printf("v%u, #%d", vA, sB);
+        Printf("v%u, #%d", vA, sB);
       } else if (op == 0x13) {
         uint8_t vA = *p++;
         int16_t B;
         Read(p, end, B);
-        printf("v%u, #%d", vA, B);
+        Printf("v%u, #%d", vA, B);
       } else if (op == 0x14) {
         GetAB_8_32(p, vA, BB);
-        printf("v%u, #%d", vA, BB);
+        Printf("v%u, #%d", vA, BB);
       } else if (op == 0x15) {
         GetAB_8_16(p, vA, B);
         BB = ((int16_t)B) << 16;
-        printf("v%u, #%d", vA, BB);
+        Printf("v%u, #%d", vA, BB);
       } else if (op == 0x16) {
         GetAB_8_16(p, vA, B);
-        printf("v%u, #%d", vA, (int16_t)B);
+        Printf("v%u, #%d", vA, (int16_t)B);
       } else if (op == 0x17) {
         GetAB_8_32(p, vA, BB);
-        printf("v%u, #%d", vA, BB);
+        Printf("v%u, #%d", vA, BB);
       } else if (op == 0x18) {
         uint8_t vA = *p++;
         int64_t B;
         Read(p, end, B);
-        printf("v%u, #%" PRId64, vA, B);
+        Printf("v%u, #%" PRId64, vA, B);
       } else if (op == 0x19) {
         uint8_t vA = *p++;
         int16_t tB;
         Read(p, end, tB);
         int64_t B = ((int64_t)tB) << 48;
-        printf("v%u, #%" PRId64, vA, B);
+        Printf("v%u, #%" PRId64, vA, B);
       } else if (op == 0x1a) {
         GetAB_8_16(p, vA, B);
-        printf("v%u, string@%u", vA, B);
+        Printf("v%u, string@%u", vA, B);
       } else if (op == 0x1b) {
         GetAB_8_32(p, vA, BB);
-        printf("v%u, string@%u", vA, BB);
+        Printf("v%u, string@%u", vA, BB);
       } else if (op == 0x1c) {
         GetAB_8_16(p, vA, B);
-        printf("v%u, type@%u", vA, B);
+        Printf("v%u, type@%u", vA, B);
       } else if (op == 0x1d) {
         uint8_t vA = *p++;
-        printf("v%u", vA);
+        Printf("v%u", vA);
       } else if (op == 0x1e) {
         uint8_t vA = *p++;
-        printf("v%u", vA);
+        Printf("v%u", vA);
       } else if (op == 0x1f) {
         GetAB_8_16(p, vA, B);
-        printf("v%u, type@%u", vA, B);
+        Printf("v%u, type@%u", vA, B);
       } else if (op == 0x20) {
         GetAB_4(p, vA, vB);
         Read(p, end, C);
-        printf("v%u, v%u, type@%u", vA, vB, C);
+        Printf("v%u, v%u, type@%u", vA, vB, C);
       } else if (op == 0x21) {
         GetAB_4(p, vA, vB);
-        printf("v%u, v%u", vA, vB);
+        Printf("v%u, v%u", vA, vB);
       } else if (op == 0x22) {
         GetAB_8_16(p, vA, B);
-        printf("v%u, type@%u", vA, B);
+        Printf("v%u, type@%u", vA, B);
       } else if (op == 0x23) {
         GetAB_4(p, vA, vB);
         Read(p, end, C);
-        printf("v%u, v%u, type@%u  #%s", vA, vB, C, GetType(C));
+        Printf("v%u, v%u, type@%u  #%s", vA, vB, C, GetType(C));
       } else if (op == 0x24) {
         uint16_t vG;
-        GetAB_4(p, vA, vG);
+        GetAB_4(p, vG, vA);
         Read(p, end, B);
         uint8_t regs[5];
         GetCDEF(p, regs);
         regs[4] = vG;
-        printf("{");
+        Printf("{");
         for (int i = 0; i < vA; ++i) {
-          printf("v%u, ", regs[i]);
+          Printf("v%u, ", regs[i]);
         }
-        printf("} type@%u  #%s", B, GetType(B));
+        Printf("} type@%u  #%s", B, GetType(B));
       } else if (op == 0x25) {
         GetAB_8_16(p, vA, B);
         Read(p, end, C);
-        printf("{v%u .. v%u}, type@%u  #%s", C, C + vA - 1, B, GetType(B));
+        Printf("{v%u .. v%u}, type@%u  #%s", C, C + vA - 1, B, GetType(B));
       } else if (op == 0x26) {
         GetAB_8_32(p, vA, BB);
-        printf("v%u, %u  # payload 0x%x", vA, BB, offset + BB * 2);
+        Printf("v%u, %u  # payload 0x%x", vA, BB, offset + BB * 2);
       } else if (op == 0x27) {
         vA = *p++;
-        printf("v%u", vA);
+        Printf("v%u", vA);
       } else if (op == 0x28) {
         int8_t t = *p++;
-        printf("%d", t);
+        Printf("%d", t);
       } else if (op == 0x29) {
         p++;
         int16_t t;
         Read(p, end, t);
-        printf("%d", t);
+        Printf("%d", t);
       } else if (op == 0x2a) {
         p++;
         int32_t t;
         Read(p, end, t);
-        printf("%d", t);
+        Printf("%d", t);
       } else if (op == 0x2b) {
         GetAB_8_32(p, vA, BB);
-        printf("v%u, %d", vA, BB);
+        Printf("v%u, %d", vA, BB);
       } else if (op == 0x2c) {
         GetAB_8_32(p, vA, BB);
-        printf("v%u, %d", vA, BB);
+        Printf("v%u, %d", vA, BB);
       } else if (op >= 0x2d && op <= 0x31) {
         GetABC_8(p, vA, vB, vC);
-        printf("v%u, v%u, v%u", vA, vB, vC);
+        Printf("v%u, v%u, v%u", vA, vB, vC);
       } else if (op >= 0x32 && op <= 0x37) {
         GetAB_4(p, vA, vB);
         Read(p, end, C);
-        printf("v%u, v%u, %d", vA, vB, (int16_t)C);
+        Printf("v%u, v%u, %d", vA, vB, (int16_t)C);
       } else if (op >= 0x38 && op <= 0x3d) {
         GetAB_8_16(p, vA, B);
-        printf("v%u, %d", vA, (int16_t)B);
+        Printf("v%u, %d", vA, (int16_t)B);
       } else if (op >= 0x44 && op <= 0x51) {
         GetABC_8(p, vA, vB, vC);
-        printf("v%u, v%u, v%u", vA, vB, vC);
+        Printf("v%u, v%u, v%u", vA, vB, vC);
       } else if (op >= 0x52 && op <= 0x5f) {
         GetAB_8_16(p, vA, B);
-        printf("v%u, field@%u   #%s", vA, B, GetField(B).c_str());
+        Printf("v%u, field@%u   #%s", vA, B, GetField(B).c_str());
       } else if (op >= 0x60 && op <= 0x6d) {
         GetAB_8_16(p, vA, B);
-        printf("v%u, field@%u   #%s", vA, B, GetField(B).c_str());
+        Printf("v%u, field@%u   #%s", vA, B, GetField(B).c_str());
       } else if (op >= 0x6e && op <= 0x72) {
         uint16_t vG;
-        GetAB_4(p, vA, vG);
+        GetAB_4(p, vG, vA);
         Read(p, end, B);
         uint8_t regs[5];
         GetCDEF(p, regs);
         regs[4] = vG;
-        printf("{");
+        Printf("{");
         for (int i = 0; i < vA; ++i) {
-          printf("v%u, ", regs[i]);
+          Printf("v%u, ", regs[i]);
         }
-        printf("} meth@%u   #%s", B, GetMethod(B).c_str());
+        Printf("} meth@%u   #%s", B, GetMethod(B).c_str());
       } else if (op >= 0x74 && op <= 0x78) {
         GetAB_8_16(p, vA, B);
         Read(p, end, C);
-        printf("{v%u .. v%u}, meth@%u   #%s", C, C + vA - 1, B, GetMethod(B).c_str());
+        Printf("{v%u .. v%u}, meth@%u   #%s", C, C + vA - 1, B, GetMethod(B).c_str());
       } else if (op >= 0x7b && op <= 0x8f) {
         GetAB_4(p, vA, vB);
-        printf("v%u, v%u", vA, vB);
+        Printf("v%u, v%u", vA, vB);
       } else if (op >= 0x90 && op <= 0xaf) {
         GetABC_8(p, vA, vB, vC);
-        printf("v%u, v%u, v%u", vA, vB, vC);
+        Printf("v%u, v%u, v%u", vA, vB, vC);
       } else if (op >= 0xb0 && op <= 0xcf) {
         GetAB_4(p, vA, vB);
-        printf("v%u, v%u", vA, vB);
+        Printf("v%u, v%u", vA, vB);
       } else if (op >= 0xd0 && op <= 0xd7) {
         GetAB_4(p, vA, vB);
         Read(p, end, C);
-        printf("v%u, v%u, %d", vA, vB, (int16_t)C);
+        Printf("v%u, v%u, %d", vA, vB, (int16_t)C);
       } else if (op >= 0xd8 && op <= 0xe2) {
         GetABC_8(p, vA, vB, C);
-        printf("v%u, v%u, %d", vA, vB, (int8_t)C);
+        Printf("v%u, v%u, %d", vA, vB, (int8_t)C);
       } else {
         Abort("unknown dex op 0x%x\n", op);
       }
-      printf("\n");
+      Printf("\n");
     }
     CHECK(p == end);
   }
@@ -868,109 +1415,143 @@ class JavaDex {
   }
 
   void PrintDebugInfoItem(int indent, uint32_t off) {
-    const char* p = data_ + off;
-    uint32_t line_start = ReadULEB128(p, end_);
-    uint32_t parameters_size = ReadULEB128(p, end_);
-    PrintIndented(indent, "line_start: %u\n", line_start);
-    PrintIndented(indent, "parametrs_size: %u\n", parameters_size);
-    for (uint32_t i = 0; i < parameters_size; ++i) {
-      uint32_t name_idx = ReadULEB128P1(p, end_);
-      PrintIndented(indent + 1, "parameters[%u] = %s\n", i,
-                    (name_idx == NO_INDEX) ? "" : GetString(name_idx));
-    }
-    PrintIndented(indent, "debug code:\n");
-    while (true) {
-      uint8_t op = *p++;
-      if (op == DBG_END_SEQUENCE) {
-        PrintIndented(indent + 1, "end_sequence\n");
-        break;
-      } else if (op == DBG_ADVANCE_PC) {
-        uint32_t addr_diff = ReadULEB128(p, end_);
-        PrintIndented(indent + 1, "advance_pc 0x%x\n", addr_diff);
-      } else if (op == DBG_ADVANCE_LINE) {
-        int32_t line_diff = ReadLEB128(p, end_);
-        PrintIndented(indent + 1, "advance_line %d\n", line_diff);
-      } else if (op == DBG_START_LOCAL) {
-        uint32_t register_num = ReadULEB128(p, end_);
-        int32_t name_idx = ReadULEB128P1(p, end_);
-        int32_t type_idx = ReadULEB128P1(p, end_);
-        PrintIndented(indent + 1, "start_local r%u, name %s, type %s\n",
-               register_num, (name_idx == NO_INDEX) ? "" : GetString(name_idx),
-               (type_idx == NO_INDEX) ? "" : GetType(type_idx));
-      } else if (op == DBG_START_LOCAL_EXTENDED) {
-        uint32_t register_num = ReadULEB128(p, end_);
-        int32_t name_idx = ReadULEB128P1(p, end_);
-        int32_t type_idx = ReadULEB128P1(p, end_);
-        int32_t sig_idx = ReadULEB128P1(p, end_);
-        PrintIndented(indent + 1, "start_local_extended r%u, name %s, type %s, sig %s\n",
-               register_num, (name_idx == NO_INDEX ? "" : GetString(name_idx)),
-               (type_idx == NO_INDEX ? "" : GetType(type_idx)),
-               (sig_idx == NO_INDEX ? "" : GetString(sig_idx)));
-      } else if (op == DBG_END_LOCAL) {
-        uint32_t register_num = ReadULEB128(p, end_);
-        PrintIndented(indent + 1, "end_local r%u\n", register_num);
-      } else if (op == DBG_RESTART_LOCAL) {
-        uint32_t register_num = ReadULEB128(p, end_);
-        PrintIndented(indent + 1, "restart_local r%u\n", register_num);
-      } else if (op == DBG_SET_PROLOGUE_END) {
-        PrintIndented(indent + 1, "set_prologue_end\n");
-      } else if (op == DBG_SET_EPILOGUE_BEGIN) {
-        PrintIndented(indent + 1, "set_epilogue_begin\n");
-      } else if (op == DBG_SET_FILE) {
-        int32_t name_idx = ReadULEB128P1(p, end_);
-        PrintIndented(indent + 1, "set_file %s\n", name_idx == NO_INDEX ? "" : GetString(name_idx));
-      } else {
-        uint8_t adjusted_opcode = op - 0x0a;
-        int32_t line_diff = -4 + (adjusted_opcode % 15);
-        uint32_t addr_diff = (adjusted_opcode / 15);
-        PrintIndented(indent + 1, "advance pc %u, line %d\n", addr_diff, line_diff);
-      }
-    }
-  }
+    STATS_SCOPE(STATS_PRINT_DEBUG_INFO);
+    struct PrintVisitor : DexDebugInfoVisitor {
+      const JavaDex* dex;
+      int indent;
+      uint32_t parameter = 0;
+      bool in_code = false;
 
-  const char* filename_;
-  const char* data_;
-  size_t size_;
-  const char* end_;
-  const char* p_;
-
-  uint32_t string_ids_off_;
-  uint32_t string_ids_size_;
-  const string_id_item* string_ids_;
+      const char* GetString(uint32_t string_id) const {
+        return string_id == NO_INDEX ? "" : dex->GetString(string_id);
+      }
 
-  uint32_t type_ids_off_;
-  uint32_t type_ids_size_;
-  const type_id_item* type_ids_;
+      bool OnHeader(uint32_t line_start, uint32_t parameters_size) {
+        PrintIndented(indent, "line_start: %u\n", line_start);
+        PrintIndented(indent, "parametrs_size: %u\n", parameters_size);
+        return true;
+      }
 
-  uint32_t proto_ids_off_;
-  uint32_t proto_ids_size_;
-  const proto_id_item* proto_ids_;
+      bool OnParameter(uint32_t name_idx) {
+        PrintIndented(indent + 1, "parameters[%u] = %s\n", parameter++, GetString(name_idx));
+        return true;
+      }
 
-  uint32_t field_ids_off_;
-  uint32_t field_ids_size_;
-  const field_id_item* field_ids_;
+      bool OnOp(const DexDebugOp& op) {
+        if (!in_code) {
+          PrintIndented(indent, "debug code:\n");
+          in_code = true;
+        }
+        switch (op.op) {
+          case DBG_END_SEQUENCE:
+            PrintIndented(indent + 1, "end_sequence\n");
+            break;
+          case DBG_ADVANCE_PC:
+            PrintIndented(indent + 1, "advance_pc 0x%x\n", op.addr_diff);
+            break;
+          case DBG_ADVANCE_LINE:
+            PrintIndented(indent + 1, "advance_line %d\n", op.line_diff);
+            break;
+          case DBG_START_LOCAL:
+            PrintIndented(indent + 1, "start_local r%u, name %s, type %s\n", op.register_num,
+                          GetString(op.name_idx),
+                          op.type_idx == NO_INDEX ? "" : dex->GetType(op.type_idx));
+            break;
+          case DBG_START_LOCAL_EXTENDED:
+            PrintIndented(indent + 1, "start_local_extended r%u, name %s, type %s, sig %s\n",
+                          op.register_num, GetString(op.name_idx),
+                          op.type_idx == NO_INDEX ? "" : dex->GetType(op.type_idx),
+                          GetString(op.sig_idx));
+            break;
+          case DBG_END_LOCAL:
+            PrintIndented(indent + 1, "end_local r%u\n", op.register_num);
+            break;
+          case DBG_RESTART_LOCAL:
+            PrintIndented(indent + 1, "restart_local r%u\n", op.register_num);
+            break;
+          case DBG_SET_PROLOGUE_END:
+            PrintIndented(indent + 1, "set_prologue_end\n");
+            break;
+          case DBG_SET_EPILOGUE_BEGIN:
+            PrintIndented(indent + 1, "set_epilogue_begin\n");
+            break;
+          case DBG_SET_FILE:
+            PrintIndented(indent + 1, "set_file %s\n", GetString(op.name_idx));
+            break;
+          default:
+            PrintIndented(indent + 1, "advance pc %u, line %d\n", op.addr_diff, op.line_diff);
+            break;
+        }
+        return true;
+      }
+    } visitor;
+    visitor.dex = this;
+    visitor.indent = indent;
+    const char* p = data_ + off;
+    DecodeDebugInfo(p, end_, &visitor);
+  }
 
-  uint32_t method_ids_off_;
-  uint32_t method_ids_size_;
-  const method_id_item* method_ids_;
+  DexDumpFilter filter_;
+};
 
-  uint32_t class_defs_off_;
-  uint32_t class_defs_size_;
-  const class_def_item* class_defs_;
+struct ReadDexOptions {
+  // Check the checksum and signature of the header whatever else is done.
+  bool check = false;
+  bool verify = false;
+  const char* verified_file = nullptr;
+  // Image to build from the dex file.
+  const char* build_image = nullptr;
+  // Image to load instead of linking and verifying the dex file.
+  const char* image = nullptr;
+  // Directory of decoded string and class_data tables, see DexCache.
+  const char* cache_dir = nullptr;
+  // Call graph queries: a method is given as <class descriptor>-><name>.
+  const char* callers = nullptr;
+  const char* callees = nullptr;
+  const char* overrides = nullptr;
+  // A class descriptor.
+  const char* subtypes = nullptr;
+  // An xref query, see JavaDex::PrintXrefs.
+  const char* xref = nullptr;
+  // Xref file to map, or to write if it doesn't match the dex file.
+  const char* xref_file = nullptr;
+  // Report unreachable code, from the default roots and those in keep_file.
+  bool dead_code = false;
+  const char* keep_file = nullptr;
+  // Dex file to write from the model of the input, see DexWriter.
+  const char* write_dex = nullptr;
+  // "json" or "binary" to write records instead of the dump, see
+  // JavaDex::WriteRecords.
+  const char* format = nullptr;
+  // What the dump or the records show.
+  DexDumpFilter filter;
+  // "table" or "json" to print phase times and counters to stderr at exit,
+  // see stats.h.
+  const char* stats = nullptr;
+  // File to write folded stacks of verifier samples to, see profiler.h.
+  const char* profile = nullptr;
+  uint32_t profile_hz = 1000;
 
-  uint32_t data_sec_off_;
-  uint32_t data_sec_size_;
+  bool has_call_graph_query() const {
+    return callers != nullptr || callees != nullptr || overrides != nullptr ||
+           subtypes != nullptr;
+  }
 };
 
-bool ReadDex(const char* filename) {
+bool ReadDex(const char* filename, const ReadDexOptions& options) {
   FILE* fp = fopen(filename, "rb");
   if (fp == nullptr) {
     fprintf(stderr, "failed to open %s\n", filename);
     return false;
   }
+  bool dump = !options.verify && options.build_image == nullptr && options.image == nullptr &&
+              !options.has_call_graph_query() && options.xref == nullptr && !options.dead_code &&
+              options.write_dex == nullptr && options.format == nullptr;
   fseek(fp, 0, SEEK_END);
   long size = ftell(fp);
-  printf("size of %s is %ld\n", filename, size);
+  if (dump) {
+    Printf("size of %s is %ld\n", filename, size);
+  }
   fseek(fp, 0, SEEK_SET);
   std::vector<char> buf(size);
   if (fread(buf.data(), size, 1, fp) != 1) {
@@ -979,21 +1560,241 @@ bool ReadDex(const char* filename) {
   }
   fclose(fp);
   JavaDex dex(filename, buf.data(), buf.size());
-  dex.ParseHead();
-  dex.PrintStringIds();
-  dex.PrintTypeIds();
-  dex.PrintProtoIds();
-  dex.PrintFieldIds();
-  dex.PrintMethodIds();
-  dex.PrintClassDefs();
-  return true;
+  if (dump ? !dex.ParseHead() : !dex.Init()) {
+    if (!dump) {
+      fprintf(stderr, "%s is not a dex file\n", filename);
+    }
+    return false;
+  }
+  // An image or a cache file is written only from a checked file and is
+  // keyed by its signature, so a matching one stands for the checks below.
+  DexImage image;
+  bool has_image = !dump && options.image != nullptr && image.Open(options.image, dex);
+  if (!dump && options.image != nullptr && !has_image) {
+    fprintf(stderr, "%s is not an image of %s, ignoring it\n", options.image, filename);
+  }
+  DexCache cache;
+  bool cached = !dump && options.cache_dir != nullptr && cache.Find(options.cache_dir, dex);
+  // A damaged file is still dumped, as far as it goes.
+  std::string error;
+  bool checked;
+  {
+    STATS_SCOPE(STATS_CHECK);
+    // Rehashing the whole file pays off only where all of it is read anyway,
+    // in the dump and in verification, unless asked for with --check.
+    bool check_checksums = options.check || (!has_image && (dump || options.verify ||
+                                                             options.build_image != nullptr));
+    bool check_strings = options.check || (!has_image && !cached);
+    checked = (!check_checksums || CheckDexChecksums(dex, &error)) &&
+              (!check_strings || dex.CheckStrings(&error));
+  }
+  if (!checked) {
+    fprintf(stderr, "%s: %s\n", filename, error.c_str());
+    if (!dump) {
+      return false;
+    }
+  }
+  dex.set_filter(options.filter);
+  if (options.cache_dir != nullptr && (cached || checked) &&
+      !cache.Attach(options.cache_dir, &dex)) {
+    fprintf(stderr, "can't use cache directory %s\n", options.cache_dir);
+  }
+  if (dump) {
+    dex.PrintSections();
+    return true;
+  }
+  if (options.format != nullptr) {
+    std::unique_ptr<RecordWriter> writer = NewRecordWriter(options.format, stdout);
+    return dex.WriteRecords(writer.get());
+  }
+  if (options.has_call_graph_query()) {
+    DexCallGraph graph(dex);
+    graph.Build();
+    if (graph.bad_methods() != 0) {
+      fprintf(stderr, "%s: %u methods have malformed code\n", filename, graph.bad_methods());
+    }
+    bool ok = true;
+    if (options.callers != nullptr) {
+      ok = dex.PrintCalls(graph, options.callers, true) && ok;
+    }
+    if (options.callees != nullptr) {
+      ok = dex.PrintCalls(graph, options.callees, false) && ok;
+    }
+    if (options.overrides != nullptr) {
+      ok = dex.PrintOverrides(graph, options.overrides) && ok;
+    }
+    if (options.subtypes != nullptr) {
+      ok = dex.PrintSubtypes(graph, options.subtypes) && ok;
+    }
+    return ok;
+  }
+  if (options.xref != nullptr) {
+    DexXref xref(dex);
+    if (options.xref_file == nullptr || !xref.Open(options.xref_file)) {
+      xref.Build();
+      if (xref.bad_methods() != 0) {
+        fprintf(stderr, "%s: %u methods have malformed code\n", filename, xref.bad_methods());
+      }
+      if (options.xref_file != nullptr && !xref.Write(options.xref_file)) {
+        return false;
+      }
+    }
+    return dex.PrintXrefs(xref, options.xref);
+  }
+  if (options.dead_code) {
+    DexReachability reachability(dex);
+    reachability.Init();
+    reachability.AddDefaultRoots();
+    if (options.keep_file != nullptr && !dex.AddKeepRules(options.keep_file, &reachability)) {
+      return false;
+    }
+    reachability.Run();
+    dex.PrintDeadCode(reachability);
+    return true;
+  }
+  if (options.write_dex != nullptr) {
+    DexModel model;
+    DexWriter writer(model);
+    if (!LoadDexModel(dex, &model, &error) || !writer.WriteFile(options.write_dex, &error)) {
+      fprintf(stderr, "%s: %s\n", filename, error.c_str());
+      return false;
+    }
+    return true;
+  }
+  std::vector<uint8_t> verified(dex.method_ids_size(), 0);
+  if (has_image) {
+    for (uint32_t i = 0; i < dex.method_ids_size(); ++i) {
+      verified[i] = image.IsVerified(i);
+    }
+  }
+  bool ok = true;
+  if (options.verify || options.build_image != nullptr) {
+    if (options.verified_file != nullptr) {
+      LoadVerifiedMethods(options.verified_file, dex, &verified);
+    }
+    Profiler profiler;
+    if (options.profile != nullptr && !profiler.Start(options.profile_hz, &error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      return false;
+    }
+    ok = dex.Verify(&verified);
+    if (options.profile != nullptr) {
+      profiler.Stop();
+      ok &= dex.WriteProfile(options.profile, profiler);
+    }
+    if (options.verified_file != nullptr &&
+        !SaveVerifiedMethods(options.verified_file, dex, verified)) {
+      ok = false;
+    }
+  } else if (has_image) {
+    ok = dex.PrintImage(image);
+  }
+  if (options.build_image != nullptr) {
+    DexImageWriter writer(dex);
+    if (!writer.Write(options.build_image, verified)) {
+      return false;
+    }
+  }
+  return ok;
+}
+
+// Names an index of Stats::opcodes.
+static const char* GetStatsOpcodeName(int i) {
+  return JavaDex::GetInsnName(i < 0x100 ? i : (i - 0xff) << 8);
 }
 
 int main(int argc, char** argv) {
-  if (argc != 2) {
-    fprintf(stderr, "read_dex <dex_file>\n");
+  ReadDexOptions options;
+  const char* filename = nullptr;
+  const char* sections = nullptr;
+  bool usage_error = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--verify") == 0) {
+      options.verify = true;
+    } else if (strcmp(argv[i], "--check") == 0) {
+      options.check = true;
+    } else if (strcmp(argv[i], "--verified-file") == 0 && i + 1 < argc) {
+      options.verified_file = argv[++i];
+    } else if (strcmp(argv[i], "--build-image") == 0 && i + 1 < argc) {
+      options.build_image = argv[++i];
+    } else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+      options.image = argv[++i];
+    } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+      options.cache_dir = argv[++i];
+    } else if (strcmp(argv[i], "--callers") == 0 && i + 1 < argc) {
+      options.callers = argv[++i];
+    } else if (strcmp(argv[i], "--callees") == 0 && i + 1 < argc) {
+      options.callees = argv[++i];
+    } else if (strcmp(argv[i], "--overrides") == 0 && i + 1 < argc) {
+      options.overrides = argv[++i];
+    } else if (strcmp(argv[i], "--subtypes") == 0 && i + 1 < argc) {
+      options.subtypes = argv[++i];
+    } else if (strcmp(argv[i], "--dead-code") == 0) {
+      options.dead_code = true;
+    } else if (strcmp(argv[i], "--keep") == 0 && i + 1 < argc) {
+      options.keep_file = argv[++i];
+    } else if (strcmp(argv[i], "--write-dex") == 0 && i + 1 < argc) {
+      options.write_dex = argv[++i];
+    } else if (strcmp(argv[i], "--sections") == 0 && i + 1 < argc) {
+      sections = argv[++i];
+    } else if (strcmp(argv[i], "--class") == 0 && i + 1 < argc) {
+      options.filter.classes.push_back(argv[++i]);
+    } else if (strcmp(argv[i], "--method") == 0 && i + 1 < argc) {
+      options.filter.method = argv[++i];
+    } else if (strcmp(argv[i], "--no-code") == 0) {
+      options.filter.code = false;
+    } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+      options.format = argv[++i];
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      options.stats = "table";
+    } else if (strcmp(argv[i], "--stats-format") == 0 && i + 1 < argc) {
+      options.stats = argv[++i];
+    } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      options.profile = argv[++i];
+    } else if (strcmp(argv[i], "--profile-hz") == 0 && i + 1 < argc) {
+      options.profile_hz = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--xref") == 0 && i + 1 < argc) {
+      options.xref = argv[++i];
+    } else if (strcmp(argv[i], "--xref-file") == 0 && i + 1 < argc) {
+      options.xref_file = argv[++i];
+    } else if (filename == nullptr) {
+      filename = argv[i];
+    } else {
+      usage_error = true;
+    }
+  }
+  // A class or method query dumps only class_defs unless told otherwise.
+  if (sections != nullptr) {
+    usage_error |= !ParseDumpSections(sections, &options.filter.sections);
+  } else if (!options.filter.classes.empty() || options.filter.method != nullptr) {
+    options.filter.sections = DUMP_CLASS_DEFS;
+  }
+  if (filename == nullptr || usage_error ||
+      (options.verified_file != nullptr && !options.verify) ||
+      (options.profile != nullptr && !options.verify) || options.profile_hz == 0 ||
+      (options.xref_file != nullptr && options.xref == nullptr) ||
+      (options.keep_file != nullptr && !options.dead_code) ||
+      (options.format != nullptr && !IsRecordFormat(options.format)) ||
+      (options.stats != nullptr && strcmp(options.stats, "table") != 0 &&
+       strcmp(options.stats, "json") != 0)) {
+    fprintf(stderr, "read_dex [--check] [--verify [--verified-file <file>] [--profile <file> "
+            "[--profile-hz <n>]]] [--build-image <image>] "
+            "[--image <image>] [--cache-dir <dir>] [--callers <method>] [--callees <method>] "
+            "[--overrides <method>] [--subtypes <class>] [--xref <kind>:<name> "
+            "[--xref-file <file>]] [--dead-code [--keep <file>]] [--write-dex <file>] "
+            "[--format json|binary] [--sections strings,types,protos,fields,methods,classes] "
+            "[--class <glob>]... [--method <glob>] [--no-code] "
+            "[--stats | --stats-format table|json] <dex_file>\n");
     return 1;
   }
-  const char* filename = argv[1];
-  ReadDex(filename);
+  bool ok = ReadDex(filename, options);
+  if (options.stats != nullptr) {
+    fflush(stdout);
+    if (STATS_ENABLED) {
+      PrintStats(stderr, strcmp(options.stats, "json") == 0, GetStatsOpcodeName);
+    } else {
+      fprintf(stderr, "read_dex was built without stats, see STATS in the Makefile\n");
+    }
+  }
+  return ok ? 0 : 1;
 }
@@ -0,0 +1,337 @@
+#ifndef RECORD_WRITER_H_
+#define RECORD_WRITER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mutf8.h"
+#include "utils.h"
+
+// Machine-readable output of read_class and read_dex. A tool emits a stream
+// of records, each a kind and a list of named fields, and a RecordWriter
+// writes every record out as soon as it ends, so memory use doesn't depend
+// on the size of the input.
+//
+// A tool adds the fields of a kind always in the same order. The binary
+// format relies on that and leaves out the names:
+//
+//   file:   "RECS" u4 version
+//   record: u4 size (of the rest of the record) u1 kind field*
+//   field:  u1 RECORD_INT sleb128
+//         | u1 RECORD_STRING u4 size bytes (modified UTF-8, no terminator)
+//         | u1 RECORD_LIST u4 count uleb128*
+//         | u1 RECORD_STRING_LIST u4 count (u4 size bytes)*
+//
+// The u4s are little-endian.
+//
+// read_class and read_dex share the keys below, written with the Add*Head
+// and AddRef helpers of RecordWriter, so a consumer reads the same fields
+// from both. Class names and types are type descriptors, e.g.
+// "Ljava/lang/String;", in both tools.
+//   class:  name, access_flags, superclass, interfaces
+//   field:  idx, class, name, type, access_flags
+//   method: idx, class, name, return_type, parameters, access_flags
+//   insn:   method, pc, op, ref, index, class, name, type, value
+// Each tool adds its own fields after these, see its WriteRecords. The
+// operand fields of an insn are those of a RecordRef, with ref its kind.
+
+enum RECORD_KIND {
+  RECORD_CLASS = 1,
+  RECORD_FIELD = 2,
+  RECORD_METHOD = 3,
+  RECORD_INSN = 4,
+};
+
+enum RECORD_FIELD_TYPE {
+  RECORD_INT = 0,
+  RECORD_STRING = 1,
+  RECORD_LIST = 2,
+  RECORD_STRING_LIST = 3,
+};
+
+constexpr uint32_t RECORD_VERSION = 3;
+
+// What the constant or id operand of an instruction refers to, so that
+// consumers don't have to parse a formatted reference.
+struct RecordRef {
+  // "" if there is no such operand, otherwise "string", "type", "field",
+  // "method", "constant", "call_site", "method_handle" or "method_type".
+  const char* kind = "";
+  // The constant pool or id index of the operand; -1 if there is none.
+  int64_t index = -1;
+  // The class declaring a field or method.
+  std::string cls;
+  // The name of a field, method or call site.
+  std::string name;
+  // The type of a type, field or method_type reference, and the method
+  // descriptor, e.g. "(I)V", of a method or call site.
+  std::string type;
+  // The value of a string or numeric constant.
+  std::string value;
+};
+
+static const char* GetRecordKindName(uint8_t kind) {
+  switch (kind) {
+    case RECORD_CLASS:
+      return "class";
+    case RECORD_FIELD:
+      return "field";
+    case RECORD_METHOD:
+      return "method";
+    case RECORD_INSN:
+      return "insn";
+  }
+  return "unknown";
+}
+
+class RecordWriter {
+ public:
+  explicit RecordWriter(FILE* fp) : fp_(fp) {
+  }
+
+  virtual ~RecordWriter() {
+  }
+
+  virtual void Begin(uint8_t kind) = 0;
+  virtual void AddInt(const char* key, int64_t value) = 0;
+  // value is modified UTF-8.
+  virtual void AddString(const char* key, const char* value, size_t size) = 0;
+  virtual void AddList(const char* key, const uint32_t* values, size_t count) = 0;
+  // The values are modified UTF-8.
+  virtual void AddList(const char* key, const std::vector<std::string>& values) = 0;
+  virtual void End() = 0;
+
+  void AddString(const char* key, const char* value) {
+    AddString(key, value, strlen(value));
+  }
+
+  void AddString(const char* key, const std::string& value) {
+    AddString(key, value.data(), value.size());
+  }
+
+  // The shared fields of a class record.
+  void AddClassHead(const std::string& name, uint32_t access_flags,
+                    const std::string& superclass, const std::vector<std::string>& interfaces) {
+    AddString("name", name);
+    AddInt("access_flags", access_flags);
+    AddString("superclass", superclass);
+    AddList("interfaces", interfaces);
+  }
+
+  // The shared fields of a field record.
+  void AddFieldHead(int64_t idx, const std::string& cls, const std::string& name,
+                    const std::string& type, uint32_t access_flags) {
+    AddInt("idx", idx);
+    AddString("class", cls);
+    AddString("name", name);
+    AddString("type", type);
+    AddInt("access_flags", access_flags);
+  }
+
+  // The shared fields of a method record.
+  void AddMethodHead(int64_t idx, const std::string& cls, const std::string& name,
+                     const std::string& return_type, const std::vector<std::string>& parameters,
+                     uint32_t access_flags) {
+    AddInt("idx", idx);
+    AddString("class", cls);
+    AddString("name", name);
+    AddString("return_type", return_type);
+    AddList("parameters", parameters);
+    AddInt("access_flags", access_flags);
+  }
+
+  // The shared fields of an insn record.
+  void AddInsnHead(int64_t method, uint32_t pc, const char* op, const RecordRef& ref) {
+    AddInt("method", method);
+    AddInt("pc", pc);
+    AddString("op", op);
+    AddString("ref", ref.kind);
+    AddInt("index", ref.index);
+    AddString("class", ref.cls);
+    AddString("name", ref.name);
+    AddString("type", ref.type);
+    AddString("value", ref.value);
+  }
+
+ protected:
+  FILE* fp_;
+  // The record being built.
+  std::string buf_;
+};
+
+// One JSON object per line. Strings are decoded from modified UTF-8 and
+// everything outside printable ASCII is written as \u escapes, so the output
+// is plain ASCII.
+class JsonRecordWriter : public RecordWriter {
+ public:
+  explicit JsonRecordWriter(FILE* fp) : RecordWriter(fp) {
+  }
+
+  void Begin(uint8_t kind) override {
+    buf_ = "{\"kind\":\"";
+    buf_ += GetRecordKindName(kind);
+    buf_.push_back('"');
+  }
+
+  void AddInt(const char* key, int64_t value) override {
+    AddKey(key);
+    buf_ += std::to_string(value);
+  }
+
+  void AddString(const char* key, const char* value, size_t size) override {
+    AddKey(key);
+    AppendString(value, size);
+  }
+
+  void AddList(const char* key, const uint32_t* values, size_t count) override {
+    AddKey(key);
+    buf_.push_back('[');
+    for (size_t i = 0; i < count; ++i) {
+      if (i > 0) {
+        buf_.push_back(',');
+      }
+      buf_ += std::to_string(values[i]);
+    }
+    buf_.push_back(']');
+  }
+
+  void AddList(const char* key, const std::vector<std::string>& values) override {
+    AddKey(key);
+    buf_.push_back('[');
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (i > 0) {
+        buf_.push_back(',');
+      }
+      AppendString(values[i].data(), values[i].size());
+    }
+    buf_.push_back(']');
+  }
+
+  void End() override {
+    buf_ += "}\n";
+    fwrite(buf_.data(), 1, buf_.size(), fp_);
+  }
+
+ private:
+  void AddKey(const char* key) {
+    buf_ += ",\"";
+    buf_ += key;
+    buf_ += "\":";
+  }
+
+  void AppendString(const char* value, size_t size) {
+    const uint8_t* p = (const uint8_t*)value;
+    const uint8_t* end = p + size;
+    char escape[8];
+    buf_.push_back('"');
+    while (p < end) {
+      uint8_t c = *p;
+      if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\') {
+        buf_.push_back(c);
+        p++;
+        continue;
+      }
+      uint16_t unit;
+      if (c < 0x80) {
+        unit = c;
+        p++;
+      } else if (DecodeMutf8Char(p, end) != 0) {
+        unit = ReadMutf8Unit(p);
+      } else {
+        // Damaged input is still dumped, with a replacement character.
+        unit = 0xfffd;
+        p++;
+      }
+      if (unit == '"' || unit == '\\') {
+        buf_.push_back('\\');
+        buf_.push_back(unit);
+      } else {
+        snprintf(escape, sizeof(escape), "\\u%04x", unit);
+        buf_ += escape;
+      }
+    }
+    buf_.push_back('"');
+  }
+};
+
+// The length-prefixed records described above. A reader can mmap the output
+// and skip from record to record by size without decoding the fields.
+class BinaryRecordWriter : public RecordWriter {
+ public:
+  explicit BinaryRecordWriter(FILE* fp) : RecordWriter(fp) {
+    buf_ = "RECS";
+    AppendU4(RECORD_VERSION);
+    fwrite(buf_.data(), 1, buf_.size(), fp_);
+  }
+
+  void Begin(uint8_t kind) override {
+    buf_.assign(4, '\0');
+    buf_.push_back(kind);
+  }
+
+  void AddInt(const char*, int64_t value) override {
+    buf_.push_back(RECORD_INT);
+    WriteLEB128(&buf_, value);
+  }
+
+  void AddString(const char*, const char* value, size_t size) override {
+    buf_.push_back(RECORD_STRING);
+    AppendU4(size);
+    buf_.append(value, size);
+  }
+
+  void AddList(const char*, const uint32_t* values, size_t count) override {
+    buf_.push_back(RECORD_LIST);
+    AppendU4(count);
+    for (size_t i = 0; i < count; ++i) {
+      WriteULEB128(&buf_, values[i]);
+    }
+  }
+
+  void AddList(const char*, const std::vector<std::string>& values) override {
+    buf_.push_back(RECORD_STRING_LIST);
+    AppendU4(values.size());
+    for (const std::string& value : values) {
+      AppendU4(value.size());
+      buf_ += value;
+    }
+  }
+
+  void End() override {
+    uint32_t size = buf_.size() - 4;
+    for (int i = 0; i < 4; ++i) {
+      buf_[i] = (char)(size >> (8 * i));
+    }
+    fwrite(buf_.data(), 1, buf_.size(), fp_);
+  }
+
+ private:
+  void AppendU4(uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      buf_.push_back((char)(value >> (8 * i)));
+    }
+  }
+};
+
+static bool IsRecordFormat(const char* format) {
+  return strcmp(format, "json") == 0 || strcmp(format, "binary") == 0;
+}
+
+// Returns the writer of format "json" or "binary", or nullptr for any other
+// format.
+static std::unique_ptr<RecordWriter> NewRecordWriter(const char* format, FILE* fp) {
+  if (strcmp(format, "json") == 0) {
+    return std::unique_ptr<RecordWriter>(new JsonRecordWriter(fp));
+  }
+  if (strcmp(format, "binary") == 0) {
+    return std::unique_ptr<RecordWriter>(new BinaryRecordWriter(fp));
+  }
+  return nullptr;
+}
+
+#endif  // RECORD_WRITER_H_
@@ -0,0 +1,194 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <mutex>
+
+// Phase timers and counters for --stats. They are compiled in only when
+// ENABLE_STATS is defined; otherwise every STATS_* macro expands to nothing
+// and the tool pays nothing for them. Each thread counts into its own
+// Stats, which ParallelFor merges into the totals when its threads finish.
+
+enum STATS_PHASE {
+  STATS_PARSE_HEAD,
+  STATS_CHECK,
+  STATS_PRINT_STRING_IDS,
+  STATS_PRINT_TYPE_IDS,
+  STATS_PRINT_PROTO_IDS,
+  STATS_PRINT_FIELD_IDS,
+  STATS_PRINT_METHOD_IDS,
+  STATS_PRINT_CLASS_DEFS,
+  STATS_PRINT_CLASS_DATA,
+  STATS_PRINT_CODE_ITEM,
+  STATS_PRINT_INSTRUCTIONS,
+  STATS_PRINT_DEBUG_INFO,
+  STATS_PRINT_ANNOTATIONS,
+  STATS_VERIFY,
+  STATS_WRITE_RECORDS,
+  STATS_PHASE_COUNT,
+};
+
+static const char* const STATS_PHASE_NAMES[STATS_PHASE_COUNT] = {
+    "parse_head",      "check",        "string_ids",   "type_ids",    "proto_ids",
+    "field_ids",       "method_ids",   "class_defs",   "class_data",  "code_item",
+    "instructions",    "debug_info",   "annotations",  "verify",      "write_records",
+};
+
+// bytes_touched counts the bytes of the LEB128 values and instructions
+// that were decoded, which is where the variable-length work is.
+enum STATS_COUNTER {
+  STATS_ULEB128_DECODES,
+  STATS_STRINGS_RESOLVED,
+  STATS_INSNS_DECODED,
+  STATS_BYTES_TOUCHED,
+  STATS_COUNTER_COUNT,
+};
+
+static const char* const STATS_COUNTER_NAMES[STATS_COUNTER_COUNT] = {
+    "uleb128_decodes", "strings_resolved", "insns_decoded", "bytes_touched",
+};
+
+// Opcodes 0x00-0xff, then the three payload pseudo-opcodes.
+static constexpr int STATS_OPCODE_COUNT = 259;
+
+struct Stats {
+  uint64_t phase_calls[STATS_PHASE_COUNT];
+  uint64_t phase_ns[STATS_PHASE_COUNT];
+  uint64_t counters[STATS_COUNTER_COUNT];
+  uint64_t opcodes[STATS_OPCODE_COUNT];
+
+  void Add(const Stats& other) {
+    for (int i = 0; i < STATS_PHASE_COUNT; ++i) {
+      phase_calls[i] += other.phase_calls[i];
+      phase_ns[i] += other.phase_ns[i];
+    }
+    for (int i = 0; i < STATS_COUNTER_COUNT; ++i) {
+      counters[i] += other.counters[i];
+    }
+    for (int i = 0; i < STATS_OPCODE_COUNT; ++i) {
+      opcodes[i] += other.opcodes[i];
+    }
+  }
+};
+
+// Zero-initialized and trivially destructible, so using it needs no guard.
+static thread_local Stats thread_stats;
+
+static Stats& GetTotalStats() {
+  static Stats total;
+  return total;
+}
+
+static std::mutex& GetStatsMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// Adds the calling thread's counts to the totals and clears them.
+static void MergeThreadStats() {
+  std::lock_guard<std::mutex> lock(GetStatsMutex());
+  GetTotalStats().Add(thread_stats);
+  memset(&thread_stats, 0, sizeof(thread_stats));
+}
+
+static uint64_t GetStatsClockNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Adds the time from construction to destruction to a phase. Nested phases
+// are counted in full by each enclosing phase, and phases that run on
+// several threads add up the time of every thread.
+class StatsTimer {
+ public:
+  explicit StatsTimer(int phase) : phase_(phase), start_(GetStatsClockNs()) {
+  }
+
+  ~StatsTimer() {
+    thread_stats.phase_calls[phase_]++;
+    thread_stats.phase_ns[phase_] += GetStatsClockNs() - start_;
+  }
+
+ private:
+  int phase_;
+  uint64_t start_;
+};
+
+// Prints the totals, with the calling thread's counts merged in, as a table
+// or as JSON. opcode_name names an index of Stats::opcodes.
+static void PrintStats(FILE* fp, bool json, const char* (*opcode_name)(int)) {
+  MergeThreadStats();
+  const Stats& stats = GetTotalStats();
+  if (json) {
+    fprintf(fp, "{\"phases\": {");
+    const char* sep = "";
+    for (int i = 0; i < STATS_PHASE_COUNT; ++i) {
+      if (stats.phase_calls[i] != 0) {
+        fprintf(fp, "%s\"%s\": {\"calls\": %lu, \"ns\": %lu}", sep, STATS_PHASE_NAMES[i],
+                (unsigned long)stats.phase_calls[i], (unsigned long)stats.phase_ns[i]);
+        sep = ", ";
+      }
+    }
+    fprintf(fp, "}, \"counters\": {");
+    for (int i = 0; i < STATS_COUNTER_COUNT; ++i) {
+      fprintf(fp, "%s\"%s\": %lu", i ? ", " : "", STATS_COUNTER_NAMES[i],
+              (unsigned long)stats.counters[i]);
+    }
+    fprintf(fp, "}, \"opcodes\": {");
+    sep = "";
+    for (int i = 0; i < STATS_OPCODE_COUNT; ++i) {
+      if (stats.opcodes[i] != 0) {
+        fprintf(fp, "%s\"%s\": %lu", sep, opcode_name(i), (unsigned long)stats.opcodes[i]);
+        sep = ", ";
+      }
+    }
+    fprintf(fp, "}}\n");
+    return;
+  }
+  fprintf(fp, "%-24s %12s %12s\n", "phase", "calls", "ms");
+  for (int i = 0; i < STATS_PHASE_COUNT; ++i) {
+    if (stats.phase_calls[i] != 0) {
+      fprintf(fp, "%-24s %12lu %12.3f\n", STATS_PHASE_NAMES[i],
+              (unsigned long)stats.phase_calls[i], stats.phase_ns[i] / 1e6);
+    }
+  }
+  fprintf(fp, "%-24s %12s\n", "counter", "count");
+  for (int i = 0; i < STATS_COUNTER_COUNT; ++i) {
+    fprintf(fp, "%-24s %12lu\n", STATS_COUNTER_NAMES[i], (unsigned long)stats.counters[i]);
+  }
+  fprintf(fp, "%-24s %12s\n", "opcode", "count");
+  for (int i = 0; i < STATS_OPCODE_COUNT; ++i) {
+    if (stats.opcodes[i] != 0) {
+      fprintf(fp, "%-24s %12lu\n", opcode_name(i), (unsigned long)stats.opcodes[i]);
+    }
+  }
+}
+
+#ifdef ENABLE_STATS
+static constexpr bool STATS_ENABLED = true;
+#define STATS_CONCAT_(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_(a, b)
+// Times the rest of the enclosing scope as phase.
+#define STATS_SCOPE(phase) StatsTimer STATS_CONCAT(stats_timer_, __LINE__)(phase)
+#define STATS_ADD(counter, n) (thread_stats.counters[counter] += (n))
+// Counts one decoded instruction or payload, of opcode op or DEX_PAYLOAD_IDENT.
+#define STATS_INSN(op)                                                          \
+  do {                                                                          \
+    thread_stats.counters[STATS_INSNS_DECODED]++;                               \
+    thread_stats.opcodes[(op) < 0x100 ? (op) : 0xff + ((op) >> 8)]++;           \
+  } while (0)
+#define STATS_MERGE_THREAD() MergeThreadStats()
+#else
+static constexpr bool STATS_ENABLED = false;
+#define STATS_SCOPE(phase)
+#define STATS_ADD(counter, n)
+#define STATS_INSN(op)
+#define STATS_MERGE_THREAD()
+#endif
+
+#endif  // STATS_H_
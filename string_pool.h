@@ -0,0 +1,215 @@
+#ifndef STRING_POOL_H_
+#define STRING_POOL_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A handle names one interned string. Two handles from the same pool are
+// equal exactly when their strings are, so names and descriptors are compared
+// and hashed as integers. Handles stay valid for the life of the pool.
+typedef uint32_t StringHandle;
+
+// A process-wide table of interned strings, shared by every loaded class and
+// dex file and by the passes over them. Interning is split over shards, each
+// with its own lock, so parallel loaders rarely wait on each other. Looking up
+// the string of a handle takes no lock.
+//
+// Handles are for names that come from more than one file or from no id
+// table: the types of the class and dex verifiers, the image linker and
+// dexdiff. Within one dex file the string and type ids are already unique, so
+// DexFile, the call graph, the xref index and the reachability pass compare
+// ids and resolve a constant name to its id once with FindString or FindType.
+// The merger needs the sort order of strings across files, which handles
+// don't keep, so it compares the strings themselves.
+class StringPool {
+ public:
+  StringPool() : next_handle_(0) {
+    for (auto& chunk : chunks_) {
+      chunk.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  ~StringPool() {
+    for (auto& chunk : chunks_) {
+      delete[] chunk.load(std::memory_order_relaxed);
+    }
+    for (auto& shard : shards_) {
+      for (char* block : shard.blocks) {
+        delete[] block;
+      }
+    }
+  }
+
+  // The pool is never destroyed, so handles held by static objects stay
+  // valid through exit.
+  static StringPool& Global() {
+    static StringPool* pool = new StringPool;
+    return *pool;
+  }
+
+  StringHandle Intern(const char* data, size_t size) {
+    uint32_t hash = Hash(data, size);
+    Shard& shard = shards_[hash & (SHARD_COUNT - 1)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.slots.empty()) {
+      shard.slots.resize(64, 0);
+    }
+    size_t mask = shard.slots.size() - 1;
+    size_t i = (hash >> SHARD_BITS) & mask;
+    for (; shard.slots[i] != 0; i = (i + 1) & mask) {
+      StringHandle handle = shard.slots[i] - 1;
+      const Entry* entry = GetEntry(handle);
+      if (entry->hash == hash && entry->size == size && memcmp(entry + 1, data, size) == 0) {
+        return handle;
+      }
+    }
+    StringHandle handle = next_handle_.fetch_add(1, std::memory_order_relaxed);
+    Entry* entry = Allocate(shard, size);
+    entry->hash = hash;
+    entry->size = size;
+    char* s = (char*)(entry + 1);
+    memcpy(s, data, size);
+    s[size] = '\0';
+    SetEntry(handle, entry);
+    shard.slots[i] = handle + 1;
+    if (++shard.count * 2 > shard.slots.size()) {
+      Grow(shard);
+    }
+    return handle;
+  }
+
+  StringHandle Intern(const char* s) {
+    return Intern(s, strlen(s));
+  }
+
+  StringHandle Intern(const std::string& s) {
+    return Intern(s.data(), s.size());
+  }
+
+  // The returned string is NUL-terminated and lives as long as the pool.
+  const char* GetString(StringHandle handle) const {
+    return (const char*)(GetEntry(handle) + 1);
+  }
+
+  uint32_t GetLength(StringHandle handle) const {
+    return GetEntry(handle)->size;
+  }
+
+  size_t size() const {
+    return next_handle_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Entry {
+    uint32_t hash;
+    uint32_t size;
+    // Followed by size bytes and a NUL.
+  };
+
+  static const int SHARD_BITS = 6;
+  static const size_t SHARD_COUNT = 1 << SHARD_BITS;
+  // The directory from handles to entries is split into chunks that are
+  // allocated on first use and never move.
+  static const int CHUNK_BITS = 16;
+  static const size_t CHUNK_SIZE = 1 << CHUNK_BITS;
+  static const size_t CHUNK_COUNT = (1ull << 32) >> CHUNK_BITS;
+  static const size_t BLOCK_SIZE = 64 * 1024;
+
+  struct Shard {
+    Shard() : count(0), block(nullptr), block_left(0) {
+    }
+
+    std::mutex mutex;
+    // handle + 1 of each string in the shard, 0 for an empty slot.
+    std::vector<uint32_t> slots;
+    size_t count;
+    std::vector<char*> blocks;
+    char* block;
+    size_t block_left;
+  };
+
+  // FNV-1a.
+  static uint32_t Hash(const char* data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+      hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+    }
+    return hash;
+  }
+
+  const Entry* GetEntry(StringHandle handle) const {
+    const Entry* const* chunk = chunks_[handle >> CHUNK_BITS].load(std::memory_order_acquire);
+    return chunk[handle & (CHUNK_SIZE - 1)];
+  }
+
+  void SetEntry(StringHandle handle, const Entry* entry) {
+    std::atomic<const Entry**>& slot = chunks_[handle >> CHUNK_BITS];
+    const Entry** chunk = slot.load(std::memory_order_acquire);
+    if (chunk == nullptr) {
+      // Another shard may be filling the same chunk; the loser frees its copy.
+      const Entry** fresh = new const Entry*[CHUNK_SIZE]();
+      if (slot.compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel)) {
+        chunk = fresh;
+      } else {
+        delete[] fresh;
+      }
+    }
+    chunk[handle & (CHUNK_SIZE - 1)] = entry;
+  }
+
+  static Entry* Allocate(Shard& shard, size_t size) {
+    size_t bytes = (sizeof(Entry) + size + 1 + 3) & ~(size_t)3;
+    if (bytes > BLOCK_SIZE / 4) {
+      char* block = new char[bytes];
+      shard.blocks.push_back(block);
+      return (Entry*)block;
+    }
+    if (bytes > shard.block_left) {
+      shard.block = new char[BLOCK_SIZE];
+      shard.block_left = BLOCK_SIZE;
+      shard.blocks.push_back(shard.block);
+    }
+    Entry* entry = (Entry*)shard.block;
+    shard.block += bytes;
+    shard.block_left -= bytes;
+    return entry;
+  }
+
+  void Grow(Shard& shard) {
+    std::vector<uint32_t> slots(shard.slots.size() * 2, 0);
+    size_t mask = slots.size() - 1;
+    for (uint32_t slot : shard.slots) {
+      if (slot != 0) {
+        size_t i = (GetEntry(slot - 1)->hash >> SHARD_BITS) & mask;
+        while (slots[i] != 0) {
+          i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+      }
+    }
+    shard.slots.swap(slots);
+  }
+
+  Shard shards_[SHARD_COUNT];
+  std::atomic<const Entry**> chunks_[CHUNK_COUNT];
+  std::atomic<uint32_t> next_handle_;
+};
+
+static StringHandle InternString(const char* s) {
+  return StringPool::Global().Intern(s);
+}
+
+static StringHandle InternString(const std::string& s) {
+  return StringPool::Global().Intern(s);
+}
+
+static const char* GetInternedString(StringHandle handle) {
+  return StringPool::Global().GetString(handle);
+}
+
+#endif  // STRING_POOL_H_
@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dex.h"
+#include "dex_model.h"
+#include "dex_writer.h"
+#include "dexer.h"
+#include "dexer_model.h"
+#include "synth.h"
+#include "utils.h"
+
+// Writes synthetic dex or class files for benchmarks. A dex output that
+// would pass the 16-bit id limits is split into classes.dex,
+// classes2.dex, ... the way dexmerge splits, so any class count works; a
+// single large dex file comes from fewer classes with more code instead.
+// For example, --classes 6000 --methods 10 --code-size 8192 makes about
+// 1 GB of dex.
+
+// Builds the DexerClass of class class_index, the same program the class
+// file generator writes. v0 holds the result, v1 a second accumulator, v2 a
+// constant and v3 the last string; v4 and v5 are the parameters.
+class SynthDexBuilder {
+ public:
+  SynthDexBuilder(const SynthOptions& options, uint32_t class_index, DexerClass* cls)
+      : options_(options), class_index_(class_index), cls_(cls) {
+  }
+
+  void Build() {
+    cls_->descriptor = "Lsynth/C" + std::to_string(class_index_) + ";";
+    cls_->access_flags = CLASS_ACC_PUBLIC;
+    cls_->superclass = "Ljava/lang/Object;";
+    cls_->needs_default_methods = false;
+    for (uint32_t i = 0; i < options_.strings; ++i) {
+      AddRef(DEX_INDEX_STRING, GetSynthString(class_index_, i));
+    }
+    cls_->methods.resize(options_.methods);
+    for (uint32_t i = 0; i < options_.methods; ++i) {
+      DexerMethod& method = cls_->methods[i];
+      method.access_flags = METHOD_ACC_PUBLIC | METHOD_ACC_STATIC;
+      method.name = "m" + std::to_string(i);
+      method.descriptor = "(II)I";
+      method.is_direct = true;
+      method.has_code = true;
+      BuildCode(i, &method.code);
+    }
+  }
+
+ private:
+  uint32_t AddRef(uint8_t index_type, const std::string& name,
+                  const std::string& class_descriptor = "", const std::string& descriptor = "") {
+    DexerRef ref{index_type, name, class_descriptor, descriptor};
+    auto it = refs_.find(ref);
+    if (it != refs_.end()) {
+      return it->second;
+    }
+    cls_->refs.push_back(ref);
+    refs_.emplace(ref, cls_->refs.size() - 1);
+    return cls_->refs.size() - 1;
+  }
+
+  void BuildCode(uint32_t method_index, DexerCode* code) {
+    code->registers_size = 6;
+    code->ins_size = 2;
+    code->outs_size = 2;
+    insns_ = &code->insns;
+    for (uint32_t reg = 0; reg < 3; ++reg) {
+      Unit(DEX_OP_CONST_4 | reg << 8 | reg << 12);
+    }
+    // (pc of the switch, its block) of the switches, whose payloads go
+    // after the return.
+    std::vector<std::pair<uint32_t, SynthBlock>> switches;
+    std::vector<uint32_t> joins;
+    SynthBlockGenerator generator(options_, class_index_, method_index);
+    while (insns_->size() < options_.code_size) {
+      SynthBlock block = generator.Next();
+      switch (block.kind) {
+        case SYNTH_ARITHMETIC:
+          Unit(DEX_OP_ADD_INT | 0 << 8);
+          Unit(0 | 4 << 8);
+          Unit(DEX_OP_MUL_INT_LIT8 | 0 << 8);
+          Unit(0 | block.value << 8);
+          Unit(DEX_OP_XOR_INT_2ADDR | 0 << 8 | 5 << 12);
+          Unit(DEX_OP_ADD_INT_2ADDR | 1 << 8 | 0 << 12);
+          break;
+        case SYNTH_STRING:
+          Unit(DEX_OP_CONST_STRING | 3 << 8);
+          Fixup(AddRef(DEX_INDEX_STRING, GetSynthString(class_index_, block.value)), code);
+          break;
+        case SYNTH_CALL:
+          Unit(DEX_OP_INVOKE_STATIC | 2 << 12);
+          Fixup(AddRef(DEX_INDEX_METHOD, "m" + std::to_string(block.value), cls_->descriptor,
+                       "(II)I"),
+                code);
+          Unit(0 | 1 << 4);
+          Unit(DEX_OP_MOVE_RESULT | 0 << 8);
+          break;
+        case SYNTH_PACKED_SWITCH:
+        case SYNTH_SPARSE_SWITCH: {
+          uint32_t switch_pc = insns_->size();
+          switches.emplace_back(switch_pc, block);
+          Unit((block.kind == SYNTH_PACKED_SWITCH ? DEX_OP_PACKED_SWITCH : DEX_OP_SPARSE_SWITCH) |
+               0 << 8);
+          Unit32(0);
+          Goto(&joins);
+          for (uint32_t i = 0; i < options_.switch_cases; ++i) {
+            Unit(DEX_OP_ADD_INT_LIT8 | 1 << 8);
+            Unit(1 | (i % 100 + 1) << 8);
+            Goto(&joins);
+          }
+          uint32_t join = insns_->size();
+          for (uint32_t pc : joins) {
+            Patch32(pc + 1, join - pc);
+          }
+          joins.clear();
+          break;
+        }
+      }
+    }
+    Unit(DEX_OP_RETURN | 0 << 8);
+    for (const auto& item : switches) {
+      uint32_t switch_pc = item.first;
+      if (insns_->size() % 2 != 0) {
+        Unit(DEX_OP_NOP);
+      }
+      Patch32(switch_pc + 1, insns_->size() - switch_pc);
+      // The cases start after the switch and the goto/32 of the fallthrough.
+      uint32_t target = 6;
+      if (item.second.kind == SYNTH_PACKED_SWITCH) {
+        Unit(PACKED_SWITCH_PAYLOAD);
+        Unit(options_.switch_cases);
+        Unit32(0);
+      } else {
+        Unit(SPARSE_SWITCH_PAYLOAD);
+        Unit(options_.switch_cases);
+        for (uint32_t i = 0; i < options_.switch_cases; ++i) {
+          Unit32(i * 3 + 1);
+        }
+      }
+      for (uint32_t i = 0; i < options_.switch_cases; ++i) {
+        Unit32(target + i * 5);
+      }
+    }
+  }
+
+  void Unit(uint16_t unit) {
+    insns_->push_back(unit);
+  }
+
+  void Unit32(uint32_t value) {
+    Unit(value & 0xffff);
+    Unit(value >> 16);
+  }
+
+  void Patch32(uint32_t pos, uint32_t value) {
+    (*insns_)[pos] = value & 0xffff;
+    (*insns_)[pos + 1] = value >> 16;
+  }
+
+  void Fixup(uint32_t ref, DexerCode* code) {
+    code->fixups.emplace_back(insns_->size(), ref);
+    Unit(0);
+  }
+
+  // A goto/32 to the end of the switch, patched once that is known.
+  void Goto(std::vector<uint32_t>* joins) {
+    joins->push_back(insns_->size());
+    Unit(DEX_OP_GOTO_32);
+    Unit32(0);
+  }
+
+  const SynthOptions& options_;
+  uint32_t class_index_;
+  DexerClass* cls_;
+  std::map<DexerRef, uint32_t> refs_;
+  std::vector<uint16_t>* insns_ = nullptr;
+};
+
+// An encoded_annotation of type Lsynth/Nested; whose value element is
+// another one, depth levels down to an int.
+static void EncodeSynthAnnotation(uint32_t depth, uint32_t value, uint32_t type_idx,
+                                  uint32_t name_idx, std::string* out) {
+  WriteULEB128(out, type_idx);
+  WriteULEB128(out, 1);
+  WriteULEB128(out, name_idx);
+  if (depth > 1) {
+    out->push_back(ENCODED_VALUE_ANNOTATION);
+    EncodeSynthAnnotation(depth - 1, value, type_idx, name_idx, out);
+  } else {
+    out->push_back((char)(3 << 5 | ENCODED_VALUE_INT));
+    for (int i = 0; i < 4; ++i) {
+      out->push_back((char)(value >> (i * 8)));
+    }
+  }
+}
+
+// Adds classes to a model, writing it out and starting a new one whenever
+// the next class might not fit the id limits.
+class SynthDexWriter {
+ public:
+  SynthDexWriter(const SynthOptions& options, const std::string& path)
+      : options_(options), path_(path) {
+    Reset();
+  }
+
+  bool AddClass(const DexerClass& cls, std::string* error) {
+    // Each class brings at most its own strings, names, descriptor and the
+    // types and protos every class shares.
+    size_t strings = cls.refs.size() + cls.methods.size() + 8;
+    if (!model_.classes.empty() &&
+        (model_.strings.size() + strings > 0x10000 ||
+         model_.methods.size() + cls.methods.size() > 0x10000 ||
+         model_.types.size() + 4 > 0x10000)) {
+      if (!Flush(error)) {
+        return false;
+      }
+    }
+    if (!builder_->AddClass(cls, error)) {
+      *error = cls.descriptor + ": " + *error;
+      return false;
+    }
+    if (options_.annotation_depth > 0) {
+      if (nested_type_idx_ == NO_INDEX) {
+        nested_type_idx_ = model_.AddType("Lsynth/Nested;");
+        value_name_idx_ = model_.AddString("value");
+      }
+      DexModelAnnotation annotation;
+      annotation.visibility = VISIBILITY_RUNTIME;
+      EncodeSynthAnnotation(options_.annotation_depth, model_.classes.size() - 1 + first_class_,
+                            nested_type_idx_, value_name_idx_, &annotation.encoded);
+      model_.classes.back().annotations.push_back(annotation);
+    }
+    return true;
+  }
+
+  bool Flush(std::string* error) {
+    std::string path = GetOutputPath(outputs_.size() + 1);
+    DexWriter writer(model_);
+    if (!writer.WriteFile(path.c_str(), error)) {
+      *error = StringPrintf("%s: %s", path.c_str(), error->c_str());
+      return false;
+    }
+    outputs_.push_back(path);
+    first_class_ += model_.classes.size();
+    Reset();
+    return true;
+  }
+
+  const std::vector<std::string>& outputs() const {
+    return outputs_;
+  }
+
+ private:
+  void Reset() {
+    model_ = DexModel();
+    builder_.reset(new DexerModelBuilder(&model_));
+    nested_type_idx_ = NO_INDEX;
+    value_name_idx_ = NO_INDEX;
+  }
+
+  std::string GetOutputPath(size_t n) const {
+    if (n == 1) {
+      return path_;
+    }
+    size_t dot = path_.size() >= 4 && path_.compare(path_.size() - 4, 4, ".dex") == 0
+                     ? path_.size() - 4
+                     : path_.size();
+    return path_.substr(0, dot) + std::to_string(n) + path_.substr(dot);
+  }
+
+  const SynthOptions& options_;
+  std::string path_;
+  DexModel model_;
+  std::unique_ptr<DexerModelBuilder> builder_;
+  uint32_t nested_type_idx_;
+  uint32_t value_name_idx_;
+  uint32_t first_class_ = 0;
+  std::vector<std::string> outputs_;
+};
+
+static bool WriteSynthDexFiles(const SynthOptions& options, const std::string& path,
+                               std::vector<std::string>* outputs, std::string* error) {
+  SynthDexWriter writer(options, path);
+  for (uint32_t i = 0; i < options.classes; ++i) {
+    DexerClass cls;
+    SynthDexBuilder builder(options, i, &cls);
+    builder.Build();
+    if (!writer.AddClass(cls, error)) {
+      return false;
+    }
+  }
+  if (!writer.Flush(error)) {
+    return false;
+  }
+  *outputs = writer.outputs();
+  return true;
+}
+
+int main(int argc, char** argv) {
+  SynthOptions options;
+  const char* format = "dex";
+  const char* output = nullptr;
+  bool usage_error = false;
+  struct {
+    const char* name;
+    uint32_t* value;
+  } numbers[] = {
+      {"--classes", &options.classes},
+      {"--methods", &options.methods},
+      {"--code-size", &options.code_size},
+      {"--strings", &options.strings},
+      {"--switch-percent", &options.switch_percent},
+      {"--switch-cases", &options.switch_cases},
+      {"--annotation-depth", &options.annotation_depth},
+      {"--class-version", &options.class_version},
+      {"--seed", &options.seed},
+  };
+  for (int i = 1; i < argc; ++i) {
+    bool found = false;
+    for (const auto& number : numbers) {
+      if (strcmp(argv[i], number.name) == 0 && i + 1 < argc) {
+        *number.value = strtoul(argv[++i], nullptr, 0);
+        found = true;
+        break;
+      }
+    }
+    if (found) {
+      continue;
+    }
+    if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+      format = argv[++i];
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else {
+      usage_error = true;
+    }
+  }
+  bool is_dex = strcmp(format, "dex") == 0;
+  if (output == nullptr || usage_error || (!is_dex && strcmp(format, "class") != 0) ||
+      options.methods == 0 || options.switch_percent > 100 || options.switch_cases > 0xffff ||
+      options.class_version < 49 || options.class_version > 52) {
+    fprintf(stderr, "synth [--format dex|class] -o <dex_file_or_dir> [--classes <n>] "
+            "[--methods <n>] [--code-size <n>] [--strings <n>] [--switch-percent <n>] "
+            "[--switch-cases <n>] [--annotation-depth <n>] [--class-version <n>] "
+            "[--seed <n>]\n");
+    return 1;
+  }
+  std::string error;
+  if (!is_dex) {
+    if (!WriteSynthClassFiles(options, output, &error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+    printf("wrote %u classes to %s/synth\n", options.classes, output);
+    return 0;
+  }
+  std::vector<std::string> outputs;
+  if (!WriteSynthDexFiles(options, output, &outputs, &error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  printf("wrote %u classes to", options.classes);
+  for (const std::string& path : outputs) {
+    printf(" %s", path.c_str());
+  }
+  printf("\n");
+  return 0;
+}
@@ -0,0 +1,100 @@
+#ifndef SYNTH_H_
+#define SYNTH_H_
+
+#include <stdint.h>
+
+#include <string>
+
+// Generates large, valid class and dex files for scaling tests. Class i is
+// synth/C<i>, with public static methods m0, m1, ... of type (II)I. Each
+// method body is a run of random blocks: arithmetic, string loads, calls to
+// methods of the same class, and packed or sparse switches. The class
+// file and dex generators draw the same blocks, so both formats describe
+// the same program.
+
+struct SynthOptions {
+  uint32_t classes = 100;
+  uint32_t methods = 10;
+  // Approximate size of each method's code, in bytes for class files and in
+  // 16-bit code units for dex files.
+  uint32_t code_size = 64;
+  // Strings of each class, beyond its names, that its methods load.
+  uint32_t strings = 16;
+  // Percentage of blocks that are switches, and the cases of each.
+  uint32_t switch_percent = 10;
+  uint32_t switch_cases = 8;
+  // Depth of the annotation nested in each class's annotation; 0 for none.
+  uint32_t annotation_depth = 0;
+  // major_version of class files, 49 to 52. From 50 on, methods get a
+  // StackMapTable, so they are checked rather than inferred.
+  uint32_t class_version = 49;
+  uint32_t seed = 1;
+};
+
+enum SYNTH_BLOCK_KIND {
+  SYNTH_ARITHMETIC,
+  SYNTH_STRING,
+  SYNTH_CALL,
+  SYNTH_PACKED_SWITCH,
+  SYNTH_SPARSE_SWITCH,
+};
+
+struct SynthBlock {
+  uint8_t kind;
+  // The constant of an arithmetic block, the string of a string block, or
+  // the method of a call.
+  uint32_t value;
+};
+
+// Draws the blocks of one method, from a stream that only depends on the
+// seed and the method.
+class SynthBlockGenerator {
+ public:
+  SynthBlockGenerator(const SynthOptions& options, uint32_t class_index, uint32_t method_index)
+      : options_(options),
+        state_(((uint64_t)options.seed << 40) ^ ((uint64_t)class_index << 16) ^ method_index ^
+               0x9e3779b97f4a7c15ull) {
+  }
+
+  SynthBlock Next() {
+    uint32_t r = Random();
+    SynthBlock block;
+    block.value = Random();
+    if (options_.switch_cases > 0 && r % 100 < options_.switch_percent) {
+      block.kind = (r / 100) % 2 ? SYNTH_SPARSE_SWITCH : SYNTH_PACKED_SWITCH;
+    } else if ((r / 100) % 4 == 0 && options_.strings > 0) {
+      block.kind = SYNTH_STRING;
+      block.value %= options_.strings;
+    } else if ((r / 100) % 4 == 1) {
+      block.kind = SYNTH_CALL;
+      block.value %= options_.methods;
+    } else {
+      block.kind = SYNTH_ARITHMETIC;
+      block.value = block.value % 100 + 1;
+    }
+    return block;
+  }
+
+ private:
+  // xorshift64*.
+  uint32_t Random() {
+    state_ ^= state_ >> 12;
+    state_ ^= state_ << 25;
+    state_ ^= state_ >> 27;
+    return (state_ * 0x2545f4914f6cdd1dull) >> 32;
+  }
+
+  const SynthOptions& options_;
+  uint64_t state_;
+};
+
+static std::string GetSynthString(uint32_t class_index, uint32_t string_index) {
+  return "synth string " + std::to_string(class_index) + "." + std::to_string(string_index);
+}
+
+// Writes dir/synth/C<i>.class for every class. Defined in synth_class.cpp,
+// because java_class.h and dex.h can't be included together.
+bool WriteSynthClassFiles(const SynthOptions& options, const std::string& dir,
+                          std::string* error);
+
+#endif  // SYNTH_H_
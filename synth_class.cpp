@@ -0,0 +1,347 @@
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "java_class.h"
+#include "synth.h"
+#include "utils.h"
+
+// Constants are deduplicated by tag and contents.
+class SynthConstantPool {
+ public:
+  uint16_t AddUtf8(const std::string& s) {
+    return Add(CONSTANT_Utf8, s, [&]() {
+      Put2(s.size());
+      bytes_ += s;
+    });
+  }
+
+  uint16_t AddClass(const std::string& name) {
+    uint16_t name_index = AddUtf8(name);
+    return Add(CONSTANT_Class, name, [&]() {
+      Put2(name_index);
+    });
+  }
+
+  uint16_t AddString(const std::string& s) {
+    uint16_t string_index = AddUtf8(s);
+    return Add(CONSTANT_String, s, [&]() {
+      Put2(string_index);
+    });
+  }
+
+  uint16_t AddInteger(int32_t value) {
+    return Add(CONSTANT_Integer, std::to_string(value), [&]() {
+      Put2((uint32_t)value >> 16);
+      Put2(value & 0xffff);
+    });
+  }
+
+  uint16_t AddMethodref(const std::string& class_name, const std::string& name,
+                        const std::string& descriptor) {
+    uint16_t class_index = AddClass(class_name);
+    uint16_t name_index = AddUtf8(name);
+    uint16_t descriptor_index = AddUtf8(descriptor);
+    uint16_t name_and_type_index = Add(CONSTANT_NameAndType, name + ":" + descriptor, [&]() {
+      Put2(name_index);
+      Put2(descriptor_index);
+    });
+    return Add(CONSTANT_Methodref, class_name + "." + name + ":" + descriptor, [&]() {
+      Put2(class_index);
+      Put2(name_and_type_index);
+    });
+  }
+
+  // The constant_pool_count of the class file, or 0 if there are too many
+  // constants.
+  uint16_t count() const {
+    return overflow_ ? 0 : indices_.size() + 1;
+  }
+
+  const std::string& bytes() const {
+    return bytes_;
+  }
+
+ private:
+  template <typename F>
+  uint16_t Add(uint8_t tag, const std::string& key, F write) {
+    auto it = indices_.find(std::make_pair(tag, key));
+    if (it != indices_.end()) {
+      return it->second;
+    }
+    if (indices_.size() + 1 >= 0xffff) {
+      overflow_ = true;
+      return 0;
+    }
+    bytes_.push_back(tag);
+    write();
+    uint16_t index = indices_.size() + 1;
+    indices_[std::make_pair(tag, key)] = index;
+    return index;
+  }
+
+  void Put2(uint32_t value) {
+    bytes_.push_back((char)(value >> 8));
+    bytes_.push_back((char)value);
+  }
+
+  std::map<std::pair<uint8_t, std::string>, uint16_t> indices_;
+  std::string bytes_;
+  bool overflow_ = false;
+};
+
+static void Put1(std::string* out, uint32_t value) {
+  out->push_back((char)value);
+}
+
+static void Put2(std::string* out, uint32_t value) {
+  out->push_back((char)(value >> 8));
+  out->push_back((char)value);
+}
+
+static void Put4(std::string* out, uint32_t value) {
+  Put2(out, value >> 16);
+  Put2(out, value & 0xffff);
+}
+
+static void Patch4(std::string* out, size_t pos, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    (*out)[pos + i] = (char)(value >> (24 - 8 * i));
+  }
+}
+
+// Locals 0 and 1 are the parameters, and local 2 holds the result. The pcs
+// that branches go to are appended to targets, in increasing order.
+static void EmitClassBlock(const SynthBlock& block, const SynthOptions& options,
+                           const std::string& class_name, uint32_t class_index,
+                           SynthConstantPool* pool, std::string* code,
+                           std::vector<uint32_t>* targets) {
+  switch (block.kind) {
+    case SYNTH_ARITHMETIC:
+      Put1(code, INST_ILOAD_2);
+      Put1(code, INST_ILOAD_0);
+      Put1(code, INST_IADD);
+      Put1(code, INST_BIPUSH);
+      Put1(code, block.value);
+      Put1(code, INST_IMUL);
+      Put1(code, INST_ILOAD_1);
+      Put1(code, INST_IXOR);
+      Put1(code, INST_ISTORE_2);
+      break;
+    case SYNTH_STRING:
+      Put1(code, INST_LDC_W);
+      Put2(code, pool->AddString(GetSynthString(class_index, block.value)));
+      Put1(code, INST_POP);
+      break;
+    case SYNTH_CALL:
+      Put1(code, INST_ILOAD_2);
+      Put1(code, INST_ILOAD_1);
+      Put1(code, INST_INVOKESTATIC);
+      Put2(code, pool->AddMethodref(class_name, "m" + std::to_string(block.value), "(II)I"));
+      Put1(code, INST_ISTORE_2);
+      break;
+    case SYNTH_PACKED_SWITCH:
+    case SYNTH_SPARSE_SWITCH: {
+      uint32_t cases = options.switch_cases;
+      bool packed = block.kind == SYNTH_PACKED_SWITCH;
+      Put1(code, INST_ILOAD_2);
+      size_t switch_pc = code->size();
+      Put1(code, packed ? INST_TABLESWITCH : INST_LOOKUPSWITCH);
+      while (code->size() % 4 != 0) {
+        Put1(code, 0);
+      }
+      size_t default_pos = code->size();
+      Put4(code, 0);
+      std::vector<size_t> offset_pos;
+      if (packed) {
+        Put4(code, 0);
+        Put4(code, cases - 1);
+        for (uint32_t i = 0; i < cases; ++i) {
+          offset_pos.push_back(code->size());
+          Put4(code, 0);
+        }
+      } else {
+        Put4(code, cases);
+        for (uint32_t i = 0; i < cases; ++i) {
+          Put4(code, i * 3 + 1);
+          offset_pos.push_back(code->size());
+          Put4(code, 0);
+        }
+      }
+      std::vector<size_t> gotos;
+      for (uint32_t i = 0; i < cases; ++i) {
+        Patch4(code, offset_pos[i], code->size() - switch_pc);
+        targets->push_back(code->size());
+        Put1(code, INST_IINC);
+        Put1(code, 2);
+        Put1(code, i % 100 + 1);
+        gotos.push_back(code->size());
+        Put1(code, INST_GOTO_W);
+        Put4(code, 0);
+      }
+      size_t join = code->size();
+      targets->push_back(join);
+      Patch4(code, default_pos, join - switch_pc);
+      for (size_t pc : gotos) {
+        Patch4(code, pc + 1, join - pc);
+      }
+      break;
+    }
+  }
+}
+
+static void PutAnnotation(std::string* out, uint32_t depth, uint32_t class_index,
+                          SynthConstantPool* pool) {
+  Put2(out, pool->AddUtf8("Lsynth/Nested;"));
+  Put2(out, 1);
+  Put2(out, pool->AddUtf8("value"));
+  if (depth > 1) {
+    Put1(out, '@');
+    PutAnnotation(out, depth - 1, class_index, pool);
+  } else {
+    Put1(out, 'I');
+    Put2(out, pool->AddInteger(class_index));
+  }
+}
+
+// Writes a StackMapTable with a frame at each target. Every target has the
+// three int locals and an empty stack; local 2 is stored before the first
+// one, so the first frame appends it to the two parameters and the rest are
+// the same.
+static void PutStackMapTable(const std::vector<uint32_t>& targets, std::string* out) {
+  Put2(out, targets.size());
+  for (size_t i = 0; i < targets.size(); ++i) {
+    if (i == 0) {
+      Put1(out, 252);
+      Put2(out, targets[0]);
+      Put1(out, ITEM_Integer);
+      continue;
+    }
+    uint32_t offset_delta = targets[i] - targets[i - 1] - 1;
+    if (offset_delta < 64) {
+      Put1(out, offset_delta);
+    } else {
+      Put1(out, 251);
+      Put2(out, offset_delta);
+    }
+  }
+}
+
+static bool BuildSynthClass(const SynthOptions& options, uint32_t class_index, std::string* out,
+                            std::string* error) {
+  SynthConstantPool pool;
+  std::string class_name = "synth/C" + std::to_string(class_index);
+  uint16_t this_class = pool.AddClass(class_name);
+  uint16_t super_class = pool.AddClass("java/lang/Object");
+  for (uint32_t i = 0; i < options.strings; ++i) {
+    pool.AddString(GetSynthString(class_index, i));
+  }
+  std::string methods;
+  uint16_t code_name = pool.AddUtf8("Code");
+  uint16_t stack_map_table_name = options.class_version >= 50 ? pool.AddUtf8("StackMapTable") : 0;
+  uint16_t descriptor = pool.AddUtf8("(II)I");
+  for (uint32_t i = 0; i < options.methods; ++i) {
+    SynthBlockGenerator generator(options, class_index, i);
+    std::string code;
+    std::vector<uint32_t> targets;
+    Put1(&code, INST_ICONST_0);
+    Put1(&code, INST_ISTORE_2);
+    while (code.size() < options.code_size) {
+      EmitClassBlock(generator.Next(), options, class_name, class_index, &pool, &code, &targets);
+    }
+    Put1(&code, INST_ILOAD_2);
+    Put1(&code, INST_IRETURN);
+    if (code.size() > 0xffff) {
+      *error = StringPrintf("code of %s.m%u is too long", class_name.c_str(), i);
+      return false;
+    }
+    Put2(&methods, METHOD_ACC_PUBLIC | METHOD_ACC_STATIC);
+    Put2(&methods, pool.AddUtf8("m" + std::to_string(i)));
+    Put2(&methods, descriptor);
+    Put2(&methods, 1);
+    std::string code_attributes;
+    if (stack_map_table_name != 0 && !targets.empty()) {
+      std::string frames;
+      PutStackMapTable(targets, &frames);
+      Put2(&code_attributes, 1);
+      Put2(&code_attributes, stack_map_table_name);
+      Put4(&code_attributes, frames.size());
+      code_attributes += frames;
+    } else {
+      Put2(&code_attributes, 0);
+    }
+    Put2(&methods, code_name);
+    Put4(&methods, 10 + code.size() + code_attributes.size());
+    Put2(&methods, 2);
+    Put2(&methods, 3);
+    Put4(&methods, code.size());
+    methods += code;
+    Put2(&methods, 0);
+    methods += code_attributes;
+  }
+  std::string attributes;
+  uint16_t attribute_count = 0;
+  if (options.annotation_depth > 0) {
+    std::string annotations;
+    Put2(&annotations, 1);
+    PutAnnotation(&annotations, options.annotation_depth, class_index, &pool);
+    Put2(&attributes, pool.AddUtf8("RuntimeVisibleAnnotations"));
+    Put4(&attributes, annotations.size());
+    attributes += annotations;
+    attribute_count++;
+  }
+  if (pool.count() == 0) {
+    *error = StringPrintf("too many constants in %s", class_name.c_str());
+    return false;
+  }
+  Put4(out, 0xCAFEBABE);
+  Put2(out, 0);
+  Put2(out, options.class_version);
+  Put2(out, pool.count());
+  *out += pool.bytes();
+  Put2(out, CLASS_ACC_PUBLIC | CLASS_ACC_SUPER);
+  Put2(out, this_class);
+  Put2(out, super_class);
+  Put2(out, 0);
+  Put2(out, 0);
+  Put2(out, options.methods);
+  *out += methods;
+  Put2(out, attribute_count);
+  *out += attributes;
+  return true;
+}
+
+bool WriteSynthClassFiles(const SynthOptions& options, const std::string& dir,
+                          std::string* error) {
+  std::string package_dir = dir + "/synth";
+  for (const std::string& path : {dir, package_dir}) {
+    if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+      *error = "can't create " + path;
+      return false;
+    }
+  }
+  std::string out;
+  for (uint32_t i = 0; i < options.classes; ++i) {
+    out.clear();
+    if (!BuildSynthClass(options, i, &out, error)) {
+      return false;
+    }
+    std::string path = package_dir + "/C" + std::to_string(i) + ".class";
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr) {
+      *error = "can't create " + path;
+      return false;
+    }
+    bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+    ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+      *error = "failed to write " + path;
+      return false;
+    }
+  }
+  return true;
+}
@@ -5,10 +5,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include "stats.h"
+
 #define CHECK(expr) \
   if (!(expr)) abort()
 
@@ -18,11 +26,27 @@
     abort(); \
   } while (0)
 
+// Where PrintIndented and Printf write; stdout unless the thread is
+// formatting into a buffer for ParallelPrint.
+static thread_local FILE* print_file = nullptr;
+
+static FILE* GetPrintFile() {
+  return print_file != nullptr ? print_file : stdout;
+}
+
+static void Printf(const char* fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  vfprintf(GetPrintFile(), fmt, ap);
+  va_end(ap);
+}
+
 static void PrintIndented(int indent, const char* fmt, ...) {
   va_list ap;
   va_start(ap, fmt);
-  printf("%*s", indent * 2, "");
-  vprintf(fmt, ap);
+  FILE* fp = GetPrintFile();
+  fprintf(fp, "%*s", indent * 2, "");
+  vfprintf(fp, fmt, ap);
   va_end(ap);
 }
 
@@ -55,6 +79,7 @@ static std::string GetHexString(const char* p, size_t size) {
 }
 
 static uint64_t ReadULEB128(const char*& p, const char* end) {
+  STATS_ADD(STATS_ULEB128_DECODES, 1);
   uint64_t result = 0;
   int shift = 0;
   while ((*p & 0x80) && p < end) {
@@ -67,10 +92,12 @@ static uint64_t ReadULEB128(const char*& p, const char* end) {
   }
   result |= *p << shift;
   p++;
+  STATS_ADD(STATS_BYTES_TOUCHED, shift / 7 + 1);
   return result;
 }
 
 static int64_t ReadLEB128(const char*& p, const char* end) {
+  STATS_ADD(STATS_ULEB128_DECODES, 1);
   int64_t result = 0;
   int shift = 0;
   while ((*p & 0x80) && p < end) {
@@ -86,6 +113,7 @@ static int64_t ReadLEB128(const char*& p, const char* end) {
     result |= (-1LL << (shift + 7));
   }
   p++;
+  STATS_ADD(STATS_BYTES_TOUCHED, shift / 7 + 1);
   return result;
 }
 
@@ -95,6 +123,31 @@ static int64_t ReadULEB128P1(const char*& p, const char* end) {
   return result - 1;
 }
 
+static void WriteULEB128(std::string* out, uint32_t value) {
+  while (value >= 0x80) {
+    out->push_back((char)((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back((char)value);
+}
+
+static void WriteLEB128(std::string* out, int64_t value) {
+  while (true) {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    if ((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40))) {
+      out->push_back((char)byte);
+      return;
+    }
+    out->push_back((char)(byte | 0x80));
+  }
+}
+
+// NO_INDEX is written as 0.
+static void WriteULEB128P1(std::string* out, uint32_t value) {
+  WriteULEB128(out, value + 1);
+}
+
 static const char* FindMap(const std::unordered_map<int, const char*>& map, int value) {
   auto it = map.find(value);
   if (it != map.end()) {
@@ -116,5 +169,170 @@ static std::string FindMaskVector(const std::vector<std::pair<int, const char*>>
   return result;
 }
 
+// Threads that run the items of ParallelFor and ParallelPrint: one per core
+// besides the calling thread, started on first use and kept waiting for work
+// between calls, so a call costs a wakeup rather than starting threads.
+class WorkerPool {
+ public:
+  static WorkerPool& Get() {
+    static WorkerPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+  size_t workers() const {
+    return threads_.size();
+  }
+
+  // Runs func(i) for i in [0, n) on the workers and the calling thread, and
+  // returns once every call is done. Items are handed out through a shared
+  // counter, so uneven items (e.g. methods of very different sizes) still
+  // balance across threads. Returns false without running anything if the
+  // pool is already running something, as it is when func calls Run.
+  bool Run(size_t n, const std::function<void(size_t)>& func) {
+    bool running = false;
+    if (!running_.compare_exchange_strong(running, true)) {
+      return false;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      func_ = &func;
+      n_ = n;
+      next_ = 0;
+      busy_ = threads_.size();
+      generation_++;
+    }
+    wake_.notify_all();
+    Work();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait(lock, [&]() { return busy_ == 0; });
+      func_ = nullptr;
+    }
+    running_ = false;
+    return true;
+  }
+
+ private:
+  explicit WorkerPool(size_t workers) {
+    for (size_t i = 0; i < workers; ++i) {
+      threads_.emplace_back([this]() { Loop(); });
+    }
+  }
+
+  void Loop() {
+    uint64_t generation = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&]() { return stop_ || generation_ != generation; });
+        if (stop_) {
+          return;
+        }
+        generation = generation_;
+      }
+      Work();
+      STATS_MERGE_THREAD();
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--busy_ == 0) {
+        done_.notify_all();
+      }
+    }
+  }
+
+  void Work() {
+    for (size_t i = next_++; i < n_; i = next_++) {
+      (*func_)(i);
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::atomic<bool> running_{false};
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  bool stop_ = false;
+  // Bumped for each Run, guarded by mutex_ like the job below it.
+  uint64_t generation_ = 0;
+  const std::function<void(size_t)>* func_ = nullptr;
+  size_t n_ = 0;
+  std::atomic<size_t> next_{0};
+  // Workers that haven't finished the current job.
+  size_t busy_ = 0;
+};
+
+// Run func(i) for i in [0, n) on all available cores, see WorkerPool::Run.
+// Calls from within func run serially on the calling thread.
+static void ParallelFor(size_t n, const std::function<void(size_t)>& func) {
+  if (n > 1 && WorkerPool::Get().workers() > 0 && WorkerPool::Get().Run(n, func)) {
+    return;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    func(i);
+  }
+}
+
+// Runs print(i) for i in [0, n) on all available cores, and writes what
+// each call prints with Printf and PrintIndented to stdout in the order of
+// i, as if the calls had run one after another. Each call formats into a
+// buffer of a ring of them, and whichever thread finishes the next call to
+// be written drains the finished buffers in order. A call waits while its
+// buffer is still waiting to be written, so memory doesn't grow with n.
+static void ParallelPrint(size_t n, const std::function<void(size_t)>& print) {
+  if (n <= 1 || WorkerPool::Get().workers() == 0) {
+    for (size_t i = 0; i < n; ++i) {
+      print(i);
+    }
+    return;
+  }
+  size_t window = (WorkerPool::Get().workers() + 1) * 16;
+  std::vector<char*> bufs(window);
+  std::vector<size_t> sizes(window);
+  std::vector<uint8_t> ready(window, 0);
+  std::mutex mutex;
+  std::condition_variable space;
+  // Calls below written are on stdout; draining is set while a thread writes.
+  size_t written = 0;
+  bool draining = false;
+  ParallelFor(n, [&](size_t i) {
+    size_t slot = i % window;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      space.wait(lock, [&]() { return i < written + window; });
+    }
+    print_file = open_memstream(&bufs[slot], &sizes[slot]);
+    CHECK(print_file != nullptr);
+    print(i);
+    fclose(print_file);
+    print_file = nullptr;
+    std::unique_lock<std::mutex> lock(mutex);
+    ready[slot] = 1;
+    if (draining) {
+      return;
+    }
+    draining = true;
+    while (written < n && ready[written % window]) {
+      size_t next = written % window;
+      lock.unlock();
+      fwrite(bufs[next], 1, sizes[next], stdout);
+      free(bufs[next]);
+      lock.lock();
+      ready[next] = 0;
+      written++;
+      space.notify_all();
+    }
+    draining = false;
+  });
+}
 
 #endif  // UTILS_H_